@@ -0,0 +1,125 @@
+// CFG construction benchmark: the former alcc-cfg analysis (std::set of
+// leaders, std::map of heap-allocated blocks, map lookups per edge) against
+// ControlFlowGraph::build reused across rounds, on a synthetic function of
+// if/else chains and backward jumps.
+//
+//   make bench-cfg && ./bench-cfg [instructions] [rounds]
+
+#include "../src/analysis/ControlFlow.h"
+#include "../src/core/alcc_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include <set>
+
+extern "C" {
+#include "lopcodes.h"
+}
+
+struct MapBlock {
+    int id;
+    int start_pc;
+    int end_pc;
+    std::vector<int> successors;
+};
+
+// Same leaders and edges as ControlFlowGraph, built the way alcc-cfg used to
+static long long map_cfg(Proto* p) {
+    std::set<int> leaders;
+    leaders.insert(0);
+    AlccInstruction dec;
+    int out[2];
+    for (int pc = 0; pc < p->sizecode; pc++) {
+        current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+        int cnt = ControlFlowGraph::successors(dec, pc, out);
+        if (cnt == 1 && out[0] == pc + 1) continue;
+        if (pc + 1 < p->sizecode) leaders.insert(pc + 1);
+        for (int s = 0; s < cnt; s++) {
+            if (out[s] >= 0 && out[s] < p->sizecode) leaders.insert(out[s]);
+        }
+    }
+
+    std::map<int, MapBlock*> blocks;
+    std::vector<int> sorted(leaders.begin(), leaders.end());
+    for (size_t k = 0; k < sorted.size(); k++) {
+        MapBlock* bb = new MapBlock();
+        bb->id = (int)k;
+        bb->start_pc = sorted[k];
+        bb->end_pc = k + 1 < sorted.size() ? sorted[k + 1] - 1 : p->sizecode - 1;
+        blocks[bb->start_pc] = bb;
+    }
+
+    long long edges = 0;
+    for (auto const& [start_pc, bb] : blocks) {
+        current_backend->decode_instruction((uint32_t)p->code[bb->end_pc], &dec);
+        int cnt = ControlFlowGraph::successors(dec, bb->end_pc, out);
+        for (int s = 0; s < cnt; s++) {
+            if (blocks.find(out[s]) != blocks.end()) bb->successors.push_back(out[s]);
+        }
+        edges += bb->successors.size();
+    }
+    for (auto const& [start_pc, bb] : blocks) delete bb;
+    return edges;
+}
+
+static uint32_t encode(int op, int a, int b, int c, int bx) {
+    AlccInstruction in;
+    memset(&in, 0, sizeof(in));
+    in.op = op;
+    in.a = a;
+    in.b = b;
+    in.c = c;
+    in.bx = bx;
+    return current_backend->encode_instruction(&in);
+}
+
+// Repeats "if a == b then x else y end" with a backward jump every 16 units
+static void synthetic_code(std::vector<Instruction>& code, int n) {
+    code.clear();
+    while ((int)code.size() + 8 < n) {
+        int unit = (int)code.size() / 6;
+        code.push_back(encode(OP_MOVE, unit % 8, unit % 7, 0, 0));
+        code.push_back(encode(OP_EQ, 0, 1, 2, 0));
+        code.push_back(encode(OP_JMP, 0, 0, 0, 2));
+        code.push_back(encode(OP_MOVE, 3, 4, 0, 0));
+        code.push_back(encode(OP_JMP, 0, 0, 0, 1));
+        code.push_back(encode(OP_MOVE, 3, 5, 0, 0));
+        if (unit % 16 == 15) code.push_back(encode(OP_JMP, 0, 0, 0, -(int)code.size() / 2));
+    }
+    code.push_back(encode(OP_RETURN, 0, 1, 0, 0));
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 200000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+    std::vector<Instruction> code;
+    synthetic_code(code, n);
+    Proto p;
+    memset(&p, 0, sizeof(p));
+    p.code = code.data();
+    p.sizecode = (int)code.size();
+
+    double map_ms = 0, flat_ms = 0;
+    long long map_edges = 0;
+    ControlFlowGraph cfg;
+    for (int r = 0; r < rounds; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        map_edges = map_cfg(&p);
+        map_ms += ms_since(t0);
+
+        t0 = std::chrono::steady_clock::now();
+        cfg.build(&p);
+        flat_ms += ms_since(t0);
+    }
+    printf("%d instructions, %d blocks, %d rounds\n", p.sizecode, cfg.num_blocks(), rounds);
+    printf("set/map  %8.3f ms/round  (%lld edges)\n", map_ms / rounds, map_edges);
+    printf("flat     %8.3f ms/round  (%d edges)\n", flat_ms / rounds, (int)cfg.succ.size());
+    return 0;
+}
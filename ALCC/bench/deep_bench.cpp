@@ -0,0 +1,123 @@
+// Deep nesting regression benchmark: builds expressions nested a million
+// levels deep (more than any call stack holds when walked recursively) and
+// prints, clones, walks and frees each of them, reporting the time taken.
+// A recursive pass anywhere on these paths crashes this program.
+//
+//   make bench-deep && ./bench-deep [depth]
+
+#include "../src/ast/AST.h"
+#include "../src/ast/ASTPrinter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+// Counts bytes and throws them away
+class NullBuf : public std::streambuf {
+public:
+    size_t bytes = 0;
+protected:
+    std::streamsize xsputn(const char*, std::streamsize n) override { bytes += n; return n; }
+    int overflow(int c) override { bytes++; return c; }
+};
+
+// t["k"]["k"]...["k"]
+static Expression* index_chain(int depth) {
+    Expression* e = new Variable("t");
+    for (int i = 0; i < depth; i++) e = new BinaryExpr(e, "[", new Literal(std::string("k")));
+    return e;
+}
+
+// ((x + 1) - 1) + 1 ...
+static Expression* left_chain(int depth) {
+    Expression* e = new Variable("x");
+    for (int i = 0; i < depth; i++) e = new BinaryExpr(e, i & 1 ? "-" : "+", new Literal(1.0));
+    return e;
+}
+
+// "a" .. ("a" .. ( ... .. x))
+static Expression* concat_chain(int depth) {
+    Expression* e = new Variable("x");
+    for (int i = 0; i < depth; i++) e = new BinaryExpr(new Literal(std::string("a")), "..", e);
+    return e;
+}
+
+// not -not -x
+static Expression* unary_chain(int depth) {
+    Expression* e = new Variable("x");
+    for (int i = 0; i < depth; i++) e = new UnaryExpr(i & 1 ? "-" : "not", e);
+    return e;
+}
+
+// f(f(f(x)))
+static Expression* call_chain(int depth) {
+    Expression* e = new Variable("x");
+    for (int i = 0; i < depth; i++) {
+        FunctionCall* call = new FunctionCall(new Variable("f"));
+        call->args.push_back(e);
+        e = call;
+    }
+    return e;
+}
+
+// { { { x } } }
+static Expression* table_chain(int depth) {
+    Expression* e = new Variable("x");
+    for (int i = 0; i < depth; i++) {
+        TableConstructor* t = new TableConstructor();
+        t->fields.push_back(TableConstructor::Field{nullptr, e});
+        e = t;
+    }
+    return e;
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void run(const char* label, Expression* (*build)(int), int depth) {
+    auto t0 = std::chrono::steady_clock::now();
+    Block* chunk = new Block();
+    Assignment* assign = new Assignment(true);
+    assign->targets.push_back(new Variable("v"));
+    assign->values.push_back(build(depth));
+    chunk->add(assign);
+    double build_ms = ms_since(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    NullBuf sink;
+    std::ostream out(&sink);
+    {
+        LuaPrinter printer(out);
+        chunk->accept(printer);
+    }
+    double print_ms = ms_since(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    Expression* copy = ast_clone(assign->values[0]);
+    double clone_ms = ms_since(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    size_t nodes = 0;
+    ast_walk(chunk, [&](ASTNode*) { nodes++; return true; });
+    double walk_ms = ms_since(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    delete copy;
+    delete chunk;
+    double free_ms = ms_since(t0);
+
+    printf("%-8s %9zu nodes %10zu bytes  build %7.1f  print %7.1f  clone %7.1f  walk %7.1f  free %7.1f ms\n",
+           label, nodes, sink.bytes, build_ms, print_ms, clone_ms, walk_ms, free_ms);
+}
+
+int main(int argc, char** argv) {
+    int depth = argc > 1 ? atoi(argv[1]) : 1000000;
+    printf("depth %d\n", depth);
+    run("index", index_chain, depth);
+    run("left", left_chain, depth);
+    run("concat", concat_chain, depth);
+    run("unary", unary_chain, depth);
+    run("call", call_chain, depth);
+    run("table", table_chain, depth);
+    return 0;
+}
@@ -0,0 +1,31 @@
+#!/bin/bash
+# Pending-register flush benchmark: decompiles N generated functions, each
+# with a 180-local frame and 150 `if` statements, so flush_all_pending runs at
+# many labels over a wide frame with few pending values. Reports the time and
+# the --timing output, whose flush line compares the slots visited with a
+# full frame scan.
+#
+#   make bench-flush
+#   bench/flush_bench.sh [functions]    (from the ALCC directory, after make)
+set -e
+funcs=${1:-200}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+awk -v n="$funcs" 'BEGIN {
+    for (f = 0; f < n; f++) {
+        printf "local function f%d(x)\n  local a0", f
+        for (i = 1; i < 180; i++) printf ", a%d", i
+        print ""
+        for (k = 0; k < 150; k++) printf "  if x == %d then a%d = x end\n", k, k
+        print "  return a0\nend"
+    }
+    print "print(f0(1))"
+}' > "$dir/flush.lua"
+
+./alcc-c$SUFFIX "$dir/flush.lua" -o "$dir/flush.luac"
+start=$(date +%s%N)
+./alcc-dec$SUFFIX --timing "$dir/flush.luac" > "$dir/flush.out" 2> "$dir/timing.txt"
+end=$(date +%s%N)
+echo "$funcs functions: $(( (end - start) / 1000000 )) ms"
+cat "$dir/timing.txt"
@@ -0,0 +1,103 @@
+// Opcode histogram benchmark: counting with a full decode per instruction
+// (what the other alcc-info passes do) and with GET_OPCODE into one table,
+// against OpStats::add_function, on a synthetic function with a typical
+// instruction mix and runs of the same opcode.
+//
+//   make bench-opstats && ./bench-opstats [instructions] [rounds]
+
+#include "../src/analysis/OpStats.h"
+#include "../src/core/alcc_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+extern "C" {
+#include "lopcodes.h"
+}
+
+static void decode_count(Proto* p, std::vector<uint64_t>& ops) {
+    AlccInstruction dec;
+    for (int pc = 0; pc < p->sizecode; pc++) {
+        current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+        ops[dec.op]++;
+    }
+}
+
+static void table_count(Proto* p, std::vector<uint64_t>& ops) {
+    for (int pc = 0; pc < p->sizecode; pc++) ops[GET_OPCODE(p->code[pc])]++;
+}
+
+static uint32_t encode(int op, int a, int b, int c, int bx) {
+    AlccInstruction in;
+    memset(&in, 0, sizeof(in));
+    in.op = op;
+    in.a = a;
+    in.b = b;
+    in.c = c;
+    in.bx = bx;
+    return current_backend->encode_instruction(&in);
+}
+
+// Mostly moves, table reads, calls and tests, with runs of up to 8 equal
+// opcodes as in table constructors and argument setup
+static void synthetic_code(std::vector<Instruction>& code, int n) {
+    static const int mix[] = {
+        OP_MOVE, OP_MOVE, OP_MOVE, OP_GETFIELD, OP_GETFIELD, OP_GETTABUP, OP_LOADK, OP_LOADI,
+        OP_CALL, OP_CALL, OP_SETFIELD, OP_ADD, OP_EQ, OP_JMP, OP_TEST, OP_RETURN
+    };
+    uint32_t seed = 12345;
+    code.clear();
+    while ((int)code.size() + 8 < n) {
+        seed = seed * 1103515245 + 12345;
+        int op = mix[(seed >> 16) % (sizeof(mix) / sizeof(mix[0]))];
+        int run = (int)(seed >> 8) % 8 + 1;
+        for (int r = 0; r < run; r++) {
+            if (op == OP_JMP) code.push_back(encode(op, 0, 0, 0, (int)(seed >> 4) % 64 - 32));
+            else code.push_back(encode(op, r, r + 1, (seed >> 12) & 0xff, r));
+        }
+    }
+    code.push_back(encode(OP_RETURN, 0, 1, 0, 0));
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+    std::vector<Instruction> code;
+    synthetic_code(code, n);
+    Proto p;
+    memset(&p, 0, sizeof(p));
+    p.code = code.data();
+    p.sizecode = (int)code.size();
+
+    OpStats stats;
+    std::vector<uint64_t> decoded(stats.ops.size(), 0), table(stats.ops.size(), 0);
+    double decode_ms = 0, table_ms = 0, stats_ms = 0;
+    for (int r = 0; r < rounds; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        decode_count(&p, decoded);
+        decode_ms += ms_since(t0);
+
+        t0 = std::chrono::steady_clock::now();
+        table_count(&p, table);
+        table_ms += ms_since(t0);
+
+        t0 = std::chrono::steady_clock::now();
+        stats.add_function(&p);
+        stats_ms += ms_since(t0);
+    }
+    if (decoded != stats.ops || table != stats.ops) {
+        fprintf(stderr, "opcode counts differ\n");
+        return 1;
+    }
+    printf("%d instructions, %d rounds, %llu jumps\n", p.sizecode, rounds, (unsigned long long)stats.jump_count());
+    printf("decode   %8.3f ms/round\n", decode_ms / rounds);
+    printf("table    %8.3f ms/round\n", table_ms / rounds);
+    printf("opstats  %8.3f ms/round  (with K-form and jump distances)\n", stats_ms / rounds);
+    return 0;
+}
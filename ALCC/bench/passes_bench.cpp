@@ -0,0 +1,90 @@
+// AST pass manager benchmark: the four built-in passes fused into one
+// traversal against one traversal per pass, on a synthetic chunk of
+// operator trees, temporary stores and nested if/else statements. Both
+// variants see a freshly generated copy of the same chunk every round.
+//
+//   make bench-passes && ./bench-passes [statements] [rounds]
+
+#include "../src/ast/AST.h"
+#include "../src/ast/ASTPasses.h"
+#include "random_ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+static Block* pass_chunk(int statements) {
+    rng_state = 12345;
+    Block* chunk = random_chunk(statements);
+    for (int i = 0; i < statements / 4; i++) {
+        // Stores to registers, some of which are never read
+        Assignment* store = new Assignment(false);
+        store->targets.push_back(new Variable("v" + std::to_string(rng() % 32)));
+        store->values.push_back(new Literal((double)(rng() % 100)));
+        chunk->add(store);
+
+        IfStmt* outer = new IfStmt();
+        Block* then_block = new Block();
+        then_block->add(new ExprStmt(random_expr(3)));
+        outer->clauses.push_back({random_expr(2), then_block});
+        Block* else_block = new Block();
+        IfStmt* inner = new IfStmt();
+        Block* inner_block = new Block();
+        inner_block->add(new ExprStmt(new FunctionCall(new Variable("v" + std::to_string(rng() % 16)))));
+        inner->clauses.push_back({random_expr(2), inner_block});
+        else_block->add(inner);
+        outer->clauses.push_back({nullptr, else_block});
+        chunk->add(outer);
+    }
+    return chunk;
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+typedef AstPass* (*PassFactory)();
+static const PassFactory factories[] = {
+    new_fold_constants_pass, new_elseif_pass, new_multi_assign_pass, new_dead_temps_pass
+};
+
+int main(int argc, char** argv) {
+    int statements = argc > 1 ? atoi(argv[1]) : 20000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+    double fused_ms = 0, separate_ms = 0;
+    long long fused_rewrites = 0, separate_rewrites = 0;
+    for (int r = 0; r < rounds; r++) {
+        Block* chunk = pass_chunk(statements);
+        AstPassManager pm;
+        pm.add_defaults();
+        auto t0 = std::chrono::steady_clock::now();
+        pm.run(chunk);
+        fused_ms += ms_since(t0);
+        for (AstPass* p : pm.passes) fused_rewrites += p->rewrites;
+        delete chunk;
+
+        chunk = pass_chunk(statements);
+        t0 = std::chrono::steady_clock::now();
+        for (PassFactory f : factories) {
+            AstPassManager one;
+            one.add(f());
+            one.run(chunk);
+            separate_rewrites += one.passes[0]->rewrites;
+        }
+        separate_ms += ms_since(t0);
+        delete chunk;
+    }
+    printf("%d statements, %d rounds\n", statements, rounds);
+    printf("fused     %8.3f ms/round  (%lld rewrites)\n", fused_ms / rounds, fused_rewrites / rounds);
+    printf("separate  %8.3f ms/round  (%lld rewrites)\n", separate_ms / rounds, separate_rewrites / rounds);
+
+    // Per-pass split of one timed run; timing adds clock reads to every call
+    Block* chunk = pass_chunk(statements);
+    AstPassManager pm;
+    pm.add_defaults();
+    pm.timed = true;
+    pm.run(chunk);
+    pm.print(stdout);
+    delete chunk;
+    return 0;
+}
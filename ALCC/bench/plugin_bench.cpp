@@ -0,0 +1,174 @@
+// Plugin hook benchmark: the per-instruction on_instruction hook (API 1,
+// one call per pc, decoding the instruction itself, formatting into the
+// tool's 4096-byte buffer) against the batched on_code hook (API 3, one
+// call per function over the decoded array), which either formats into its
+// own buffer and set()s the text or formats straight into the table through
+// open() and reserve()/commit(). Each plugin renames MOVEs as the sample
+// plugin does: every MOVE (dense), only those reading R0 (sparse, closer to
+// an analysis plugin that annotates a few instructions), or R0 = R0 with a
+// 6000-byte annotation (large, which API 1 truncates). The set() plugin
+// also runs alone in a PluginChain, as the tools load it, with and without
+// --plugin-stats timing. Times PluginOverrides::collect plus one find() per
+// pc, as a listing does; "none" is the decode the listing needs anyway.
+//
+//   make bench-plugin && ./bench-plugin [instructions] [rounds]
+
+#include "../src/plugin/alcc_plugin_host.h"
+#include "../src/core/alcc_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+extern "C" {
+#include "lopcodes.h"
+}
+
+enum { DENSE, SPARSE, LARGE };
+static int mode = DENSE;
+#define LARGE_SIZE 6000
+
+static bool renamed(const AlccInstruction& dec) {
+    if (dec.op != OP_MOVE) return false;
+    if (mode == SPARSE) return dec.b == 0;
+    if (mode == LARGE) return dec.a == 0 && dec.b == 0;
+    return true;
+}
+
+// The annotation for dec into buf (at least size bytes), as snprintf
+static int format(char* buf, size_t size, const AlccInstruction& dec) {
+    int len = snprintf(buf, size, "[PLUGIN] MOVE %d -> %d", dec.b, dec.a);
+    if (mode != LARGE) return len;
+    size_t n = LARGE_SIZE < size ? LARGE_SIZE : size - 1;
+    for (size_t i = (size_t)len; i < n; i++) buf[i] = '.';
+    buf[n] = 0;
+    return LARGE_SIZE;
+}
+
+static int v1_on_instruction(Proto* p, int pc, char* out_buffer, size_t buffer_size) {
+    AlccInstruction dec;
+    current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+    if (!renamed(dec)) return 0;
+    format(out_buffer, buffer_size, dec);
+    return 1;
+}
+
+static void v2_on_code(Proto* p, const AlccInstruction* code, int count, AlccOverrides* out) {
+    (void)p;
+    char text[LARGE_SIZE + 1];
+    for (int pc = 0; pc < count; pc++) {
+        if (!renamed(code[pc])) continue;
+        int len = format(text, sizeof(text), code[pc]);
+        out->set(out, pc, text, (size_t)len);
+    }
+}
+
+static void v2_sink_on_code(Proto* p, const AlccInstruction* code, int count, AlccOverrides* out) {
+    (void)p;
+    for (int pc = 0; pc < count; pc++) {
+        if (!renamed(code[pc])) continue;
+        AlccOutput* text = out->open(out, pc);
+        int len = format(text->reserve(text, LARGE_SIZE + 1), LARGE_SIZE + 1, code[pc]);
+        text->commit(text, (size_t)len);
+    }
+}
+
+static uint32_t encode(int op, int a, int b, int c, int bx) {
+    AlccInstruction in;
+    memset(&in, 0, sizeof(in));
+    in.op = op;
+    in.a = a;
+    in.b = b;
+    in.c = c;
+    in.bx = bx;
+    return current_backend->encode_instruction(&in);
+}
+
+// One MOVE in eight, between table reads, calls and jumps
+static void synthetic_code(std::vector<Instruction>& code, int n) {
+    code.clear();
+    for (int i = 0; (int)code.size() + 1 < n; i++) {
+        switch (i % 8) {
+            case 0: code.push_back(encode(OP_MOVE, i % 7, i % 5, 0, 0)); break;
+            case 1: case 2: code.push_back(encode(OP_GETFIELD, 1, 0, i % 200, 0)); break;
+            case 3: code.push_back(encode(OP_LOADK, 2, 0, 0, i % 100)); break;
+            case 4: code.push_back(encode(OP_CALL, 1, 2, 1, 0)); break;
+            case 5: code.push_back(encode(OP_EQ, 0, 1, 2, 0)); break;
+            case 6: code.push_back(encode(OP_JMP, 0, 0, 0, 1)); break;
+            default: code.push_back(encode(OP_ADD, 3, 1, 2, 0)); break;
+        }
+    }
+    code.push_back(encode(OP_RETURN, 0, 1, 0, 0));
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Listing-side work: collect, then one lookup per pc
+static double run(AlccPlugin* plugin, Proto* p, int rounds, size_t* bytes) {
+    PluginOverrides overrides;
+    double ms = 0;
+    for (int r = 0; r < rounds; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        overrides.collect(plugin, p);
+        *bytes = 0;
+        for (int pc = 0; pc < p->sizecode; pc++) {
+            size_t len;
+            if (overrides.find(pc, &len)) *bytes += len;
+        }
+        ms += ms_since(t0);
+    }
+    return ms / rounds;
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+    std::vector<Instruction> code;
+    synthetic_code(code, n);
+    Proto p;
+    memset(&p, 0, sizeof(p));
+    p.code = code.data();
+    p.sizecode = (int)code.size();
+
+    AlccPlugin v1;
+    memset(&v1, 0, sizeof(v1));
+    v1.name = "api1";
+    v1.on_instruction = v1_on_instruction;
+    AlccPlugin v2;
+    memset(&v2, 0, sizeof(v2));
+    v2.name = "api2";
+    v2.on_code = v2_on_code;
+    AlccPlugin v2_sink = v2;
+    v2_sink.on_code = v2_sink_on_code;
+    PluginChain::add(&v2);
+
+    size_t none_bytes;
+    double none_ms = run(NULL, &p, rounds, &none_bytes);
+    printf("%d instructions, %d rounds\n", p.sizecode, rounds);
+    printf("none               %8.3f ms/round\n", none_ms);
+    static const char* const names[] = {"dense ", "sparse", "large "};
+    for (mode = DENSE; mode <= LARGE; mode++) {
+        size_t v1_bytes, v2_bytes, sink_bytes;
+        double v1_ms = run(&v1, &p, rounds, &v1_bytes);
+        double v2_ms = run(&v2, &p, rounds, &v2_bytes);
+        double sink_ms = run(&v2_sink, &p, rounds, &sink_bytes);
+        size_t chain_bytes, timed_bytes;
+        PluginChain::set_stats(false);
+        double chain_ms = run(PluginChain::plugin(), &p, rounds, &chain_bytes);
+        PluginChain::set_stats(true);
+        double timed_ms = run(PluginChain::plugin(), &p, rounds, &timed_bytes);
+        if (v2_bytes != sink_bytes || v2_bytes != chain_bytes || v2_bytes != timed_bytes || (mode != LARGE && v1_bytes != v2_bytes)) {
+            fprintf(stderr, "override text differs\n");
+            return 1;
+        }
+        printf("api1 hook  %s  %8.3f ms/round  (+%.3f, %zu bytes)\n", names[mode], v1_ms, v1_ms - none_ms, v1_bytes);
+        printf("api2 set   %s  %8.3f ms/round  (+%.3f, %zu bytes)\n", names[mode], v2_ms, v2_ms - none_ms, v2_bytes);
+        printf("api2 sink  %s  %8.3f ms/round  (+%.3f)\n", names[mode], sink_ms, sink_ms - none_ms);
+        printf("chain      %s  %8.3f ms/round  (+%.3f)\n", names[mode], chain_ms, chain_ms - none_ms);
+        printf("chain+stat %s  %8.3f ms/round  (+%.3f)\n", names[mode], timed_ms, timed_ms - none_ms);
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+// Printer benchmark: prints a synthetic expression-heavy AST with LuaPrinter
+// and with a reference printer that writes through std::ostream and wraps
+// every binary operation (the printer's former behaviour), and reports the
+// output size and throughput of both.
+//
+//   make bench-print && ./bench-print [statements] [rounds]
+//   ./bench-print --dump N    prints N random statements with both printers
+
+#include "../src/ast/AST.h"
+#include "../src/ast/ASTPrinter.h"
+#include "random_ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+// Counts bytes and throws them away
+class NullBuf : public std::streambuf {
+public:
+    size_t bytes = 0;
+protected:
+    std::streamsize xsputn(const char*, std::streamsize n) override { bytes += n; return n; }
+    int overflow(int c) override { bytes++; return c; }
+};
+
+class ReferencePrinter : public ASTVisitor {
+public:
+    std::ostream& out;
+    ReferencePrinter(std::ostream& o) : out(o) {}
+
+    void visit(Block& node) override {
+        for (auto stmt : node.statements) {
+            stmt->accept(*this);
+            out << "\n";
+        }
+    }
+    void visit(Literal& node) override {
+        switch (node.type) {
+            case Literal::NIL: out << "nil"; break;
+            case Literal::BOOLEAN: out << (node.bool_val ? "true" : "false"); break;
+            case Literal::NUMBER:
+                if ((long long)node.number_val == node.number_val) out << (long long)node.number_val;
+                else out << node.number_val;
+                break;
+            case Literal::STRING:
+                out << "\"";
+                for (char c : node.string_val) {
+                    if (c == '"') out << "\\\"";
+                    else if (c == '\\') out << "\\\\";
+                    else if (c == '\n') out << "\\n";
+                    else if (c == '\r') out << "\\r";
+                    else if (c == '\t') out << "\\t";
+                    else if (isprint((unsigned char)c)) out << c;
+                    else out << "\\" << std::setfill('0') << std::setw(3) << (int)(unsigned char)c;
+                }
+                out << "\"";
+                break;
+        }
+    }
+    void visit(Variable& node) override { out << node.name; }
+    void visit(BinaryExpr& node) override {
+        if (node.op == "[") {
+            node.left->accept(*this);
+            out << "[";
+            node.right->accept(*this);
+            out << "]";
+        } else {
+            out << "(";
+            node.left->accept(*this);
+            out << " " << node.op << " ";
+            node.right->accept(*this);
+            out << ")";
+        }
+    }
+    void visit(UnaryExpr& node) override {
+        out << node.op;
+        if (node.op == "not") out << " ";
+        node.expr->accept(*this);
+    }
+    void visit(FunctionCall& node) override {
+        node.func->accept(*this);
+        out << "(";
+        for (size_t i = 0; i < node.args.size(); ++i) {
+            if (i > 0) out << ", ";
+            node.args[i]->accept(*this);
+        }
+        out << ")";
+    }
+    void visit(Assignment& node) override {
+        if (node.is_local) out << "local ";
+        for (size_t i = 0; i < node.targets.size(); ++i) {
+            if (i > 0) out << ", ";
+            node.targets[i]->accept(*this);
+        }
+        out << " = ";
+        for (size_t i = 0; i < node.values.size(); ++i) {
+            if (i > 0) out << ", ";
+            node.values[i]->accept(*this);
+        }
+    }
+    void visit(TableConstructor&) override {}
+    void visit(ClosureExpr&) override {}
+    void visit(IfStmt&) override {}
+    void visit(WhileStmt&) override {}
+    void visit(RepeatStmt&) override {}
+    void visit(ForNumStmt&) override {}
+    void visit(ForInStmt&) override {}
+    void visit(FunctionDecl&) override {}
+    void visit(ReturnStmt&) override {}
+    void visit(BreakStmt&) override {}
+    void visit(LabelStmt&) override {}
+    void visit(GotoStmt&) override {}
+    void visit(ExprStmt&) override {}
+    void visit(RawStmt&) override {}
+};
+
+template <typename Printer>
+static void run(const char* label, Block* chunk, int rounds, size_t* bytes_out) {
+    NullBuf sink;
+    std::ostream out(&sink);
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        Printer printer(out);
+        chunk->accept(printer);
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t bytes = sink.bytes / rounds;
+    printf("%-10s %10zu bytes  %8.3f ms/round  %8.1f MB/s\n", label, bytes, s * 1000 / rounds,
+           sink.bytes / s / 1e6);
+    if (bytes_out) *bytes_out = bytes;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 2 && strcmp(argv[1], "--dump") == 0) {
+        Block* chunk = random_chunk(atoi(argv[2]));
+        std::ostringstream ref, cur;
+        { ReferencePrinter printer(ref); chunk->accept(printer); }
+        { LuaPrinter printer(cur); chunk->accept(printer); }
+        printf("%s%s", ref.str().c_str(), cur.str().c_str());
+        delete chunk;
+        return 0;
+    }
+
+    int statements = argc > 1 ? atoi(argv[1]) : 20000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    Block* chunk = random_chunk(statements);
+    printf("%d statements, %d rounds\n", statements, rounds);
+    size_t ref_bytes = 0, cur_bytes = 0;
+    run<ReferencePrinter>("reference", chunk, rounds, &ref_bytes);
+    run<LuaPrinter>("LuaPrinter", chunk, rounds, &cur_bytes);
+    printf("output size: %.1f%% of reference\n", ref_bytes ? 100.0 * cur_bytes / ref_bytes : 0.0);
+    delete chunk;
+    return 0;
+}
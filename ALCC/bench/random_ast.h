@@ -0,0 +1,52 @@
+// Synthetic expression-heavy chunks for the benchmarks: local assignments of
+// random operator, index, call and literal trees, from a fixed seed.
+
+#ifndef ALCC_BENCH_RANDOM_AST_H
+#define ALCC_BENCH_RANDOM_AST_H
+
+#include "../src/ast/AST.h"
+#include <string>
+
+static const char* const binary_ops[] = {
+    "or", "and", "<", "<=", "==", "~=", "|", "~", "&", "<<", "..", "+", "-", "*", "/", "//", "%", "^"
+};
+static const char* const unary_ops[] = { "-", "not", "#", "~" };
+
+static unsigned rng_state = 12345;
+static unsigned rng() {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return (rng_state >> 16) & 0x7fff;
+}
+
+static Expression* random_expr(int depth) {
+    unsigned r = rng();
+    if (depth <= 0 || r % 8 == 0) {
+        switch (rng() % 5) {
+            case 0: return new Literal((double)(rng() % 1000));
+            case 1: return new Literal((double)(rng() % 1000) / 8.0 - 50.0);
+            case 2: return new Literal(std::string("str\t\"") + std::to_string(rng() % 100) + "\"\n");
+            case 3: {
+                FunctionCall* call = new FunctionCall(new Variable("f" + std::to_string(rng() % 4)));
+                call->args.push_back(random_expr(depth - 2));
+                return call;
+            }
+            default: return new Variable("v" + std::to_string(rng() % 16));
+        }
+    }
+    if (r % 8 == 1) return new UnaryExpr(unary_ops[rng() % 4], random_expr(depth - 1));
+    if (r % 8 == 2) return new BinaryExpr(new Variable("t"), "[", random_expr(depth - 1));
+    return new BinaryExpr(random_expr(depth - 1), binary_ops[rng() % 18], random_expr(depth - 1));
+}
+
+static Block* random_chunk(int statements) {
+    Block* block = new Block();
+    for (int i = 0; i < statements; i++) {
+        Assignment* assign = new Assignment(true);
+        assign->targets.push_back(new Variable("x" + std::to_string(i)));
+        assign->values.push_back(random_expr(6));
+        block->add(assign);
+    }
+    return block;
+}
+
+#endif
@@ -0,0 +1,90 @@
+// Node store benchmark: imports a synthetic chunk into an AstStore and
+// compares its memory and traversal time with the pointer tree.
+//
+//   make bench-store && ./bench-store [statements] [rounds]
+
+#include "../src/ast/AST.h"
+#include "../src/ast/ASTStore.h"
+#include "random_ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <malloc.h>
+
+// Heap bytes in use, malloc's own overhead included (glibc)
+static size_t heap_in_use() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd; // large blocks are mmap'ed
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Depth-first over the store, as a pass over the tree would go
+static size_t store_walk(const AstStore& s, uint32_t root, std::vector<uint32_t>& stack) {
+    size_t nodes = 0;
+    stack.assign(1, root);
+    while (!stack.empty()) {
+        uint32_t id = stack.back();
+        stack.pop_back();
+        nodes++;
+        int k = s.kind(id);
+        uint32_t n = s.count(id);
+        // Names are string ids, not nodes
+        uint32_t names_from = n, names_to = n;
+        if (k == AST_BIN_CLOSURE || k == AST_BIN_FUNCTION) { names_from = 1; names_to = 1 + s.aux[id]; }
+        else if (k == AST_BIN_FOR_IN) { names_from = 0; names_to = s.aux[id]; }
+        for (uint32_t i = n; i-- > 0;) {
+            uint32_t c = s.child(id, i);
+            if ((i < names_from || i >= names_to) && c != AST_BIN_NONE) stack.push_back(c);
+        }
+    }
+    return nodes;
+}
+
+int main(int argc, char** argv) {
+    int statements = argc > 1 ? atoi(argv[1]) : 20000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+    size_t before = heap_in_use();
+    Block* chunk = random_chunk(statements);
+    size_t tree_bytes = heap_in_use() - before;
+
+    before = heap_in_use();
+    AstStore store;
+    auto t0 = std::chrono::steady_clock::now();
+    uint32_t root = store.add(chunk);
+    double import_ms = ms_since(t0);
+    size_t store_bytes = heap_in_use() - before;
+    store.shrink();
+    size_t shrunk_bytes = heap_in_use() - before;
+    double nodes = store.size();
+
+    printf("%d statements, %u nodes\n", statements, store.size());
+    printf("pointer tree %10zu bytes  %6.1f bytes/node\n", tree_bytes, tree_bytes / nodes);
+    printf("store        %10zu bytes  %6.1f bytes/node  (import %.1f ms)\n", store_bytes, store_bytes / nodes, import_ms);
+    printf("  shrunk     %10zu bytes  %6.1f bytes/node\n", shrunk_bytes, shrunk_bytes / nodes);
+
+    size_t visited = 0;
+    t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) ast_walk(chunk, [&](ASTNode*) { visited++; return true; });
+    printf("walk tree    %8.3f ms/round  (%zu nodes)\n", ms_since(t0) / rounds, visited / rounds);
+
+    std::vector<uint32_t> stack;
+    visited = 0;
+    t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) visited += store_walk(store, root, stack);
+    printf("walk store   %8.3f ms/round  (%zu nodes)\n", ms_since(t0) / rounds, visited / rounds);
+
+    // Passes that only look for one kind of node can scan the kind array
+    size_t calls = 0;
+    t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (uint32_t id = 0; id < store.size(); id++) calls += store.kind(id) == AST_BIN_CALL;
+    }
+    printf("scan kinds   %8.3f ms/round  (%zu calls)\n", ms_since(t0) / rounds, calls / rounds);
+
+    delete chunk;
+    return 0;
+}
@@ -0,0 +1,31 @@
+#!/bin/bash
+# Table constructor benchmark: decompiles a generated data file returning one
+# constructor of N items (integers, strings, a nested record every tenth item
+# and two hash fields) and reports the time, the output size and how many
+# `vN = ...` temporary stores are left in the output.
+#
+#   make bench-table
+#   bench/table_bench.sh [items]    (from the ALCC directory, after make)
+set -e
+items=${1:-1000000}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# Values stay within LOADI and a small string set so the constant table is small
+awk -v n="$items" 'BEGIN {
+    print "return {"
+    for (i = 1; i <= n; i++) {
+        if (i % 10 == 0) printf "  {x = %d, y = \"s%d\"},\n", i % 30000, i % 100
+        else if (i % 3 == 0) printf "  \"s%d\",\n", i % 100
+        else printf "  %d,\n", i % 30000
+    }
+    printf "  name = \"data\", count = %d,\n}\n", n
+}' > "$dir/data.lua"
+
+./alcc-c$SUFFIX "$dir/data.lua" -o "$dir/data.luac"
+start=$(date +%s%N)
+./alcc-dec$SUFFIX --timing "$dir/data.luac" > "$dir/data.out" 2> "$dir/timing.txt"
+end=$(date +%s%N)
+echo "$items items: $(( (end - start) / 1000000 )) ms, $(wc -c < "$dir/data.out") bytes," \
+     "$(grep -oE 'v[0-9]+ = ' "$dir/data.out" | wc -l) temporary stores"
+cat "$dir/timing.txt"
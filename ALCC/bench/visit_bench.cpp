@@ -0,0 +1,156 @@
+// Visitor dispatch benchmark: the same counting pass over a synthetic chunk
+// written against the virtual ASTVisitor (accept() then visit(), two
+// indirect calls per node), against StaticASTVisitor (one switch on the
+// node kind, visits inlined), and the static pass driven through
+// ASTVisitorAdapter as plugin-facing code would.
+//
+// The last line times the type test passes use to pick nodes out:
+// dynamic_cast against a compare of the kind tag.
+//
+//   make bench-visit && ./bench-visit [statements] [rounds]
+
+#include "../src/ast/AST.h"
+#include "../src/ast/ASTDispatch.h"
+#include "random_ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+struct Counts {
+    size_t nodes = 0, calls = 0, operators = 0;
+    double numbers = 0;
+};
+
+class VirtualCounter : public ASTVisitor {
+public:
+    Counts c;
+    void go(ASTNode* n) { if (n) n->accept(*this); }
+
+    void visit(Block& node) override { c.nodes++; for (auto s : node.statements) go(s); }
+    void visit(Literal& node) override {
+        c.nodes++;
+        if (node.type == Literal::NUMBER) c.numbers += node.number_val;
+    }
+    void visit(Variable&) override { c.nodes++; }
+    void visit(BinaryExpr& node) override { c.nodes++; c.operators++; go(node.left); go(node.right); }
+    void visit(UnaryExpr& node) override { c.nodes++; c.operators++; go(node.expr); }
+    void visit(FunctionCall& node) override { c.nodes++; c.calls++; go(node.func); for (auto a : node.args) go(a); }
+    void visit(TableConstructor& node) override { c.nodes++; for (auto& f : node.fields) { go(f.key); go(f.value); } }
+    void visit(ClosureExpr& node) override { c.nodes++; go(node.body); }
+    void visit(Assignment& node) override {
+        c.nodes++;
+        for (auto t : node.targets) go(t);
+        for (auto v : node.values) go(v);
+    }
+    void visit(IfStmt& node) override { c.nodes++; for (auto& cl : node.clauses) { go(cl.condition); go(cl.block); } }
+    void visit(WhileStmt& node) override { c.nodes++; go(node.condition); go(node.body); }
+    void visit(RepeatStmt& node) override { c.nodes++; go(node.body); go(node.condition); }
+    void visit(ForNumStmt& node) override { c.nodes++; go(node.start); go(node.end); go(node.step); go(node.body); }
+    void visit(ForInStmt& node) override { c.nodes++; for (auto e : node.exprs) go(e); go(node.body); }
+    void visit(FunctionDecl& node) override { c.nodes++; go(node.body); }
+    void visit(ReturnStmt& node) override { c.nodes++; for (auto v : node.values) go(v); }
+    void visit(BreakStmt&) override { c.nodes++; }
+    void visit(LabelStmt&) override { c.nodes++; }
+    void visit(GotoStmt&) override { c.nodes++; }
+    void visit(ExprStmt& node) override { c.nodes++; go(node.expr); }
+    void visit(RawStmt&) override { c.nodes++; }
+};
+
+class StaticCounter : public StaticASTVisitor<StaticCounter> {
+public:
+    Counts c;
+    void go(ASTNode* n) { if (n) dispatch(*n); }
+
+    void visit(Block& node) { c.nodes++; for (auto s : node.statements) go(s); }
+    void visit(Literal& node) {
+        c.nodes++;
+        if (node.type == Literal::NUMBER) c.numbers += node.number_val;
+    }
+    void visit(Variable&) { c.nodes++; }
+    void visit(BinaryExpr& node) { c.nodes++; c.operators++; go(node.left); go(node.right); }
+    void visit(UnaryExpr& node) { c.nodes++; c.operators++; go(node.expr); }
+    void visit(FunctionCall& node) { c.nodes++; c.calls++; go(node.func); for (auto a : node.args) go(a); }
+    void visit(TableConstructor& node) { c.nodes++; for (auto& f : node.fields) { go(f.key); go(f.value); } }
+    void visit(ClosureExpr& node) { c.nodes++; go(node.body); }
+    void visit(Assignment& node) {
+        c.nodes++;
+        for (auto t : node.targets) go(t);
+        for (auto v : node.values) go(v);
+    }
+    void visit(IfStmt& node) { c.nodes++; for (auto& cl : node.clauses) { go(cl.condition); go(cl.block); } }
+    void visit(WhileStmt& node) { c.nodes++; go(node.condition); go(node.body); }
+    void visit(RepeatStmt& node) { c.nodes++; go(node.body); go(node.condition); }
+    void visit(ForNumStmt& node) { c.nodes++; go(node.start); go(node.end); go(node.step); go(node.body); }
+    void visit(ForInStmt& node) { c.nodes++; for (auto e : node.exprs) go(e); go(node.body); }
+    void visit(FunctionDecl& node) { c.nodes++; go(node.body); }
+    void visit(ReturnStmt& node) { c.nodes++; for (auto v : node.values) go(v); }
+    void visit(BreakStmt&) { c.nodes++; }
+    void visit(LabelStmt&) { c.nodes++; }
+    void visit(GotoStmt&) { c.nodes++; }
+    void visit(ExprStmt& node) { c.nodes++; go(node.expr); }
+    void visit(RawStmt&) { c.nodes++; }
+};
+
+template <typename Pass>
+static void run(const char* label, Block* chunk, int rounds) {
+    Counts total;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        Pass pass;
+        pass.run(chunk);
+        total = pass.counts();
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-8s %8.3f ms/round  %7.1f Mnodes/s  (%zu nodes, %zu calls, %zu operators)\n", label, s * 1000 / rounds,
+           total.nodes * (double)rounds / s / 1e6, total.nodes, total.calls, total.operators);
+}
+
+struct VirtualPass {
+    VirtualCounter v;
+    void run(Block* b) { b->accept(v); }
+    Counts counts() { return v.c; }
+};
+
+struct StaticPass {
+    StaticCounter v;
+    void run(Block* b) { v.dispatch(*b); }
+    Counts counts() { return v.c; }
+};
+
+// Only the root goes through the adapter: its visit recurses with dispatch
+struct AdapterPass {
+    StaticCounter v;
+    void run(Block* b) {
+        ASTVisitorAdapter<StaticCounter> adapter(v);
+        b->accept(adapter);
+    }
+    Counts counts() { return v.c; }
+};
+
+int main(int argc, char** argv) {
+    int statements = argc > 1 ? atoi(argv[1]) : 20000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 50;
+    Block* chunk = random_chunk(statements);
+    printf("%d statements, %d rounds\n", statements, rounds);
+    run<VirtualPass>("virtual", chunk, rounds);
+    run<StaticPass>("static", chunk, rounds);
+    run<AdapterPass>("adapter", chunk, rounds);
+
+    std::vector<ASTNode*> all;
+    ast_walk(chunk, [&](ASTNode* n) { all.push_back(n); return true; });
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (ASTNode* n : all) found += dynamic_cast<UnaryExpr*>(n) != nullptr;
+    }
+    double cast_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (ASTNode* n : all) found += n->kind == ASTNode::UNARY;
+    }
+    double kind_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("type test: dynamic_cast %.3f ms/round, kind %.3f ms/round (%zu unary)\n", cast_s * 1000 / rounds,
+           kind_s * 1000 / rounds, found / rounds / 2);
+    delete chunk;
+    return 0;
+}
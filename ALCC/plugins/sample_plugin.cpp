@@ -28,6 +28,19 @@ static int my_on_instruction(Proto* p, int pc, char* out_buffer, size_t buffer_s
     return 0;
 }
 
+// API 3: the same override for the whole function at once, formatted
+// straight into the tool's table
+static void my_on_code(Proto* p, const AlccInstruction* code, int count, AlccOverrides* out) {
+    (void)p;
+    for (int pc = 0; pc < count; pc++) {
+        if (code[pc].op == OP_MOVE) {
+            AlccOutput* text = out->open(out, pc);
+            int len = snprintf(text->reserve(text, 64), 64, "[PLUGIN] MOVE %d -> %d", code[pc].b, code[pc].a);
+            text->commit(text, (size_t)len);
+        }
+    }
+}
+
 static void my_on_disasm_header(Proto* p) {
     printf("; [PLUGIN] Disassembling Proto at %p\n", (void*)p);
 }
@@ -58,9 +71,17 @@ static AlccPlugin plugin = {
     my_on_instruction,
     my_on_disasm_header,
     my_on_asm_line,
-    my_on_decompile_inst
+    my_on_decompile_inst,
+    NULL, // on_ast_process
+    NULL, // on_liveness
+    my_on_code
 };
 
 extern "C" AlccPlugin* alcc_plugin_init(void) {
     return &plugin;
 }
+
+// Tools from before API 3 ignore this and call my_on_instruction
+extern "C" int alcc_plugin_api(void) {
+    return ALCC_PLUGIN_API_VERSION;
+}
@@ -0,0 +1,454 @@
+#include "CallGraph.h"
+#include "ControlFlow.h"
+#include "Liveness.h"
+
+extern "C" {
+#include "lopcodes.h"
+}
+
+#include "../core/alcc_utils.h"
+#include "../core/compat.h"
+
+#include <string.h>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+enum ValueKind { V_UNKNOWN, V_FUNCTION, V_PATH, V_KEY, V_CONFLICT };
+
+struct Value {
+    int kind;
+    int id; // function index, path id or key id
+    bool operator==(const Value& o) const { return kind == o.kind && id == o.id; }
+};
+
+const Value UNKNOWN_VALUE = {V_UNKNOWN, -1};
+const int ENV_PATH = 0;
+
+// Field path: a key under another path, or a root (_ENV, or one table constructor)
+struct PathNode {
+    int parent;
+    int key;   // key id, -1 for roots
+    int label; // roots: key id of the local holding the table, -1 if none
+    int alias; // roots: first global or field path the table was stored in, -1 if none
+};
+
+struct Builder {
+    CallGraph& g;
+    std::vector<int> child_offset; // function -> first entry in children
+    std::vector<int> children;     // function indices of p[] in order
+    std::vector<int> upval_offset; // function -> first entry in upvals
+    std::vector<Value> upvals;
+    std::vector<unsigned char> captured;
+
+    // Keys point into the Lua strings, which outlive the build
+    std::unordered_map<std::string_view, int> key_ids;
+    std::vector<std::string_view> keys;
+    std::vector<PathNode> paths;
+    std::unordered_map<uint64_t, int> path_ids;
+    std::unordered_map<int, Value> bindings; // path -> value stored there
+    std::vector<int> bound_path;             // function -> first path it was stored in
+    std::vector<int> local_name;             // function -> key id of the local it was stored in
+
+    std::vector<Value> site_values;
+    std::vector<int> locreg; // scratch: register of each locvar
+    ControlFlowGraph cfg;
+
+    Builder(CallGraph& graph) : g(graph) {}
+
+    int intern(TString* ts) {
+        auto it = key_ids.emplace(std::string_view(getstr(ts), tsslen(ts)), (int)keys.size());
+        if (it.second) keys.push_back(it.first->first);
+        return it.first->second;
+    }
+
+    // Id of string constant k, -1 for other constants
+    int key_of(Proto* p, int k) {
+        if (k < 0 || k >= p->sizek || !ttisstring(&p->k[k])) return -1;
+        return intern(tsvalue(&p->k[k]));
+    }
+
+    // Key held in a register: functions with more than 255 constants load
+    // field names with LOADK and index with GETTABLE/SETTABLE
+    static int reg_key(const Value& v) { return v.kind == V_KEY ? v.id : -1; }
+
+    int new_root() {
+        paths.push_back({-1, -1, -1, -1});
+        return (int)paths.size() - 1;
+    }
+
+    int field(int parent, int key) {
+        uint64_t h = ((uint64_t)(uint32_t)parent << 32) | (uint32_t)key;
+        auto it = path_ids.emplace(h, (int)paths.size());
+        if (it.second) paths.push_back({parent, key, -1, -1});
+        return it.first->second;
+    }
+
+    // Value read from base[key]
+    Value get(const Value& base, int key) {
+        if (base.kind != V_PATH || key < 0) return UNKNOWN_VALUE;
+        int path = field(base.id, key);
+        // A path holding a table is followed to the table, so fields set
+        // through one name are found through the other (M = {}; M.f = ...)
+        auto it = bindings.find(path);
+        if (it != bindings.end() && it->second.kind == V_PATH) return it->second;
+        Value v = {V_PATH, path};
+        return v;
+    }
+
+    // base[key] = value
+    void set(const Value& base, int key, const Value& value) {
+        if (base.kind != V_PATH || key < 0) return;
+        int path = field(base.id, key);
+        auto it = bindings.emplace(path, value);
+        if (!it.second && !(it.first->second == value)) it.first->second.kind = V_CONFLICT;
+        if (value.kind == V_FUNCTION && bound_path[value.id] < 0) bound_path[value.id] = path;
+        if (value.kind == V_PATH && value.id != ENV_PATH && root_of(path) != value.id) {
+            PathNode& table = paths[value.id];
+            if (table.parent < 0 && table.label < 0 && table.alias < 0) table.alias = path;
+        }
+    }
+
+    int root_of(int path) const {
+        while (paths[path].parent >= 0) path = paths[path].parent;
+        return path;
+    }
+
+    // Dotted name; tables are named after their local or first store, "?" without either
+    std::string path_name(int path) const {
+        std::vector<int> chain;
+        for (int hops = 0;; hops++) {
+            while (paths[path].parent >= 0) {
+                chain.push_back(paths[path].key);
+                path = paths[path].parent;
+            }
+            // Tables stored into each other's fields can alias in a cycle
+            if (path == ENV_PATH || paths[path].label >= 0 || paths[path].alias < 0 || hops == 16) break;
+            path = paths[path].alias;
+        }
+        std::string name;
+        if (path != ENV_PATH) name = paths[path].label >= 0 ? std::string(keys[paths[path].label]) : "?";
+        for (size_t i = chain.size(); i-- > 0;) {
+            if (!name.empty()) name += '.';
+            name += keys[chain[i]];
+        }
+        return name;
+    }
+
+    void collect(Proto* root);
+    void compute_locregs(Proto* p);
+    int local_at(Proto* p, int reg, int pc);
+    void scan(int f);
+    void finish();
+};
+
+void Builder::collect(Proto* root) {
+    std::vector<std::pair<Proto*, std::pair<int, int>>> stack(1, {root, {-1, 0}});
+    while (!stack.empty()) {
+        Proto* p = stack.back().first;
+        int parent = stack.back().second.first;
+        int index = stack.back().second.second;
+        stack.pop_back();
+        int self = (int)g.functions.size();
+        g.functions.push_back(p);
+        g.parent.push_back(parent);
+        g.index.push_back(index);
+        for (int j = p->sizep - 1; j >= 0; j--) stack.push_back({p->p[j], {self, j}});
+    }
+
+    // Children of f: the first follows f, each later one the subtree of the one before
+    int n = g.num_functions();
+    child_offset.assign(n + 1, 0);
+    for (int f = 0; f < n; f++) child_offset[f + 1] = child_offset[f] + g.functions[f]->sizep;
+    children.assign(child_offset[n], -1);
+    for (int f = 1; f < n; f++) children[child_offset[g.parent[f]] + g.index[f]] = f;
+
+    upval_offset.assign(n + 1, 0);
+    for (int f = 0; f < n; f++) upval_offset[f + 1] = upval_offset[f] + g.functions[f]->sizeupvalues;
+    upvals.assign(upval_offset[n], UNKNOWN_VALUE);
+    captured.assign(n, 0);
+    Value env = {V_PATH, ENV_PATH};
+    for (int f = 0; f < n; f++) {
+        Proto* p = g.functions[f];
+        for (int i = 0; i < p->sizeupvalues; i++) {
+            TString* name = p->upvalues[i].name;
+            // The main function's only upvalue is _ENV, named or not
+            if ((name && strcmp(getstr(name), "_ENV") == 0) || (f == 0 && i == 0)) upvals[upval_offset[f] + i] = env;
+        }
+    }
+    bound_path.assign(n, -1);
+    local_name.assign(n, -1);
+
+    size_t code = 0;
+    for (int f = 0; f < n; f++) code += g.functions[f]->sizecode;
+    key_ids.reserve(code / 4);
+    path_ids.reserve(code / 4);
+    bindings.reserve(n);
+}
+
+// Locals are declared in order and nest like a stack, so the register of
+// each one is the number of locals still active where it starts
+void Builder::compute_locregs(Proto* p) {
+    locreg.resize(p->sizelocvars);
+    std::vector<int> active;
+    for (int i = 0; i < p->sizelocvars; i++) {
+        while (!active.empty() && p->locvars[active.back()].endpc <= p->locvars[i].startpc) active.pop_back();
+        locreg[i] = (int)active.size();
+        active.push_back(i);
+    }
+}
+
+// Key id of the local living in reg right after pc, -1 for a temporary
+int Builder::local_at(Proto* p, int reg, int pc) {
+    for (int i = 0; i < p->sizelocvars; i++) {
+        const LocVar& v = p->locvars[i];
+        if (v.startpc > pc + 1) break;
+        if (locreg[i] == reg && pc + 1 < v.endpc && v.varname) return intern(v.varname);
+    }
+    return -1;
+}
+
+void Builder::scan(int f) {
+    Proto* p = g.functions[f];
+    g.site_offset[f] = (int)g.sites.size();
+    cfg.build(p);
+    if (p->sizelocvars) compute_locregs(p);
+
+    // Sized for any 9-bit operand; only the frame is reset at joins
+    Value regs[512];
+    for (int r = 0; r < 512; r++) regs[r] = UNKNOWN_VALUE;
+    int frame = p->maxstacksize;
+    const Value* up = upvals.data() + upval_offset[f];
+    AlccInstruction dec;
+    RegSet use, def;
+
+    int next_local = 0;
+    for (int pc = 0; pc < p->sizecode; pc++) {
+        // A local starting here names the table its register holds (local M = {...})
+        for (; next_local < p->sizelocvars && p->locvars[next_local].startpc <= pc; next_local++) {
+            const Value& v = regs[locreg[next_local]];
+            TString* name = p->locvars[next_local].varname;
+            if (v.kind == V_PATH && name && paths[v.id].parent < 0 && paths[v.id].label < 0 && v.id != ENV_PATH) {
+                paths[v.id].label = intern(name);
+            }
+        }
+        int b = cfg.block_of[pc];
+        if (pc > 0 && cfg.blocks[b].start_pc == pc && !(cfg.pred_count(b) == 1 && *cfg.pred_begin(b) == b - 1)) {
+            for (int r = 0; r < frame; r++) regs[r] = UNKNOWN_VALUE;
+        }
+        current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+        int a = dec.a, bb = dec.b, c = dec.c;
+#if defined(LUA_53) || defined(LUA_52)
+        bool c_const = ISK(c);
+#else
+        bool c_const = dec.k;
+#endif
+        Value rc = c_const ? UNKNOWN_VALUE : regs[c & 511];
+
+        switch (dec.op) {
+            case OP_MOVE:
+                regs[a] = regs[bb];
+                continue;
+            case OP_LOADK: {
+                int key = key_of(p, dec.bx);
+                regs[a].kind = key >= 0 ? V_KEY : V_UNKNOWN;
+                regs[a].id = key;
+                continue;
+            }
+            case OP_NEWTABLE: {
+                int root = new_root();
+                regs[a].kind = V_PATH;
+                regs[a].id = root;
+                continue;
+            }
+            case OP_CLOSURE: {
+                if (dec.bx < 0 || dec.bx >= p->sizep) {
+                    regs[a] = UNKNOWN_VALUE;
+                    continue;
+                }
+                int child = children[child_offset[f] + dec.bx];
+                Proto* sub = p->p[dec.bx];
+                if (!captured[child]) {
+                    captured[child] = 1;
+                    Value* cu = upvals.data() + upval_offset[child];
+                    for (int i = 0; i < sub->sizeupvalues; i++) {
+                        int idx = sub->upvalues[i].idx;
+                        Value v = UNKNOWN_VALUE;
+                        if (!sub->upvalues[i].instack) {
+                            if (idx < p->sizeupvalues) v = up[idx];
+                        } else if (idx == a) {
+                            v.kind = V_FUNCTION; // local function f: f is its own upvalue
+                            v.id = child;
+                        } else {
+                            v = regs[idx];
+                        }
+                        if (v.kind != V_UNKNOWN) cu[i] = v;
+                    }
+                }
+                if (p->sizelocvars && local_name[child] < 0) local_name[child] = local_at(p, a, pc);
+                regs[a].kind = V_FUNCTION;
+                regs[a].id = child;
+                continue;
+            }
+            case OP_GETUPVAL:
+                regs[a] = bb < p->sizeupvalues ? up[bb] : UNKNOWN_VALUE;
+                continue;
+            case OP_GETTABUP: {
+                Value base = bb < p->sizeupvalues ? up[bb] : UNKNOWN_VALUE;
+#if defined(LUA_53) || defined(LUA_52)
+                regs[a] = get(base, ISK(c) ? key_of(p, INDEXK(c)) : reg_key(regs[c]));
+#else
+                regs[a] = get(base, key_of(p, c));
+#endif
+                continue;
+            }
+            case OP_GETFIELD:
+                regs[a] = get(regs[bb], key_of(p, c));
+                continue;
+#if defined(LUA_53) || defined(LUA_52)
+            case OP_GETTABLE:
+                regs[a] = get(regs[bb], ISK(c) ? key_of(p, INDEXK(c)) : reg_key(regs[c]));
+                continue;
+            case OP_SELF: {
+                Value obj = regs[bb];
+                regs[a + 1] = obj;
+                regs[a] = get(obj, ISK(c) ? key_of(p, INDEXK(c)) : reg_key(regs[c]));
+                continue;
+            }
+            case OP_SETTABUP:
+                if (a < p->sizeupvalues) set(up[a], ISK(bb) ? key_of(p, INDEXK(bb)) : reg_key(regs[bb]), rc);
+                continue;
+            case OP_SETTABLE:
+                set(regs[a], ISK(bb) ? key_of(p, INDEXK(bb)) : reg_key(regs[bb]), rc);
+                continue;
+#else
+            case OP_GETTABLE:
+                regs[a] = get(regs[bb], reg_key(regs[c]));
+                continue;
+            case OP_SELF: {
+                Value obj = regs[bb];
+                regs[a + 1] = obj;
+                regs[a] = get(obj, c_const ? key_of(p, c) : reg_key(regs[c]));
+                continue;
+            }
+            case OP_SETTABUP:
+                if (a < p->sizeupvalues) set(up[a], key_of(p, bb), rc);
+                continue;
+            case OP_SETTABLE:
+                set(regs[a], reg_key(regs[bb]), rc);
+                continue;
+#endif
+            case OP_SETFIELD:
+                set(regs[a], key_of(p, bb), rc);
+                continue;
+            case OP_CALL:
+            case OP_TAILCALL: {
+                CallGraph::CallSite site = {pc, -1, CallGraph::CALLEE_UNKNOWN, (uint8_t)(dec.op == OP_TAILCALL)};
+                g.sites.push_back(site);
+                site_values.push_back(regs[a]);
+                break;
+            }
+            default:
+                break;
+        }
+        Liveness::effects(p, pc, dec, use, def);
+        for (int r = def.first(); r < 256; r++) {
+            if (def.test(r)) regs[r] = UNKNOWN_VALUE;
+        }
+    }
+}
+
+void Builder::finish() {
+    int n = g.num_functions();
+    g.site_offset[n] = (int)g.sites.size();
+
+    std::unordered_map<std::string, int> name_ids;
+    auto name_index = [&](const std::string& s) {
+        auto it = name_ids.emplace(s, (int)g.names.size());
+        if (it.second) g.names.push_back(s);
+        return it.first->second;
+    };
+    std::unordered_map<int, int> path_names; // path -> name index
+    auto named_path = [&](int path) {
+        auto it = path_names.find(path);
+        if (it != path_names.end()) return it->second;
+        int id = name_index(path_name(path));
+        path_names.emplace(path, id);
+        return id;
+    };
+
+    for (size_t i = 0; i < g.sites.size(); i++) {
+        CallGraph::CallSite& s = g.sites[i];
+        const Value& v = site_values[i];
+        if (v.kind == V_FUNCTION) {
+            s.kind = CallGraph::CALLEE_FUNCTION;
+            s.callee = v.id;
+        } else if (v.kind == V_PATH && v.id != ENV_PATH) {
+            auto it = bindings.find(v.id);
+            if (it != bindings.end() && it->second.kind == V_FUNCTION) {
+                s.kind = CallGraph::CALLEE_FUNCTION;
+                s.callee = it->second.id;
+            } else {
+                s.kind = CallGraph::CALLEE_NAMED;
+                s.callee = named_path(v.id);
+            }
+        }
+    }
+
+    g.name_of.assign(n, -1);
+    for (int f = 0; f < n; f++) {
+        if (bound_path[f] >= 0) g.name_of[f] = named_path(bound_path[f]);
+        else if (local_name[f] >= 0) g.name_of[f] = name_index(std::string(keys[local_name[f]]));
+    }
+
+    // Distinct callees per caller, then callers by counting sort
+    std::vector<int> last(n, -1);
+    g.succ_offset.assign(n + 1, 0);
+    g.succ.clear();
+    for (int f = 0; f < n; f++) {
+        g.succ_offset[f] = (int)g.succ.size();
+        for (const CallGraph::CallSite* s = g.site_begin(f); s != g.site_end(f); s++) {
+            if (s->kind != CallGraph::CALLEE_FUNCTION || last[s->callee] == f) continue;
+            last[s->callee] = f;
+            g.succ.push_back(s->callee);
+        }
+    }
+    g.succ_offset[n] = (int)g.succ.size();
+    g.pred_offset.assign(n + 1, 0);
+    for (int t : g.succ) g.pred_offset[t + 1]++;
+    for (int f = 0; f < n; f++) g.pred_offset[f + 1] += g.pred_offset[f];
+    g.pred.resize(g.succ.size());
+    std::vector<int> fill(g.pred_offset.begin(), g.pred_offset.end() - 1);
+    for (int f = 0; f < n; f++) {
+        for (const int* s = g.succ_begin(f); s != g.succ_end(f); s++) g.pred[fill[*s]++] = f;
+    }
+}
+
+} // namespace
+
+void CallGraph::build(Proto* root) {
+    functions.clear();
+    parent.clear();
+    index.clear();
+    names.clear();
+    sites.clear();
+
+    Builder b(*this);
+    b.paths.push_back({-1, -1, -1, -1}); // ENV_PATH
+    b.collect(root);
+    int n = num_functions();
+    site_offset.assign(n + 1, 0);
+    // Pre-order scans every parent before the closures it creates
+    for (int f = 0; f < n; f++) b.scan(f);
+    b.finish();
+}
+
+std::string CallGraph::path_of(int f) const {
+    std::string path;
+    for (; parent[f] >= 0; f = parent[f]) {
+        std::string step = std::to_string(index[f]);
+        path = path.empty() ? step : step + "/" + path;
+    }
+    return path;
+}
@@ -0,0 +1,69 @@
+#ifndef ALCC_CALL_GRAPH_H
+#define ALCC_CALL_GRAPH_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "lua.h"
+#include "lobject.h"
+}
+
+// Static call graph of a function tree.
+// Each function is scanned once, in pre-order, tracking what every register
+// holds: a function of this chunk (CLOSURE), a captured upvalue (GETUPVAL),
+// or a field path rooted at _ENV or at a table constructor (GETTABUP,
+// GETFIELD, SELF), copied by MOVE. Closures capture the state of their
+// parent at the CLOSURE instruction. Stores of a function into a global or a
+// field (SETTABUP, SETFIELD) bind its path, and calls through a path are
+// resolved against these bindings once every function has been scanned.
+// Register state only survives into a block entered by fall-through alone;
+// any other join starts from unknown values.
+class CallGraph {
+public:
+    enum CalleeKind {
+        CALLEE_FUNCTION, // a function of this chunk
+        CALLEE_NAMED,    // a global or field path bound to no single function (print, string.format)
+        CALLEE_UNKNOWN   // a parameter, call result, table element, ...
+    };
+
+    struct CallSite {
+        int pc;
+        int callee;      // function index, name index for CALLEE_NAMED, -1 when unknown
+        uint8_t kind;    // CalleeKind
+        uint8_t tail;    // OP_TAILCALL
+    };
+
+    std::vector<Proto*> functions;  // pre-order, [0] is the root
+    std::vector<int> parent;        // -1 for the root
+    std::vector<int> index;         // position in the parent's p[]
+    std::vector<int> name_of;       // name index of the global, field or local the function is stored in, -1 if none
+    std::vector<std::string> names; // dotted paths and local names; "?" stands for a table with no name
+    std::vector<int> site_offset;   // function -> first call site (num_functions + 1 entries)
+    std::vector<CallSite> sites;    // in pc order within each function
+    std::vector<int> succ_offset;   // function -> first callee in succ (num_functions + 1 entries)
+    std::vector<int> succ;          // distinct resolved callees in order of first call
+    std::vector<int> pred_offset;   // function -> first caller in pred (num_functions + 1 entries)
+    std::vector<int> pred;          // distinct callers in function order
+
+    void build(Proto* root);
+
+    int num_functions() const { return (int)functions.size(); }
+
+    const CallSite* site_begin(int f) const { return sites.data() + site_offset[f]; }
+    const CallSite* site_end(int f) const { return sites.data() + site_offset[f + 1]; }
+
+    int succ_count(int f) const { return succ_offset[f + 1] - succ_offset[f]; }
+    const int* succ_begin(int f) const { return succ.data() + succ_offset[f]; }
+    const int* succ_end(int f) const { return succ.data() + succ_offset[f + 1]; }
+
+    int pred_count(int f) const { return pred_offset[f + 1] - pred_offset[f]; }
+    const int* pred_begin(int f) const { return pred.data() + pred_offset[f]; }
+    const int* pred_end(int f) const { return pred.data() + pred_offset[f + 1]; }
+
+    // "" for the root, else p[] indices joined by '/' as taken by --func
+    std::string path_of(int f) const;
+};
+
+#endif
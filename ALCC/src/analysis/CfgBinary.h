@@ -0,0 +1,70 @@
+#ifndef ALCC_CFG_BINARY_H
+#define ALCC_CFG_BINARY_H
+
+#include <stdint.h>
+
+// Binary CSR dump of the control flow graphs of a function tree, written by
+// alcc-cfg --format csr. Blocks of all functions share one numbering, so the
+// arrays can be mmap'ed and used in place as a single graph. All fields are
+// uint32_t/int32_t in the producer's byte order.
+//
+// Layout:
+//   CfgBinHeader
+//   CfgBinFunction functions[function_count]   (pre-order; [0] is the selected function)
+//   CfgBinBlock    blocks[block_count]
+//   uint32_t       succ_offset[block_count + 1]
+//   uint32_t       succ[edge_count]            (block ids)
+//   CfgBinClosure  closures[closure_count]
+// With CFG_BIN_STRUCTURE in flags (alcc-cfg --analyze), per block and edge:
+//   uint32_t       idom[block_count]           (CFG_BIN_NONE for entries and unreachable blocks)
+//   uint32_t       ipdom[block_count]          (CFG_BIN_EXIT, or CFG_BIN_NONE if the exit is never reached)
+//   uint32_t       loop[block_count]           (innermost loop header, CFG_BIN_NONE outside loops)
+//   uint32_t       depth[block_count]          (loop nesting depth)
+//   uint8_t        edge_kind[edge_count]       (EdgeClasses::Kind: tree, forward, back, cross, unreachable)
+//
+// The successors of block b are succ[succ_offset[b] .. succ_offset[b + 1] - 1].
+// Pcs are 0-based indices into the function's code.
+
+#define CFG_BIN_MAGIC "ALCG"
+#define CFG_BIN_VERSION 1
+#define CFG_BIN_BYTE_ORDER 0x01020304u
+#define CFG_BIN_NONE 0xFFFFFFFFu
+#define CFG_BIN_EXIT 0xFFFFFFFEu
+
+enum CfgBinFlags {
+    CFG_BIN_STRUCTURE = 1
+};
+
+struct CfgBinHeader {
+    char magic[4];
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t function_count;
+    uint32_t block_count;
+    uint32_t edge_count;
+    uint32_t closure_count;
+    uint32_t flags;
+};
+
+struct CfgBinFunction {
+    uint32_t first_block; // entry block
+    uint32_t block_count;
+    uint32_t parent;      // function index, CFG_BIN_NONE for functions[0]
+    uint32_t index;       // position in the parent's p[]
+    int32_t line;         // linedefined
+    int32_t last_line;    // lastlinedefined
+};
+
+struct CfgBinBlock {
+    uint32_t start_pc;
+    uint32_t end_pc; // inclusive
+};
+
+// An OP_CLOSURE instruction and the function it creates
+struct CfgBinClosure {
+    uint32_t block;
+    uint32_t pc;
+    uint32_t function;
+};
+
+#endif
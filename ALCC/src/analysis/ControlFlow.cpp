@@ -0,0 +1,137 @@
+#include "ControlFlow.h"
+
+extern "C" {
+#include "lopcodes.h"
+}
+
+#include "../core/alcc_utils.h"
+#include "../core/compat.h"
+
+bool ControlFlowGraph::is_test(int op) {
+    return op == OP_EQ || op == OP_LT || op == OP_LE || op == OP_EQK || op == OP_EQI ||
+           op == OP_LTI || op == OP_LEI || op == OP_GTI || op == OP_GEI ||
+           op == OP_TEST || op == OP_TESTSET;
+}
+
+bool ControlFlowGraph::is_return(int op) {
+    return op == OP_RETURN || op == OP_RETURN0 || op == OP_RETURN1;
+}
+
+int ControlFlowGraph::branch_target(const AlccInstruction& dec, int pc) {
+    int op = dec.op;
+    if (op == OP_JMP) return pc + 1 + dec.bx;
+#if defined(LUA_53) || defined(LUA_52)
+    // Signed offsets relative to the next instruction
+    if (op == OP_FORPREP || op == OP_FORLOOP || op == OP_TFORLOOP) return pc + 1 + dec.bx;
+#else
+    if (op == OP_FORLOOP || op == OP_TFORLOOP) return pc + 1 - dec.bx;
+    if (op == OP_FORPREP) return pc + 1 + dec.bx + 1;
+    if (op == OP_TFORPREP) return pc + 1 + dec.bx;
+#endif
+    return -1;
+}
+
+int ControlFlowGraph::successors(const AlccInstruction& dec, int pc, int out[2]) {
+    int op = dec.op;
+    if (is_return(op)) return 0;
+    if (is_test(op)) {
+        out[0] = pc + 1;
+        out[1] = pc + 2;
+        return 2;
+    }
+#if defined(LUA_53) || defined(LUA_52)
+    if (op == OP_LOADBOOL && dec.c) {
+        out[0] = pc + 2;
+        return 1;
+    }
+    if (op == OP_JMP || op == OP_FORPREP) {
+        out[0] = branch_target(dec, pc);
+        return 1;
+    }
+#else
+    if (op == OP_LFALSESKIP) {
+        out[0] = pc + 2;
+        return 1;
+    }
+    if (op == OP_JMP || op == OP_TFORPREP) {
+        out[0] = branch_target(dec, pc);
+        return 1;
+    }
+#endif
+    int target = branch_target(dec, pc);
+    out[0] = pc + 1;
+    if (target >= 0) {
+        out[1] = target;
+        return 2;
+    }
+    return 1;
+}
+
+void ControlFlowGraph::build(Proto* p) {
+    int n = p->sizecode;
+    blocks.clear();
+    block_of.resize(n);
+    succ_offset.clear();
+    succ.clear();
+    pred_offset.clear();
+    pred.clear();
+    if (n == 0) {
+        succ_offset.push_back(0);
+        pred_offset.push_back(0);
+        return;
+    }
+
+    // Pass 1: leaders, one bit per pc
+    leader_bits.assign((n + 63) >> 6, 0);
+    uint64_t* leader = leader_bits.data();
+    leader[0] = 1;
+    AlccInstruction dec;
+    int out[2];
+    for (int pc = 0; pc < n; pc++) {
+        current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+        int cnt = successors(dec, pc, out);
+        if (cnt == 1 && out[0] == pc + 1) continue;
+        if (pc + 1 < n) leader[(pc + 1) >> 6] |= 1ull << ((pc + 1) & 63);
+        for (int s = 0; s < cnt; s++) {
+            if (out[s] >= 0 && out[s] < n) leader[out[s] >> 6] |= 1ull << (out[s] & 63);
+        }
+    }
+
+    // Pass 2: blocks and pc -> block map
+    for (int pc = 0; pc < n; pc++) {
+        if (leader[pc >> 6] & (1ull << (pc & 63))) {
+            if (!blocks.empty()) blocks.back().end_pc = pc - 1;
+            blocks.push_back({pc, n - 1});
+        }
+        block_of[pc] = (int)blocks.size() - 1;
+    }
+
+    // Pass 3: successor edges (CSR)
+    int nb = (int)blocks.size();
+    succ_offset.resize(nb + 1);
+    for (int b = 0; b < nb; b++) {
+        succ_offset[b] = (int)succ.size();
+        int end = blocks[b].end_pc;
+        current_backend->decode_instruction((uint32_t)p->code[end], &dec);
+        int cnt = successors(dec, end, out);
+        for (int s = 0; s < cnt; s++) {
+            if (out[s] < 0 || out[s] >= n) continue;
+            int target = block_of[out[s]];
+            if (s == 1 && cnt == 2 && out[0] >= 0 && out[0] < n && block_of[out[0]] == target) continue;
+            succ.push_back(target);
+        }
+    }
+    succ_offset[nb] = (int)succ.size();
+
+    // Pass 4: predecessor edges (CSR) by counting sort over the successor lists
+    pred_offset.assign(nb + 1, 0);
+    for (int t : succ) pred_offset[t + 1]++;
+    for (int b = 0; b < nb; b++) pred_offset[b + 1] += pred_offset[b];
+    pred.resize(succ.size());
+    fill.assign(pred_offset.begin(), pred_offset.end() - 1);
+    for (int b = 0; b < nb; b++) {
+        for (int e = succ_offset[b]; e < succ_offset[b + 1]; e++) {
+            pred[fill[succ[e]]++] = b;
+        }
+    }
+}
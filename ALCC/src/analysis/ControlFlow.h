@@ -0,0 +1,67 @@
+#ifndef ALCC_CONTROL_FLOW_H
+#define ALCC_CONTROL_FLOW_H
+
+#include <stdint.h>
+#include <vector>
+
+extern "C" {
+#include "lua.h"
+#include "lobject.h"
+}
+
+#include "../core/alcc_backend.h"
+
+// Flat control flow graph of a single function.
+// Blocks are numbered in pc order and edges are kept in CSR arrays,
+// so every query is an index lookup instead of a map search.
+// build() runs in linear passes and keeps its buffers between calls, so a
+// graph reused across functions stops allocating once it has seen the
+// largest one.
+class ControlFlowGraph {
+public:
+    struct BasicBlock {
+        int start_pc;
+        int end_pc;
+    };
+
+    std::vector<BasicBlock> blocks;
+    std::vector<int> block_of;     // pc -> block id
+    std::vector<int> succ_offset;  // block id -> first edge in succ (num_blocks + 1 entries)
+    std::vector<int> succ;
+    std::vector<int> pred_offset;  // block id -> first edge in pred (num_blocks + 1 entries)
+    std::vector<int> pred;
+
+    void build(Proto* p);
+
+    int num_blocks() const { return (int)blocks.size(); }
+
+    int succ_count(int b) const { return succ_offset[b + 1] - succ_offset[b]; }
+    const int* succ_begin(int b) const { return succ.data() + succ_offset[b]; }
+    const int* succ_end(int b) const { return succ.data() + succ_offset[b + 1]; }
+
+    int pred_count(int b) const { return pred_offset[b + 1] - pred_offset[b]; }
+    const int* pred_begin(int b) const { return pred.data() + pred_offset[b]; }
+    const int* pred_end(int b) const { return pred.data() + pred_offset[b + 1]; }
+
+    // Block containing pc, or -1 when pc is outside the function.
+    int block_at(int pc) const {
+        return (pc >= 0 && pc < (int)block_of.size()) ? block_of[pc] : -1;
+    }
+
+    // Explicit branch target of a decoded instruction (JMP, FORPREP, FORLOOP,
+    // TFORPREP, TFORLOOP), or -1 if it only falls through.
+    static int branch_target(const AlccInstruction& dec, int pc);
+
+    // Fills out[] with the successor pcs of the instruction and returns their count (0-2).
+    static int successors(const AlccInstruction& dec, int pc, int out[2]);
+
+    // Comparison/test opcodes that skip the next instruction.
+    static bool is_test(int op);
+    static bool is_return(int op);
+
+private:
+    std::vector<uint64_t> leader_bits; // pc -> starts a block
+    std::vector<int> fill;             // predecessor insertion points
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include "Dominators.h"
+
+void DominatorTree::compute(const ControlFlowGraph& cfg, bool post_dominators) {
+    post = post_dominators;
+    int nb = cfg.num_blocks();
+    int n = post ? nb + 1 : nb;
+
+    // Materialize the graph in the direction being analyzed
+    std::vector<int> s_off(n + 1, 0), s_list, p_off(n + 1, 0), p_list;
+    if (!post) {
+        s_off = cfg.succ_offset;
+        s_list = cfg.succ;
+        p_off = cfg.pred_offset;
+        p_list = cfg.pred;
+        root = 0;
+    } else {
+        root = nb;
+        // Reversed successors: CFG predecessors, plus exit -> returning blocks
+        for (int b = 0; b < nb; b++) {
+            s_off[b] = (int)s_list.size();
+            s_list.insert(s_list.end(), cfg.pred_begin(b), cfg.pred_end(b));
+        }
+        s_off[nb] = (int)s_list.size();
+        for (int b = 0; b < nb; b++) {
+            if (cfg.succ_count(b) == 0) s_list.push_back(b);
+        }
+        s_off[n] = (int)s_list.size();
+        // Reversed predecessors: CFG successors, plus returning blocks <- exit
+        for (int b = 0; b < nb; b++) {
+            p_off[b] = (int)p_list.size();
+            p_list.insert(p_list.end(), cfg.succ_begin(b), cfg.succ_end(b));
+            if (cfg.succ_count(b) == 0) p_list.push_back(nb);
+        }
+        p_off[nb] = (int)p_list.size();
+        p_off[n] = (int)p_list.size();
+    }
+
+    idom.assign(n, -1);
+    rpo_index.assign(n, -1);
+    order.clear();
+    tree_pre.assign(n, -1);
+    tree_post.assign(n, -1);
+    if (n == 0) return;
+
+    // Reverse post-order by iterative DFS
+    std::vector<int> post_order;
+    std::vector<std::pair<int, int>> stack;
+    std::vector<unsigned char> visited(n, 0);
+    stack.push_back({root, s_off[root]});
+    visited[root] = 1;
+    while (!stack.empty()) {
+        int node = stack.back().first;
+        int& edge = stack.back().second;
+        if (edge < s_off[node + 1]) {
+            int next = s_list[edge++];
+            if (!visited[next]) {
+                visited[next] = 1;
+                stack.push_back({next, s_off[next]});
+            }
+        } else {
+            post_order.push_back(node);
+            stack.pop_back();
+        }
+    }
+    order.assign(post_order.rbegin(), post_order.rend());
+    for (size_t i = 0; i < order.size(); i++) rpo_index[order[i]] = (int)i;
+
+    // Iterate to a fixed point; reducible graphs settle in two or three passes
+    idom[root] = root;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < order.size(); i++) {
+            int node = order[i];
+            int new_idom = -1;
+            for (int e = p_off[node]; e < p_off[node + 1]; e++) {
+                int q = p_list[e];
+                if (rpo_index[q] < 0 || idom[q] < 0) continue;
+                if (new_idom < 0) {
+                    new_idom = q;
+                    continue;
+                }
+                int a = q, b = new_idom;
+                while (a != b) {
+                    while (rpo_index[a] > rpo_index[b]) a = idom[a];
+                    while (rpo_index[b] > rpo_index[a]) b = idom[b];
+                }
+                new_idom = a;
+            }
+            if (idom[node] != new_idom) {
+                idom[node] = new_idom;
+                changed = true;
+            }
+        }
+    }
+    idom[root] = -1;
+
+    // Pre/post numbering of the dominator tree for constant-time queries
+    std::vector<int> c_off(n + 1, 0), c_list(order.size());
+    for (int node : order) if (idom[node] >= 0) c_off[idom[node] + 1]++;
+    for (int i = 0; i < n; i++) c_off[i + 1] += c_off[i];
+    std::vector<int> fill(c_off.begin(), c_off.end() - 1);
+    for (int node : order) if (idom[node] >= 0) c_list[fill[idom[node]]++] = node;
+
+    int counter = 0;
+    stack.clear();
+    stack.push_back({root, c_off[root]});
+    tree_pre[root] = counter++;
+    while (!stack.empty()) {
+        int node = stack.back().first;
+        int& edge = stack.back().second;
+        if (edge < c_off[node + 1]) {
+            int child = c_list[edge++];
+            tree_pre[child] = counter++;
+            stack.push_back({child, c_off[child]});
+        } else {
+            tree_post[node] = counter++;
+            stack.pop_back();
+        }
+    }
+}
+
+void LoopForest::compute(const ControlFlowGraph& cfg, const DominatorTree& dom) {
+    int nb = cfg.num_blocks();
+    header.assign(nb, -1);
+    parent.assign(nb, -1);
+    depth.assign(nb, 0);
+    first_pc.assign(nb, -1);
+    last_pc.assign(nb, -1);
+
+    outer.resize(nb);
+
+    // Inner headers come later in RPO than the headers enclosing them,
+    // so walking RPO backwards discovers loops innermost first.
+    std::vector<int> work;
+    for (int k = (int)dom.order.size() - 1; k >= 0; k--) {
+        int h = dom.order[k];
+        if (h >= nb) continue;
+        work.clear();
+        for (const int* q = cfg.pred_begin(h); q != cfg.pred_end(h); q++) {
+            if (dom.reachable(*q) && dom.dominates(h, *q)) work.push_back(*q);
+        }
+        if (work.empty()) continue;
+        header[h] = h;
+        outer[h] = h;
+
+        while (!work.empty()) {
+            int n = work.back();
+            work.pop_back();
+            if (n == h) continue;
+            int from;
+            if (header[n] < 0) {
+                header[n] = h;
+                from = n;
+            } else {
+                // Already inside a loop: jump to the outermost loop found so far,
+                // halving the path so deep nests stay near-linear
+                int t = header[n];
+                while (outer[t] != t) {
+                    outer[t] = outer[outer[t]];
+                    t = outer[t];
+                }
+                if (t == h) continue;
+                parent[t] = h;
+                outer[t] = h;
+                from = t;
+            }
+            for (const int* q = cfg.pred_begin(from); q != cfg.pred_end(from); q++) {
+                if (dom.reachable(*q)) work.push_back(*q);
+            }
+        }
+    }
+
+    for (int b : dom.order) {
+        if (b >= nb) continue;
+        int h = header[b];
+        if (h < 0) continue;
+        if (h == b) depth[b] = parent[b] < 0 ? 1 : depth[parent[b]] + 1;
+        else depth[b] = depth[h];
+        if (first_pc[h] < 0 || cfg.blocks[b].start_pc < first_pc[h]) first_pc[h] = cfg.blocks[b].start_pc;
+        if (cfg.blocks[b].end_pc > last_pc[h]) last_pc[h] = cfg.blocks[b].end_pc;
+    }
+
+    for (int k = (int)dom.order.size() - 1; k >= 0; k--) {
+        int h = dom.order[k];
+        if (h >= nb || header[h] != h || parent[h] < 0) continue;
+        int ph = parent[h];
+        if (first_pc[h] < first_pc[ph]) first_pc[ph] = first_pc[h];
+        if (last_pc[h] > last_pc[ph]) last_pc[ph] = last_pc[h];
+    }
+}
+
+const char* EdgeClasses::name(int k) {
+    static const char* const names[] = {"tree", "forward", "back", "cross", "unreachable"};
+    return k >= 0 && k <= UNREACHABLE ? names[k] : "?";
+}
+
+void EdgeClasses::compute(const ControlFlowGraph& cfg, const DominatorTree& dom) {
+    int nb = cfg.num_blocks();
+    kind.assign(cfg.succ.size(), UNREACHABLE);
+    pre.assign(nb, -1);
+    post.assign(nb, -1);
+    unreachable = nb;
+    irreducible = 0;
+    if (nb == 0) return;
+
+    // Iterative DFS from the entry; an edge to a block still on the stack is a back edge
+    int pre_count = 0, post_count = 0;
+    stack.clear();
+    stack.push_back({0, cfg.succ_offset[0]});
+    pre[0] = pre_count++;
+    while (!stack.empty()) {
+        int node = stack.back().first;
+        int& edge = stack.back().second;
+        if (edge < cfg.succ_offset[node + 1]) {
+            int e = edge++;
+            int next = cfg.succ[e];
+            if (pre[next] < 0) {
+                kind[e] = TREE;
+                pre[next] = pre_count++;
+                stack.push_back({next, cfg.succ_offset[next]});
+            } else if (post[next] < 0) {
+                kind[e] = BACK;
+                if (!dom.dominates(next, node)) irreducible++;
+            } else {
+                kind[e] = pre[next] > pre[node] ? FORWARD : CROSS;
+            }
+        } else {
+            post[node] = post_count++;
+            stack.pop_back();
+        }
+    }
+    unreachable = nb - pre_count;
+}
@@ -0,0 +1,87 @@
+#ifndef ALCC_DOMINATORS_H
+#define ALCC_DOMINATORS_H
+
+#include <vector>
+#include "ControlFlow.h"
+
+// Dominator tree over a ControlFlowGraph (Cooper-Harvey-Kennedy).
+// With post = true the tree is built on the reversed graph from a virtual
+// exit node (id num_blocks) that every returning block flows into.
+class DominatorTree {
+public:
+    std::vector<int> idom;      // node -> immediate dominator, -1 for the root and unreachable nodes
+    std::vector<int> order;     // reachable nodes in reverse post-order
+    std::vector<int> rpo_index; // node -> position in order, -1 if unreachable
+    int root;
+    bool post;
+
+    DominatorTree() : root(0), post(false) {}
+
+    void compute(const ControlFlowGraph& cfg, bool post_dominators = false);
+
+    bool reachable(int n) const { return n >= 0 && n < (int)rpo_index.size() && rpo_index[n] >= 0; }
+
+    // True if a dominates b (every node dominates itself). Constant time.
+    bool dominates(int a, int b) const {
+        if (!reachable(a) || !reachable(b)) return false;
+        return tree_pre[a] <= tree_pre[b] && tree_post[b] <= tree_post[a];
+    }
+
+private:
+    std::vector<int> tree_pre;
+    std::vector<int> tree_post;
+};
+
+// Natural loops of a ControlFlowGraph, nested by containment.
+// Each loop is identified by its header block.
+class LoopForest {
+public:
+    std::vector<int> header;  // block -> innermost loop header containing it, -1 if none
+    std::vector<int> parent;  // header -> enclosing loop header, -1 if outermost
+    std::vector<int> depth;   // block -> loop nesting depth (0 outside loops)
+    std::vector<int> first_pc; // header -> lowest pc in the loop
+    std::vector<int> last_pc;  // header -> highest pc in the loop
+
+    void compute(const ControlFlowGraph& cfg, const DominatorTree& dom);
+
+    bool is_header(int b) const { return b >= 0 && header[b] == b; }
+
+    // Whether block b lies inside the loop headed by h (including nested loops).
+    bool contains(int h, int b) const {
+        if (b < 0) return false;
+        int c = header[b];
+        while (c >= 0 && c != h) c = parent[c];
+        return c == h;
+    }
+
+    // First pc after the loop body.
+    int exit_pc(int h) const { return last_pc[h] + 1; }
+
+private:
+    std::vector<int> outer; // header -> enclosing header found so far (union-find)
+};
+
+// Depth-first classification of the edges of a ControlFlowGraph, in the
+// successor order of the CSR arrays. A back edge whose target does not
+// dominate its source enters a loop with more than one entry.
+class EdgeClasses {
+public:
+    enum Kind { TREE, FORWARD, BACK, CROSS, UNREACHABLE };
+
+    std::vector<unsigned char> kind; // edge index in cfg.succ -> Kind
+    std::vector<int> pre;            // block -> DFS preorder number, -1 if unreachable
+    int unreachable;                 // blocks not reachable from the entry
+    int irreducible;                 // back edges whose target does not dominate the source
+
+    EdgeClasses() : unreachable(0), irreducible(0) {}
+
+    void compute(const ControlFlowGraph& cfg, const DominatorTree& dom);
+
+    static const char* name(int k);
+
+private:
+    std::vector<int> post;
+    std::vector<std::pair<int, int>> stack;
+};
+
+#endif
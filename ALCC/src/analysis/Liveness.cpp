@@ -0,0 +1,205 @@
+#include "Liveness.h"
+
+extern "C" {
+#include "lopcodes.h"
+}
+
+#include "../core/alcc_utils.h"
+#include "../core/compat.h"
+
+static void use_rk(RegSet& use, int x) {
+    if (!ISK(x)) use.set(x);
+}
+
+void Liveness::effects(Proto* p, int pc, const AlccInstruction& dec, RegSet& use, RegSet& def) {
+    (void)pc;
+    int a = dec.a, b = dec.b, c = dec.c;
+    int top = p->maxstacksize - 1;
+    use.clear();
+    def.clear();
+
+    switch (dec.op) {
+        case OP_MOVE: case OP_UNM: case OP_NOT: case OP_LEN: case OP_BNOT:
+            use.set(b); def.set(a); break;
+        case OP_LOADK: case OP_LOADKX: case OP_GETUPVAL: case OP_NEWTABLE:
+            def.set(a); break;
+        case OP_LOADNIL:
+            def.set_range(a, a + b); break;
+        case OP_SETUPVAL:
+            use.set(a); break;
+        case OP_JMP: case OP_EXTRAARG:
+            break;
+        case OP_CALL: case OP_TAILCALL:
+            use.set_range(a, b == 0 ? top : a + b - 1);
+            if (c == 0) def.set(a);
+            else def.set_range(a, a + c - 2);
+            break;
+        case OP_RETURN:
+            use.set_range(a, b == 0 ? top : a + b - 2); break;
+        case OP_SETLIST:
+            use.set_range(a, b == 0 ? top : a + b); break;
+        case OP_CLOSURE: {
+            // Upvalues captured from the enclosing frame are reads
+            Proto* sub = p->p[dec.bx];
+            for (int i = 0; i < sub->sizeupvalues; i++) {
+                if (sub->upvalues[i].instack) use.set(sub->upvalues[i].idx);
+            }
+            def.set(a);
+            break;
+        }
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD: case OP_POW:
+        case OP_IDIV: case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
+            use_rk(use, b); use_rk(use, c); def.set(a); break;
+        case OP_TEST:
+            use.set(a); break;
+#if defined(LUA_53) || defined(LUA_52)
+        case OP_LOADBOOL:
+            def.set(a); break;
+        case OP_GETTABUP:
+            use_rk(use, c); def.set(a); break;
+        case OP_GETTABLE:
+            use.set(b); use_rk(use, c); def.set(a); break;
+        case OP_SETTABUP:
+            use_rk(use, b); use_rk(use, c); break;
+        case OP_SETTABLE:
+            use.set(a); use_rk(use, b); use_rk(use, c); break;
+        case OP_SELF:
+            use.set(b); use_rk(use, c); def.set(a); def.set(a + 1); break;
+        case OP_CONCAT:
+            use.set_range(b, c); def.set(a); break;
+        case OP_EQ: case OP_LT: case OP_LE:
+            use_rk(use, b); use_rk(use, c); break;
+        case OP_TESTSET:
+            use.set(b); break; // A is only written on one path
+        case OP_FORPREP:
+            use.set(a); use.set(a + 2); break;
+        case OP_FORLOOP:
+            use.set_range(a, a + 2); def.set(a + 3); break;
+        case OP_TFORCALL:
+            use.set_range(a, a + 2); def.set_range(a + 3, a + 2 + c); break;
+        case OP_TFORLOOP:
+            use.set(a + 1); break;
+        case OP_VARARG:
+            if (b == 0) def.set(a);
+            else def.set_range(a, a + b - 2);
+            break;
+#else
+        case OP_LOADI: case OP_LOADF: case OP_LOADFALSE: case OP_LFALSESKIP: case OP_LOADTRUE:
+            def.set(a); break;
+        case OP_GETTABUP:
+            def.set(a); break;
+        case OP_GETTABLE:
+            use.set(b); use.set(c); def.set(a); break;
+        case OP_GETI: case OP_GETFIELD:
+            use.set(b); def.set(a); break;
+        case OP_SETTABUP:
+            if (!dec.k) use.set(c);
+            break;
+        case OP_SETTABLE:
+            use.set(a); use.set(b); if (!dec.k) use.set(c); break;
+        case OP_SETI: case OP_SETFIELD:
+            use.set(a); if (!dec.k) use.set(c); break;
+        case OP_SELF:
+            use.set(b); if (!dec.k) use.set(c); def.set(a); def.set(a + 1); break;
+        case OP_ADDI: case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_MODK: case OP_POWK:
+        case OP_DIVK: case OP_IDIVK: case OP_BANDK: case OP_BORK: case OP_BXORK:
+        case OP_SHRI: case OP_SHLI:
+            use.set(b); def.set(a); break;
+        case OP_MMBIN:
+            use.set(a); use.set(b); break;
+        case OP_MMBINI: case OP_MMBINK: case OP_TBC:
+            use.set(a); break;
+        case OP_CONCAT:
+            use.set_range(a, a + b - 1); def.set(a); break;
+        case OP_CLOSE: case OP_RETURN0: case OP_VARARGPREP:
+            break;
+        case OP_EQ: case OP_LT: case OP_LE:
+            use.set(a); use.set(b); break;
+        case OP_EQK: case OP_EQI: case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+            use.set(a); break;
+        case OP_TESTSET:
+            use.set(b); break; // A is only written on one path
+        case OP_RETURN1:
+            use.set(a); break;
+        case OP_FORPREP: case OP_FORLOOP:
+            use.set_range(a, a + 2); def.set(a + 3); break;
+        case OP_TFORPREP:
+            use.set_range(a, a + 3); break;
+        case OP_TFORCALL:
+            use.set_range(a, a + 2); def.set_range(a + 4, a + 3 + c); break;
+        case OP_TFORLOOP:
+            use.set(a + 4); break;
+        case OP_VARARG:
+            if (c == 0) def.set(a);
+            else def.set_range(a, a + c - 2);
+            break;
+#endif
+        default:
+            // Unknown to this analysis: assume every register operand is read
+            use.set(a);
+            if (b <= top) use.set(b);
+            if (c <= top) use.set(c);
+            break;
+    }
+}
+
+void Liveness::compute(const ControlFlowGraph& cfg, Proto* p) {
+    int nb = cfg.num_blocks();
+    gen.assign(nb, RegSet());
+    kill.assign(nb, RegSet());
+    live_in.assign(nb, RegSet());
+    live_out.assign(nb, RegSet());
+
+    // Block summaries, scanning each block backwards
+    AlccInstruction dec;
+    RegSet use, def;
+    for (int b = 0; b < nb; b++) {
+        RegSet& g = gen[b];
+        RegSet& k = kill[b];
+        for (int pc = cfg.blocks[b].end_pc; pc >= cfg.blocks[b].start_pc; pc--) {
+            current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+            effects(p, pc, dec, use, def);
+            g.transfer(use, def);
+            k |= def;
+        }
+    }
+
+    // Worklist, seeded last block first so most blocks see final successor sets
+    std::vector<int> work;
+    std::vector<unsigned char> queued(nb, 1);
+    work.reserve(nb);
+    for (int b = 0; b < nb; b++) work.push_back(b);
+    while (!work.empty()) {
+        int b = work.back();
+        work.pop_back();
+        queued[b] = 0;
+
+        RegSet out;
+        for (const int* s = cfg.succ_begin(b); s != cfg.succ_end(b); s++) out |= live_in[*s];
+        live_out[b] = out;
+        out.transfer(gen[b], kill[b]);
+        if (out == live_in[b]) continue;
+        live_in[b] = out;
+        for (const int* q = cfg.pred_begin(b); q != cfg.pred_end(b); q++) {
+            if (!queued[*q]) {
+                queued[*q] = 1;
+                work.push_back(*q);
+            }
+        }
+    }
+}
+
+void Liveness::block_live_after(const ControlFlowGraph& cfg, Proto* p, int b, std::vector<RegSet>& out) const {
+    int start = cfg.blocks[b].start_pc;
+    int end = cfg.blocks[b].end_pc;
+    out.resize(end - start + 1);
+    RegSet live = live_out[b];
+    AlccInstruction dec;
+    RegSet use, def;
+    for (int pc = end; pc >= start; pc--) {
+        out[pc - start] = live;
+        current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+        effects(p, pc, dec, use, def);
+        live.transfer(use, def);
+    }
+}
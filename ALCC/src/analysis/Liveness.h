@@ -0,0 +1,51 @@
+#ifndef ALCC_LIVENESS_H
+#define ALCC_LIVENESS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "ControlFlow.h"
+
+// Set of registers of one frame (Lua frames hold at most 255 registers).
+struct RegSet {
+    uint64_t w[4];
+
+    RegSet() { clear(); }
+    void clear() { memset(w, 0, sizeof(w)); }
+    void set(int r) { if (r >= 0 && r < 256) w[r >> 6] |= 1ULL << (r & 63); }
+    void reset(int r) { if (r >= 0 && r < 256) w[r >> 6] &= ~(1ULL << (r & 63)); }
+    bool test(int r) const { return r >= 0 && r < 256 && (w[r >> 6] >> (r & 63)) & 1; }
+    void set_range(int from, int to) { for (int r = from; r <= to; r++) set(r); }
+    // Lowest register in the set, 256 when empty
+    int first() const {
+        for (int i = 0; i < 4; i++) if (w[i]) return i * 64 + __builtin_ctzll(w[i]);
+        return 256;
+    }
+    bool operator==(const RegSet& o) const { return memcmp(w, o.w, sizeof(w)) == 0; }
+    bool operator!=(const RegSet& o) const { return !(*this == o); }
+    RegSet& operator|=(const RegSet& o) { for (int i = 0; i < 4; i++) w[i] |= o.w[i]; return *this; }
+    // this = use | (this & ~def): transfer through one instruction or block, backwards
+    void transfer(const RegSet& use, const RegSet& def) { for (int i = 0; i < 4; i++) w[i] = use.w[i] | (w[i] & ~def.w[i]); }
+};
+
+// Backward register liveness over a ControlFlowGraph.
+// Per-block use/def sets feed a worklist seeded in reverse pc order, which
+// settles in a few passes on the reducible graphs Lua compilers emit.
+class Liveness {
+public:
+    std::vector<RegSet> gen;      // block -> registers read before being written in the block
+    std::vector<RegSet> kill;     // block -> registers written in the block
+    std::vector<RegSet> live_in;  // block -> registers live on entry
+    std::vector<RegSet> live_out; // block -> registers live on exit
+
+    void compute(const ControlFlowGraph& cfg, Proto* p);
+
+    // Registers live right after instruction pc, for every pc of block b (index pc - start_pc)
+    void block_live_after(const ControlFlowGraph& cfg, Proto* p, int b, std::vector<RegSet>& out) const;
+
+    // Registers read (use) and unconditionally written (def) by one instruction.
+    // Variable-length operands (B or C = 0) read conservatively up to the frame top.
+    static void effects(Proto* p, int pc, const AlccInstruction& dec, RegSet& use, RegSet& def);
+};
+
+#endif
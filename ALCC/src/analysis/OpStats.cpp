@@ -0,0 +1,200 @@
+#include "OpStats.h"
+#include "ControlFlow.h"
+
+extern "C" {
+#include "lopcodes.h"
+}
+
+#include "../core/alcc_utils.h"
+#include "../core/compat.h"
+
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static_assert(sizeof(Instruction) == 4, "OpStats reads the code array as 32-bit words");
+
+// Histogram key: opcode, plus one bit above it when the instruction has a
+// constant operand
+#define OP_BITS SIZE_OP
+#define KEY_BINS (2 << OP_BITS)
+#define OP_MASK ((1u << OP_BITS) - 1)
+
+#if defined(LUA_53) || defined(LUA_52)
+// RK operands: bit BITRK of B or C marks a constant
+#define K_FLAG(i) (((((i) >> POS_B) | ((i) >> POS_C)) & BITRK) >> (SIZE_B - 1))
+#else
+#define K_FLAG(i) (((i) >> POS_k) & 1)
+#endif
+
+static inline uint32_t key_of(uint32_t i) {
+    return ((i >> POS_OP) & OP_MASK) | (K_FLAG(i) << OP_BITS);
+}
+
+static void histogram(const uint32_t* code, int n, uint32_t* h) {
+    uint32_t* h0 = h;
+    uint32_t* h1 = h + KEY_BINS;
+    uint32_t* h2 = h + 2 * KEY_BINS;
+    uint32_t* h3 = h + 3 * KEY_BINS;
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i op_mask = _mm_set1_epi32((int)OP_MASK);
+#if defined(LUA_53) || defined(LUA_52)
+    const __m128i rk_mask = _mm_set1_epi32(BITRK);
+#else
+    const __m128i one = _mm_set1_epi32(1);
+#endif
+    alignas(16) uint32_t lane[4];
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(code + i));
+        __m128i key = _mm_and_si128(_mm_srli_epi32(v, POS_OP), op_mask);
+#if defined(LUA_53) || defined(LUA_52)
+        __m128i k = _mm_and_si128(_mm_or_si128(_mm_srli_epi32(v, POS_B), _mm_srli_epi32(v, POS_C)), rk_mask);
+        k = _mm_slli_epi32(_mm_srli_epi32(k, SIZE_B - 1), OP_BITS);
+#else
+        __m128i k = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v, POS_k), one), OP_BITS);
+#endif
+        _mm_store_si128((__m128i*)lane, _mm_or_si128(key, k));
+        h0[lane[0]]++;
+        h1[lane[1]]++;
+        h2[lane[2]]++;
+        h3[lane[3]]++;
+    }
+#else
+    for (; i + 4 <= n; i += 4) {
+        h0[key_of(code[i])]++;
+        h1[key_of(code[i + 1])]++;
+        h2[key_of(code[i + 2])]++;
+        h3[key_of(code[i + 3])]++;
+    }
+#endif
+    for (; i < n; i++) h0[key_of(code[i])]++;
+}
+
+// Whether the K bit of the key means a constant operand for this opcode.
+// In 5.4+ k only selects K[C] over R[C] for the table stores and SELF;
+// elsewhere it is a condition or a close flag.
+static bool has_k_form(int op) {
+#if defined(LUA_53) || defined(LUA_52)
+    return getBMode((OpCode)op) == OpArgK || getCMode((OpCode)op) == OpArgK;
+#else
+    switch (op) {
+        case OP_SETTABUP: case OP_SETTABLE: case OP_SETI: case OP_SETFIELD: case OP_SELF:
+            return true;
+        default:
+            return false;
+    }
+#endif
+}
+
+static bool is_branch(int op) {
+    switch (op) {
+        case OP_JMP: case OP_FORLOOP: case OP_FORPREP: case OP_TFORLOOP: case OP_TFORPREP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+struct BranchOps {
+    uint8_t is[1 << OP_BITS];
+    BranchOps() {
+        for (int op = 0; op < (1 << OP_BITS); op++) is[op] = is_branch(op);
+    }
+};
+static const BranchOps branch_ops;
+
+OpStats::OpStats() {
+    clear();
+}
+
+void OpStats::clear() {
+    functions = 0;
+    instructions = 0;
+    ops.assign(1u << OP_BITS, 0);
+    k_ops.assign(1u << OP_BITS, 0);
+    memset(stack, 0, sizeof(stack));
+    stack_total = 0;
+    stack_max = 0;
+    memset(jumps_forward, 0, sizeof(jumps_forward));
+    memset(jumps_backward, 0, sizeof(jumps_backward));
+}
+
+void OpStats::add_function(Proto* p) {
+    const uint32_t* code = (const uint32_t*)p->code;
+    int n = p->sizecode;
+
+    // Four sub-histograms; 32-bit counters cannot overflow for one function
+    uint32_t h[4 * KEY_BINS];
+    memset(h, 0, sizeof(h));
+    histogram(code, n, h);
+    bool branches = false;
+    for (unsigned op = 0; op <= OP_MASK; op++) {
+        uint64_t plain = (uint64_t)h[op] + h[KEY_BINS + op] + h[2 * KEY_BINS + op] + h[3 * KEY_BINS + op];
+        unsigned kop = op | (1u << OP_BITS);
+        uint64_t with_k = (uint64_t)h[kop] + h[KEY_BINS + kop] + h[2 * KEY_BINS + kop] + h[3 * KEY_BINS + kop];
+        if (!(plain | with_k)) continue;
+        ops[op] += plain + with_k;
+        if (has_k_form(op)) k_ops[op] += with_k;
+        if (branch_ops.is[op]) branches = true;
+    }
+
+    if (branches) {
+        // Branch pcs are gathered a block at a time without a jump per
+        // instruction (mixed code mispredicts it), then decoded
+        AlccInstruction dec;
+        int found[256];
+        for (int base = 0; base < n; base += 256) {
+            int end = n - base < 256 ? n : base + 256;
+            int m = 0;
+            for (int pc = base; pc < end; pc++) {
+                found[m] = pc;
+                m += branch_ops.is[GET_OPCODE(p->code[pc])];
+            }
+            for (int j = 0; j < m; j++) {
+                int pc = found[j];
+                current_backend->decode_instruction(code[pc], &dec);
+                int target = ControlFlowGraph::branch_target(dec, pc);
+                if (target < 0) continue;
+                int d = target - (pc + 1);
+                if (d >= 0) jumps_forward[bucket((uint32_t)d)]++;
+                else jumps_backward[bucket((uint32_t)-d)]++;
+            }
+        }
+    }
+
+    functions++;
+    instructions += n;
+    stack[bucket(p->maxstacksize)]++;
+    stack_total += p->maxstacksize;
+    if (p->maxstacksize > stack_max) stack_max = p->maxstacksize;
+}
+
+void OpStats::add(const OpStats& o) {
+    functions += o.functions;
+    instructions += o.instructions;
+    for (size_t i = 0; i < ops.size(); i++) {
+        ops[i] += o.ops[i];
+        k_ops[i] += o.k_ops[i];
+    }
+    for (int b = 0; b < BUCKETS; b++) {
+        stack[b] += o.stack[b];
+        jumps_forward[b] += o.jumps_forward[b];
+        jumps_backward[b] += o.jumps_backward[b];
+    }
+    stack_total += o.stack_total;
+    if (o.stack_max > stack_max) stack_max = o.stack_max;
+}
+
+uint64_t OpStats::k_total() const {
+    uint64_t t = 0;
+    for (uint64_t k : k_ops) t += k;
+    return t;
+}
+
+uint64_t OpStats::jump_count() const {
+    uint64_t t = 0;
+    for (int b = 0; b < BUCKETS; b++) t += jumps_forward[b] + jumps_backward[b];
+    return t;
+}
@@ -0,0 +1,47 @@
+#ifndef ALCC_OP_STATS_H
+#define ALCC_OP_STATS_H
+
+#include <stdint.h>
+#include <vector>
+
+extern "C" {
+#include "lua.h"
+#include "lobject.h"
+}
+
+// Instruction mix of a function, a chunk or a whole corpus (add() merges).
+// Opcodes are counted in one pass over the raw code array: the opcode and
+// K bit of four instructions are extracted at a time (SSE2 where the target
+// has it) and the increments are spread over four sub-histograms, so runs
+// of the same opcode do not serialize on one counter. Only branches are
+// fully decoded, for the jump distances.
+class OpStats {
+public:
+    // Power-of-two buckets: 0 holds 0, b > 0 holds [2^(b-1), 2^b - 1]
+    enum { BUCKETS = 33 };
+
+    uint64_t functions;
+    uint64_t instructions;
+    std::vector<uint64_t> ops;   // opcode -> count
+    std::vector<uint64_t> k_ops; // opcode -> count with a constant RK operand (K[C] in 5.4+)
+    uint64_t stack[BUCKETS];     // functions by maxstacksize
+    uint64_t stack_total;        // sum of maxstacksize
+    int stack_max;
+    uint64_t jumps_forward[BUCKETS];  // branches by distance to the target, from the next pc
+    uint64_t jumps_backward[BUCKETS];
+
+    OpStats();
+    void clear();
+
+    void add_function(Proto* p);
+    void add(const OpStats& o);
+
+    uint64_t k_total() const;
+    uint64_t jump_count() const;
+
+    static int bucket(uint32_t v) { return v ? 32 - __builtin_clz(v) : 0; }
+    static uint32_t bucket_low(int b) { return b ? 1u << (b - 1) : 0; }
+    static uint32_t bucket_high(int b) { return b ? (uint32_t)((1ull << b) - 1) : 0; }
+};
+
+#endif
@@ -1,4 +1,8 @@
 #include "AST.h"
+#include "ASTDispatch.h"
+#include <algorithm>
+
+thread_local size_t ASTNode::created = 0;
 
 void Block::accept(ASTVisitor& v) { v.visit(*this); }
 void Literal::accept(ASTVisitor& v) { v.visit(*this); }
@@ -20,3 +24,166 @@ void BreakStmt::accept(ASTVisitor& v) { v.visit(*this); }
 void LabelStmt::accept(ASTVisitor& v) { v.visit(*this); }
 void GotoStmt::accept(ASTVisitor& v) { v.visit(*this); }
 void ExprStmt::accept(ASTVisitor& v) { v.visit(*this); }
+void RawStmt::accept(ASTVisitor& v) { v.visit(*this); }
+
+void ast_dispose(ASTNode* n) {
+    static thread_local std::vector<ASTNode*> pending;
+    static thread_local bool draining = false;
+    if (!n) return;
+    pending.push_back(n);
+    if (draining) return; // an outer call frees it
+    draining = true;
+    while (!pending.empty()) {
+        ASTNode* next = pending.back();
+        pending.pop_back();
+        delete next; // queues its children
+    }
+    draining = false;
+}
+
+// Appends the direct children of a node, in source order
+class ChildCollector : public StaticASTVisitor<ChildCollector> {
+public:
+    std::vector<ASTNode*>& out;
+    ChildCollector(std::vector<ASTNode*>& o) : out(o) {}
+
+    void add(ASTNode* n) { if (n) out.push_back(n); }
+
+    void visit(Block& node) { for (auto s : node.statements) add(s); }
+    void visit(Literal&) {}
+    void visit(Variable&) {}
+    void visit(BinaryExpr& node) { add(node.left); add(node.right); }
+    void visit(UnaryExpr& node) { add(node.expr); }
+    void visit(FunctionCall& node) {
+        add(node.func);
+        for (auto a : node.args) add(a);
+    }
+    void visit(TableConstructor& node) {
+        for (auto& f : node.fields) { add(f.key); add(f.value); }
+    }
+    void visit(ClosureExpr& node) { add(node.body); }
+    void visit(Assignment& node) {
+        for (auto t : node.targets) add(t);
+        for (auto v : node.values) add(v);
+    }
+    void visit(IfStmt& node) {
+        for (auto& c : node.clauses) { add(c.condition); add(c.block); }
+    }
+    void visit(WhileStmt& node) { add(node.condition); add(node.body); }
+    void visit(RepeatStmt& node) { add(node.body); add(node.condition); }
+    void visit(ForNumStmt& node) { add(node.start); add(node.end); add(node.step); add(node.body); }
+    void visit(ForInStmt& node) {
+        for (auto e : node.exprs) add(e);
+        add(node.body);
+    }
+    void visit(FunctionDecl& node) { add(node.body); }
+    void visit(ReturnStmt& node) { for (auto v : node.values) add(v); }
+    void visit(BreakStmt&) {}
+    void visit(LabelStmt&) {}
+    void visit(GotoStmt&) {}
+    void visit(ExprStmt& node) { add(node.expr); }
+    void visit(RawStmt&) {}
+};
+
+void ast_walk(ASTNode* root, const std::function<bool(ASTNode*)>& fn) {
+    if (!root) return;
+    std::vector<ASTNode*> stack;
+    ChildCollector children(stack);
+    stack.push_back(root);
+    while (!stack.empty()) {
+        ASTNode* n = stack.back();
+        stack.pop_back();
+        if (!fn(n)) continue;
+        // Reversed so the first child is popped first
+        size_t mark = stack.size();
+        children.dispatch(*n);
+        std::reverse(stack.begin() + mark, stack.end());
+    }
+}
+
+// Copies one node with its operands left null, and queues each operand
+// together with the slot its copy goes into
+class ShallowCloner : public StaticASTVisitor<ShallowCloner> {
+public:
+    std::vector<std::pair<Expression*, Expression**>>& work;
+    Expression** slot;
+    ShallowCloner(std::vector<std::pair<Expression*, Expression**>>& w) : work(w), slot(nullptr) {}
+
+    void queue(Expression* src, Expression** dst) { if (src) work.push_back(std::make_pair(src, dst)); }
+
+    void visit(Literal& node) {
+        Literal* l = new Literal();
+        l->type = node.type;
+        l->string_val = node.string_val;
+        l->number_val = node.number_val;
+        l->bool_val = node.bool_val;
+        *slot = l;
+    }
+    void visit(Variable& node) { *slot = new Variable(node.name, node.is_upvalue); }
+    void visit(BinaryExpr& node) {
+        BinaryExpr* be = new BinaryExpr(nullptr, node.op, nullptr);
+        *slot = be;
+        queue(node.left, &be->left);
+        queue(node.right, &be->right);
+    }
+    void visit(UnaryExpr& node) {
+        UnaryExpr* ue = new UnaryExpr(node.op, nullptr);
+        *slot = ue;
+        queue(node.expr, &ue->expr);
+    }
+    void visit(FunctionCall& node) {
+        FunctionCall* call = new FunctionCall(nullptr);
+        call->is_method_call = node.is_method_call;
+        call->method_name = node.method_name;
+        call->args.resize(node.args.size(), nullptr);
+        *slot = call;
+        queue(node.func, &call->func);
+        for (size_t i = 0; i < node.args.size(); i++) queue(node.args[i], &call->args[i]);
+    }
+    void visit(TableConstructor& node) {
+        TableConstructor* tc = new TableConstructor();
+        tc->fields.resize(node.fields.size(), TableConstructor::Field{nullptr, nullptr});
+        *slot = tc;
+        for (size_t i = 0; i < node.fields.size(); i++) {
+            queue(node.fields[i].key, &tc->fields[i].key);
+            queue(node.fields[i].value, &tc->fields[i].value);
+        }
+    }
+    void visit(ClosureExpr&) {}
+    void visit(Block&) {}
+    void visit(Assignment&) {}
+    void visit(IfStmt&) {}
+    void visit(WhileStmt&) {}
+    void visit(RepeatStmt&) {}
+    void visit(ForNumStmt&) {}
+    void visit(ForInStmt&) {}
+    void visit(FunctionDecl&) {}
+    void visit(ReturnStmt&) {}
+    void visit(BreakStmt&) {}
+    void visit(LabelStmt&) {}
+    void visit(GotoStmt&) {}
+    void visit(ExprStmt&) {}
+    void visit(RawStmt&) {}
+};
+
+Expression* ast_clone(Expression* e) {
+    if (!e) return nullptr;
+    bool closure = false;
+    ast_walk(e, [&](ASTNode* n) {
+        if (n->kind == ASTNode::CLOSURE) closure = true;
+        return !closure;
+    });
+    if (closure) return nullptr;
+
+    Expression* root = nullptr;
+    std::vector<std::pair<Expression*, Expression**>> work;
+    ShallowCloner cloner(work);
+    work.push_back(std::make_pair(e, &root));
+    while (!work.empty()) {
+        std::pair<Expression*, Expression**> next = work.back();
+        work.pop_back();
+        cloner.slot = next.second;
+        cloner.dispatch(*next.first);
+    }
+    return root;
+}
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <functional>
 
 // Forward declarations
 class ASTVisitor;
@@ -11,18 +12,38 @@ class ASTVisitor;
 // Base Node
 class ASTNode {
 public:
+    // Concrete node type, for switch-based dispatch (ASTDispatch.h)
+    enum Kind : unsigned char {
+        BLOCK, LITERAL, VARIABLE, BINARY, UNARY, CALL, TABLE, CLOSURE,
+        ASSIGN, IF, WHILE, REPEAT, FOR_NUM, FOR_IN, FUNCTION, RETURN,
+        BREAK, LABEL, GOTO, EXPR_STMT, RAW
+    };
+    const Kind kind;
+
+    // Nodes constructed on this thread so far; polled for per-function budgets
+    static thread_local size_t created;
+
+    ASTNode(Kind k) : kind(k) { created++; }
     virtual ~ASTNode() = default;
     virtual void accept(ASTVisitor& v) = 0;
 };
 
+// Frees a node and everything under it. The destructors below hand their
+// children to this instead of deleting them, so the children are queued and
+// freed in a loop rather than by nested destructor calls: deeply nested trees
+// cannot overflow the stack.
+void ast_dispose(ASTNode* n);
+
 // Statements
 class Statement : public ASTNode {
 public:
+    Statement(Kind k) : ASTNode(k) {}
     virtual ~Statement() = default;
 };
 
 class Expression : public ASTNode {
 public:
+    Expression(Kind k) : ASTNode(k) {}
     virtual ~Expression() = default;
 };
 
@@ -31,8 +52,9 @@ class Block : public Statement {
 public:
     std::vector<Statement*> statements;
 
+    Block() : Statement(BLOCK) {}
     ~Block() {
-        for (auto s : statements) delete s;
+        for (auto s : statements) ast_dispose(s);
     }
 
     void add(Statement* stmt) {
@@ -52,10 +74,10 @@ public:
     double number_val;
     bool bool_val;
 
-    Literal() : type(NIL) {}
-    Literal(bool b) : type(BOOLEAN), bool_val(b) {}
-    Literal(double n) : type(NUMBER), number_val(n) {}
-    Literal(const std::string& s) : type(STRING), string_val(s) {}
+    Literal() : Expression(LITERAL), type(NIL) {}
+    Literal(bool b) : Expression(LITERAL), type(BOOLEAN), bool_val(b) {}
+    Literal(double n) : Expression(LITERAL), type(NUMBER), number_val(n) {}
+    Literal(const std::string& s) : Expression(LITERAL), type(STRING), string_val(s) {}
 
     void accept(ASTVisitor& v) override;
 };
@@ -65,7 +87,7 @@ public:
     std::string name;
     bool is_upvalue;
 
-    Variable(const std::string& n, bool up = false) : name(n), is_upvalue(up) {}
+    Variable(const std::string& n, bool up = false) : Expression(VARIABLE), name(n), is_upvalue(up) {}
     void accept(ASTVisitor& v) override;
 };
 
@@ -76,9 +98,9 @@ public:
     Expression* right;
 
     BinaryExpr(Expression* l, const std::string& o, Expression* r)
-        : left(l), op(o), right(r) {}
+        : Expression(BINARY), left(l), op(o), right(r) {}
 
-    ~BinaryExpr() { delete left; delete right; }
+    ~BinaryExpr() { ast_dispose(left); ast_dispose(right); }
     void accept(ASTVisitor& v) override;
 };
 
@@ -87,8 +109,8 @@ public:
     std::string op;
     Expression* expr;
 
-    UnaryExpr(const std::string& o, Expression* e) : op(o), expr(e) {}
-    ~UnaryExpr() { delete expr; }
+    UnaryExpr(const std::string& o, Expression* e) : Expression(UNARY), op(o), expr(e) {}
+    ~UnaryExpr() { ast_dispose(expr); }
     void accept(ASTVisitor& v) override;
 };
 
@@ -99,10 +121,10 @@ public:
     bool is_method_call; // obj:method()
     std::string method_name;
 
-    FunctionCall(Expression* f) : func(f), is_method_call(false) {}
+    FunctionCall(Expression* f) : Expression(CALL), func(f), is_method_call(false) {}
     ~FunctionCall() {
-        delete func;
-        for(auto a : args) delete a;
+        ast_dispose(func);
+        for(auto a : args) ast_dispose(a);
     }
     void accept(ASTVisitor& v) override;
 };
@@ -115,10 +137,11 @@ public:
     };
     std::vector<Field> fields;
 
+    TableConstructor() : Expression(TABLE) {}
     ~TableConstructor() {
         for(auto& f : fields) {
-            if(f.key) delete f.key;
-            delete f.value;
+            ast_dispose(f.key);
+            ast_dispose(f.value);
         }
     }
     void accept(ASTVisitor& v) override;
@@ -130,8 +153,8 @@ public:
     bool is_vararg;
     Block* body;
 
-    ClosureExpr(Block* b) : is_vararg(false), body(b) {}
-    ~ClosureExpr() { delete body; }
+    ClosureExpr(Block* b) : Expression(CLOSURE), is_vararg(false), body(b) {}
+    ~ClosureExpr() { ast_dispose(body); }
     void accept(ASTVisitor& v) override;
 };
 
@@ -143,10 +166,10 @@ public:
     std::vector<Expression*> values;
     bool is_local;
 
-    Assignment(bool local = false) : is_local(local) {}
+    Assignment(bool local = false) : Statement(ASSIGN), is_local(local) {}
     ~Assignment() {
-        for(auto t : targets) delete t;
-        for(auto v : values) delete v;
+        for(auto t : targets) ast_dispose(t);
+        for(auto v : values) ast_dispose(v);
     }
     void accept(ASTVisitor& v) override;
 };
@@ -159,10 +182,11 @@ public:
     };
     std::vector<Clause> clauses;
 
+    IfStmt() : Statement(IF) {}
     ~IfStmt() {
         for(auto& c : clauses) {
-            if(c.condition) delete c.condition;
-            delete c.block;
+            ast_dispose(c.condition);
+            ast_dispose(c.block);
         }
     }
     void accept(ASTVisitor& v) override;
@@ -173,8 +197,8 @@ public:
     Expression* condition;
     Block* body;
 
-    WhileStmt(Expression* c, Block* b) : condition(c), body(b) {}
-    ~WhileStmt() { delete condition; delete body; }
+    WhileStmt(Expression* c, Block* b) : Statement(WHILE), condition(c), body(b) {}
+    ~WhileStmt() { ast_dispose(condition); ast_dispose(body); }
     void accept(ASTVisitor& v) override;
 };
 
@@ -183,8 +207,8 @@ public:
     Block* body;
     Expression* condition;
 
-    RepeatStmt(Block* b, Expression* c) : body(b), condition(c) {}
-    ~RepeatStmt() { delete body; delete condition; }
+    RepeatStmt(Block* b, Expression* c) : Statement(REPEAT), body(b), condition(c) {}
+    ~RepeatStmt() { ast_dispose(body); ast_dispose(condition); }
     void accept(ASTVisitor& v) override;
 };
 
@@ -197,8 +221,8 @@ public:
     Block* body;
 
     ForNumStmt(const std::string& v, Expression* s, Expression* e, Expression* st, Block* b)
-        : var_name(v), start(s), end(e), step(st), body(b) {}
-    ~ForNumStmt() { delete start; delete end; delete step; delete body; }
+        : Statement(FOR_NUM), var_name(v), start(s), end(e), step(st), body(b) {}
+    ~ForNumStmt() { ast_dispose(start); ast_dispose(end); ast_dispose(step); ast_dispose(body); }
     void accept(ASTVisitor& v) override;
 };
 
@@ -208,10 +232,10 @@ public:
     std::vector<Expression*> exprs;
     Block* body;
 
-    ForInStmt(Block* b) : body(b) {}
+    ForInStmt(Block* b) : Statement(FOR_IN), body(b) {}
     ~ForInStmt() {
-        for(auto e : exprs) delete e;
-        delete body;
+        for(auto e : exprs) ast_dispose(e);
+        ast_dispose(body);
     }
     void accept(ASTVisitor& v) override;
 };
@@ -225,8 +249,8 @@ public:
     bool is_local;
 
     FunctionDecl(const std::string& n, Block* b, bool local=false)
-        : name(n), is_vararg(false), body(b), is_local(local) {}
-    ~FunctionDecl() { delete body; }
+        : Statement(FUNCTION), name(n), is_vararg(false), body(b), is_local(local) {}
+    ~FunctionDecl() { ast_dispose(body); }
     void accept(ASTVisitor& v) override;
 };
 
@@ -234,34 +258,45 @@ class ReturnStmt : public Statement {
 public:
     std::vector<Expression*> values;
 
-    ~ReturnStmt() { for(auto v : values) delete v; }
+    ReturnStmt() : Statement(RETURN) {}
+    ~ReturnStmt() { for(auto v : values) ast_dispose(v); }
     void accept(ASTVisitor& v) override;
 };
 
 class BreakStmt : public Statement {
 public:
+    BreakStmt() : Statement(BREAK) {}
     void accept(ASTVisitor& v) override;
 };
 
 class LabelStmt : public Statement {
 public:
     std::string label;
-    LabelStmt(const std::string& l) : label(l) {}
+    LabelStmt(const std::string& l) : Statement(LABEL), label(l) {}
     void accept(ASTVisitor& v) override;
 };
 
 class GotoStmt : public Statement {
 public:
     std::string label;
-    GotoStmt(const std::string& l) : label(l) {}
+    GotoStmt(const std::string& l) : Statement(GOTO), label(l) {}
     void accept(ASTVisitor& v) override;
 };
 
 class ExprStmt : public Statement {
 public:
     Expression* expr;
-    ExprStmt(Expression* e) : expr(e) {}
-    ~ExprStmt() { delete expr; }
+    ExprStmt(Expression* e) : Statement(EXPR_STMT), expr(e) {}
+    ~ExprStmt() { ast_dispose(expr); }
+    void accept(ASTVisitor& v) override;
+};
+
+// Already decompiled source spliced in verbatim (e.g. from the function cache).
+// Lines are relative to the enclosing indentation.
+class RawStmt : public Statement {
+public:
+    std::string text;
+    RawStmt(const std::string& t) : Statement(RAW), text(t) {}
     void accept(ASTVisitor& v) override;
 };
 
@@ -288,6 +323,16 @@ public:
     virtual void visit(LabelStmt& node) = 0;
     virtual void visit(GotoStmt& node) = 0;
     virtual void visit(ExprStmt& node) = 0;
+    virtual void visit(RawStmt& node) = 0;
 };
 
+// Calls fn on root and every node under it in pre-order, using an explicit
+// stack. The children of a node are skipped when fn returns false.
+// Plugins can use this from on_ast_process instead of recursing.
+void ast_walk(ASTNode* root, const std::function<bool(ASTNode*)>& fn);
+
+// Deep copy of an expression, built without recursion. Function bodies are
+// not copied: returns nullptr if e contains a ClosureExpr.
+Expression* ast_clone(Expression* e);
+
 #endif
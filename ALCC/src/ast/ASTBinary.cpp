@@ -0,0 +1,107 @@
+#include "ASTBinary.h"
+#include "ASTStore.h"
+
+template <typename T>
+static void append_raw(std::string& out, const T* data, size_t count) {
+    if (count) out.append((const char*)data, count * sizeof(T));
+}
+
+void ast_write_binary(ASTNode* root, std::string& out) {
+    AstStore store;
+    uint32_t root_id = store.add(root);
+    ast_write_binary(store, root_id, out);
+}
+
+void ast_write_binary(const AstStore& store, uint32_t root, std::string& out) {
+    AstBinHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, AST_BIN_MAGIC, 4);
+    hdr.byte_order = AST_BIN_BYTE_ORDER;
+    hdr.version = AST_BIN_VERSION;
+    hdr.root = root;
+    hdr.node_count = store.size();
+    hdr.child_count = (uint32_t)store.pool.size();
+    hdr.number_count = (uint32_t)store.numbers.size();
+    hdr.string_count = store.string_count();
+    hdr.string_bytes = (uint32_t)store.strings.size();
+
+    out.reserve(out.size() + sizeof(hdr) + store.numbers.size() * 8 + store.size() * sizeof(AstBinNode) +
+                (store.pool.size() + store.offsets.size()) * 4 + store.strings.size());
+    append_raw(out, &hdr, 1);
+    append_raw(out, store.numbers.data(), store.numbers.size());
+    // The store keeps one array per field; the file keeps one record per node
+    for (uint32_t id = 0; id < store.size(); id++) {
+        AstBinNode n;
+        n.kind = store.kinds[id];
+        n.flags = store.flags[id];
+        n.reserved = 0;
+        n.aux = store.aux[id];
+        n.value = store.values[id];
+        n.first = store.firsts[id];
+        n.count = store.counts[id];
+        append_raw(out, &n, 1);
+    }
+    append_raw(out, store.pool.data(), store.pool.size());
+    append_raw(out, store.offsets.data(), store.offsets.size());
+    out.append(store.strings);
+}
+
+bool AstBinaryView::open(const void* data, size_t size) {
+    const char* base = (const char*)data;
+    if (size < sizeof(AstBinHeader) || ((uintptr_t)base & 7)) return false;
+    const AstBinHeader* h = (const AstBinHeader*)base;
+    if (memcmp(h->magic, AST_BIN_MAGIC, 4) != 0 || h->byte_order != AST_BIN_BYTE_ORDER ||
+        h->version != AST_BIN_VERSION) {
+        return false;
+    }
+
+    uint64_t need = sizeof(AstBinHeader) + (uint64_t)h->number_count * 8 + (uint64_t)h->node_count * sizeof(AstBinNode) +
+                    ((uint64_t)h->child_count + h->string_count + 1) * 4 + h->string_bytes;
+    if (need > size || h->root >= h->node_count) return false;
+
+    const char* p = base + sizeof(AstBinHeader);
+    const double* nums = (const double*)p;
+    p += (size_t)h->number_count * 8;
+    const AstBinNode* ns = (const AstBinNode*)p;
+    p += (size_t)h->node_count * sizeof(AstBinNode);
+    const uint32_t* ks = (const uint32_t*)p;
+    p += (size_t)h->child_count * 4;
+    const uint32_t* offs = (const uint32_t*)p;
+    p += ((size_t)h->string_count + 1) * 4;
+
+    // Strings must be in order and NUL-terminated
+    if (offs[h->string_count] != h->string_bytes) return false;
+    for (uint32_t i = 0; i < h->string_count; i++) {
+        if (offs[i] >= offs[i + 1] || p[offs[i + 1] - 1] != '\0') return false;
+    }
+
+    // Every operand must point at a node, a string or NONE as its kind says
+    for (uint32_t id = 0; id < h->node_count; id++) {
+        const AstBinNode& n = ns[id];
+        if (n.kind >= AST_BIN_KIND_COUNT || (uint64_t)n.first + n.count > h->child_count) return false;
+        if (n.kind == AST_BIN_NUMBER ? n.value >= h->number_count
+                                     : (n.value >= h->string_count && n.value != 0)) {
+            return false;
+        }
+        uint32_t names_from = n.count, names_to = n.count;
+        if (n.kind == AST_BIN_CLOSURE || n.kind == AST_BIN_FUNCTION) { names_from = 1; names_to = 1 + n.aux; }
+        else if (n.kind == AST_BIN_FOR_IN) { names_from = 0; names_to = n.aux; }
+        if (names_to > n.count) return false;
+        for (uint32_t i = 0; i < n.count; i++) {
+            uint32_t c = ks[n.first + i];
+            if (i >= names_from && i < names_to) {
+                if (c >= h->string_count) return false;
+            } else if (c != AST_BIN_NONE && c >= h->node_count) {
+                return false;
+            }
+        }
+    }
+
+    hdr = h;
+    numbers = nums;
+    nodes = ns;
+    kids = ks;
+    offsets = offs;
+    strings = p;
+    return true;
+}
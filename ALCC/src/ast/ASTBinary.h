@@ -0,0 +1,122 @@
+#ifndef ALCC_AST_BINARY_H
+#define ALCC_AST_BINARY_H
+
+#include "AST.h"
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+// Compact binary form of a decompiled AST, for tools that want the tree
+// without re-parsing printed Lua. The file can be mmap'ed and read in place
+// with AstBinaryView; all fields are in the producer's byte order. The file
+// is an AstStore (ASTStore.h) with its per-node arrays interleaved.
+//
+// Layout (every section starts 4-byte aligned, numbers 8-byte aligned):
+//   AstBinHeader
+//   double      numbers[number_count]
+//   AstBinNode  nodes[node_count]
+//   uint32_t    children[child_count]
+//   uint32_t    string_offsets[string_count + 1]
+//   char        strings[string_bytes]        (each string is also NUL-terminated)
+//
+// A node's operands are children[first .. first + count - 1]; AST_BIN_NONE
+// marks an absent optional node. Per kind:
+//   BLOCK       statements
+//   NUMBER      value = number id
+//   STRING      value = string id
+//   VARIABLE    value = name, flags AST_BIN_UPVALUE
+//   BINARY      value = op; left, right (op "[" is indexing)
+//   UNARY       value = op; operand
+//   CALL        value = method name if AST_BIN_METHOD; callee or object, args...
+//   TABLE       key or NONE, value, key or NONE, value, ...
+//   CLOSURE     aux params: body, then aux parameter names (string ids); AST_BIN_VARARG
+//   FUNCTION    as CLOSURE, value = name; AST_BIN_LOCAL
+//   ASSIGN      aux targets: targets..., values...; AST_BIN_LOCAL
+//   IF          condition or NONE (else), block, condition, block, ...
+//   WHILE       condition, body
+//   REPEAT      body or NONE, condition or NONE
+//   FOR_NUM     value = variable; start, end, step or NONE, body
+//   FOR_IN      aux variables: variable names (string ids)..., exprs..., body
+//   RETURN      values
+//   LABEL, GOTO value = label
+//   EXPR_STMT   expression
+//   RAW         value = source text (spliced from the decompile cache)
+
+#define AST_BIN_MAGIC "ALCB"
+#define AST_BIN_VERSION 2
+#define AST_BIN_BYTE_ORDER 0x01020304u
+#define AST_BIN_NONE 0xFFFFFFFFu
+
+enum AstBinKind {
+    AST_BIN_BLOCK, AST_BIN_NIL, AST_BIN_TRUE, AST_BIN_FALSE, AST_BIN_NUMBER, AST_BIN_STRING,
+    AST_BIN_VARIABLE, AST_BIN_BINARY, AST_BIN_UNARY, AST_BIN_CALL, AST_BIN_TABLE, AST_BIN_CLOSURE,
+    AST_BIN_ASSIGN, AST_BIN_IF, AST_BIN_WHILE, AST_BIN_REPEAT, AST_BIN_FOR_NUM, AST_BIN_FOR_IN,
+    AST_BIN_FUNCTION, AST_BIN_RETURN, AST_BIN_BREAK, AST_BIN_LABEL, AST_BIN_GOTO, AST_BIN_EXPR_STMT,
+    AST_BIN_RAW,
+    AST_BIN_KIND_COUNT
+};
+
+enum AstBinFlags {
+    AST_BIN_UPVALUE = 1,
+    AST_BIN_LOCAL = 2,
+    AST_BIN_VARARG = 4,
+    AST_BIN_METHOD = 8
+};
+
+struct AstBinHeader {
+    char magic[4];
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t root;
+    uint32_t node_count;
+    uint32_t child_count;
+    uint32_t number_count;
+    uint32_t string_count;
+    uint32_t string_bytes;
+    uint32_t reserved;
+};
+
+struct AstBinNode {
+    uint8_t kind;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t aux;   // parameter, target or loop variable count
+    uint32_t value; // string id, or number id for AST_BIN_NUMBER
+    uint32_t first; // first operand in the child array
+    uint32_t count; // operands in the child array
+};
+
+class AstStore;
+
+// Serializes the tree under root, appending to out
+void ast_write_binary(ASTNode* root, std::string& out);
+// Serializes a store as is (every node in it), with root as the root
+void ast_write_binary(const AstStore& store, uint32_t root, std::string& out);
+
+// Read-only view over a serialized tree; never allocates or copies
+class AstBinaryView {
+public:
+    AstBinaryView() : hdr(nullptr), numbers(nullptr), nodes(nullptr), kids(nullptr), offsets(nullptr), strings(nullptr) {}
+
+    // Checks the header and section bounds; the buffer must outlive the view
+    bool open(const void* data, size_t size);
+
+    uint32_t root() const { return hdr->root; }
+    uint32_t node_count() const { return hdr->node_count; }
+    const AstBinNode& node(uint32_t id) const { return nodes[id]; }
+    const uint32_t* children(uint32_t id) const { return kids + nodes[id].first; }
+    uint32_t child(uint32_t id, uint32_t i) const { return kids[nodes[id].first + i]; }
+    double number(uint32_t id) const { return numbers[id]; }
+    const char* str(uint32_t id) const { return strings + offsets[id]; }
+    size_t str_len(uint32_t id) const { return offsets[id + 1] - offsets[id] - 1; }
+
+private:
+    const AstBinHeader* hdr;
+    const double* numbers;
+    const AstBinNode* nodes;
+    const uint32_t* kids;
+    const uint32_t* offsets;
+    const char* strings;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef ALCC_AST_DISPATCH_H
+#define ALCC_AST_DISPATCH_H
+
+#include "AST.h"
+
+// Statically dispatched visitors. A pass derives from
+// StaticASTVisitor<Pass>, defines visit() for every node type (as for
+// ASTVisitor, but non-virtual) and calls dispatch(node): one switch on
+// node.kind selects the overload, which the compiler can inline, instead
+// of a virtual accept() followed by a virtual visit().
+template <typename Derived>
+class StaticASTVisitor {
+public:
+    void dispatch(ASTNode& n) {
+        Derived& d = static_cast<Derived&>(*this);
+        switch (n.kind) {
+            case ASTNode::BLOCK: d.visit(static_cast<Block&>(n)); break;
+            case ASTNode::LITERAL: d.visit(static_cast<Literal&>(n)); break;
+            case ASTNode::VARIABLE: d.visit(static_cast<Variable&>(n)); break;
+            case ASTNode::BINARY: d.visit(static_cast<BinaryExpr&>(n)); break;
+            case ASTNode::UNARY: d.visit(static_cast<UnaryExpr&>(n)); break;
+            case ASTNode::CALL: d.visit(static_cast<FunctionCall&>(n)); break;
+            case ASTNode::TABLE: d.visit(static_cast<TableConstructor&>(n)); break;
+            case ASTNode::CLOSURE: d.visit(static_cast<ClosureExpr&>(n)); break;
+            case ASTNode::ASSIGN: d.visit(static_cast<Assignment&>(n)); break;
+            case ASTNode::IF: d.visit(static_cast<IfStmt&>(n)); break;
+            case ASTNode::WHILE: d.visit(static_cast<WhileStmt&>(n)); break;
+            case ASTNode::REPEAT: d.visit(static_cast<RepeatStmt&>(n)); break;
+            case ASTNode::FOR_NUM: d.visit(static_cast<ForNumStmt&>(n)); break;
+            case ASTNode::FOR_IN: d.visit(static_cast<ForInStmt&>(n)); break;
+            case ASTNode::FUNCTION: d.visit(static_cast<FunctionDecl&>(n)); break;
+            case ASTNode::RETURN: d.visit(static_cast<ReturnStmt&>(n)); break;
+            case ASTNode::BREAK: d.visit(static_cast<BreakStmt&>(n)); break;
+            case ASTNode::LABEL: d.visit(static_cast<LabelStmt&>(n)); break;
+            case ASTNode::GOTO: d.visit(static_cast<GotoStmt&>(n)); break;
+            case ASTNode::EXPR_STMT: d.visit(static_cast<ExprStmt&>(n)); break;
+            case ASTNode::RAW: d.visit(static_cast<RawStmt&>(n)); break;
+        }
+    }
+};
+
+// Exposes a static visitor as an ASTVisitor, for code that takes the
+// virtual interface: node->accept(adapter), or a plugin's on_ast_process
+// handing the root to an existing ASTVisitor-based helper.
+template <typename Impl>
+class ASTVisitorAdapter : public ASTVisitor {
+public:
+    Impl& impl;
+    ASTVisitorAdapter(Impl& i) : impl(i) {}
+
+    void visit(Block& node) override { impl.visit(node); }
+    void visit(Literal& node) override { impl.visit(node); }
+    void visit(Variable& node) override { impl.visit(node); }
+    void visit(BinaryExpr& node) override { impl.visit(node); }
+    void visit(UnaryExpr& node) override { impl.visit(node); }
+    void visit(FunctionCall& node) override { impl.visit(node); }
+    void visit(TableConstructor& node) override { impl.visit(node); }
+    void visit(ClosureExpr& node) override { impl.visit(node); }
+    void visit(Assignment& node) override { impl.visit(node); }
+    void visit(IfStmt& node) override { impl.visit(node); }
+    void visit(WhileStmt& node) override { impl.visit(node); }
+    void visit(RepeatStmt& node) override { impl.visit(node); }
+    void visit(ForNumStmt& node) override { impl.visit(node); }
+    void visit(ForInStmt& node) override { impl.visit(node); }
+    void visit(FunctionDecl& node) override { impl.visit(node); }
+    void visit(ReturnStmt& node) override { impl.visit(node); }
+    void visit(BreakStmt& node) override { impl.visit(node); }
+    void visit(LabelStmt& node) override { impl.visit(node); }
+    void visit(GotoStmt& node) override { impl.visit(node); }
+    void visit(ExprStmt& node) override { impl.visit(node); }
+    void visit(RawStmt& node) override { impl.visit(node); }
+};
+
+#endif
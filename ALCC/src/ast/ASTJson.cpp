@@ -0,0 +1,303 @@
+#include "ASTJson.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <charconv>
+
+void JsonWriter::write_string(std::string& out, const char* s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    size_t run = 0; // start of the pending run of plain characters
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') continue;
+        out.append(s + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"': out.append("\\\"", 2); break;
+            case '\\': out.append("\\\\", 2); break;
+            case '\n': out.append("\\n", 2); break;
+            case '\r': out.append("\\r", 2); break;
+            case '\t': out.append("\\t", 2); break;
+            default: {
+                char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                out.append(esc, 6);
+                break;
+            }
+        }
+    }
+    out.append(s + run, len - run);
+    out.push_back('"');
+}
+
+void JsonWriter::write_number(std::string& out, double v) {
+    // JSON has no infinities or NaN
+    if (v != v) { out.append("\"nan\""); return; }
+    if (v > 1e308 || v < -1e308) { out.append(v > 0 ? "\"inf\"" : "\"-inf\""); return; }
+    char tmp[32];
+    if (v >= -9.2e18 && v <= 9.2e18 && (double)(long long)v == v) {
+        int n = snprintf(tmp, sizeof(tmp), "%lld", (long long)v);
+        out.append(tmp, n);
+        return;
+    }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    std::to_chars_result res = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    out.append(tmp, res.ptr - tmp);
+#else
+    int n = snprintf(tmp, sizeof(tmp), "%.17g", v);
+    for (int i = 0; i < n; i++) {
+        if (tmp[i] == ',') tmp[i] = '.'; // locales with a decimal comma
+    }
+    out.append(tmp, n);
+#endif
+}
+
+void JsonWriter::key(const char* k) {
+    out.append(",\"");
+    out.append(k);
+    out.append("\":");
+}
+
+void JsonWriter::child(ASTNode* n) {
+    if (n) dispatch(*n);
+    else out.append("null");
+}
+
+void JsonWriter::list(const std::vector<Expression*>& items) {
+    out.push_back('[');
+    for (size_t i = 0; i < items.size(); i++) {
+        if (i > 0) out.push_back(',');
+        child(items[i]);
+    }
+    out.push_back(']');
+}
+
+void JsonWriter::names(const std::vector<std::string>& items) {
+    out.push_back('[');
+    for (size_t i = 0; i < items.size(); i++) {
+        if (i > 0) out.push_back(',');
+        write_string(out, items[i]);
+    }
+    out.push_back(']');
+}
+
+void JsonWriter::function_tail(const std::vector<std::string>& params, bool is_vararg, Block** body) {
+    key("params");
+    names(params);
+    key("vararg");
+    out.append(is_vararg ? "true" : "false");
+    key("body");
+    child(*body);
+    if (!*body) {
+        auto it = proto_refs.find(body);
+        if (it != proto_refs.end()) {
+            key("proto");
+            write_string(out, it->second);
+        }
+    }
+    out.push_back('}');
+}
+
+void JsonWriter::visit(Block& node) {
+    out.push_back('[');
+    for (size_t i = 0; i < node.statements.size(); i++) {
+        if (i > 0) out.push_back(',');
+        dispatch(*node.statements[i]);
+    }
+    out.push_back(']');
+}
+
+void JsonWriter::visit(Literal& node) {
+    switch (node.type) {
+        case Literal::NIL: out.append("{\"type\":\"Nil\"}"); break;
+        case Literal::BOOLEAN: out.append(node.bool_val ? "{\"type\":\"Boolean\",\"value\":true}" : "{\"type\":\"Boolean\",\"value\":false}"); break;
+        case Literal::NUMBER:
+            out.append("{\"type\":\"Number\",\"value\":");
+            write_number(out, node.number_val);
+            out.push_back('}');
+            break;
+        case Literal::STRING:
+            out.append("{\"type\":\"String\",\"value\":");
+            write_string(out, node.string_val);
+            out.push_back('}');
+            break;
+    }
+}
+
+void JsonWriter::visit(Variable& node) {
+    out.append("{\"type\":\"Name\",\"name\":");
+    write_string(out, node.name);
+    if (node.is_upvalue) out.append(",\"upvalue\":true");
+    out.push_back('}');
+}
+
+void JsonWriter::visit(BinaryExpr& node) {
+    if (node.op == "[") {
+        out.append("{\"type\":\"Index\",\"object\":");
+        dispatch(*node.left);
+        key("key");
+        dispatch(*node.right);
+    } else {
+        out.append("{\"type\":\"Binary\",\"op\":");
+        write_string(out, node.op);
+        key("left");
+        dispatch(*node.left);
+        key("right");
+        dispatch(*node.right);
+    }
+    out.push_back('}');
+}
+
+void JsonWriter::visit(UnaryExpr& node) {
+    out.append("{\"type\":\"Unary\",\"op\":");
+    write_string(out, node.op);
+    key("operand");
+    dispatch(*node.expr);
+    out.push_back('}');
+}
+
+void JsonWriter::visit(FunctionCall& node) {
+    if (node.is_method_call) {
+        out.append("{\"type\":\"MethodCall\",\"object\":");
+        dispatch(*node.func);
+        key("method");
+        write_string(out, node.method_name);
+    } else {
+        out.append("{\"type\":\"Call\",\"func\":");
+        dispatch(*node.func);
+    }
+    key("args");
+    list(node.args);
+    out.push_back('}');
+}
+
+void JsonWriter::visit(TableConstructor& node) {
+    out.append("{\"type\":\"Table\",\"fields\":[");
+    for (size_t i = 0; i < node.fields.size(); i++) {
+        if (i > 0) out.push_back(',');
+        out.push_back('{');
+        if (node.fields[i].key) {
+            out.append("\"key\":");
+            dispatch(*node.fields[i].key);
+            out.push_back(',');
+        }
+        out.append("\"value\":");
+        dispatch(*node.fields[i].value);
+        out.push_back('}');
+    }
+    out.append("]}");
+}
+
+void JsonWriter::visit(ClosureExpr& node) {
+    out.append("{\"type\":\"Function\"");
+    function_tail(node.params, node.is_vararg, &node.body);
+}
+
+void JsonWriter::visit(Assignment& node) {
+    out.append(node.is_local ? "{\"type\":\"Local\",\"targets\":" : "{\"type\":\"Assign\",\"targets\":");
+    list(node.targets);
+    key("values");
+    list(node.values);
+    out.push_back('}');
+}
+
+void JsonWriter::visit(IfStmt& node) {
+    out.append("{\"type\":\"If\",\"clauses\":[");
+    for (size_t i = 0; i < node.clauses.size(); i++) {
+        if (i > 0) out.push_back(',');
+        out.push_back('{');
+        if (node.clauses[i].condition) {
+            out.append("\"cond\":");
+            dispatch(*node.clauses[i].condition);
+            out.push_back(',');
+        }
+        out.append("\"body\":");
+        dispatch(*node.clauses[i].block);
+        out.push_back('}');
+    }
+    out.append("]}");
+}
+
+void JsonWriter::visit(WhileStmt& node) {
+    out.append("{\"type\":\"While\",\"cond\":");
+    dispatch(*node.condition);
+    key("body");
+    dispatch(*node.body);
+    out.push_back('}');
+}
+
+void JsonWriter::visit(RepeatStmt& node) {
+    out.append("{\"type\":\"Repeat\",\"body\":");
+    child(node.body);
+    key("cond");
+    child(node.condition);
+    out.push_back('}');
+}
+
+void JsonWriter::visit(ForNumStmt& node) {
+    out.append("{\"type\":\"ForNum\",\"var\":");
+    write_string(out, node.var_name);
+    key("start");
+    dispatch(*node.start);
+    key("end");
+    dispatch(*node.end);
+    if (node.step) {
+        key("step");
+        dispatch(*node.step);
+    }
+    key("body");
+    dispatch(*node.body);
+    out.push_back('}');
+}
+
+void JsonWriter::visit(ForInStmt& node) {
+    out.append("{\"type\":\"ForIn\",\"vars\":");
+    names(node.vars);
+    key("exprs");
+    list(node.exprs);
+    key("body");
+    dispatch(*node.body);
+    out.push_back('}');
+}
+
+void JsonWriter::visit(FunctionDecl& node) {
+    out.append("{\"type\":\"FunctionDecl\",\"name\":");
+    write_string(out, node.name);
+    key("local");
+    out.append(node.is_local ? "true" : "false");
+    function_tail(node.params, node.is_vararg, &node.body);
+}
+
+void JsonWriter::visit(ReturnStmt& node) {
+    out.append("{\"type\":\"Return\",\"values\":");
+    list(node.values);
+    out.push_back('}');
+}
+
+void JsonWriter::visit(BreakStmt&) {
+    out.append("{\"type\":\"Break\"}");
+}
+
+void JsonWriter::visit(LabelStmt& node) {
+    out.append("{\"type\":\"Label\",\"name\":");
+    write_string(out, node.label);
+    out.push_back('}');
+}
+
+void JsonWriter::visit(GotoStmt& node) {
+    out.append("{\"type\":\"Goto\",\"name\":");
+    write_string(out, node.label);
+    out.push_back('}');
+}
+
+void JsonWriter::visit(ExprStmt& node) {
+    out.append("{\"type\":\"ExprStmt\",\"expr\":");
+    dispatch(*node.expr);
+    out.push_back('}');
+}
+
+void JsonWriter::visit(RawStmt& node) {
+    out.append("{\"type\":\"Raw\",\"text\":");
+    write_string(out, node.text);
+    out.push_back('}');
+}
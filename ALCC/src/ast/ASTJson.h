@@ -0,0 +1,56 @@
+#ifndef ALCC_AST_JSON_H
+#define ALCC_AST_JSON_H
+
+#include "AST.h"
+#include "ASTDispatch.h"
+#include <string>
+#include <unordered_map>
+
+// Writes an AST as one line of JSON, appending to a caller-owned buffer that
+// can be cleared and reused between functions. Blocks become arrays of
+// statements; every other node is an object with a "type" field.
+// Lua strings are bytes: bytes >= 0x80 are written as \u00XX.
+class JsonWriter final : public ASTVisitor, public StaticASTVisitor<JsonWriter> {
+public:
+    std::string& out;
+    // Function bodies not built yet (nested functions decompiled on their
+    // own) are written as "body": null plus "proto": the name given here
+    std::unordered_map<Block**, std::string> proto_refs;
+
+    JsonWriter(std::string& o) : out(o) {}
+
+    static void write_string(std::string& out, const char* s, size_t len);
+    static void write_string(std::string& out, const std::string& s) { write_string(out, s.data(), s.size()); }
+    static void write_number(std::string& out, double v);
+
+    void visit(Block& node) override;
+    void visit(Literal& node) override;
+    void visit(Variable& node) override;
+    void visit(BinaryExpr& node) override;
+    void visit(UnaryExpr& node) override;
+    void visit(FunctionCall& node) override;
+    void visit(TableConstructor& node) override;
+    void visit(ClosureExpr& node) override;
+    void visit(Assignment& node) override;
+    void visit(IfStmt& node) override;
+    void visit(WhileStmt& node) override;
+    void visit(RepeatStmt& node) override;
+    void visit(ForNumStmt& node) override;
+    void visit(ForInStmt& node) override;
+    void visit(FunctionDecl& node) override;
+    void visit(ReturnStmt& node) override;
+    void visit(BreakStmt& node) override;
+    void visit(LabelStmt& node) override;
+    void visit(GotoStmt& node) override;
+    void visit(ExprStmt& node) override;
+    void visit(RawStmt& node) override;
+
+private:
+    void key(const char* k);
+    void child(ASTNode* n);
+    void list(const std::vector<Expression*>& items);
+    void names(const std::vector<std::string>& items);
+    void function_tail(const std::vector<std::string>& params, bool is_vararg, Block** body);
+};
+
+#endif
@@ -0,0 +1,545 @@
+#include "ASTPasses.h"
+#include "ASTDispatch.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#include <unordered_map>
+
+static long long ns_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+namespace {
+
+struct PassFrame {
+    ASTNode* node;
+    Expression** slot; // where an expression replacement goes; NULL otherwise
+    bool entered;
+};
+
+// Appends the direct children of a node with their slots, in source order
+class FrameCollector : public StaticASTVisitor<FrameCollector> {
+public:
+    std::vector<PassFrame>& out;
+    FrameCollector(std::vector<PassFrame>& o) : out(o) {}
+
+    void expr(Expression*& e) { if (e) out.push_back(PassFrame{e, &e, false}); }
+    void stmt(ASTNode* n) { if (n) out.push_back(PassFrame{n, nullptr, false}); }
+
+    void visit(Block& node) { for (auto s : node.statements) stmt(s); }
+    void visit(Literal&) {}
+    void visit(Variable&) {}
+    void visit(BinaryExpr& node) { expr(node.left); expr(node.right); }
+    void visit(UnaryExpr& node) { expr(node.expr); }
+    void visit(FunctionCall& node) {
+        expr(node.func);
+        for (auto& a : node.args) expr(a);
+    }
+    void visit(TableConstructor& node) {
+        for (auto& f : node.fields) { expr(f.key); expr(f.value); }
+    }
+    void visit(ClosureExpr& node) { stmt(node.body); }
+    void visit(Assignment& node) {
+        for (auto& t : node.targets) expr(t);
+        for (auto& v : node.values) expr(v);
+    }
+    void visit(IfStmt& node) {
+        for (auto& c : node.clauses) { expr(c.condition); stmt(c.block); }
+    }
+    void visit(WhileStmt& node) { expr(node.condition); stmt(node.body); }
+    void visit(RepeatStmt& node) { stmt(node.body); expr(node.condition); }
+    void visit(ForNumStmt& node) { expr(node.start); expr(node.end); expr(node.step); stmt(node.body); }
+    void visit(ForInStmt& node) {
+        for (auto& e : node.exprs) expr(e);
+        stmt(node.body);
+    }
+    void visit(FunctionDecl& node) { stmt(node.body); }
+    void visit(ReturnStmt& node) { for (auto& v : node.values) expr(v); }
+    void visit(BreakStmt&) {}
+    void visit(LabelStmt&) {}
+    void visit(GotoStmt&) {}
+    void visit(ExprStmt& node) { expr(node.expr); }
+    void visit(RawStmt&) {}
+};
+
+// Numbers that are integers in the source text (the printer writes them
+// without a fraction) and that doubles hold exactly. Below 2^53 a rounded
+// sum or product only stays below it if it was exact.
+const double MAX_EXACT = 9007199254740992.0; // 2^53
+const long long MAX_EXACT_INT = 9007199254740992LL;
+
+bool exact(long long v) { return v < MAX_EXACT_INT && v > -MAX_EXACT_INT; }
+
+bool is_int(double v) { return v == floor(v) && fabs(v) < MAX_EXACT; }
+bool is_frac(double v) { return isfinite(v) && v != floor(v); }
+
+bool truthy(const Literal* l) {
+    return !(l->type == Literal::NIL || (l->type == Literal::BOOLEAN && !l->bool_val));
+}
+
+// Evaluating these cannot call anything, raise an error or observe an
+// assignment made alongside them. Operators over literals that folding
+// left alone are excluded: they are the ones that may raise errors.
+bool is_plain(Expression* e) {
+    return e->kind == ASTNode::LITERAL || e->kind == ASTNode::VARIABLE;
+}
+
+// Register names the decompiler gives unnamed temporaries: v0, v1, ...
+bool is_temp_name(const std::string& s) {
+    if (s.size() < 2 || s[0] != 'v') return false;
+    for (size_t i = 1; i < s.size(); i++) if (s[i] < '0' || s[i] > '9') return false;
+    return true;
+}
+
+bool is_temp_var(Expression* e) {
+    if (e->kind != ASTNode::VARIABLE) return false;
+    Variable* v = static_cast<Variable*>(e);
+    return !v->is_upvalue && is_temp_name(v->name);
+}
+
+class FoldConstantsPass : public AstPass {
+public:
+    FoldConstantsPass() : AstPass("fold", AST_KIND_BIT(ASTNode::BINARY) | AST_KIND_BIT(ASTNode::UNARY)) {}
+
+    ASTNode* leave(ASTNode* n) override {
+        Expression* r = n->kind == ASTNode::BINARY ? fold(static_cast<BinaryExpr*>(n))
+                                                   : fold(static_cast<UnaryExpr*>(n));
+        if (r) rewrites++;
+        return r ? r : n;
+    }
+
+private:
+    static Literal* number(double v) { return new Literal(v); }
+
+    // Integer operands: the result must be an integer doubles hold exactly.
+    // Otherwise Lua computes a float, which must keep a fraction so it does
+    // not print as an integer.
+    static bool arith(const std::string& op, double a, double b, double& r) {
+        bool ints = is_int(a) && is_int(b);
+        if (op == "+") r = a + b;
+        else if (op == "-") r = a - b;
+        else if (op == "*") r = a * b;
+        else if (op == "/" || op == "^") {
+            r = op == "/" ? a / b : pow(a, b);
+            return is_frac(r);
+        } else if (op == "//" || op == "%") {
+            if (b == 0) return false; // an error for integers, inf or nan for floats
+            if (ints) {
+                long long x = (long long)a, y = (long long)b;
+                long long q = x / y, m = x % y;
+                if (m != 0 && (m ^ y) < 0) { q--; m += y; }
+                r = op == "//" ? (double)q : (double)m;
+                return true;
+            }
+            if (op == "//") return false; // floor of a float has no fraction
+            r = fmod(a, b);
+            if (r != 0 && (r < 0) != (b < 0)) r += b;
+            return is_frac(r);
+        } else if (op == "&" || op == "|" || op == "~") {
+            if (!ints) return false;
+            long long x = (long long)a, y = (long long)b;
+            long long v = op == "&" ? (x & y) : op == "|" ? (x | y) : (x ^ y);
+            r = (double)v;
+            return exact(v);
+        } else if (op == "<<" || op == ">>") {
+            if (!ints || a < 0 || b < 0 || b >= 64) return false;
+            unsigned long long x = (unsigned long long)a;
+            unsigned long long v = op == "<<" ? x << (int)b : x >> (int)b;
+            if (op == "<<" && (b >= 53 || (v >> (int)b) != x)) return false;
+            r = (double)v;
+            return v < (unsigned long long)MAX_EXACT_INT;
+        } else {
+            return false;
+        }
+        return ints ? is_int(r) : is_frac(r);
+    }
+
+    static int compare(const std::string& op, double a, double b) {
+        if (op == "<") return a < b;
+        if (op == "<=") return a <= b;
+        if (op == ">") return a > b;
+        if (op == ">=") return a >= b;
+        if (op == "==") return a == b;
+        if (op == "~=") return a != b;
+        return -1;
+    }
+
+    static bool same(const Literal* a, const Literal* b) {
+        if (a->type != b->type) return false;
+        switch (a->type) {
+            case Literal::NIL: return true;
+            case Literal::BOOLEAN: return a->bool_val == b->bool_val;
+            case Literal::NUMBER: return a->number_val == b->number_val;
+            case Literal::STRING: return a->string_val == b->string_val;
+        }
+        return false;
+    }
+
+    // Detaches one operand as the result and frees the rest
+    static Expression* keep(BinaryExpr* be, bool left) {
+        Expression* r = left ? be->left : be->right;
+        if (left) be->left = nullptr;
+        else be->right = nullptr;
+        ast_dispose(be);
+        return r;
+    }
+
+    static Expression* replace(ASTNode* n, Literal* r) {
+        ast_dispose(n);
+        return r;
+    }
+
+    static Expression* fold(BinaryExpr* be) {
+        if (!be->left || !be->right || be->left->kind != ASTNode::LITERAL) return nullptr;
+        Literal* l = static_cast<Literal*>(be->left);
+        const std::string& op = be->op;
+        // Short-circuit operators only need the left operand
+        if (op == "and") return keep(be, !truthy(l));
+        if (op == "or") return keep(be, truthy(l));
+        if (be->right->kind != ASTNode::LITERAL) return nullptr;
+        Literal* r = static_cast<Literal*>(be->right);
+
+        if (l->type == Literal::NUMBER && r->type == Literal::NUMBER) {
+            double a = l->number_val, b = r->number_val;
+            if (isnan(a) || isnan(b)) return nullptr;
+            int c = compare(op, a, b);
+            if (c >= 0) return replace(be, new Literal(c != 0));
+            double v;
+            if (!arith(op, a, b, v)) return nullptr;
+            return replace(be, number(v));
+        }
+        if (op == "==" || op == "~=") {
+            // Values of different types are never equal; numbers are handled above
+            bool eq = same(l, r);
+            return replace(be, new Literal(op == "==" ? eq : !eq));
+        }
+        if (op == ".." && l->type == Literal::STRING && r->type == Literal::STRING) {
+            l->string_val += r->string_val;
+            return keep(be, true);
+        }
+        return nullptr;
+    }
+
+    static Expression* fold(UnaryExpr* ue) {
+        if (!ue->expr || ue->expr->kind != ASTNode::LITERAL) return nullptr;
+        Literal* l = static_cast<Literal*>(ue->expr);
+        if (ue->op == "not") return replace(ue, new Literal(!truthy(l)));
+        if (ue->op == "#" && l->type == Literal::STRING) return replace(ue, number((double)l->string_val.size()));
+        if (l->type != Literal::NUMBER || isnan(l->number_val)) return nullptr;
+        double v = l->number_val;
+        if (ue->op == "-" && isfinite(v)) return replace(ue, number(-v));
+        if (ue->op == "~" && is_int(v)) return replace(ue, number((double)~(long long)v));
+        return nullptr;
+    }
+};
+
+class ElseIfPass : public AstPass {
+public:
+    ElseIfPass() : AstPass("elseif", AST_KIND_BIT(ASTNode::IF)) {}
+
+    // The inner if was left first, so a chain folds up in one traversal
+    ASTNode* leave(ASTNode* n) override {
+        IfStmt* node = static_cast<IfStmt*>(n);
+        if (node->clauses.size() < 2) return n;
+        IfStmt::Clause& last = node->clauses.back();
+        if (last.condition || !last.block || last.block->statements.size() != 1 ||
+            last.block->statements[0]->kind != ASTNode::IF) {
+            return n;
+        }
+        IfStmt* inner = static_cast<IfStmt*>(last.block->statements[0]);
+        last.block->statements.clear();
+        ast_dispose(last.block);
+        node->clauses.pop_back();
+        node->clauses.insert(node->clauses.end(), inner->clauses.begin(), inner->clauses.end());
+        inner->clauses.clear();
+        ast_dispose(inner);
+        rewrites++;
+        return n;
+    }
+};
+
+class MultiAssignPass : public AstPass {
+public:
+    MultiAssignPass() : AstPass("multi-assign", AST_KIND_BIT(ASTNode::BLOCK)) {}
+
+    ASTNode* leave(ASTNode* n) override {
+        std::vector<Statement*>& stmts = static_cast<Block*>(n)->statements;
+        size_t out = 0;
+        for (size_t i = 0; i < stmts.size();) {
+            Statement* s = stmts[i++];
+            stmts[out++] = s;
+            if (!single(s)) continue;
+            Assignment* group = static_cast<Assignment*>(s);
+            while (i < stmts.size() && group->targets.size() < MAX_TARGETS && joins(group, stmts[i])) {
+                Assignment* next = static_cast<Assignment*>(stmts[i++]);
+                group->targets.push_back(next->targets[0]);
+                group->values.push_back(next->values[0]);
+                next->targets.clear();
+                next->values.clear();
+                ast_dispose(next);
+                rewrites++;
+            }
+        }
+        stmts.resize(out);
+        return n;
+    }
+
+private:
+    // Longer lists read worse than the separate statements
+    static const size_t MAX_TARGETS = 8;
+
+    static bool single(Statement* s) {
+        if (s->kind != ASTNode::ASSIGN) return false;
+        Assignment* a = static_cast<Assignment*>(s);
+        return a->targets.size() == 1 && a->values.size() == 1 && a->targets[0] && a->values[0] &&
+               a->targets[0]->kind == ASTNode::VARIABLE && !static_cast<Variable*>(a->targets[0])->is_upvalue &&
+               mergeable(a->values[0]);
+    }
+
+    // Constants, locals and upvalues. A global read is an _ENV index that
+    // may run __index, and "..." and multret stand for results that the
+    // merged statement would spread over its other targets.
+    static bool mergeable(Expression* e) {
+        if (e->kind == ASTNode::LITERAL) return true;
+        if (e->kind != ASTNode::VARIABLE) return false;
+        const std::string& name = static_cast<Variable*>(e)->name;
+        return name != "..." && name != "multret";
+    }
+
+    // All values of a multiple assignment are evaluated before any target
+    // is set, so the value must not read a target of the group
+    static bool joins(Assignment* group, Statement* s) {
+        if (!single(s)) return false;
+        Assignment* a = static_cast<Assignment*>(s);
+        if (a->is_local != group->is_local) return false;
+        const std::string& name = static_cast<Variable*>(a->targets[0])->name;
+        for (auto t : group->targets) {
+            const std::string& prev = static_cast<Variable*>(t)->name;
+            if (prev == name) return false;
+            Expression* v = a->values[0];
+            if (v->kind == ASTNode::VARIABLE && static_cast<Variable*>(v)->name == prev) return false;
+        }
+        return true;
+    }
+};
+
+// A store to a temporary is dead when nothing in the function reads the
+// register: reads are counted during the traversal, and the stores are
+// removed when the function has been left. Functions with nested
+// functions or raw text are skipped, since reads there are not visible.
+class DeadTempsPass : public AstPass {
+public:
+    DeadTempsPass()
+        : AstPass("dead-temps",
+                  AST_KIND_BIT(ASTNode::BLOCK) | AST_KIND_BIT(ASTNode::VARIABLE) | AST_KIND_BIT(ASTNode::ASSIGN) |
+                      AST_KIND_BIT(ASTNode::CLOSURE) | AST_KIND_BIT(ASTNode::FUNCTION) | AST_KIND_BIT(ASTNode::RAW),
+                  AST_KIND_BIT(ASTNode::CLOSURE) | AST_KIND_BIT(ASTNode::FUNCTION)) {}
+
+    void start(ASTNode*) override {
+        scopes.clear();
+        scopes.emplace_back();
+    }
+
+    void enter(ASTNode*) override {
+        scopes.back().opaque = true;
+        scopes.emplace_back();
+    }
+
+    ASTNode* leave(ASTNode* n) override {
+        Scope& scope = scopes.back();
+        switch (n->kind) {
+            case ASTNode::VARIABLE: {
+                Variable* v = static_cast<Variable*>(n);
+                if (!v->is_upvalue && is_temp_name(v->name)) scope.reads[v->name]++;
+                break;
+            }
+            case ASTNode::ASSIGN:
+                // Its targets were counted as reads when they were left
+                for (auto t : static_cast<Assignment*>(n)->targets) {
+                    if (t && is_temp_var(t)) scope.reads[static_cast<Variable*>(t)->name]--;
+                }
+                break;
+            case ASTNode::BLOCK:
+                for (auto s : static_cast<Block*>(n)->statements) {
+                    if (candidate(s)) {
+                        scope.blocks.push_back(static_cast<Block*>(n));
+                        break;
+                    }
+                }
+                break;
+            case ASTNode::RAW:
+                scope.opaque = true;
+                break;
+            default: // the function is done
+                sweep(scope);
+                scopes.pop_back();
+                break;
+        }
+        return n;
+    }
+
+    void finish() override {
+        if (!scopes.empty()) sweep(scopes.back());
+        scopes.clear();
+    }
+
+private:
+    struct Scope {
+        std::unordered_map<std::string, int> reads;
+        std::vector<Block*> blocks; // blocks holding candidate stores
+        bool opaque = false;
+    };
+    std::vector<Scope> scopes;
+
+    static bool candidate(Statement* s) {
+        if (!s || s->kind != ASTNode::ASSIGN) return false;
+        Assignment* a = static_cast<Assignment*>(s);
+        if (a->is_local || a->targets.size() != a->values.size()) return false;
+        for (size_t i = 0; i < a->targets.size(); i++) {
+            if (a->targets[i] && a->values[i] && is_temp_var(a->targets[i]) && is_plain(a->values[i])) return true;
+        }
+        return false;
+    }
+
+    bool dead(Scope& scope, Expression* target, Expression* value) {
+        if (!target || !value || !is_temp_var(target) || !is_plain(value)) return false;
+        auto it = scope.reads.find(static_cast<Variable*>(target)->name);
+        return it == scope.reads.end() || it->second <= 0;
+    }
+
+    void sweep(Scope& scope) {
+        if (scope.opaque) return;
+        for (Block* b : scope.blocks) {
+            size_t out = 0;
+            for (Statement* s : b->statements) {
+                if (candidate(s)) {
+                    Assignment* a = static_cast<Assignment*>(s);
+                    size_t keep = 0;
+                    for (size_t i = 0; i < a->targets.size(); i++) {
+                        if (dead(scope, a->targets[i], a->values[i])) {
+                            ast_dispose(a->targets[i]);
+                            ast_dispose(a->values[i]);
+                            rewrites++;
+                            continue;
+                        }
+                        a->targets[keep] = a->targets[i];
+                        a->values[keep] = a->values[i];
+                        keep++;
+                    }
+                    a->targets.resize(keep);
+                    a->values.resize(keep);
+                    if (keep == 0) {
+                        ast_dispose(a);
+                        continue;
+                    }
+                }
+                b->statements[out++] = s;
+            }
+            b->statements.resize(out);
+        }
+    }
+};
+
+} // namespace
+
+AstPass* new_fold_constants_pass() { return new FoldConstantsPass(); }
+AstPass* new_elseif_pass() { return new ElseIfPass(); }
+AstPass* new_multi_assign_pass() { return new MultiAssignPass(); }
+AstPass* new_dead_temps_pass() { return new DeadTempsPass(); }
+
+AstPassManager::~AstPassManager() {
+    for (auto p : passes) delete p;
+}
+
+void AstPassManager::add_defaults() {
+    add(new_fold_constants_pass());
+    add(new_elseif_pass());
+    add(new_multi_assign_pass());
+    add(new_dead_temps_pass());
+}
+
+ASTNode* AstPassManager::run(ASTNode* root) {
+    if (!root) return root;
+    std::chrono::steady_clock::time_point run_start;
+    if (timed) run_start = std::chrono::steady_clock::now();
+
+    // Passes by kind, so a node only meets the passes that asked for it
+    std::vector<size_t> on_leave[ASTNode::RAW + 1], on_enter[ASTNode::RAW + 1];
+    for (size_t i = 0; i < passes.size(); i++) {
+        for (int k = 0; k <= ASTNode::RAW; k++) {
+            if (passes[i]->kinds & AST_KIND_BIT(k)) on_leave[k].push_back(i);
+            if (passes[i]->enter_kinds & AST_KIND_BIT(k)) on_enter[k].push_back(i);
+        }
+        passes[i]->start(root);
+    }
+
+    // An expression root gets a slot of its own, so it can be replaced too
+    Expression* root_expr = dynamic_cast<Expression*>(root);
+    std::vector<PassFrame> stack;
+    FrameCollector children(stack);
+    stack.push_back(PassFrame{root, root_expr ? &root_expr : nullptr, false});
+    while (!stack.empty()) {
+        PassFrame& top = stack.back();
+        if (!top.entered) {
+            top.entered = true;
+            ASTNode* n = top.node;
+            for (size_t i : on_enter[n->kind]) {
+                AstPass* p = passes[i];
+                std::chrono::steady_clock::time_point start;
+                if (timed) start = std::chrono::steady_clock::now();
+                p->enter(n);
+                p->nodes++;
+                if (timed) p->ns += ns_since(start);
+            }
+            // Reversed so the first child is left first
+            size_t mark = stack.size();
+            children.dispatch(*n);
+            std::reverse(stack.begin() + mark, stack.end());
+            continue;
+        }
+        PassFrame frame = top;
+        stack.pop_back();
+        ASTNode* n = frame.node;
+        size_t from = 0; // passes before this index are done with the node
+        for (;;) {
+            const std::vector<size_t>& list = on_leave[n->kind];
+            ASTNode* r = n;
+            for (auto it = std::lower_bound(list.begin(), list.end(), from); it != list.end(); ++it) {
+                AstPass* p = passes[*it];
+                std::chrono::steady_clock::time_point start;
+                if (timed) start = std::chrono::steady_clock::now();
+                r = p->leave(n);
+                p->nodes++;
+                if (timed) p->ns += ns_since(start);
+                if (r != n) {
+                    from = *it + 1;
+                    break;
+                }
+            }
+            if (r == n) break;
+            // The passes after the one that replaced it see the replacement
+            *frame.slot = static_cast<Expression*>(r);
+            n = r;
+        }
+    }
+
+    for (AstPass* p : passes) {
+        std::chrono::steady_clock::time_point start;
+        if (timed) start = std::chrono::steady_clock::now();
+        p->finish();
+        if (timed) p->ns += ns_since(start);
+    }
+    if (timed) total_ns = ns_since(run_start);
+    return root_expr ? root_expr : root;
+}
+
+void AstPassManager::print(FILE* f) const {
+    long long in_passes = 0;
+    for (const AstPass* p : passes) in_passes += p->ns;
+    fprintf(f, "AST passes (one traversal, %.3f ms):\n", total_ns / 1e6);
+    for (const AstPass* p : passes) {
+        fprintf(f, "  %-14s %10.3f ms  %10lld nodes  %8lld rewrites\n", p->name, p->ns / 1e6, p->nodes, p->rewrites);
+    }
+    fprintf(f, "  %-14s %10.3f ms\n", "traversal", (total_ns - in_passes) / 1e6);
+}
@@ -0,0 +1,70 @@
+#ifndef ALCC_AST_PASSES_H
+#define ALCC_AST_PASSES_H
+
+#include "AST.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Bit of a node kind in a pass's kind mask
+#define AST_KIND_BIT(k) (1u << (k))
+
+// A rewrite run by AstPassManager. A pass declares the node kinds it looks
+// at and is only called for those; all passes of a manager share one
+// post-order traversal instead of walking the tree once each.
+class AstPass {
+public:
+    const char* name;
+    uint32_t kinds;       // kinds passed to leave()
+    uint32_t enter_kinds; // kinds also passed to enter(), before their children
+
+    // Filled in by the manager
+    long long ns;       // time in this pass (only when the manager is timed)
+    long long nodes;    // enter and leave calls
+    long long rewrites; // changes the pass made
+
+    AstPass(const char* n, uint32_t k, uint32_t e = 0)
+        : name(n), kinds(k), enter_kinds(e), ns(0), nodes(0), rewrites(0) {}
+    virtual ~AstPass() {}
+
+    virtual void start(ASTNode*) {}
+    virtual void enter(ASTNode*) {}
+    // Called once the children of n are done. An expression may be replaced
+    // by returning another node: the pass frees what it replaces, and the
+    // passes after it see the replacement. Anything else must return n.
+    virtual ASTNode* leave(ASTNode* n) = 0;
+    virtual void finish() {}
+};
+
+// Runs its passes over a tree in a single traversal with an explicit stack.
+// At each node the passes that declared its kind run in registration order.
+class AstPassManager {
+public:
+    std::vector<AstPass*> passes; // owned
+    bool timed;        // time each pass call (two clock reads per call)
+    long long total_ns; // last run, traversal included (only when timed)
+
+    AstPassManager() : timed(false), total_ns(0) {}
+    ~AstPassManager();
+
+    void add(AstPass* pass) { passes.push_back(pass); }
+    // Constant folding, elseif chains, multiple assignment, dead temporaries
+    void add_defaults();
+
+    // Rewrites the tree in place and returns its root, which differs from
+    // root only when root is an expression a pass replaced
+    ASTNode* run(ASTNode* root);
+    void print(FILE* f) const;
+};
+
+// Built-in passes; the caller owns the result until it is added to a manager
+// Folds operators on literals where Lua gives the same value and type
+AstPass* new_fold_constants_pass();
+// Turns "else" holding only an if statement into "elseif" clauses
+AstPass* new_elseif_pass();
+// Merges consecutive single assignments of literals and variables
+AstPass* new_multi_assign_pass();
+// Drops "vN = value" stores of registers never read in the function
+AstPass* new_dead_temps_pass();
+
+#endif
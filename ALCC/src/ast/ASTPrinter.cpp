@@ -1,324 +1,577 @@
 #include "ASTPrinter.h"
-#include <iomanip>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <math.h>
+#include <charconv>
+
+#define UNARY_PRIORITY 12
+#define UNKNOWN_PRIORITY 15  // operators not in the table: parenthesize every operand
+#define PRIMARY_PRIORITY 100 // names, calls, indexing, literals
+
+// Binary operator priorities {left, right}, as in lparser.c:
+//   or 1, and 2, comparisons 3, | 4, ~ 5, & 6, shifts 7, .. 9/8,
+//   + - 10, * / // % 11, ^ 14/13 (.. and ^ are right associative)
+static bool binary_priority(const std::string& op, int& left, int& right) {
+    const char* s = op.c_str();
+    int p;
+    switch (op.size()) {
+        case 1:
+            switch (s[0]) {
+                case '<': case '>': p = 3; break;
+                case '|': p = 4; break;
+                case '~': p = 5; break;
+                case '&': p = 6; break;
+                case '+': case '-': p = 10; break;
+                case '*': case '/': case '%': p = 11; break;
+                case '^': left = 14; right = 13; return true;
+                default: return false;
+            }
+            break;
+        case 2:
+            if (s[1] == '=' && (s[0] == '<' || s[0] == '>' || s[0] == '~' || s[0] == '=')) p = 3;
+            else if ((s[0] == '<' && s[1] == '<') || (s[0] == '>' && s[1] == '>')) p = 7;
+            else if (s[0] == '.' && s[1] == '.') { left = 9; right = 8; return true; }
+            else if (s[0] == '/' && s[1] == '/') p = 11;
+            else if (s[0] == 'o' && s[1] == 'r') p = 1;
+            else return false;
+            break;
+        case 3:
+            if (op != "and") return false;
+            p = 2;
+            break;
+        default:
+            return false;
+    }
+    left = right = p;
+    return true;
+}
+
+static bool is_index(const BinaryExpr& be) {
+    return be.op.size() == 1 && be.op[0] == '[';
+}
+
+// How tightly an expression holds on to operators written next to its left
+// and right edges, and whether it can be called or indexed as is
+struct Edges {
+    int left, right;
+    bool prefix;
+
+    Edges(Expression* e) : left(PRIMARY_PRIORITY), right(PRIMARY_PRIORITY), prefix(false) {
+        switch (e->kind) {
+            case ASTNode::BINARY: {
+                BinaryExpr* be = static_cast<BinaryExpr*>(e);
+                if (is_index(*be)) prefix = true;
+                else if (!binary_priority(be->op, left, right)) left = right = 0;
+                break;
+            }
+            case ASTNode::UNARY:
+                right = UNARY_PRIORITY;
+                break;
+            case ASTNode::LITERAL: {
+                // Printed with a leading minus, which reads back as a unary operator
+                Literal* lit = static_cast<Literal*>(e);
+                if (lit->type == Literal::NUMBER && lit->number_val < 0) right = UNARY_PRIORITY;
+                break;
+            }
+            case ASTNode::VARIABLE:
+            case ASTNode::CALL:
+                prefix = true;
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+void LuaPrinter::flush() {
+    if (!buf.empty()) {
+        out.write(buf.data(), buf.size());
+        flushed += buf.size();
+        buf.clear();
+    }
+}
+
+void LuaPrinter::end_line() {
+    put('\n');
+    if (!hold && buf.size() >= FLUSH_SIZE) flush();
+}
+
+void LuaPrinter::print_body(Block*& body) {
+    if (!body_sizes) {
+        visit(*body);
+        return;
+    }
+    size_t start = written();
+    size_t outer = nested_bytes;
+    nested_bytes = 0;
+    visit(*body);
+    size_t total = written() - start;
+    (*body_sizes)[body] = BodySize{&body, total - nested_bytes};
+    nested_bytes = outer + total;
+}
 
 void LuaPrinter::print_indent() {
-    for (int i = 0; i < indent_level; ++i) out << "  ";
+    buf.append((size_t)indent_level * 2, ' ');
+}
+
+// Prints e and everything under it from the task stack. Expression visits
+// called from here push their operands instead of recursing; called from
+// anywhere else they come back through this.
+void LuaPrinter::print_expr(Expression* e) {
+    size_t base = tasks.size();
+    push_expr(e);
+    while (tasks.size() > base) {
+        Task t = tasks.back();
+        tasks.pop_back();
+        switch (t.kind) {
+            case TASK_TEXT:
+                put((const char*)t.item, t.arg);
+                break;
+            case TASK_OP:
+                put(' ');
+                put(*(const std::string*)t.item);
+                put(' ');
+                break;
+            case TASK_EXPR:
+                expanding = true;
+                dispatch(*(Expression*)t.item);
+                expanding = false;
+                break;
+            case TASK_LEFT:
+            case TASK_RIGHT:
+                expand_operand((Expression*)t.item, (int)t.arg, t.kind == TASK_RIGHT);
+                break;
+            case TASK_PREFIX:
+                expand_prefix((Expression*)t.item);
+                break;
+        }
+    }
+}
+
+static bool is_leaf(Expression* e) {
+    return e->kind == ASTNode::LITERAL || e->kind == ASTNode::VARIABLE;
+}
+
+void LuaPrinter::print_leaf(Expression* e, bool wrap) {
+    if (wrap) put('(');
+    dispatch(*e);
+    if (wrap) put(')');
+}
+
+bool LuaPrinter::take_expanding() {
+    bool e = expanding;
+    expanding = false;
+    return e;
+}
+
+void LuaPrinter::expand_operand(Expression* e, int limit, bool right) {
+    Edges edges(e);
+    // A left operand must not capture the operator; a right one must not extend past it
+    bool wrap = right ? edges.left <= limit : edges.right < limit;
+    if (wrap) {
+        put('(');
+        push_text(")", 1);
+    }
+    expanding = true;
+    dispatch(*e);
+    expanding = false;
+}
+
+void LuaPrinter::expand_prefix(Expression* e) {
+    // Only names, calls and indexing can be called or indexed without parentheses
+    Edges edges(e);
+    if (!edges.prefix) {
+        put('(');
+        push_text(")", 1);
+    }
+    expanding = true;
+    dispatch(*e);
+    expanding = false;
+}
+
+void LuaPrinter::print_number(double v) {
+    char tmp[32];
+    if (v >= -9.2e18 && v <= 9.2e18 && (double)(long long)v == v) {
+        long long i = (long long)v;
+        unsigned long long u = i < 0 ? 0ULL - (unsigned long long)i : (unsigned long long)i;
+        char* end = tmp + sizeof(tmp);
+        char* p = end;
+        do {
+            *--p = (char)('0' + u % 10);
+            u /= 10;
+        } while (u);
+        if (i < 0) *--p = '-';
+        put(p, end - p);
+    } else if (v != v) {
+        put("(0/0)");
+    } else if (isinf(v)) {
+        put(v > 0 ? "(1/0)" : "(-1/0)");
+    } else {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        // Shortest text that reads back as the same double, independent of locale
+        std::to_chars_result res = std::to_chars(tmp, tmp + sizeof(tmp), v);
+        put(tmp, res.ptr - tmp);
+#else
+        // Shortest of Lua's own format and a round-trip one
+        int n = snprintf(tmp, sizeof(tmp), "%.14g", v);
+        if (strtod(tmp, NULL) != v) n = snprintf(tmp, sizeof(tmp), "%.17g", v);
+        for (int i = 0; i < n; i++) {
+            if (tmp[i] == ',') tmp[i] = '.'; // locales with a decimal comma
+        }
+        put(tmp, n);
+#endif
+    }
+}
+
+void LuaPrinter::print_string(const std::string& s) {
+    put('"');
+    const char* p = s.data();
+    size_t n = s.size();
+    size_t run = 0; // start of the pending run of plain characters
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)p[i];
+        if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\') continue;
+        put(p + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"': put("\\\"", 2); break;
+            case '\\': put("\\\\", 2); break;
+            case '\n': put("\\n", 2); break;
+            case '\r': put("\\r", 2); break;
+            case '\t': put("\\t", 2); break;
+            default: {
+                char esc[4] = {'\\', (char)('0' + c / 100), (char)('0' + c / 10 % 10), (char)('0' + c % 10)};
+                put(esc, 4);
+                break;
+            }
+        }
+    }
+    put(p + run, n - run);
+    put('"');
+}
+
+void LuaPrinter::print_params(const std::vector<std::string>& params, bool is_vararg) {
+    put('(');
+    for (size_t i = 0; i < params.size(); ++i) {
+        if (i > 0) put(", ", 2);
+        put(params[i]);
+    }
+    if (is_vararg) {
+        if (!params.empty()) put(", ", 2);
+        put("...", 3);
+    }
+    put(')');
 }
 
 void LuaPrinter::visit(Block& node) {
     for (auto stmt : node.statements) {
-        // Blocks inside statements handle their own indentation often,
-        // but top-level statements in a block need indentation.
-        // However, some statements (If, While) have blocks as children.
-        // The block visit itself shouldn't necessarily print newlines if it's inline?
-        // No, in Lua blocks are chunks.
-
-        // Check if statement is a block itself (scope)?
-        // Usually we just iterate.
-        stmt->accept(*this);
-        out << "\n";
+        dispatch(*stmt);
+        end_line();
     }
 }
 
 void LuaPrinter::visit(Literal& node) {
     switch (node.type) {
-        case Literal::NIL: out << "nil"; break;
-        case Literal::BOOLEAN: out << (node.bool_val ? "true" : "false"); break;
-        case Literal::NUMBER:
-            // format logic matching original
-            if ((long long)node.number_val == node.number_val)
-                out << (long long)node.number_val;
-            else
-                out << node.number_val;
-            break;
-        case Literal::STRING:
-            out << "\"";
-            for (char c : node.string_val) {
-                if (c == '"') out << "\\\"";
-                else if (c == '\\') out << "\\\\";
-                else if (c == '\n') out << "\\n";
-                else if (c == '\r') out << "\\r";
-                else if (c == '\t') out << "\\t";
-                else if (isprint(c)) out << c;
-                else out << "\\" << std::setfill('0') << std::setw(3) << (int)(unsigned char)c;
-            }
-            out << "\"";
-            break;
+        case Literal::NIL: put("nil", 3); break;
+        case Literal::BOOLEAN: node.bool_val ? put("true", 4) : put("false", 5); break;
+        case Literal::NUMBER: print_number(node.number_val); break;
+        case Literal::STRING: print_string(node.string_val); break;
     }
 }
 
 void LuaPrinter::visit(Variable& node) {
-    out << node.name;
+    put(node.name);
 }
 
 void LuaPrinter::visit(BinaryExpr& node) {
-    // Basic precedence handling: always wrap to be safe for now,
-    // unless strict logic is implemented.
-    // Original decompiler didn't wrap much.
-    // Let's wrap if children are binary exprs.
-    // Or just wrap everything to guarantee correctness.
-
-    if (node.op == "[") {
-        node.left->accept(*this);
-        out << "[";
-        node.right->accept(*this);
-        out << "]";
-    } else {
-        out << "(";
-        node.left->accept(*this);
-        out << " " << node.op << " ";
-        node.right->accept(*this);
-        out << ")";
+    if (!take_expanding()) {
+        print_expr(&node);
+        return;
+    }
+    // Pushed last piece first
+    if (is_index(node)) {
+        push_text("]", 1);
+        push_expr(node.right);
+        push_text("[", 1);
+        push_expr(node.left, TASK_PREFIX);
+        return;
     }
+
+    int left, right;
+    if (!binary_priority(node.op, left, right)) left = right = UNKNOWN_PRIORITY;
+    if (!is_leaf(node.left)) {
+        push_expr(node.right, TASK_RIGHT, right);
+        tasks.push_back(Task{&node.op, 0, TASK_OP});
+        push_expr(node.left, TASK_LEFT, left);
+        return;
+    }
+    // Names and literals print at once, without a round trip through the stack
+    print_leaf(node.left, Edges(node.left).right < left);
+    put(' ');
+    put(node.op);
+    put(' ');
+    if (is_leaf(node.right)) print_leaf(node.right, Edges(node.right).left <= right);
+    else push_expr(node.right, TASK_RIGHT, right);
 }
 
 void LuaPrinter::visit(UnaryExpr& node) {
-    out << node.op;
-    if (node.op == "not") out << " "; // spacing
-    node.expr->accept(*this);
+    if (!take_expanding()) {
+        print_expr(&node);
+        return;
+    }
+    put(node.op);
+    if (node.op == "not") {
+        put(' ');
+    } else if (node.op == "-") {
+        // "- -x" must not turn into a comment
+        Expression* e = node.expr;
+        if ((e->kind == ASTNode::UNARY && static_cast<UnaryExpr*>(e)->op == "-") ||
+            (e->kind == ASTNode::LITERAL && static_cast<Literal*>(e)->type == Literal::NUMBER &&
+             static_cast<Literal*>(e)->number_val < 0)) {
+            put(' ');
+        }
+    }
+    push_expr(node.expr, TASK_RIGHT, UNARY_PRIORITY);
 }
 
 void LuaPrinter::visit(FunctionCall& node) {
+    if (!take_expanding()) {
+        print_expr(&node);
+        return;
+    }
+    push_text(")", 1);
+    for (size_t i = node.args.size(); i-- > 0;) {
+        push_expr(node.args[i]);
+        if (i > 0) push_text(", ", 2);
+    }
+    push_text("(", 1);
     if (node.is_method_call) {
-        // We assume func is a variable or expr that evaluates to object
-        // But for obj:method(), 'func' in AST might be 'obj'.
-        node.func->accept(*this);
-        out << ":" << node.method_name;
-    } else {
-        node.func->accept(*this);
+        // For obj:method(), func holds obj
+        push_text(node.method_name);
+        push_text(":", 1);
     }
+    push_expr(node.func, TASK_PREFIX);
+}
 
-    out << "(";
-    for (size_t i = 0; i < node.args.size(); ++i) {
-        if (i > 0) out << ", ";
-        node.args[i]->accept(*this);
+// String keys that can be written as name = value
+static bool is_identifier_key(Expression* key) {
+    if (key->kind != ASTNode::LITERAL) return false;
+    Literal* lit = static_cast<Literal*>(key);
+    if (lit->type != Literal::STRING) return false;
+    const std::string& s = lit->string_val;
+    if (s.empty() || isdigit((unsigned char)s[0])) return false;
+    for (char c : s) {
+        if (!isalnum((unsigned char)c) && c != '_') return false;
     }
-    out << ")";
+    return true;
 }
 
 void LuaPrinter::visit(TableConstructor& node) {
-    out << "{";
-    if (!node.fields.empty()) out << " ";
-    for (size_t i = 0; i < node.fields.size(); ++i) {
-        if (i > 0) out << ", ";
-        if (node.fields[i].key) {
-            // check if key is string literal valid identifier
-            bool standard_key = false;
-            if (Literal* lit = dynamic_cast<Literal*>(node.fields[i].key)) {
-                if (lit->type == Literal::STRING) {
-                    // check simple identifier
-                    bool is_id = true;
-                    if (lit->string_val.empty() || isdigit(lit->string_val[0])) is_id = false;
-                    else {
-                        for(char c : lit->string_val) {
-                            if (!isalnum(c) && c != '_') { is_id = false; break; }
-                        }
-                    }
-                    if (is_id) {
-                        out << lit->string_val << " = ";
-                        standard_key = true;
-                    }
-                }
-            }
-            if (!standard_key) {
-                out << "[";
-                node.fields[i].key->accept(*this);
-                out << "] = ";
+    if (!take_expanding()) {
+        print_expr(&node);
+        return;
+    }
+    put('{');
+    if (node.fields.empty()) {
+        put('}');
+        return;
+    }
+    put(' ');
+    push_text(" }", 2);
+    for (size_t i = node.fields.size(); i-- > 0;) {
+        TableConstructor::Field& f = node.fields[i];
+        push_expr(f.value);
+        if (f.key) {
+            if (is_identifier_key(f.key)) {
+                push_text(" = ", 3);
+                push_text(static_cast<Literal*>(f.key)->string_val);
+            } else {
+                push_text("] = ", 4);
+                push_expr(f.key);
+                push_text("[", 1);
             }
         }
-        node.fields[i].value->accept(*this);
+        if (i > 0) push_text(", ", 2);
     }
-    if (!node.fields.empty()) out << " ";
-    out << "}";
 }
 
 void LuaPrinter::visit(ClosureExpr& node) {
-    out << "function(";
-    for (size_t i = 0; i < node.params.size(); ++i) {
-        if (i > 0) out << ", ";
-        out << node.params[i];
-    }
-    if (node.is_vararg) {
-        if (!node.params.empty()) out << ", ";
-        out << "...";
-    }
-    out << ")\n";
+    // The body's statements start their own expression stacks
+    take_expanding();
+    put("function", 8);
+    print_params(node.params, node.is_vararg);
+    end_line();
     indent_level++;
-    node.body->accept(*this);
+    print_body(node.body);
     indent_level--;
     print_indent();
-    out << "end";
+    put("end", 3);
 }
 
 void LuaPrinter::visit(Assignment& node) {
     print_indent();
-    if (node.is_local) out << "local ";
+    if (node.is_local) put("local ", 6);
     for (size_t i = 0; i < node.targets.size(); ++i) {
-        if (i > 0) out << ", ";
-        node.targets[i]->accept(*this);
+        if (i > 0) put(", ", 2);
+        print_expr(node.targets[i]);
     }
     if (!node.values.empty()) {
-        out << " = ";
+        put(" = ", 3);
         for (size_t i = 0; i < node.values.size(); ++i) {
-            if (i > 0) out << ", ";
-            node.values[i]->accept(*this);
+            if (i > 0) put(", ", 2);
+            print_expr(node.values[i]);
         }
     }
 }
 
 void LuaPrinter::visit(IfStmt& node) {
     for (size_t i = 0; i < node.clauses.size(); ++i) {
-        if (i == 0) {
-            print_indent();
-            out << "if ";
-            node.clauses[i].condition->accept(*this);
-            out << " then\n";
-        } else if (node.clauses[i].condition) {
-            print_indent();
-            out << "elseif ";
-            node.clauses[i].condition->accept(*this);
-            out << " then\n";
+        print_indent();
+        if (i == 0 || node.clauses[i].condition) {
+            put(i == 0 ? "if " : "elseif ");
+            print_expr(node.clauses[i].condition);
+            put(" then", 5);
         } else {
-            print_indent();
-            out << "else\n";
+            put("else", 4);
         }
+        end_line();
 
         indent_level++;
-        node.clauses[i].block->accept(*this);
+        visit(*node.clauses[i].block);
         indent_level--;
     }
     print_indent();
-    out << "end";
+    put("end", 3);
 }
 
 void LuaPrinter::visit(WhileStmt& node) {
     print_indent();
-    out << "while ";
-    node.condition->accept(*this);
-    out << " do\n";
+    put("while ", 6);
+    print_expr(node.condition);
+    put(" do", 3);
+    end_line();
     indent_level++;
-    node.body->accept(*this);
+    visit(*node.body);
     indent_level--;
     print_indent();
-    out << "end";
+    put("end", 3);
 }
 
 void LuaPrinter::visit(RepeatStmt& node) {
     print_indent();
-    out << "repeat\n";
+    put("repeat", 6);
+    end_line();
     indent_level++;
-    if (node.body) node.body->accept(*this);
+    if (node.body) visit(*node.body);
     indent_level--;
     print_indent();
-    out << "until ";
-    if (node.condition) node.condition->accept(*this);
-    else out << "true"; // fallback if missing condition
+    put("until ", 6);
+    if (node.condition) print_expr(node.condition);
+    else put("true", 4); // fallback if missing condition
 }
 
 void LuaPrinter::visit(ForNumStmt& node) {
     print_indent();
-    out << "for " << node.var_name << " = ";
-    node.start->accept(*this);
-    out << ", ";
-    node.end->accept(*this);
+    put("for ", 4);
+    put(node.var_name);
+    put(" = ", 3);
+    print_expr(node.start);
+    put(", ", 2);
+    print_expr(node.end);
     if (node.step) {
-        out << ", ";
-        node.step->accept(*this);
+        put(", ", 2);
+        print_expr(node.step);
     }
-    out << " do\n";
+    put(" do", 3);
+    end_line();
     indent_level++;
-    node.body->accept(*this);
+    visit(*node.body);
     indent_level--;
     print_indent();
-    out << "end";
+    put("end", 3);
 }
 
 void LuaPrinter::visit(ForInStmt& node) {
     print_indent();
-    out << "for ";
+    put("for ", 4);
     for (size_t i = 0; i < node.vars.size(); ++i) {
-        if (i > 0) out << ", ";
-        out << node.vars[i];
+        if (i > 0) put(", ", 2);
+        put(node.vars[i]);
     }
-    out << " in ";
+    put(" in ", 4);
     for (size_t i = 0; i < node.exprs.size(); ++i) {
-        if (i > 0) out << ", ";
-        node.exprs[i]->accept(*this);
+        if (i > 0) put(", ", 2);
+        print_expr(node.exprs[i]);
     }
-    out << " do\n";
+    put(" do", 3);
+    end_line();
     indent_level++;
-    node.body->accept(*this);
+    visit(*node.body);
     indent_level--;
     print_indent();
-    out << "end";
+    put("end", 3);
 }
 
 void LuaPrinter::visit(FunctionDecl& node) {
-    // If it's a statement (named function), indent.
-    // If it's an expression (anonymous), no indent, no name.
-    // Wait, FunctionDecl is a Statement in AST.
-    // If it's inside an assignment, we use FunctionExpr?
-    // Ah, I didn't create FunctionExpr. I just used FunctionDecl as a statement.
-    // But anonymous functions are Expressions.
-    // I should have separate classes or a flag.
-    // Current design: FunctionDecl is Statement.
-    // For anonymous functions in assignments, I need an Expression.
-    // Let's assume FunctionDecl handles both or I need to add FunctionExpr.
-
-    // Check if name is empty -> likely intended as expression but used as statement?
-    // Actually, 'local function f()' is statement. 'f = function()' is assignment with expression.
-    // The AST has 'FunctionDecl' as Statement.
-    // I need 'Closure' expression.
-    // I defined 'Closure' in my thought process but didn't put it in AST.h explicitly?
-    // Let's check AST.h.
-
+    // Named or local function statement; anonymous functions are ClosureExpr
     print_indent();
-    if (node.is_local) out << "local ";
-    out << "function ";
-    if (!node.name.empty()) out << node.name;
-    out << "(";
-    for (size_t i = 0; i < node.params.size(); ++i) {
-        if (i > 0) out << ", ";
-        out << node.params[i];
-    }
-    if (node.is_vararg) {
-        if (!node.params.empty()) out << ", ";
-        out << "...";
-    }
-    out << ")\n";
+    if (node.is_local) put("local ", 6);
+    put("function ", 9);
+    put(node.name);
+    print_params(node.params, node.is_vararg);
+    end_line();
     indent_level++;
-    node.body->accept(*this);
+    print_body(node.body);
     indent_level--;
     print_indent();
-    out << "end";
+    put("end", 3);
 }
 
 void LuaPrinter::visit(ReturnStmt& node) {
     print_indent();
-    out << "return";
-    if (!node.values.empty()) out << " ";
+    put("return", 6);
+    if (!node.values.empty()) put(' ');
     for (size_t i = 0; i < node.values.size(); ++i) {
-        if (i > 0) out << ", ";
-        node.values[i]->accept(*this);
+        if (i > 0) put(", ", 2);
+        print_expr(node.values[i]);
     }
 }
 
 void LuaPrinter::visit(BreakStmt& node) {
     print_indent();
-    out << "break";
+    put("break", 5);
 }
 
 void LuaPrinter::visit(LabelStmt& node) {
     print_indent(); // Labels usually de-indented but let's keep simple
-    out << "::" << node.label << "::";
+    put("::", 2);
+    put(node.label);
+    put("::", 2);
 }
 
 void LuaPrinter::visit(GotoStmt& node) {
     print_indent();
-    out << "goto " << node.label;
+    put("goto ", 5);
+    put(node.label);
 }
 
 void LuaPrinter::visit(ExprStmt& node) {
     print_indent();
-    node.expr->accept(*this);
+    print_expr(node.expr);
+}
+
+void LuaPrinter::visit(RawStmt& node) {
+    size_t start = 0;
+    while (start <= node.text.size()) {
+        size_t end = node.text.find('\n', start);
+        if (end == std::string::npos) end = node.text.size();
+        if (start > 0) end_line();
+        if (end > start) {
+            print_indent();
+            put(node.text.data() + start, end - start);
+        }
+        start = end + 1;
+    }
 }
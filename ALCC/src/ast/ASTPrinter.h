@@ -2,15 +2,41 @@
 #define ALCC_AST_PRINTER_H
 
 #include "AST.h"
+#include "ASTDispatch.h"
 #include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
 
-class LuaPrinter : public ASTVisitor {
+// Prints an AST as Lua source. Text is appended to an internal buffer and
+// handed to the stream in large chunks; call flush() before reading the
+// stream or mixing in other output (the destructor flushes too).
+// Callers go through accept(); inside, nodes are dispatched on their kind.
+class LuaPrinter final : public ASTVisitor, public StaticASTVisitor<LuaPrinter> {
 public:
     int indent_level;
     std::ostream& out;
 
-    LuaPrinter(std::ostream& o = std::cout) : indent_level(0), out(o) {}
+    // Filled while set: for each function body printed, the bytes it added
+    // without its nested function bodies, and the node field holding it
+    struct BodySize {
+        Block** slot;
+        size_t bytes;
+    };
+    std::unordered_map<const Block*, BodySize>* body_sizes;
+    bool hold; // keep all text in the buffer until flush() or discard()
 
+    LuaPrinter(std::ostream& o = std::cout)
+        : indent_level(0), out(o), body_sizes(nullptr), hold(false), expanding(false), flushed(0), nested_bytes(0) {
+        buf.reserve(FLUSH_SIZE + 4096);
+        tasks.reserve(256);
+    }
+    ~LuaPrinter() { flush(); }
+
+    void flush();
+    void discard() { buf.clear(); }
+    size_t written() const { return flushed + buf.size(); }
     void print_indent();
 
     void visit(Block& node) override;
@@ -33,6 +59,45 @@ public:
     void visit(LabelStmt& node) override;
     void visit(GotoStmt& node) override;
     void visit(ExprStmt& node) override;
+    void visit(RawStmt& node) override;
+
+private:
+    static const size_t FLUSH_SIZE = 1 << 16;
+    std::string buf;
+
+    // Expressions are printed from an explicit stack of pending pieces, so
+    // nesting depth is limited by memory rather than by the call stack
+    enum TaskKind { TASK_TEXT, TASK_OP, TASK_EXPR, TASK_LEFT, TASK_RIGHT, TASK_PREFIX };
+    struct Task {
+        const void* item; // Expression*, text, or std::string* operator
+        uint32_t arg;     // text length or operand priority
+        uint32_t kind;
+    };
+    std::vector<Task> tasks;
+    bool expanding; // set while an expression visit is driven from the stack
+    size_t flushed;
+    size_t nested_bytes; // bytes of function bodies finished inside the current one
+
+    void put(char c) { buf.push_back(c); }
+    void put(const char* s, size_t n) { buf.append(s, n); }
+    void put(const char* s) { buf.append(s); }
+    void put(const std::string& s) { buf.append(s); }
+    void end_line();
+    void print_body(Block*& body);
+
+    void push_text(const char* s, size_t n) { tasks.push_back(Task{s, (uint32_t)n, TASK_TEXT}); }
+    void push_text(const std::string& s) { push_text(s.data(), s.size()); }
+    void push_expr(Expression* e, uint32_t kind = TASK_EXPR, int limit = 0) { tasks.push_back(Task{e, (uint32_t)limit, kind}); }
+    void print_expr(Expression* e);
+    bool take_expanding();
+
+    // Parentheses only where the parser would regroup the operand
+    void expand_operand(Expression* e, int limit, bool right);
+    void expand_prefix(Expression* e);
+    void print_leaf(Expression* e, bool wrap);
+    void print_number(double v);
+    void print_string(const std::string& s);
+    void print_params(const std::vector<std::string>& params, bool is_vararg);
 };
 
 #endif
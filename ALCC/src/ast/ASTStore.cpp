@@ -0,0 +1,357 @@
+#include "ASTStore.h"
+#include "ASTDispatch.h"
+#include <algorithm>
+
+uint32_t AstStore::open_node(int kind, uint32_t value, uint8_t flag_bits, uint32_t aux_count, uint32_t n) {
+    uint32_t id = size();
+    kinds.push_back((uint8_t)kind);
+    flags.push_back(flag_bits);
+    aux.push_back(aux_count);
+    values.push_back(value);
+    firsts.push_back((uint32_t)pool.size());
+    counts.push_back(n);
+    pool.resize(pool.size() + n, AST_BIN_NONE);
+    return id;
+}
+
+uint32_t AstStore::add_node(int kind, uint32_t value, uint8_t flag_bits, uint32_t aux_count, const uint32_t* operands, uint32_t n) {
+    uint32_t id = open_node(kind, value, flag_bits, aux_count, n);
+    if (n) std::copy(operands, operands + n, pool.begin() + firsts[id]);
+    return id;
+}
+
+uint32_t AstStore::intern(const std::string& s) {
+    auto it = interned.find(s);
+    if (it != interned.end()) return it->second;
+    uint32_t sid = string_count();
+    strings.append(s);
+    strings.push_back('\0');
+    offsets.push_back((uint32_t)strings.size());
+    interned.emplace(s, sid);
+    return sid;
+}
+
+uint32_t AstStore::add_number(double v) {
+    numbers.push_back(v);
+    return (uint32_t)numbers.size() - 1;
+}
+
+size_t AstStore::bytes() const {
+    return kinds.capacity() + flags.capacity() + aux.capacity() * 4 +
+           (values.capacity() + firsts.capacity() + counts.capacity() + pool.capacity() + offsets.capacity()) * 4 +
+           numbers.capacity() * 8 + strings.capacity();
+}
+
+void AstStore::shrink() {
+    std::unordered_map<std::string, uint32_t>().swap(interned);
+    kinds.shrink_to_fit();
+    flags.shrink_to_fit();
+    aux.shrink_to_fit();
+    values.shrink_to_fit();
+    firsts.shrink_to_fit();
+    counts.shrink_to_fit();
+    pool.shrink_to_fit();
+    numbers.shrink_to_fit();
+    offsets.shrink_to_fit();
+    strings.shrink_to_fit();
+}
+
+void AstStore::clear() {
+    kinds.clear();
+    flags.clear();
+    aux.clear();
+    values.clear();
+    firsts.clear();
+    counts.clear();
+    pool.clear();
+    numbers.clear();
+    offsets.assign(1, 0);
+    strings.clear();
+    interned.clear();
+}
+
+// Opens one node per visit, with its operand slots reserved in the pool, and
+// queues its children with the slot each child's id goes into
+class StoreImporter : public StaticASTVisitor<StoreImporter> {
+public:
+    AstStore& s;
+    std::vector<std::pair<ASTNode*, uint32_t>> work;
+    uint32_t slot; // pool slot for the node being visited, AST_BIN_NONE for the root
+
+    StoreImporter(AstStore& store) : s(store), slot(AST_BIN_NONE) {}
+
+    uint32_t begin(int kind, uint32_t value, uint8_t flags, uint32_t aux, size_t n) {
+        uint32_t id = s.open_node(kind, value, flags, aux, (uint32_t)n);
+        if (slot != AST_BIN_NONE) s.pool[slot] = id;
+        return s.firsts[id];
+    }
+
+    void queue(ASTNode* n, uint32_t at) { if (n) work.push_back(std::make_pair(n, at)); }
+    void name(const std::string& str, uint32_t at) { s.pool[at] = s.intern(str); }
+
+    void visit(Block& node) {
+        uint32_t at = begin(AST_BIN_BLOCK, 0, 0, 0, node.statements.size());
+        for (auto st : node.statements) queue(st, at++);
+    }
+
+    void visit(Literal& node) {
+        switch (node.type) {
+            case Literal::NIL: begin(AST_BIN_NIL, 0, 0, 0, 0); break;
+            case Literal::BOOLEAN: begin(node.bool_val ? AST_BIN_TRUE : AST_BIN_FALSE, 0, 0, 0, 0); break;
+            case Literal::NUMBER: begin(AST_BIN_NUMBER, s.add_number(node.number_val), 0, 0, 0); break;
+            case Literal::STRING: begin(AST_BIN_STRING, s.intern(node.string_val), 0, 0, 0); break;
+        }
+    }
+
+    void visit(Variable& node) {
+        begin(AST_BIN_VARIABLE, s.intern(node.name), node.is_upvalue ? AST_BIN_UPVALUE : 0, 0, 0);
+    }
+
+    void visit(BinaryExpr& node) {
+        uint32_t at = begin(AST_BIN_BINARY, s.intern(node.op), 0, 0, 2);
+        queue(node.left, at);
+        queue(node.right, at + 1);
+    }
+
+    void visit(UnaryExpr& node) {
+        uint32_t at = begin(AST_BIN_UNARY, s.intern(node.op), 0, 0, 1);
+        queue(node.expr, at);
+    }
+
+    void visit(FunctionCall& node) {
+        uint32_t method = node.is_method_call ? s.intern(node.method_name) : 0;
+        uint32_t at = begin(AST_BIN_CALL, method, node.is_method_call ? AST_BIN_METHOD : 0, 0, 1 + node.args.size());
+        queue(node.func, at++);
+        for (auto a : node.args) queue(a, at++);
+    }
+
+    void visit(TableConstructor& node) {
+        uint32_t at = begin(AST_BIN_TABLE, 0, 0, 0, node.fields.size() * 2);
+        for (auto& f : node.fields) {
+            queue(f.key, at++);
+            queue(f.value, at++);
+        }
+    }
+
+    void visit(ClosureExpr& node) {
+        uint32_t at = begin(AST_BIN_CLOSURE, 0, node.is_vararg ? AST_BIN_VARARG : 0, (uint32_t)node.params.size(),
+                            1 + node.params.size());
+        queue(node.body, at++);
+        for (auto& p : node.params) name(p, at++);
+    }
+
+    void visit(Assignment& node) {
+        uint32_t at = begin(AST_BIN_ASSIGN, 0, node.is_local ? AST_BIN_LOCAL : 0, (uint32_t)node.targets.size(),
+                            node.targets.size() + node.values.size());
+        for (auto t : node.targets) queue(t, at++);
+        for (auto v : node.values) queue(v, at++);
+    }
+
+    void visit(IfStmt& node) {
+        uint32_t at = begin(AST_BIN_IF, 0, 0, 0, node.clauses.size() * 2);
+        for (auto& c : node.clauses) {
+            queue(c.condition, at++);
+            queue(c.block, at++);
+        }
+    }
+
+    void visit(WhileStmt& node) {
+        uint32_t at = begin(AST_BIN_WHILE, 0, 0, 0, 2);
+        queue(node.condition, at);
+        queue(node.body, at + 1);
+    }
+
+    void visit(RepeatStmt& node) {
+        uint32_t at = begin(AST_BIN_REPEAT, 0, 0, 0, 2);
+        queue(node.body, at);
+        queue(node.condition, at + 1);
+    }
+
+    void visit(ForNumStmt& node) {
+        uint32_t at = begin(AST_BIN_FOR_NUM, s.intern(node.var_name), 0, 0, 4);
+        queue(node.start, at);
+        queue(node.end, at + 1);
+        queue(node.step, at + 2);
+        queue(node.body, at + 3);
+    }
+
+    void visit(ForInStmt& node) {
+        uint32_t at = begin(AST_BIN_FOR_IN, 0, 0, (uint32_t)node.vars.size(), node.vars.size() + node.exprs.size() + 1);
+        for (auto& v : node.vars) name(v, at++);
+        for (auto e : node.exprs) queue(e, at++);
+        queue(node.body, at);
+    }
+
+    void visit(FunctionDecl& node) {
+        uint8_t flags = (node.is_vararg ? AST_BIN_VARARG : 0) | (node.is_local ? AST_BIN_LOCAL : 0);
+        uint32_t at = begin(AST_BIN_FUNCTION, s.intern(node.name), flags, (uint32_t)node.params.size(),
+                            1 + node.params.size());
+        queue(node.body, at++);
+        for (auto& p : node.params) name(p, at++);
+    }
+
+    void visit(ReturnStmt& node) {
+        uint32_t at = begin(AST_BIN_RETURN, 0, 0, 0, node.values.size());
+        for (auto v : node.values) queue(v, at++);
+    }
+
+    void visit(BreakStmt&) { begin(AST_BIN_BREAK, 0, 0, 0, 0); }
+    void visit(LabelStmt& node) { begin(AST_BIN_LABEL, s.intern(node.label), 0, 0, 0); }
+    void visit(GotoStmt& node) { begin(AST_BIN_GOTO, s.intern(node.label), 0, 0, 0); }
+
+    void visit(ExprStmt& node) {
+        uint32_t at = begin(AST_BIN_EXPR_STMT, 0, 0, 0, 1);
+        queue(node.expr, at);
+    }
+
+    void visit(RawStmt& node) { begin(AST_BIN_RAW, s.intern(node.text), 0, 0, 0); }
+};
+
+uint32_t AstStore::add(ASTNode* root) {
+    if (!root) return AST_BIN_NONE;
+    uint32_t root_id = size();
+    StoreImporter importer(*this);
+    importer.work.push_back(std::make_pair(root, AST_BIN_NONE));
+    while (!importer.work.empty()) {
+        std::pair<ASTNode*, uint32_t> next = importer.work.back();
+        importer.work.pop_back();
+        importer.slot = next.second;
+        size_t mark = importer.work.size();
+        importer.dispatch(*next.first);
+        // Reversed so the first operand is numbered first
+        std::reverse(importer.work.begin() + mark, importer.work.end());
+    }
+    return root_id;
+}
+
+// Operands that are string ids rather than node ids
+static bool is_name_slot(int kind, uint32_t aux, uint32_t i) {
+    if (kind == AST_BIN_CLOSURE || kind == AST_BIN_FUNCTION) return i >= 1 && i <= aux;
+    if (kind == AST_BIN_FOR_IN) return i < aux;
+    return false;
+}
+
+ASTNode* AstStore::to_tree(uint32_t root) const {
+    if (root == AST_BIN_NONE) return nullptr;
+    // Post-order: a node is built once all of its operands are on the result stack
+    std::vector<std::pair<uint32_t, bool>> work;
+    std::vector<ASTNode*> built;
+    std::vector<ASTNode*> kids;     // operands of the node being built, nullptr for AST_BIN_NONE
+    std::vector<std::string> names; // its parameter or loop variable names
+    work.push_back(std::make_pair(root, false));
+    while (!work.empty()) {
+        std::pair<uint32_t, bool> next = work.back();
+        work.pop_back();
+        uint32_t id = next.first;
+        int k = kinds[id];
+        uint32_t n = counts[id];
+        const uint32_t* ops = pool.data() + firsts[id];
+        if (!next.second) {
+            work.push_back(std::make_pair(id, true));
+            for (uint32_t i = n; i-- > 0;) {
+                if (!is_name_slot(k, aux[id], i) && ops[i] != AST_BIN_NONE) work.push_back(std::make_pair(ops[i], false));
+            }
+            continue;
+        }
+
+        size_t taken = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (!is_name_slot(k, aux[id], i) && ops[i] != AST_BIN_NONE) taken++;
+        }
+        kids.assign(n, nullptr);
+        names.clear();
+        size_t from = built.size() - taken;
+        for (uint32_t i = 0; i < n; i++) {
+            if (is_name_slot(k, aux[id], i)) names.push_back(std::string(str(ops[i]), str_len(ops[i])));
+            else if (ops[i] != AST_BIN_NONE) kids[i] = built[from++];
+        }
+        built.resize(built.size() - taken);
+        auto expr = [&](uint32_t i) { return static_cast<Expression*>(kids[i]); };
+        auto block = [&](uint32_t i) { return static_cast<Block*>(kids[i]); };
+        std::string value = (k == AST_BIN_NUMBER || values[id] >= string_count()) ? std::string()
+                                                                                  : std::string(str(values[id]), str_len(values[id]));
+
+        ASTNode* node = nullptr;
+        switch (k) {
+            case AST_BIN_BLOCK: {
+                Block* b = new Block();
+                for (uint32_t i = 0; i < n; i++) b->add(static_cast<Statement*>(kids[i]));
+                node = b;
+                break;
+            }
+            case AST_BIN_NIL: node = new Literal(); break;
+            case AST_BIN_TRUE: node = new Literal(true); break;
+            case AST_BIN_FALSE: node = new Literal(false); break;
+            case AST_BIN_NUMBER: node = new Literal(numbers[values[id]]); break;
+            case AST_BIN_STRING: node = new Literal(value); break;
+            case AST_BIN_VARIABLE: node = new Variable(value, (flags[id] & AST_BIN_UPVALUE) != 0); break;
+            case AST_BIN_BINARY: node = new BinaryExpr(expr(0), value, expr(1)); break;
+            case AST_BIN_UNARY: node = new UnaryExpr(value, expr(0)); break;
+            case AST_BIN_CALL: {
+                FunctionCall* call = new FunctionCall(expr(0));
+                for (uint32_t i = 1; i < n; i++) call->args.push_back(expr(i));
+                if (flags[id] & AST_BIN_METHOD) {
+                    call->is_method_call = true;
+                    call->method_name = value;
+                }
+                node = call;
+                break;
+            }
+            case AST_BIN_TABLE: {
+                TableConstructor* t = new TableConstructor();
+                for (uint32_t i = 0; i + 1 < n; i += 2) t->fields.push_back(TableConstructor::Field{expr(i), expr(i + 1)});
+                node = t;
+                break;
+            }
+            case AST_BIN_CLOSURE: {
+                ClosureExpr* c = new ClosureExpr(block(0));
+                c->params = names;
+                c->is_vararg = (flags[id] & AST_BIN_VARARG) != 0;
+                node = c;
+                break;
+            }
+            case AST_BIN_ASSIGN: {
+                Assignment* a = new Assignment((flags[id] & AST_BIN_LOCAL) != 0);
+                for (uint32_t i = 0; i < n; i++) (i < aux[id] ? a->targets : a->values).push_back(expr(i));
+                node = a;
+                break;
+            }
+            case AST_BIN_IF: {
+                IfStmt* st = new IfStmt();
+                for (uint32_t i = 0; i + 1 < n; i += 2) st->clauses.push_back(IfStmt::Clause{expr(i), block(i + 1)});
+                node = st;
+                break;
+            }
+            case AST_BIN_WHILE: node = new WhileStmt(expr(0), block(1)); break;
+            case AST_BIN_REPEAT: node = new RepeatStmt(block(0), expr(1)); break;
+            case AST_BIN_FOR_NUM: node = new ForNumStmt(value, expr(0), expr(1), expr(2), block(3)); break;
+            case AST_BIN_FOR_IN: {
+                ForInStmt* f = new ForInStmt(block(n - 1));
+                f->vars = names;
+                for (uint32_t i = aux[id]; i + 1 < n; i++) f->exprs.push_back(expr(i));
+                node = f;
+                break;
+            }
+            case AST_BIN_FUNCTION: {
+                FunctionDecl* f = new FunctionDecl(value, block(0), (flags[id] & AST_BIN_LOCAL) != 0);
+                f->params = names;
+                f->is_vararg = (flags[id] & AST_BIN_VARARG) != 0;
+                node = f;
+                break;
+            }
+            case AST_BIN_RETURN: {
+                ReturnStmt* r = new ReturnStmt();
+                for (uint32_t i = 0; i < n; i++) r->values.push_back(expr(i));
+                node = r;
+                break;
+            }
+            case AST_BIN_BREAK: node = new BreakStmt(); break;
+            case AST_BIN_LABEL: node = new LabelStmt(value); break;
+            case AST_BIN_GOTO: node = new GotoStmt(value); break;
+            case AST_BIN_EXPR_STMT: node = new ExprStmt(expr(0)); break;
+            case AST_BIN_RAW: node = new RawStmt(value); break;
+        }
+        built.push_back(node);
+    }
+    return built.back();
+}
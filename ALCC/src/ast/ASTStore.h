@@ -0,0 +1,71 @@
+#ifndef ALCC_AST_STORE_H
+#define ALCC_AST_STORE_H
+
+#include "AST.h"
+#include "ASTBinary.h"
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Columnar node store: the in-memory form of the binary AST layout. A node
+// is a 32-bit id indexing parallel arrays (kind, flags, aux, value, operand
+// range); operands of all nodes share one index pool and strings are
+// interned. Kinds, flags and per-kind operands are as in ASTBinary.h.
+//
+// A node costs 18 bytes plus 4 per operand, against a vtable pointer, heap
+// vector and string headers and 8-byte links per pointer-tree node, and a
+// traversal reads a few dense arrays instead of chasing heap pointers.
+// Import, export and serialization use explicit stacks.
+class AstStore {
+public:
+    std::vector<uint8_t> kinds;
+    std::vector<uint8_t> flags;
+    std::vector<uint32_t> aux;    // parameter, target or loop variable count
+    std::vector<uint32_t> values; // string id, or number id for AST_BIN_NUMBER
+    std::vector<uint32_t> firsts; // first operand in the pool
+    std::vector<uint32_t> counts; // operands in the pool
+    std::vector<uint32_t> pool;   // operands: node ids, string ids or AST_BIN_NONE
+    std::vector<double> numbers;
+    std::vector<uint32_t> offsets; // string start offsets, plus the end of the last
+    std::string strings;           // NUL-terminated strings
+
+    AstStore() : offsets(1, 0) {}
+
+    uint32_t size() const { return (uint32_t)kinds.size(); }
+    int kind(uint32_t id) const { return kinds[id]; }
+    uint32_t count(uint32_t id) const { return counts[id]; }
+    uint32_t child(uint32_t id, uint32_t i) const { return pool[firsts[id] + i]; }
+    double number(uint32_t id) const { return numbers[values[id]]; }
+    uint32_t string_count() const { return (uint32_t)offsets.size() - 1; }
+    const char* str(uint32_t sid) const { return strings.c_str() + offsets[sid]; }
+    size_t str_len(uint32_t sid) const { return offsets[sid + 1] - offsets[sid] - 1; }
+
+    // Appends a node whose operands are already in the store (or names);
+    // returns its id
+    uint32_t add_node(int kind, uint32_t value, uint8_t flags, uint32_t aux, const uint32_t* operands, uint32_t n);
+    uint32_t intern(const std::string& s);
+    uint32_t add_number(double v);
+
+    // Copies a pointer tree in, numbering its nodes in pre-order; returns
+    // the root id, or AST_BIN_NONE for a null root
+    uint32_t add(ASTNode* root);
+
+    // Builds a pointer tree from the subtree at id; the caller owns it
+    ASTNode* to_tree(uint32_t id) const;
+
+    // Heap bytes held by the arrays (not counting the intern table)
+    size_t bytes() const;
+    // Drops the intern table and spare capacity once the store is built;
+    // strings interned afterwards are no longer shared with earlier ones
+    void shrink();
+    void clear();
+
+private:
+    std::unordered_map<std::string, uint32_t> interned;
+
+    friend class StoreImporter;
+    uint32_t open_node(int kind, uint32_t value, uint8_t flags, uint32_t aux, uint32_t n);
+};
+
+#endif
@@ -17,190 +17,730 @@ extern "C" {
 #include "core/compat.h"
 #include "alcc_backend.h"
 
+#include "analysis/ControlFlow.h"
+#include "analysis/Dominators.h"
+#include "analysis/CfgBinary.h"
+#include "alcc_pool.h"
+#include "alcc_writer.h"
+
+#include <string>
 #include <vector>
-#include <set>
-#include <map>
-
-struct BasicBlock {
-    int id;
-    int start_pc;
-    int end_pc;
-    std::vector<int> successors;
+#include <mutex>
+#include <algorithm>
+
+enum CfgFormat {
+    CFG_DOT,     // one cluster per function, blocks list their instructions
+    CFG_BLOCKS,  // DOT without instruction text
+    CFG_JSON,    // one JSON object per function and line
+    CFG_GRAPHML, // one graph, nodes in pre-order
+    CFG_CSR      // CfgBinary.h
 };
 
-// Map of start_pc -> BasicBlock*
-typedef std::map<int, BasicBlock*> BlockMap;
+// Functions of the selected subtree in pre-order, with their --func paths
+struct ProtoList {
+    std::vector<Proto*> protos;
+    std::vector<std::string> paths;
+    std::vector<size_t> parent;      // (size_t)-1 for protos[0]
+    std::vector<int> index;          // position in the parent's p[]
+    std::vector<size_t> subtree_end; // one past the last function nested in protos[j]
+};
 
-static void analyze_cfg(Proto* p, BlockMap& blocks) {
-    std::set<int> leaders;
-    leaders.insert(0); // Entry point is always a leader
+static std::string path_of(Proto* root, Proto* target) {
+    std::vector<std::pair<Proto*, std::string>> stack(1, {root, std::string()});
+    while (!stack.empty()) {
+        Proto* f = stack.back().first;
+        std::string path = stack.back().second;
+        stack.pop_back();
+        if (f == target) return path;
+        for (int j = 0; j < f->sizep; j++) {
+            stack.push_back({f->p[j], path.empty() ? std::to_string(j) : path + "/" + std::to_string(j)});
+        }
+    }
+    return std::string();
+}
 
-    // Pass 1: Identify all leaders
+static void collect_protos(Proto* p, const std::string& path, ProtoList& list) {
+    struct Item {
+        Proto* f;
+        std::string path;
+        size_t parent;
+        int index;
+    };
+    std::vector<Item> stack(1, {p, path, (size_t)-1, 0});
+    while (!stack.empty()) {
+        Item it = stack.back();
+        stack.pop_back();
+        size_t self = list.protos.size();
+        list.protos.push_back(it.f);
+        list.paths.push_back(it.path);
+        list.parent.push_back(it.parent);
+        list.index.push_back(it.index);
+        for (int j = it.f->sizep - 1; j >= 0; j--) {
+            stack.push_back({it.f->p[j], it.path.empty() ? std::to_string(j) : it.path + "/" + std::to_string(j), self, j});
+        }
+    }
+    // Pre-order puts the first child right after its parent and each later
+    // child after the whole subtree of the one before it
+    size_t n = list.protos.size();
+    list.subtree_end.resize(n);
+    for (size_t j = n; j-- > 0;) {
+        size_t e = j + 1;
+        for (int c = 0; c < list.protos[j]->sizep; c++) e = list.subtree_end[e];
+        list.subtree_end[j] = e;
+    }
+}
+
+// File name for --split: main.dot, f0_12_3.dot
+static std::string dot_name(const std::string& path) {
+    if (path.empty()) return "main.dot";
+    std::string name = "f" + path;
+    std::replace(name.begin(), name.end(), '/', '_');
+    return name + ".dot";
+}
+
+static std::string function_title(Proto* p, const std::string& path) {
+    if (path.empty()) return "main chunk";
+    char lines[64];
+    snprintf(lines, sizeof(lines), " (lines %d-%d)", p->linedefined, p->lastlinedefined);
+    return "function " + path + lines;
+}
+
+static void put_block_listing(OutputBuffer& out, Proto* p, const ControlFlowGraph::BasicBlock& bb) {
     AlccInstruction dec;
-    for (int i = 0; i < p->sizecode; i++) {
+    for (int i = bb.start_pc; i <= bb.end_pc; i++) {
         current_backend->decode_instruction((uint32_t)p->code[i], &dec);
-        int op = dec.op;
-
-        int target = -1;
-        bool is_branch = false;
-        bool is_return = false;
-
-        if (op == OP_JMP) {
-            target = i + 1 + dec.bx;
-            is_branch = true;
-        } else if (op == OP_FORLOOP || op == OP_TFORLOOP) {
-            target = i + 1 - dec.bx;
-            is_branch = true;
-        } else if (op == OP_FORPREP) {
-            target = i + 1 + dec.bx + 1;
-            is_branch = true;
-        } else if (op == OP_RETURN || op == OP_RETURN0 || op == OP_RETURN1) {
-            is_return = true;
-        } else if (op == OP_EQ || op == OP_LT || op == OP_LE || op == OP_EQK || op == OP_EQI ||
-                   op == OP_LTI || op == OP_LEI || op == OP_GTI || op == OP_GEI ||
-                   op == OP_TEST || op == OP_TESTSET) {
-            is_branch = true;
-            // Conditional jumps typically fall through or skip the next instruction (which is usually a JMP)
-            // We just mark it as a branch to break the block. The actual target is often handled by the next JMP.
-            // But to be safe, any instruction after a branch/return is a leader.
-        }
-
-        if (is_branch && target >= 0 && target < p->sizecode) {
-            leaders.insert(target);
-        }
-
-        if (is_branch || is_return) {
-            if (i + 1 < p->sizecode) {
-                leaders.insert(i + 1);
-            }
+        const AlccOpInfo* info = current_backend->get_op_info(dec.op);
+        if (!info) {
+            out.printf("[%03d] UNKNOWN\\l", i + 1);
+            continue;
         }
+
+        out.printf("[%03d] %-12s", i + 1, info->name);
+
+        switch (info->mode) {
+            case ALCC_iABC:
+            case ALCC_ivABC:
+                out.printf("%d %d %d", dec.a, dec.b, dec.c);
+                if (info->has_k && dec.k) out.put(" (k)");
+                break;
+            case ALCC_iABx:
+            case ALCC_iAsBx:
+                out.printf("%d %d", dec.a, dec.bx);
+                break;
+            case ALCC_iAx:
+                out.printf("%d", dec.bx);
+                break;
+            case ALCC_isJ:
+                out.printf("%d", dec.bx);
+                if (info->has_k && dec.k) out.put(" (k)");
+                break;
+        }
+        out.put("\\l");
+    }
+}
+
+// OP_CLOSURE sites of a function: block, pc, function index in the list
+struct ClosureSite {
+    int block;
+    int pc;
+    size_t function;
+};
+
+// Everything known about one function; the structure part is filled in
+// only with --analyze
+struct FunctionCfg {
+    ControlFlowGraph cfg;
+    std::vector<ClosureSite> closures;
+    bool analyzed;
+    DominatorTree dom;
+    DominatorTree pdom;
+    LoopForest loops;
+    EdgeClasses edges;
+    int loop_count;
+    int max_depth;
+
+    FunctionCfg() : analyzed(false), loop_count(0), max_depth(0) {}
+
+    int idom(int b) const { return dom.idom[b]; }
+    // num_blocks for the function exit, -1 if b never reaches it
+    int ipdom(int b) const { return pdom.idom[b]; }
+    int loop(int b) const { return loops.header[b]; }
+    int depth(int b) const { return loops.depth[b]; }
+};
+
+static void find_closures(const ProtoList& list, size_t j, FunctionCfg& fc) {
+    Proto* p = list.protos[j];
+    fc.closures.clear();
+    if (p->sizep == 0) return;
+    std::vector<size_t> child(p->sizep);
+    size_t k = j + 1;
+    for (int c = 0; c < p->sizep; c++) {
+        child[c] = k;
+        k = list.subtree_end[k];
+    }
+    AlccInstruction dec;
+    for (int pc = 0; pc < p->sizecode; pc++) {
+        current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+        if (dec.op != OP_CLOSURE || dec.bx < 0 || dec.bx >= p->sizep) continue;
+        fc.closures.push_back({fc.cfg.block_at(pc), pc, child[dec.bx]});
     }
+}
 
-    // Pass 2: Create Basic Blocks
-    std::vector<int> sorted_leaders(leaders.begin(), leaders.end());
-    int block_id = 0;
-    for (size_t k = 0; k < sorted_leaders.size(); k++) {
-        BasicBlock* bb = new BasicBlock();
-        bb->id = block_id++;
-        bb->start_pc = sorted_leaders[k];
-        bb->end_pc = (k + 1 < sorted_leaders.size()) ? sorted_leaders[k + 1] - 1 : p->sizecode - 1;
-        blocks[bb->start_pc] = bb;
-    }
-
-    // Pass 3: Determine Successors
-    for (auto const& [start_pc, bb] : blocks) {
-        int end_pc = bb->end_pc;
-        current_backend->decode_instruction((uint32_t)p->code[end_pc], &dec);
-        int op = dec.op;
-
-        int target = -1;
-        bool falls_through = true;
-        bool is_return = false;
-
-        if (op == OP_JMP) {
-            target = end_pc + 1 + dec.bx;
-            falls_through = false; // Unconditional jump
-        } else if (op == OP_FORLOOP || op == OP_TFORLOOP) {
-            target = end_pc + 1 - dec.bx;
-            falls_through = true; // Conditional loop
-        } else if (op == OP_FORPREP) {
-            target = end_pc + 1 + dec.bx + 1;
-            falls_through = true; // Conditional loop start
-        } else if (op == OP_RETURN || op == OP_RETURN0 || op == OP_RETURN1) {
-            is_return = true;
-            falls_through = false;
-        } else if (op == OP_EQ || op == OP_LT || op == OP_LE || op == OP_EQK || op == OP_EQI ||
-                   op == OP_LTI || op == OP_LEI || op == OP_GTI || op == OP_GEI ||
-                   op == OP_TEST || op == OP_TESTSET) {
-            // It's a conditional. Target is handled if the next instruction is JMP,
-            // but the next instruction is the start of the next block.
-            // Wait, in Lua 5.4/5.5, the JMP is indeed the next instruction.
-            // Let's just fallthrough to the next block (which might be the JMP).
-            falls_through = true;
-        }
-
-        if (target >= 0 && target < p->sizecode) {
-            if (blocks.find(target) != blocks.end()) {
-                bb->successors.push_back(target);
+static void analyze_function(FunctionCfg& fc) {
+    const ControlFlowGraph& cfg = fc.cfg;
+    fc.dom.compute(cfg);
+    fc.pdom.compute(cfg, true);
+    fc.loops.compute(cfg, fc.dom);
+    fc.edges.compute(cfg, fc.dom);
+    fc.loop_count = 0;
+    fc.max_depth = 0;
+    for (int b = 0; b < cfg.num_blocks(); b++) {
+        if (fc.loops.is_header(b)) fc.loop_count++;
+        if (fc.loops.depth[b] > fc.max_depth) fc.max_depth = fc.loops.depth[b];
+    }
+    fc.analyzed = true;
+}
+
+static void put_dot_block_ref(OutputBuffer& out, int b, int exit) {
+    if (b < 0) out.put('-');
+    else if (b == exit) out.put("exit");
+    else {
+        out.put('B');
+        out.put_int(b);
+    }
+}
+
+// DOT blocks and edges of function j. With split set this is a whole
+// digraph whose CLOSURE sites point at placeholder nodes naming the child's
+// file; otherwise it is a cluster, and the CLOSURE edges go to deferred so
+// they can be emitted once every cluster has declared its nodes.
+static void render_dot(const ProtoList& list, size_t j, const FunctionCfg& fc, bool listing, bool split,
+                       OutputBuffer& out, OutputBuffer& deferred) {
+    const ControlFlowGraph& cfg = fc.cfg;
+    Proto* p = list.protos[j];
+    int nb = cfg.num_blocks();
+    std::string node = split ? "block_" : "f" + std::to_string(j) + "_b";
+    const char* indent = split ? "  " : "    ";
+    std::string title = function_title(p, list.paths[j]);
+    if (fc.analyzed) {
+        char summary[128];
+        snprintf(summary, sizeof(summary), "\\n%d blocks, loops %d (max depth %d), unreachable %d, irreducible %d",
+                 nb, fc.loop_count, fc.max_depth, fc.edges.unreachable, fc.edges.irreducible);
+        title += summary;
+    }
+    if (split) {
+        out.put("digraph CFG {\n");
+        out.printf("  label=\"%s\";\n", title.c_str());
+        out.put("  node [shape=box, fontname=\"Courier\"];\n");
+    } else {
+        out.printf("  subgraph cluster_%zu {\n", j);
+        out.printf("    label=\"%s\";\n", title.c_str());
+    }
+
+    for (int b = 0; b < nb; b++) {
+        const ControlFlowGraph::BasicBlock& bb = cfg.blocks[b];
+        out.put(indent);
+        out.put(node);
+        out.put_int(b);
+        out.put(" [label=\"Block ");
+        out.put_int(b);
+        out.put("\\n");
+        if (fc.analyzed) {
+            // Dominators, then the innermost loop; headers get a double border
+            out.put("idom ");
+            put_dot_block_ref(out, fc.idom(b), -2);
+            out.put("  ipdom ");
+            put_dot_block_ref(out, fc.ipdom(b), nb);
+            if (fc.loop(b) >= 0) {
+                out.put("  loop ");
+                put_dot_block_ref(out, fc.loop(b), -2);
+                out.put(" depth ");
+                out.put_int(fc.depth(b));
             }
+            out.put("\\n");
         }
-
-        if (falls_through && !is_return && end_pc + 1 < p->sizecode) {
-            if (blocks.find(end_pc + 1) != blocks.end()) {
-                bb->successors.push_back(end_pc + 1);
+        if (listing) put_block_listing(out, p, bb);
+        else out.printf("[%03d-%03d]", bb.start_pc + 1, bb.end_pc + 1);
+        out.put('"');
+        if (fc.analyzed) {
+            if (fc.loops.is_header(b)) out.put(", peripheries=2");
+            if (!fc.dom.reachable(b)) out.put(", style=dashed, fontcolor=gray");
+        }
+        out.put("];\n");
+        for (const int* s = cfg.succ_begin(b); s != cfg.succ_end(b); s++) {
+            out.put(indent);
+            out.put(node);
+            out.put_int(b);
+            out.put(" -> ");
+            out.put(node);
+            out.put_int(*s);
+            if (fc.analyzed) {
+                switch (fc.edges.kind[s - cfg.succ.data()]) {
+                    case EdgeClasses::BACK: out.put(" [color=red]"); break;
+                    case EdgeClasses::FORWARD: out.put(" [color=blue]"); break;
+                    case EdgeClasses::CROSS: out.put(" [style=dotted]"); break;
+                    case EdgeClasses::UNREACHABLE: out.put(" [color=gray]"); break;
+                }
             }
+            out.put(";\n");
         }
     }
-}
 
-static void print_cfg_dot(Proto* p, BlockMap& blocks) {
-    printf("digraph CFG {\n");
-    printf("  node [shape=box, fontname=\"Courier\"];\n");
+    for (const ClosureSite& c : fc.closures) {
+        int child = list.index[c.function];
+        if (split) {
+            out.printf("  closure_%d [shape=note, label=\"%s\\n%s\"];\n", child,
+                       function_title(list.protos[c.function], list.paths[c.function]).c_str(),
+                       dot_name(list.paths[c.function]).c_str());
+            out.printf("  block_%d -> closure_%d [style=dashed];\n", c.block, child);
+        } else {
+            deferred.printf("  f%zu_b%d -> f%zu_b0 [style=dashed, label=\"[%03d] CLOSURE\"];\n", j, c.block, c.function, c.pc + 1);
+        }
+    }
+    out.put(split ? "}\n" : "  }\n");
+}
 
-    for (auto const& [start_pc, bb] : blocks) {
-        printf("  block_%d [label=\"Block %d\\n", bb->id, bb->id);
+static void put_json_string(OutputBuffer& out, const std::string& s) {
+    // Paths are digits and slashes; nothing to escape
+    out.put('"');
+    out.put(s);
+    out.put('"');
+}
 
-        AlccInstruction dec;
-        for (int i = bb->start_pc; i <= bb->end_pc; i++) {
-            current_backend->decode_instruction((uint32_t)p->code[i], &dec);
-            const AlccOpInfo* info = current_backend->get_op_info(dec.op);
-            if (!info) {
-                printf("[%03d] UNKNOWN\\l", i + 1);
-                continue;
-            }
+static void put_json_ints(OutputBuffer& out, const char* key, const FunctionCfg& fc, int (FunctionCfg::*get)(int) const) {
+    out.put(",\"");
+    out.put(key);
+    out.put("\":[");
+    for (int b = 0; b < fc.cfg.num_blocks(); b++) {
+        if (b) out.put(',');
+        out.put_int((fc.*get)(b));
+    }
+    out.put(']');
+}
 
-            printf("[%03d] %-12s", i + 1, info->name);
-
-            switch (info->mode) {
-                case ALCC_iABC:
-                case ALCC_ivABC:
-                    printf("%d %d %d", dec.a, dec.b, dec.c);
-                    if (info->has_k && dec.k) printf(" (k)");
-                    break;
-                case ALCC_iABx:
-                case ALCC_iAsBx:
-                    printf("%d %d", dec.a, dec.bx);
-                    break;
-                case ALCC_iAx:
-                    printf("%d", dec.bx);
-                    break;
-                case ALCC_isJ:
-                    printf("%d", dec.bx);
-                    if (info->has_k && dec.k) printf(" (k)");
-                    break;
-            }
-            printf("\\l");
+// {"function":j,"path":..,"line":..,"last_line":..,"blocks":[[start,end],..],
+//  "edges":[[from,to],..],"closures":[[block,pc,function],..]}, pcs 1-based.
+// Analyzed functions add per-block "idom", "ipdom", "loop" and "depth"
+// arrays, "edge_kinds" with one letter per edge and the summary counts.
+static void render_json(const ProtoList& list, size_t j, const FunctionCfg& fc, OutputBuffer& out) {
+    const ControlFlowGraph& cfg = fc.cfg;
+    Proto* p = list.protos[j];
+    out.put("{\"function\":");
+    out.put_int((long long)j);
+    out.put(",\"path\":");
+    put_json_string(out, list.paths[j]);
+    out.put(",\"line\":");
+    out.put_int(p->linedefined);
+    out.put(",\"last_line\":");
+    out.put_int(p->lastlinedefined);
+    out.put(",\"blocks\":[");
+    for (int b = 0; b < cfg.num_blocks(); b++) {
+        if (b) out.put(',');
+        out.put('[');
+        out.put_int(cfg.blocks[b].start_pc + 1);
+        out.put(',');
+        out.put_int(cfg.blocks[b].end_pc + 1);
+        out.put(']');
+    }
+    out.put("],\"edges\":[");
+    bool first = true;
+    for (int b = 0; b < cfg.num_blocks(); b++) {
+        for (const int* s = cfg.succ_begin(b); s != cfg.succ_end(b); s++) {
+            if (!first) out.put(',');
+            first = false;
+            out.put('[');
+            out.put_int(b);
+            out.put(',');
+            out.put_int(*s);
+            out.put(']');
         }
-        printf("\"];\n");
+    }
+    out.put("],\"closures\":[");
+    for (size_t i = 0; i < fc.closures.size(); i++) {
+        if (i) out.put(',');
+        out.put('[');
+        out.put_int(fc.closures[i].block);
+        out.put(',');
+        out.put_int(fc.closures[i].pc + 1);
+        out.put(',');
+        out.put_int((long long)fc.closures[i].function);
+        out.put(']');
+    }
+    out.put(']');
+    if (fc.analyzed) {
+        put_json_ints(out, "idom", fc, &FunctionCfg::idom);
+        put_json_ints(out, "ipdom", fc, &FunctionCfg::ipdom);
+        put_json_ints(out, "loop", fc, &FunctionCfg::loop);
+        put_json_ints(out, "depth", fc, &FunctionCfg::depth);
+        out.put(",\"edge_kinds\":\"");
+        for (unsigned char k : fc.edges.kind) out.put(EdgeClasses::name(k)[0]);
+        out.put("\",\"loops\":");
+        out.put_int(fc.loop_count);
+        out.put(",\"unreachable\":");
+        out.put_int(fc.edges.unreachable);
+        out.put(",\"irreducible\":");
+        out.put_int(fc.edges.irreducible);
+    }
+    out.put("}\n");
+}
+
+static void put_graphml_node(OutputBuffer& out, size_t j, int b) {
+    out.put('f');
+    out.put_int((long long)j);
+    out.put("_b");
+    out.put_int(b);
+}
 
-        for (int succ : bb->successors) {
-            if (blocks.find(succ) != blocks.end()) {
-                BasicBlock* target_bb = blocks[succ];
-                printf("  block_%d -> block_%d;\n", bb->id, target_bb->id);
+static void put_graphml_data(OutputBuffer& out, const char* key, long long v) {
+    out.put("<data key=\"");
+    out.put(key);
+    out.put("\">");
+    out.put_int(v);
+    out.put("</data>");
+}
+
+// Nodes fN_bM with their function and 1-based pc range; the entry block
+// also carries the function's path. CLOSURE edges have kind "closure",
+// and analyzed flow edges their EdgeClasses name.
+static void render_graphml(const ProtoList& list, size_t j, const FunctionCfg& fc, OutputBuffer& out) {
+    const ControlFlowGraph& cfg = fc.cfg;
+    for (int b = 0; b < cfg.num_blocks(); b++) {
+        out.put("<node id=\"");
+        put_graphml_node(out, j, b);
+        out.put("\">");
+        put_graphml_data(out, "f", (long long)j);
+        put_graphml_data(out, "s", cfg.blocks[b].start_pc + 1);
+        put_graphml_data(out, "e", cfg.blocks[b].end_pc + 1);
+        if (b == 0) {
+            out.put("<data key=\"path\">");
+            out.put(list.paths[j]);
+            out.put("</data>");
+        }
+        if (fc.analyzed) {
+            put_graphml_data(out, "idom", fc.idom(b));
+            put_graphml_data(out, "ipdom", fc.ipdom(b));
+            put_graphml_data(out, "loop", fc.loop(b));
+            put_graphml_data(out, "depth", fc.depth(b));
+        }
+        out.put("</node>\n");
+    }
+    for (int b = 0; b < cfg.num_blocks(); b++) {
+        for (const int* s = cfg.succ_begin(b); s != cfg.succ_end(b); s++) {
+            out.put("<edge source=\"");
+            put_graphml_node(out, j, b);
+            out.put("\" target=\"");
+            put_graphml_node(out, j, *s);
+            if (fc.analyzed) {
+                out.put("\"><data key=\"kind\">");
+                out.put(EdgeClasses::name(fc.edges.kind[s - cfg.succ.data()]));
+                out.put("</data></edge>\n");
+            } else {
+                out.put("\"/>\n");
             }
         }
     }
+    for (const ClosureSite& c : fc.closures) {
+        out.put("<edge source=\"");
+        put_graphml_node(out, j, c.block);
+        out.put("\" target=\"");
+        put_graphml_node(out, c.function, 0);
+        out.put("\"><data key=\"kind\">closure</data></edge>\n");
+    }
+}
+
+// Graph of one function kept for the CSR dump, in local block numbers
+struct FunctionGraph {
+    std::vector<CfgBinBlock> blocks;
+    std::vector<uint32_t> succ_offset;
+    std::vector<uint32_t> succ;
+    std::vector<ClosureSite> closures;
+    std::vector<int> idom, ipdom, loop, depth;
+    std::vector<unsigned char> edge_kind;
+};
+
+static void keep_graph(const FunctionCfg& fc, FunctionGraph& g) {
+    const ControlFlowGraph& cfg = fc.cfg;
+    int nb = cfg.num_blocks();
+    g.blocks.resize(nb);
+    for (int b = 0; b < nb; b++) {
+        g.blocks[b].start_pc = (uint32_t)cfg.blocks[b].start_pc;
+        g.blocks[b].end_pc = (uint32_t)cfg.blocks[b].end_pc;
+    }
+    g.succ_offset.assign(cfg.succ_offset.begin(), cfg.succ_offset.end());
+    g.succ.assign(cfg.succ.begin(), cfg.succ.end());
+    g.closures = fc.closures;
+    if (!fc.analyzed) return;
+    g.idom.assign(fc.dom.idom.begin(), fc.dom.idom.begin() + nb);
+    g.ipdom.assign(fc.pdom.idom.begin(), fc.pdom.idom.begin() + nb);
+    g.loop = fc.loops.header;
+    g.depth = fc.loops.depth;
+    g.edge_kind = fc.edges.kind;
+}
+
+// Block ids of one function's array in the shared numbering
+static void put_block_ids(OutputBuffer& out, const std::vector<int>& ids, uint32_t base, int exit) {
+    for (int b : ids) {
+        uint32_t v = b < 0 ? CFG_BIN_NONE : b == exit ? CFG_BIN_EXIT : base + (uint32_t)b;
+        out.put_raw(&v, sizeof(v));
+    }
+}
+
+static void write_csr(const ProtoList& list, std::vector<FunctionGraph>& graphs, bool analyzed, OutputBuffer& out) {
+    size_t n = list.protos.size();
+    std::vector<uint32_t> first_block(n + 1, 0);
+    uint32_t edges = 0, closures = 0;
+    for (size_t j = 0; j < n; j++) {
+        first_block[j + 1] = first_block[j] + (uint32_t)graphs[j].blocks.size();
+        edges += (uint32_t)graphs[j].succ.size();
+        closures += (uint32_t)graphs[j].closures.size();
+    }
 
-    printf("}\n");
+    CfgBinHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CFG_BIN_MAGIC, 4);
+    hdr.byte_order = CFG_BIN_BYTE_ORDER;
+    hdr.version = CFG_BIN_VERSION;
+    hdr.function_count = (uint32_t)n;
+    hdr.block_count = first_block[n];
+    hdr.edge_count = edges;
+    hdr.closure_count = closures;
+    hdr.flags = analyzed ? CFG_BIN_STRUCTURE : 0;
+    out.put_raw(&hdr, sizeof(hdr));
+
+    for (size_t j = 0; j < n; j++) {
+        CfgBinFunction f;
+        f.first_block = first_block[j];
+        f.block_count = (uint32_t)graphs[j].blocks.size();
+        f.parent = list.parent[j] == (size_t)-1 ? CFG_BIN_NONE : (uint32_t)list.parent[j];
+        f.index = (uint32_t)list.index[j];
+        f.line = list.protos[j]->linedefined;
+        f.last_line = list.protos[j]->lastlinedefined;
+        out.put_raw(&f, sizeof(f));
+    }
+    for (size_t j = 0; j < n; j++) out.put_raw(graphs[j].blocks.data(), graphs[j].blocks.size() * sizeof(CfgBinBlock));
+
+    // Local edge offsets and targets shifted into the shared numbering
+    uint32_t edge_base = 0;
+    for (size_t j = 0; j < n; j++) {
+        FunctionGraph& g = graphs[j];
+        for (size_t b = 0; b + 1 < g.succ_offset.size(); b++) g.succ_offset[b] += edge_base;
+        if (!g.succ_offset.empty()) out.put_raw(g.succ_offset.data(), (g.succ_offset.size() - 1) * sizeof(uint32_t));
+        edge_base += (uint32_t)g.succ.size();
+    }
+    out.put_raw(&edge_base, sizeof(edge_base));
+    for (size_t j = 0; j < n; j++) {
+        FunctionGraph& g = graphs[j];
+        for (uint32_t& t : g.succ) t += first_block[j];
+        out.put_raw(g.succ.data(), g.succ.size() * sizeof(uint32_t));
+    }
+    for (size_t j = 0; j < n; j++) {
+        for (const ClosureSite& c : graphs[j].closures) {
+            CfgBinClosure rec;
+            rec.block = first_block[j] + (uint32_t)c.block;
+            rec.pc = (uint32_t)c.pc;
+            rec.function = (uint32_t)c.function;
+            out.put_raw(&rec, sizeof(rec));
+        }
+    }
+    if (!analyzed) return;
+
+    for (size_t j = 0; j < n; j++) put_block_ids(out, graphs[j].idom, first_block[j], -2);
+    for (size_t j = 0; j < n; j++) put_block_ids(out, graphs[j].ipdom, first_block[j], (int)graphs[j].blocks.size());
+    for (size_t j = 0; j < n; j++) put_block_ids(out, graphs[j].loop, first_block[j], -2);
+    for (size_t j = 0; j < n; j++) {
+        for (int d : graphs[j].depth) {
+            uint32_t v = (uint32_t)d;
+            out.put_raw(&v, sizeof(v));
+        }
+    }
+    for (size_t j = 0; j < n; j++) out.put_raw(graphs[j].edge_kind.data(), graphs[j].edge_kind.size());
 }
 
-static void generate_cfg_for_proto(Proto* p) {
-    BlockMap blocks;
-    analyze_cfg(p, blocks);
-    print_cfg_dot(p, blocks);
+// Writes the graphs of p and every function nested in it to out (or one
+// file per function in split_dir). Functions are analyzed in parallel;
+// text is written in pre-order as soon as each function's turn comes.
+static int generate_cfg(Proto* root, Proto* p, CfgFormat format, bool analyze, const char* split_dir, FILE* file) {
+    ProtoList list;
+    collect_protos(p, path_of(root, p), list);
+    size_t n = list.protos.size();
+
+    std::vector<size_t> order(n);
+    for (size_t j = 0; j < n; j++) order[j] = j;
+    std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+        return list.protos[x]->sizecode > list.protos[y]->sizecode;
+    });
+
+    OutputBuffer out(file);
+    if (format == CFG_DOT || format == CFG_BLOCKS) {
+        if (!split_dir) {
+            out.put("digraph CFG {\n");
+            out.put("  compound=true;\n");
+            out.put("  node [shape=box, fontname=\"Courier\"];\n");
+        }
+    } else if (format == CFG_GRAPHML) {
+        out.put("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+                "<key id=\"f\" for=\"node\" attr.name=\"function\" attr.type=\"int\"/>\n"
+                "<key id=\"s\" for=\"node\" attr.name=\"start_pc\" attr.type=\"int\"/>\n"
+                "<key id=\"e\" for=\"node\" attr.name=\"end_pc\" attr.type=\"int\"/>\n"
+                "<key id=\"path\" for=\"node\" attr.name=\"path\" attr.type=\"string\"/>\n");
+        if (analyze) {
+            out.put("<key id=\"idom\" for=\"node\" attr.name=\"idom\" attr.type=\"int\"/>\n"
+                    "<key id=\"ipdom\" for=\"node\" attr.name=\"ipdom\" attr.type=\"int\"/>\n"
+                    "<key id=\"loop\" for=\"node\" attr.name=\"loop\" attr.type=\"int\"/>\n"
+                    "<key id=\"depth\" for=\"node\" attr.name=\"depth\" attr.type=\"int\"/>\n");
+        }
+        out.put("<key id=\"kind\" for=\"edge\" attr.name=\"kind\" attr.type=\"string\"><default>flow</default></key>\n"
+                "<graph id=\"cfg\" edgedefault=\"directed\">\n");
+    }
+
+    // Text finished ahead of its turn waits here; the rest goes straight out
+    std::mutex lock;
+    std::vector<std::string> ready(n), deferred(n);
+    std::vector<unsigned char> done(n, 0), failed(n, 0);
+    std::vector<FunctionGraph> graphs(format == CFG_CSR ? n : 0);
+    size_t next = 0;
+
+    TaskPool::run(order, [&](size_t j) {
+        thread_local FunctionCfg fc;
+        fc.cfg.build(list.protos[j]);
+        find_closures(list, j, fc);
+        if (analyze) analyze_function(fc);
+        if (format == CFG_CSR) {
+            keep_graph(fc, graphs[j]);
+            return;
+        }
+
+        OutputBuffer text, later;
+        if (format == CFG_JSON) render_json(list, j, fc, text);
+        else if (format == CFG_GRAPHML) render_graphml(list, j, fc, text);
+        else render_dot(list, j, fc, format == CFG_DOT, split_dir != NULL, text, later);
+
+        if (split_dir) {
+            std::string name = std::string(split_dir) + "/" + dot_name(list.paths[j]);
+            FILE* f = fopen(name.c_str(), "w");
+            if (!f || fwrite(text.data.data(), 1, text.data.size(), f) != text.data.size()) failed[j] = 1;
+            if (f && fclose(f) != 0) failed[j] = 1;
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        deferred[j].swap(later.data);
+        if (j != next) {
+            ready[j].swap(text.data);
+            done[j] = 1;
+            return;
+        }
+        out.put(text.data);
+        for (next++; next < n && done[next]; next++) {
+            out.put(ready[next]);
+            std::string().swap(ready[next]);
+        }
+    });
+
+    if (split_dir) {
+        int rc = 0;
+        for (size_t j = 0; j < n; j++) {
+            if (!failed[j]) continue;
+            fprintf(stderr, "Cannot write %s/%s\n", split_dir, dot_name(list.paths[j]).c_str());
+            rc = 1;
+        }
+        return rc;
+    }
 
-    for (auto const& [start_pc, bb] : blocks) {
-        delete bb;
+    if (format == CFG_CSR) {
+        write_csr(list, graphs, analyze, out);
+    } else if (format == CFG_DOT || format == CFG_BLOCKS) {
+        for (size_t j = 0; j < n; j++) out.put(deferred[j]);
+        out.put("}\n");
+    } else if (format == CFG_GRAPHML) {
+        out.put("</graph>\n</graphml>\n");
+    }
+    if (!out.flush()) {
+        fprintf(stderr, "Cannot write output\n");
+        return 1;
     }
+    return 0;
 }
 
 int main(int argc, char** argv) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s input.luac\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--func path | --func-line N] [--format dot|blocks|json|graphml|csr]\n"
+                        "          [--analyze] [--split dir | -o output] input.luac\n", argv[0]);
         return 1;
     }
 
-    const char* input_file = argv[1];
+    const char* input_file = NULL;
+    const char* func_path = NULL;
+    int func_line = -1;
+    const char* split_dir = NULL;
+    const char* output_file = NULL;
+    CfgFormat format = CFG_DOT;
+    bool analyze = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--func") == 0) {
+            if (i + 1 < argc) {
+                func_path = argv[++i];
+            } else {
+                fprintf(stderr, "Missing argument for --func\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--func-line") == 0) {
+            if (i + 1 < argc) {
+                func_line = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Missing argument for --func-line\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--split") == 0) {
+            if (i + 1 < argc) {
+                split_dir = argv[++i];
+            } else {
+                fprintf(stderr, "Missing argument for --split\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--format") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing argument for --format\n");
+                return 1;
+            }
+            const char* name = argv[++i];
+            if (strcmp(name, "dot") == 0) format = CFG_DOT;
+            else if (strcmp(name, "blocks") == 0) format = CFG_BLOCKS;
+            else if (strcmp(name, "json") == 0) format = CFG_JSON;
+            else if (strcmp(name, "graphml") == 0) format = CFG_GRAPHML;
+            else if (strcmp(name, "csr") == 0) format = CFG_CSR;
+            else {
+                fprintf(stderr, "Unknown format: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--analyze") == 0) {
+            analyze = true;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 < argc) {
+                output_file = argv[++i];
+            } else {
+                fprintf(stderr, "Missing argument for -o\n");
+                return 1;
+            }
+        } else {
+            input_file = argv[i];
+        }
+    }
+
+    if (!input_file) {
+        fprintf(stderr, "No input file specified\n");
+        return 1;
+    }
+    if (split_dir && format != CFG_DOT && format != CFG_BLOCKS) {
+        fprintf(stderr, "--split only applies to the dot and blocks formats\n");
+        return 1;
+    }
+    if (split_dir && output_file) {
+        fprintf(stderr, "--split cannot be combined with -o\n");
+        return 1;
+    }
 
     lua_State* L = alcc_newstate();
     if (!L) return 1;
@@ -212,10 +752,23 @@ int main(int argc, char** argv) {
 
     StkId o = ALCC_TOP(L) - 1;
     LClosure* cl_obj = clLvalue(s2v(o));
-    Proto* p = cl_obj->p;
-
-    generate_cfg_for_proto(p);
+    Proto* p = alcc_select_proto(cl_obj->p, func_path, func_line);
+    if (!p) return 1;
+
+    FILE* out = stdout;
+    if (output_file) {
+        out = fopen(output_file, "wb");
+        if (!out) {
+            fprintf(stderr, "Cannot write %s\n", output_file);
+            return 1;
+        }
+    }
+    int rc = generate_cfg(cl_obj->p, p, format, analyze, split_dir, out);
+    if (out != stdout && fclose(out) != 0) {
+        fprintf(stderr, "Cannot write %s\n", output_file);
+        rc = 1;
+    }
 
     lua_close(L);
-    return 0;
+    return rc;
 }
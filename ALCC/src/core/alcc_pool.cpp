@@ -0,0 +1,73 @@
+#include "alcc_pool.h"
+#include <stdlib.h>
+#include <deque>
+#include <mutex>
+#ifndef __EMSCRIPTEN__
+#include <thread>
+#endif
+
+int TaskPool::default_threads(void) {
+    const char* env = getenv("ALCC_THREADS");
+    if (env && atoi(env) > 0) return atoi(env);
+#ifdef __EMSCRIPTEN__
+    return 1;
+#else
+    int n = (int)std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+#endif
+}
+
+struct WorkerQueue {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+};
+
+void TaskPool::run(const std::vector<size_t>& order, const std::function<void(size_t)>& task, int threads) {
+    if (threads <= 0) threads = default_threads();
+    if (threads > (int)order.size()) threads = (int)order.size();
+#ifdef __EMSCRIPTEN__
+    threads = 1;
+#endif
+    if (threads <= 1) {
+        for (size_t idx : order) task(idx);
+        return;
+    }
+
+    std::vector<WorkerQueue> queues(threads);
+    for (size_t i = 0; i < order.size(); i++) queues[i % threads].tasks.push_back(order[i]);
+
+#ifndef __EMSCRIPTEN__
+    auto worker = [&](int self) {
+        for (;;) {
+            size_t idx = 0;
+            bool found = false;
+            {
+                std::lock_guard<std::mutex> guard(queues[self].lock);
+                if (!queues[self].tasks.empty()) {
+                    idx = queues[self].tasks.front();
+                    queues[self].tasks.pop_front();
+                    found = true;
+                }
+            }
+            // Steal from the back: those are the smallest tasks of that worker
+            for (int k = 1; !found && k < threads; k++) {
+                WorkerQueue& victim = queues[(self + k) % threads];
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (!victim.tasks.empty()) {
+                    idx = victim.tasks.back();
+                    victim.tasks.pop_back();
+                    found = true;
+                }
+            }
+            // Nothing left anywhere: tasks never spawn new work, so we are done
+            if (!found) return;
+            task(idx);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& th : pool) th.join();
+#endif
+}
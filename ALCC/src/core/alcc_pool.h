@@ -0,0 +1,22 @@
+#ifndef ALCC_POOL_H
+#define ALCC_POOL_H
+
+#include <stddef.h>
+#include <functional>
+#include <vector>
+
+// Work-stealing pool for independent tasks.
+// Tasks are dealt round-robin to per-worker deques in the order given, so
+// callers that sort by size descending get the biggest jobs started first.
+// Idle workers steal from the back of the other deques.
+class TaskPool {
+public:
+    // Number of workers used by run(): ALCC_THREADS if set, else hardware concurrency
+    static int default_threads(void);
+
+    // Runs task(i) for every i in order[], blocking until all are done.
+    // threads <= 0 selects default_threads(). Runs inline with one thread.
+    static void run(const std::vector<size_t>& order, const std::function<void(size_t)>& task, int threads = 0);
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "alcc_strset.h"
+#include <string.h>
+#include <algorithm>
+
+static const char empty_string[1] = "";
+
+StringSet::StringSet(size_t expected) : count(0) {
+    size_t cap = 16;
+    while (cap < expected * 2) cap <<= 1;
+    slots.assign(cap, Slot{NULL, 0, 0});
+}
+
+// FNV-1a
+uint32_t StringSet::hash(std::string_view s) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool StringSet::insert(std::string_view s) {
+    if ((count + 1) * 2 > slots.size()) grow();
+    uint32_t h = hash(s);
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        Slot& slot = slots[i];
+        if (!slot.data) {
+            // A default string_view has no data pointer; keep NULL for empty slots
+            slot.data = s.data() ? s.data() : empty_string;
+            slot.len = (uint32_t)s.size();
+            slot.hash = h;
+            count++;
+            return true;
+        }
+        if (slot.hash == h && slot.len == s.size() && memcmp(slot.data, s.data(), s.size()) == 0) return false;
+    }
+}
+
+bool StringSet::contains(std::string_view s) const {
+    uint32_t h = hash(s);
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        const Slot& slot = slots[i];
+        if (!slot.data) return false;
+        if (slot.hash == h && slot.len == s.size() && memcmp(slot.data, s.data(), s.size()) == 0) return true;
+    }
+}
+
+void StringSet::grow() {
+    std::vector<Slot> old(slots.size() * 2, Slot{NULL, 0, 0});
+    old.swap(slots);
+    size_t mask = slots.size() - 1;
+    for (const Slot& slot : old) {
+        if (!slot.data) continue;
+        size_t i = slot.hash & mask;
+        while (slots[i].data) i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+}
+
+void StringSet::clear() {
+    std::fill(slots.begin(), slots.end(), Slot{NULL, 0, 0});
+    count = 0;
+}
+
+std::vector<std::string_view> StringSet::sorted() const {
+    std::vector<std::string_view> out;
+    out.reserve(count);
+    for (const Slot& slot : slots) {
+        if (slot.data) out.push_back(std::string_view(slot.data, slot.len));
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
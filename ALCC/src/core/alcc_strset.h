@@ -0,0 +1,40 @@
+#ifndef ALCC_STRSET_H
+#define ALCC_STRSET_H
+
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+
+// Set of strings owned elsewhere (e.g. the bytes of Lua TStrings), kept as
+// views without copying. Open addressing with linear probing over a
+// power-of-two table that stays at most half full; each slot caches the
+// hash so probes rarely touch the string bytes.
+class StringSet {
+public:
+    explicit StringSet(size_t expected = 0);
+
+    // True when s was not in the set yet. s must outlive the set.
+    bool insert(std::string_view s);
+    bool contains(std::string_view s) const;
+
+    size_t size() const { return count; }
+    void clear();
+
+    // Members in bytewise order (the order std::set<std::string> used)
+    std::vector<std::string_view> sorted() const;
+
+    static uint32_t hash(std::string_view s);
+
+private:
+    struct Slot {
+        const char* data; // NULL for an empty slot
+        uint32_t len;
+        uint32_t hash;
+    };
+    std::vector<Slot> slots;
+    size_t count;
+
+    void grow();
+};
+
+#endif
@@ -3,6 +3,10 @@
 #include <string.h>
 #include <stdlib.h>
 
+extern "C" {
+#include "lobject.h"
+}
+
 // Default backend
 #ifdef LUA_53
 extern AlccBackend alcc_lua53_backend;
@@ -30,23 +34,23 @@ char* alcc_skip_space(char* s) {
     return s;
 }
 
-void alcc_print_string(const char* s, size_t len) {
-    printf("\"");
+void alcc_print_string(const char* s, size_t len, FILE* out) {
+    fprintf(out, "\"");
     for (size_t i=0; i<len; i++) {
         unsigned char c = (unsigned char)s[i];
-        if (c == '"') printf("\\\"");
-        else if (c == '\\') printf("\\\\");
-        else if (c == '\n') printf("\\n");
-        else if (c == '\r') printf("\\r");
-        else if (c == '\t') printf("\\t");
-        else if (c == '\a') printf("\\a");
-        else if (c == '\b') printf("\\b");
-        else if (c == '\f') printf("\\f");
-        else if (c == '\v') printf("\\v");
-        else if (isprint(c)) printf("%c", c);
-        else printf("\\x%02x", c);
+        if (c == '"') fprintf(out, "\\\"");
+        else if (c == '\\') fprintf(out, "\\\\");
+        else if (c == '\n') fprintf(out, "\\n");
+        else if (c == '\r') fprintf(out, "\\r");
+        else if (c == '\t') fprintf(out, "\\t");
+        else if (c == '\a') fprintf(out, "\\a");
+        else if (c == '\b') fprintf(out, "\\b");
+        else if (c == '\f') fprintf(out, "\\f");
+        else if (c == '\v') fprintf(out, "\\v");
+        else if (isprint(c)) fprintf(out, "%c", c);
+        else fprintf(out, "\\x%02x", c);
     }
-    printf("\"");
+    fprintf(out, "\"");
 }
 
 static int hex_digit(char c) {
@@ -117,3 +121,56 @@ int alcc_writer(lua_State* L, const void* p, size_t sz, void* ud) {
     (void)L;
     return (fwrite(p, sz, 1, (FILE*)ud) != 1) && (sz != 0);
 }
+
+Proto* alcc_select_proto(Proto* root, const char* path, int line) {
+    Proto* p = root;
+    if (path) {
+        const char* s = path;
+        while (*s == '/') s++;
+        while (*s) {
+            char* end;
+            long idx = strtol(s, &end, 10);
+            if (end == s || (*end && *end != '/')) {
+                fprintf(stderr, "Invalid function path: %s\n", path);
+                return NULL;
+            }
+            if (idx < 0 || idx >= p->sizep) {
+                fprintf(stderr, "Function path %s: index %ld out of range (%d nested functions)\n", path, idx, p->sizep);
+                return NULL;
+            }
+            p = p->p[idx];
+            s = end;
+            while (*s == '/') s++;
+        }
+    }
+    if (line >= 0) {
+        Proto* base = p;
+        std::string where = path ? path : "";
+        // Siblings can share a line (`f(function() end, function() end)`), so
+        // a line that more than one child spans is reported, not guessed
+        for (;;) {
+            int found = -1;
+            for (int i = 0; i < p->sizep; i++) {
+                Proto* c = p->p[i];
+                if (c->linedefined > line || line > c->lastlinedefined) continue;
+                if (found >= 0) {
+                    std::string prefix = where.empty() ? "" : where + "/";
+                    fprintf(stderr, "Line %d is ambiguous: functions %s%d and %s%d both span it, use --func\n",
+                            line, prefix.c_str(), found, prefix.c_str(), i);
+                    return NULL;
+                }
+                found = i;
+            }
+            if (found < 0) break;
+            p = p->p[found];
+            if (!where.empty()) where += "/";
+            where += std::to_string(found);
+        }
+        if (p == base && base->linedefined != 0 &&
+            (line < base->linedefined || line > base->lastlinedefined)) {
+            fprintf(stderr, "No function defined at line %d\n", line);
+            return NULL;
+        }
+    }
+    return p;
+}
@@ -20,7 +20,7 @@ lua_State* alcc_newstate(void);
 char* alcc_skip_space(char* s);
 
 // Print a string with escaping for display
-void alcc_print_string(const char* s, size_t len);
+void alcc_print_string(const char* s, size_t len, FILE* out = stdout);
 
 // Parse a quoted string from input buffer into output buffer
 // Returns pointer to character after the closing quote
@@ -29,4 +29,11 @@ char* alcc_parse_string(char* s, std::string& buffer);
 // Generic Lua writer function for lua_dump
 int alcc_writer(lua_State* L, const void* p, size_t sz, void* ud);
 
+// Select the function to process: by index path ("0/12/3" = p[0]->p[12]->p[3]),
+// by source line (innermost function defined around it), or root if neither
+// is given (path NULL, line < 0). Prints an error and returns NULL on failure,
+// including when two functions on the same line both span the line.
+struct Proto;
+Proto* alcc_select_proto(Proto* root, const char* path, int line);
+
 #endif
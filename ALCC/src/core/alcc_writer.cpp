@@ -0,0 +1,54 @@
+#include "alcc_writer.h"
+#include <stdarg.h>
+
+void OutputBuffer::put(const char* s, size_t len) {
+    if (file && data.size() + len >= limit) {
+        flush();
+        // Larger than the buffer: no point copying it first
+        if (len >= limit) {
+            if (!failed && fwrite(s, 1, len, file) != len) failed = true;
+            return;
+        }
+    }
+    data.append(s, len);
+}
+
+void OutputBuffer::put_int(long long v) {
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    unsigned long long u = v < 0 ? 0ull - (unsigned long long)v : (unsigned long long)v;
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0) *--p = '-';
+    put(p, end - p);
+}
+
+void OutputBuffer::printf(const char* fmt, ...) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len < 0) return;
+    if (len < (int)sizeof(buf)) {
+        put(buf, len);
+        return;
+    }
+    std::string big(len + 1, '\0');
+    va_start(ap, fmt);
+    vsnprintf(&big[0], len + 1, fmt, ap);
+    va_end(ap);
+    put(big.data(), len);
+}
+
+bool OutputBuffer::flush() {
+    if (file && !data.empty()) {
+        if (!failed && fwrite(data.data(), 1, data.size(), file) != data.size()) failed = true;
+        data.clear();
+    }
+    if (file && !failed && fflush(file) != 0) failed = true;
+    return !failed;
+}
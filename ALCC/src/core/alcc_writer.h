@@ -0,0 +1,46 @@
+#ifndef ALCC_WRITER_H
+#define ALCC_WRITER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+// Append-only output buffer for large generated text or binary data.
+// Bound to a FILE it writes itself out whenever it reaches the flush limit;
+// without one it only collects (e.g. a worker's share, written later).
+// Write errors are sticky and reported by flush().
+class OutputBuffer {
+public:
+    std::string data;
+
+    explicit OutputBuffer(FILE* f = NULL, size_t limit = 1 << 20) : file(f), limit(limit), failed(false) {
+        if (file) data.reserve(limit);
+    }
+    ~OutputBuffer() { flush(); }
+
+    void put(char c) {
+        data.push_back(c);
+        if (file && data.size() >= limit) flush();
+    }
+    void put(const char* s) { put(s, strlen(s)); }
+    void put(const std::string& s) { put(s.data(), s.size()); }
+    void put(const char* s, size_t len);
+    void put_raw(const void* p, size_t len) { put((const char*)p, len); }
+
+    void put_int(long long v);
+    void printf(const char* fmt, ...)
+#ifdef __GNUC__
+        __attribute__((format(printf, 2, 3)))
+#endif
+        ;
+
+    // Writes out what is buffered; false once any write has failed
+    bool flush();
+
+private:
+    FILE* file;
+    size_t limit;
+    bool failed;
+};
+
+#endif
@@ -27,6 +27,8 @@
   #define OP_SETFIELD -14
   #define OP_RETURN0 -22
   #define OP_RETURN1 -23
+  #define OP_TFORPREP -24
+  #define OP_LFALSESKIP -25
 
   #ifdef LUA_52
     // Missing 5.3 opcodes in 5.2
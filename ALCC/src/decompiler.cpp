@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
 extern "C" {
 #include "lua.h"
@@ -16,12 +17,21 @@ extern "C" {
 #include "alcc_utils.h"
 #include "core/compat.h"
 #include "alcc_backend.h"
-#include "../plugin/alcc_plugin.h"
+#include "../plugin/alcc_plugin_host.h"
 #include "templates/TemplateFactory.h"
 #include "templates/DefaultTemplate.h"
 #include "templates/Template2.h"
+#include "templates/DecompilerCore.h"
+#include "templates/DecompileCache.h"
+#include "ast/ASTBinary.h"
 
-static AlccPlugin* current_plugin = NULL;
+// Each -p appends to the chain; see PluginChain for the hook order
+static void load_plugin(const char* path) {
+    AlccPlugin* plugin = alcc_load_plugin(path);
+    if (!plugin) exit(1);
+    PluginChain::add(plugin);
+    printf("-- Loaded plugin: %s\n", plugin->name);
+}
 
 int main(int argc, char** argv) {
     // Register templates
@@ -30,21 +40,107 @@ int main(int argc, char** argv) {
     TemplateFactory::instance().register_template(&default_tpl);
     TemplateFactory::instance().register_template(&tpl2);
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s [-t template] input.luac\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-t template] [-p plugin.so ...] [--cache file] [--func path | --func-line N] [--timing]\n"
+                        "          [--plugin-stats] [--no-passes] [--budget-ms N] [--budget-nodes N] [--budget-bytes N] [--ast-bin out.bin]\n"
+                        "          [--ndjson ast|source] input.luac\n", argv[0]);
         return 1;
     }
 
     const char* template_name = "default";
     const char* input_file = NULL;
+    const char* cache_file = NULL;
+    const char* func_path = NULL;
+    const char* ast_bin_file = NULL;
+    const char* ndjson_mode = NULL;
+    const char* budget_flag = NULL;
+    std::vector<const char*> plugin_paths;
+    bool template_given = false;
+    int func_line = -1;
+    bool show_timing = false;
+    bool plugin_stats = false;
+    DecompileBudget budget;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-t") == 0) {
             if (i + 1 < argc) {
                 template_name = argv[++i];
+                template_given = true;
             } else {
                 fprintf(stderr, "Missing argument for -t\n");
                 return 1;
             }
+        } else if (strcmp(argv[i], "-p") == 0) {
+            if (i + 1 < argc) {
+                plugin_paths.push_back(argv[++i]);
+            } else {
+                fprintf(stderr, "Missing plugin path\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            if (i + 1 < argc) {
+                cache_file = argv[++i];
+            } else {
+                fprintf(stderr, "Missing argument for --cache\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--func") == 0) {
+            if (i + 1 < argc) {
+                func_path = argv[++i];
+            } else {
+                fprintf(stderr, "Missing argument for --func\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--func-line") == 0) {
+            if (i + 1 < argc) {
+                func_line = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Missing argument for --func-line\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--timing") == 0) {
+            show_timing = true;
+        } else if (strcmp(argv[i], "--plugin-stats") == 0) {
+            plugin_stats = true;
+        } else if (strcmp(argv[i], "--no-passes") == 0) {
+            DecompilerCore::set_passes(false);
+        } else if (strcmp(argv[i], "--budget-ms") == 0) {
+            if (i + 1 < argc) {
+                budget_flag = argv[i];
+                budget.max_ms = atoll(argv[++i]);
+            } else {
+                fprintf(stderr, "Missing argument for --budget-ms\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--budget-nodes") == 0) {
+            if (i + 1 < argc) {
+                budget_flag = argv[i];
+                budget.max_nodes = atoll(argv[++i]);
+            } else {
+                fprintf(stderr, "Missing argument for --budget-nodes\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--budget-bytes") == 0) {
+            if (i + 1 < argc) {
+                budget_flag = argv[i];
+                budget.max_bytes = atoll(argv[++i]);
+            } else {
+                fprintf(stderr, "Missing argument for --budget-bytes\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--ast-bin") == 0) {
+            if (i + 1 < argc) {
+                ast_bin_file = argv[++i];
+            } else {
+                fprintf(stderr, "Missing argument for --ast-bin\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--ndjson") == 0) {
+            if (i + 1 < argc && (strcmp(argv[i + 1], "ast") == 0 || strcmp(argv[i + 1], "source") == 0)) {
+                ndjson_mode = argv[++i];
+            } else {
+                fprintf(stderr, "--ndjson expects ast or source\n");
+                return 1;
+            }
         } else if (strcmp(argv[i], "--list-templates") == 0) {
             printf("Available templates:\n");
             for (const auto& name : TemplateFactory::instance().get_available_templates()) {
@@ -61,6 +157,28 @@ int main(int argc, char** argv) {
         return 1;
     }
 
+    // --ndjson builds each function on its own from the whole chunk, and
+    // --ast-bin writes the tree before anything is printed
+    const char* conflict = NULL;
+    if (ndjson_mode) {
+        if (ast_bin_file) conflict = "--ast-bin";
+        else if (!plugin_paths.empty()) conflict = "-p";
+        else if (func_path) conflict = "--func";
+        else if (func_line >= 0) conflict = "--func-line";
+        else if (budget_flag) conflict = budget_flag;
+        else if (cache_file) conflict = "--cache";
+        else if (template_given) conflict = "-t";
+    }
+    if (conflict) {
+        fprintf(stderr, "--ndjson cannot be combined with %s\n", conflict);
+        return 1;
+    }
+    if (ast_bin_file && budget.max_bytes > 0) {
+        fprintf(stderr, "--budget-bytes limits printed source and cannot be combined with --ast-bin\n");
+        return 1;
+    }
+    for (const char* path : plugin_paths) load_plugin(path);
+
     lua_State* L = alcc_newstate();
     if (!L) return 1;
 
@@ -71,7 +189,14 @@ int main(int argc, char** argv) {
 
     StkId o = ALCC_TOP(L) - 1;
     LClosure* cl_obj = clLvalue(s2v(o));
-    Proto* p = cl_obj->p;
+    Proto* p = alcc_select_proto(cl_obj->p, func_path, func_line);
+    if (!p) return 1;
+
+    PluginChain::set_stats(plugin_stats);
+    AlccPlugin* plugin = PluginChain::plugin();
+    if (plugin && plugin->post_load) {
+        plugin->post_load(L, p);
+    }
 
     AlccTemplate* tmpl = TemplateFactory::instance().get_template(template_name);
     if (!tmpl) {
@@ -82,7 +207,51 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    tmpl->decompile(p, 0, current_plugin);
+    DecompileTimings timings;
+    if (show_timing) DecompilerCore::set_timings(&timings);
+
+    if (budget.enabled()) DecompilerCore::set_budget(&budget);
+
+    DecompileCache cache;
+    if (cache_file) {
+        cache.load(cache_file);
+        DecompilerCore::set_cache(&cache);
+    }
+
+    if (ndjson_mode) {
+        DecompilerCore::stream_ndjson(p, stdout, strcmp(ndjson_mode, "source") == 0);
+    } else if (ast_bin_file) {
+        // Serialize the tree instead of printing it
+        ASTNode* root = DecompilerCore::build_ast(p, plugin);
+        if (plugin && plugin->on_ast_process) plugin->on_ast_process(root);
+        std::string bin;
+        ast_write_binary(root, bin);
+        delete root;
+        FILE* out = fopen(ast_bin_file, "wb");
+        if (!out || fwrite(bin.data(), 1, bin.size(), out) != bin.size()) {
+            fprintf(stderr, "Cannot write %s\n", ast_bin_file);
+            if (out) fclose(out);
+            return 1;
+        }
+        fclose(out);
+    } else {
+        tmpl->decompile(p, 0, plugin);
+    }
+
+    if (cache_file) {
+        DecompilerCore::set_cache(NULL);
+        if (!cache.save(cache_file)) fprintf(stderr, "Cannot write cache: %s\n", cache_file);
+        cache.print_stats(stderr);
+    }
+    if (show_timing) {
+        DecompilerCore::set_timings(NULL);
+        timings.print(stderr);
+    }
+    if (budget.enabled()) {
+        DecompilerCore::set_budget(NULL);
+        budget.print(stderr);
+    }
+    if (plugin_stats) PluginChain::print_stats(stderr);
 
     lua_close(L);
     return 0;
@@ -3,7 +3,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dlfcn.h>
 #include <string>
 
 extern "C" {
@@ -15,38 +14,30 @@ extern "C" {
 }
 #include "alcc_utils.h"
 #include "core/compat.h"
-#include "../plugin/alcc_plugin.h"
+#include "../plugin/alcc_plugin_host.h"
 #include "../templates/TemplateFactory.h"
 #include "../templates/DefaultTemplate.h"
 #include "../templates/Template2.h"
 
-static AlccPlugin* current_plugin = NULL;
-
+// Each -p appends to the chain; see PluginChain for the hook order
 static void load_plugin(const char* path) {
-    void* handle = dlopen(path, RTLD_NOW | RTLD_GLOBAL);
-    if (!handle) {
-        fprintf(stderr, "Error loading plugin %s: %s\n", path, dlerror());
-        exit(1);
-    }
-
-    alcc_plugin_init_fn init = (alcc_plugin_init_fn)dlsym(handle, "alcc_plugin_init");
-    if (!init) {
-        fprintf(stderr, "Plugin %s does not export alcc_plugin_init\n", path);
-        exit(1);
-    }
-
-    current_plugin = init();
-    printf("; Loaded plugin: %s\n", current_plugin->name);
+    AlccPlugin* plugin = alcc_load_plugin(path);
+    if (!plugin) exit(1);
+    PluginChain::add(plugin);
+    printf("; Loaded plugin: %s\n", plugin->name);
 }
 
 int main(int argc, char** argv) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s input.luac [-p plugin.so] [-t template]\n", argv[0]);
+        fprintf(stderr, "Usage: %s input.luac [-p plugin.so ...] [--plugin-stats] [-t template] [--func path | --func-line N]\n", argv[0]);
         return 1;
     }
 
     const char* input_file = NULL;
     std::string template_name = "default";
+    const char* func_path = NULL;
+    int func_line = -1;
+    bool plugin_stats = false;
 
     // Register templates
     // In a real plugin system this might be dynamic, but for now we register built-ins.
@@ -65,6 +56,8 @@ int main(int argc, char** argv) {
                 fprintf(stderr, "Missing plugin path\n");
                 return 1;
             }
+        } else if (strcmp(argv[i], "--plugin-stats") == 0) {
+            plugin_stats = true;
         } else if (strcmp(argv[i], "-t") == 0) {
             if (i+1 < argc) {
                 template_name = argv[i+1];
@@ -73,6 +66,22 @@ int main(int argc, char** argv) {
                 fprintf(stderr, "Missing template name\n");
                 return 1;
             }
+        } else if (strcmp(argv[i], "--func") == 0) {
+            if (i+1 < argc) {
+                func_path = argv[i+1];
+                i++;
+            } else {
+                fprintf(stderr, "Missing function path\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--func-line") == 0) {
+            if (i+1 < argc) {
+                func_line = atoi(argv[i+1]);
+                i++;
+            } else {
+                fprintf(stderr, "Missing line number\n");
+                return 1;
+            }
         } else if (strcmp(argv[i], "--list-templates") == 0) {
             printf("Available templates:\n");
             for (const auto& name : TemplateFactory::instance().get_available_templates()) {
@@ -113,13 +122,17 @@ int main(int argc, char** argv) {
     }
 
     LClosure* cl_obj = clLvalue(s2v(o));
-    Proto* p = cl_obj->p;
+    Proto* p = alcc_select_proto(cl_obj->p, func_path, func_line);
+    if (!p) return 1;
 
-    if (current_plugin && current_plugin->post_load) {
-        current_plugin->post_load(L, p);
+    PluginChain::set_stats(plugin_stats);
+    AlccPlugin* plugin = PluginChain::plugin();
+    if (plugin && plugin->post_load) {
+        plugin->post_load(L, p);
     }
 
-    tpl->disassemble(p, current_plugin);
+    tpl->disassemble(p, plugin);
+    if (plugin_stats) PluginChain::print_stats(stderr);
 
     lua_close(L);
     return 0;
@@ -5,7 +5,8 @@
 #include <string.h>
 #include <vector>
 #include <string>
-#include <set>
+#include <string_view>
+#include <algorithm>
 
 extern "C" {
 #include "lua.h"
@@ -19,116 +20,707 @@ extern "C" {
 #include "alcc_utils.h"
 #include "core/compat.h"
 #include "alcc_backend.h"
+#include "alcc_writer.h"
+#include "alcc_strset.h"
+#include "analysis/CallGraph.h"
+#include "analysis/OpStats.h"
 
 static AlccBackend* current_backend_ptr = NULL;
-static std::vector<Proto*> all_protos;
-static std::set<std::string> all_strings;
-static std::set<std::string> globals_read;
-static std::set<std::string> globals_write;
-
-static void collect_info(Proto* p) {
-    all_protos.push_back(p);
-
-    for (int i = 0; i < p->sizek; i++) {
-        TValue* k = &p->k[i];
-        if (ttisstring(k)) {
-            all_strings.insert(std::string(getstr(tsvalue(k))));
-        }
-    }
-
-    AlccInstruction dec;
-    for (int i = 0; i < p->sizecode; i++) {
-        current_backend_ptr->decode_instruction((uint32_t)p->code[i], &dec);
-
-        // Find global access
-        if (dec.op == OP_GETTABUP) {
-            // b is upvalue, c is key
-            if (dec.b < p->sizeupvalues) {
-                Upvaldesc* u = &p->upvalues[dec.b];
-                if ((u->name && strcmp(getstr(u->name), "_ENV") == 0) || dec.b == 0) { // Fallback to upvalue 0
-                    int c_idx = dec.c;
-                    if (ISK(c_idx)) {
-                        c_idx = INDEXK(c_idx);
-                    }
-                    if (c_idx < p->sizek) {
-                        TValue* k = &p->k[c_idx];
-                        if (ttisstring(k)) {
-                            globals_read.insert(std::string(getstr(tsvalue(k))));
-                        }
-                    }
-                }
+
+// Functions in pre-order, as the recursive walk listed them
+struct ChunkInfo {
+    std::vector<Proto*> protos;
+    std::vector<int> parent; // -1 for the main function
+    std::vector<int> index;  // position in the parent's p[]
+    std::vector<int> depth;  // nesting depth, 0 for the main function
+    StringSet strings;
+    StringSet globals_read;
+    StringSet globals_write;
+};
+
+static std::string_view string_of(TString* ts) {
+    return std::string_view(getstr(ts), tsslen(ts));
+}
+
+// Constant index of an RK operand, -1 when it names a register
+static int constant_operand(int x) {
+#if defined(LUA_53) || defined(LUA_52)
+    return ISK(x) ? INDEXK(x) : -1;
+#else
+    return x;
+#endif
+}
+
+static bool is_env(Proto* p, int up) {
+    if (up >= p->sizeupvalues) return false;
+    TString* name = p->upvalues[up].name;
+    return (name && string_of(name) == "_ENV") || up == 0; // Fallback to upvalue 0
+}
+
+static void add_global(Proto* p, int k, StringSet& set) {
+    if (k >= 0 && k < p->sizek && ttisstring(&p->k[k])) set.insert(string_of(tsvalue(&p->k[k])));
+}
+
+static void list_functions(Proto* root, ChunkInfo& info) {
+    std::vector<std::pair<Proto*, int>> stack(1, {root, -1});
+    std::vector<int> stack_index(1, 0);
+    while (!stack.empty()) {
+        Proto* p = stack.back().first;
+        int parent = stack.back().second;
+        int index = stack_index.back();
+        stack.pop_back();
+        stack_index.pop_back();
+        int self = (int)info.protos.size();
+        info.protos.push_back(p);
+        info.parent.push_back(parent);
+        info.index.push_back(index);
+        info.depth.push_back(parent < 0 ? 0 : info.depth[parent] + 1);
+        for (int i = p->sizep - 1; i >= 0; i--) {
+            stack.push_back({p->p[i], self});
+            stack_index.push_back(i);
+        }
+    }
+}
+
+static void collect_info(Proto* root, ChunkInfo& info) {
+    list_functions(root, info);
+    for (Proto* p : info.protos) {
+        for (int i = 0; i < p->sizek; i++) {
+            if (ttisstring(&p->k[i])) info.strings.insert(string_of(tsvalue(&p->k[i])));
+        }
+
+        AlccInstruction dec;
+        for (int i = 0; i < p->sizecode; i++) {
+            current_backend_ptr->decode_instruction((uint32_t)p->code[i], &dec);
+            // Global access: GETTABUP A B(_ENV) C(key), SETTABUP A(_ENV) B(key) C
+            if (dec.op == OP_GETTABUP) {
+                if (is_env(p, dec.b)) add_global(p, constant_operand(dec.c), info.globals_read);
+            } else if (dec.op == OP_SETTABUP) {
+                if (is_env(p, dec.a)) add_global(p, constant_operand(dec.b), info.globals_write);
             }
-        } else if (dec.op == OP_SETTABUP) {
-            // a is upvalue, b is key
-            if (dec.a < p->sizeupvalues) {
-                Upvaldesc* u = &p->upvalues[dec.a];
-                if ((u->name && strcmp(getstr(u->name), "_ENV") == 0) || dec.a == 0) {
-                    int b_idx = dec.b;
-                    if (ISK(b_idx)) {
-                        b_idx = INDEXK(b_idx);
-                    }
-                    if (b_idx < p->sizek) {
-                        TValue* k = &p->k[b_idx];
-                        if (ttisstring(k)) {
-                            globals_write.insert(std::string(getstr(tsvalue(k))));
-                        }
-                    }
+        }
+    }
+}
+
+static std::string path_of(const ChunkInfo& info, int f) {
+    std::string path;
+    for (; info.parent[f] >= 0; f = info.parent[f]) {
+        std::string step = std::to_string(info.index[f]);
+        path = path.empty() ? step : step + "/" + path;
+    }
+    return path;
+}
+
+static std::string function_label(const CallGraph& cg, int f) {
+    if (f == 0) return "main chunk";
+    Proto* p = cg.functions[f];
+    char lines[64];
+    snprintf(lines, sizeof(lines), " (lines %d-%d)", p->linedefined, p->lastlinedefined);
+    std::string label = "function " + cg.path_of(f) + lines;
+    if (cg.name_of[f] >= 0) label = cg.names[cg.name_of[f]] + ": " + label;
+    return label;
+}
+
+// Quoted for DOT: names come from string constants and may hold anything
+static void put_dot_string(OutputBuffer& out, const std::string& s) {
+    out.put('"');
+    for (char c : s) {
+        if (c == '"' || c == '\\') out.put('\\');
+        if (c == '\n') out.put("\\n");
+        else out.put(c);
+    }
+    out.put('"');
+}
+
+// Bytes >= 0x80 as \u00XX, like the decompiler's NDJSON
+static void put_json_string(OutputBuffer& out, std::string_view s) {
+    out.put('"');
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out.put('\\');
+            out.put((char)c);
+        } else if (c < 0x20 || c >= 0x80) {
+            out.printf("\\u%04x", c);
+        } else {
+            out.put((char)c);
+        }
+    }
+    out.put('"');
+}
+
+// Functions fN, unresolved names xN (one node per name), one edge per
+// distinct caller and callee labelled with the call count when above one
+static void write_callgraph_dot(const CallGraph& cg, OutputBuffer& out) {
+    out.put("digraph CallGraph {\n  node [shape=box];\n");
+    for (int f = 0; f < cg.num_functions(); f++) {
+        out.printf("  f%d [label=", f);
+        put_dot_string(out, function_label(cg, f));
+        out.put("];\n");
+    }
+    std::vector<int> count_f(cg.num_functions(), 0);
+    std::vector<int> count_x(cg.names.size(), 0);
+    std::vector<char> external(cg.names.size(), 0);
+    for (int f = 0; f < cg.num_functions(); f++) {
+        std::vector<int> named;
+        for (const CallGraph::CallSite* s = cg.site_begin(f); s != cg.site_end(f); s++) {
+            if (s->kind == CallGraph::CALLEE_FUNCTION) {
+                count_f[s->callee]++;
+            } else if (s->kind == CallGraph::CALLEE_NAMED) {
+                if (count_x[s->callee]++ == 0) named.push_back(s->callee);
+                if (!external[s->callee]) {
+                    external[s->callee] = 1;
+                    out.printf("  x%d [shape=ellipse, style=dashed, label=", s->callee);
+                    put_dot_string(out, cg.names[s->callee]);
+                    out.put("];\n");
                 }
             }
         }
+        for (const int* c = cg.succ_begin(f); c != cg.succ_end(f); c++) {
+            out.printf("  f%d -> f%d", f, *c);
+            if (count_f[*c] > 1) out.printf(" [label=\"%d\"]", count_f[*c]);
+            out.put(";\n");
+            count_f[*c] = 0;
+        }
+        for (int x : named) {
+            out.printf("  f%d -> x%d", f, x);
+            if (count_x[x] > 1) out.printf(" [label=\"%d\"]", count_x[x]);
+            out.put(";\n");
+            count_x[x] = 0;
+        }
+    }
+    out.put("}\n");
+}
+
+// One object per function and line: {"function":j,"path":..,"name":..,
+// "line":..,"last_line":..,"calls":[[pc,callee,tail],..],"callers":[..]}.
+// callee is a function number, a name string or null; pcs are 1-based.
+static void write_callgraph_json(const CallGraph& cg, OutputBuffer& out) {
+    for (int f = 0; f < cg.num_functions(); f++) {
+        Proto* p = cg.functions[f];
+        out.put("{\"function\":");
+        out.put_int(f);
+        out.put(",\"path\":");
+        put_json_string(out, cg.path_of(f));
+        out.put(",\"name\":");
+        if (cg.name_of[f] >= 0) put_json_string(out, cg.names[cg.name_of[f]]);
+        else out.put("null");
+        out.put(",\"line\":");
+        out.put_int(p->linedefined);
+        out.put(",\"last_line\":");
+        out.put_int(p->lastlinedefined);
+        out.put(",\"calls\":[");
+        for (const CallGraph::CallSite* s = cg.site_begin(f); s != cg.site_end(f); s++) {
+            if (s != cg.site_begin(f)) out.put(',');
+            out.put('[');
+            out.put_int(s->pc + 1);
+            out.put(',');
+            if (s->kind == CallGraph::CALLEE_FUNCTION) out.put_int(s->callee);
+            else if (s->kind == CallGraph::CALLEE_NAMED) put_json_string(out, cg.names[s->callee]);
+            else out.put("null");
+            out.put(s->tail ? ",1]" : ",0]");
+        }
+        out.put("],\"callers\":[");
+        for (const int* c = cg.pred_begin(f); c != cg.pred_end(f); c++) {
+            if (c != cg.pred_begin(f)) out.put(',');
+            out.put_int(*c);
+        }
+        out.put("]}\n");
+    }
+}
+
+static void write_report(const ChunkInfo& info, const CallGraph& cg, OutputBuffer& out) {
+    out.put("=== Functions Window ===\n");
+    for (size_t i = 0; i < info.protos.size(); i++) {
+        Proto* f = info.protos[i];
+        out.printf("  [%zu] %p - lines %d-%d, %d params, %d code bytes\n",
+            i, (void*)f, f->linedefined, f->lastlinedefined, f->numparams, f->sizecode);
+    }
+
+    out.put("\n=== Strings Window ===\n");
+    for (std::string_view str : info.strings.sorted()) {
+        out.put("  \"");
+        out.put(str.data(), str.size());
+        out.put("\"\n");
+    }
+
+    out.put("\n=== Imports (Globals Read) ===\n");
+    for (std::string_view g : info.globals_read.sorted()) {
+        out.put("  ");
+        out.put(g.data(), g.size());
+        out.put('\n');
+    }
+
+    out.put("\n=== Exports (Globals Written) ===\n");
+    for (std::string_view g : info.globals_write.sorted()) {
+        out.put("  ");
+        out.put(g.data(), g.size());
+        out.put('\n');
+    }
+
+    out.put("\n=== Call Graph ===\n");
+    std::vector<int> listed(cg.names.size(), -1);
+    for (int f = 0; f < cg.num_functions(); f++) {
+        if (cg.site_begin(f) == cg.site_end(f)) continue;
+        out.printf("  [%d] ", f);
+        if (f == 0) out.put("main chunk ");
+        else if (cg.name_of[f] >= 0) out.printf("%s ", cg.names[cg.name_of[f]].c_str());
+        out.put("->");
+        const char* sep = " ";
+        for (const int* c = cg.succ_begin(f); c != cg.succ_end(f); c++) {
+            out.printf("%s[%d]", sep, *c);
+            if (cg.name_of[*c] >= 0) out.printf(" %s", cg.names[cg.name_of[*c]].c_str());
+            sep = ", ";
+        }
+        int unknown = 0;
+        for (const CallGraph::CallSite* s = cg.site_begin(f); s != cg.site_end(f); s++) {
+            if (s->kind == CallGraph::CALLEE_NAMED && listed[s->callee] != f) {
+                listed[s->callee] = f;
+                out.printf("%s%s", sep, cg.names[s->callee].c_str());
+                sep = ", ";
+            } else if (s->kind == CallGraph::CALLEE_UNKNOWN) {
+                unknown++;
+            }
+        }
+        if (unknown) out.printf("%s(%d unresolved)", sep, unknown);
+        out.put('\n');
+    }
+}
+
+static void put_json_strings(OutputBuffer& out, const char* key, const StringSet& set) {
+    out.put(",\n\"");
+    out.put(key);
+    out.put("\":[");
+    bool first = true;
+    for (std::string_view s : set.sorted()) {
+        if (!first) out.put(',');
+        first = false;
+        put_json_string(out, s);
+    }
+    out.put(']');
+}
+
+// {"functions":[{..},..],"strings":[..],"globals_read":[..],"globals_written":[..]},
+// one function per line in pre-order, string lists sorted
+static void write_json(const ChunkInfo& info, OutputBuffer& out) {
+    out.put("{\"functions\":[\n");
+    for (size_t i = 0; i < info.protos.size(); i++) {
+        Proto* p = info.protos[i];
+        if (i) out.put(",\n");
+        out.put("{\"function\":");
+        out.put_int((long long)i);
+        out.put(",\"path\":");
+        put_json_string(out, path_of(info, (int)i));
+        out.put(",\"line\":");
+        out.put_int(p->linedefined);
+        out.put(",\"last_line\":");
+        out.put_int(p->lastlinedefined);
+        out.put(",\"params\":");
+        out.put_int(p->numparams);
+        out.put(",\"vararg\":");
+        out.put(isvararg(p) ? "true" : "false");
+        out.put(",\"instructions\":");
+        out.put_int(p->sizecode);
+        out.put(",\"constants\":");
+        out.put_int(p->sizek);
+        out.put(",\"upvalues\":");
+        out.put_int(p->sizeupvalues);
+        out.put(",\"max_stack\":");
+        out.put_int(p->maxstacksize);
+        out.put(",\"functions\":");
+        out.put_int(p->sizep);
+        out.put(",\"depth\":");
+        out.put_int(info.depth[i]);
+        out.put('}');
+    }
+    out.put("]");
+    put_json_strings(out, "strings", info.strings);
+    put_json_strings(out, "globals_read", info.globals_read);
+    put_json_strings(out, "globals_written", info.globals_write);
+    out.put("}\n");
+}
+
+// --opstats: per-function rows streamed as each function is counted, then
+// the chunk totals, and corpus totals when several files were given (JSON
+// always has them: {"files":[{"file":..,"functions":[..],"total":{..}},..],
+// "corpus":{"files":n,..}})
+
+enum OpStatsFormat { OPSTATS_TEXT, OPSTATS_CSV, OPSTATS_JSON };
+
+static void put_bucket(OutputBuffer& out, int b) {
+    if (OpStats::bucket_low(b) == OpStats::bucket_high(b)) out.printf("%u", OpStats::bucket_low(b));
+    else out.printf("%u-%u", OpStats::bucket_low(b), OpStats::bucket_high(b));
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+static void write_opstats_text_total(const OpStats& s, OutputBuffer& out) {
+    out.printf("  %llu functions, %llu instructions, %llu with a constant operand (%.1f%%)\n",
+        (unsigned long long)s.functions, (unsigned long long)s.instructions,
+        (unsigned long long)s.k_total(), percent(s.k_total(), s.instructions));
+
+    std::vector<int> order;
+    for (size_t op = 0; op < s.ops.size(); op++) {
+        if (s.ops[op]) order.push_back((int)op);
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return s.ops[a] != s.ops[b] ? s.ops[a] > s.ops[b] : a < b;
+    });
+    out.printf("\n  %-12s %12s %7s %12s\n", "Opcode", "Count", "%", "K-form");
+    for (int op : order) {
+        out.printf("  %-12s %12llu %6.2f%% %12llu\n", current_backend_ptr->get_op_name(op),
+            (unsigned long long)s.ops[op], percent(s.ops[op], s.instructions), (unsigned long long)s.k_ops[op]);
+    }
+
+    out.printf("\n  Max stack: mean %.1f, max %d\n", s.functions ? (double)s.stack_total / (double)s.functions : 0.0, s.stack_max);
+    for (int b = 0; b < OpStats::BUCKETS; b++) {
+        if (!s.stack[b]) continue;
+        out.put("    ");
+        put_bucket(out, b);
+        out.printf(": %llu\n", (unsigned long long)s.stack[b]);
+    }
+
+    out.printf("\n  Jumps: %llu\n", (unsigned long long)s.jump_count());
+    if (s.jump_count()) out.printf("    %-12s %12s %12s\n", "Distance", "Forward", "Backward");
+    for (int b = 0; b < OpStats::BUCKETS; b++) {
+        if (!s.jumps_forward[b] && !s.jumps_backward[b]) continue;
+        char range[32];
+        if (OpStats::bucket_low(b) == OpStats::bucket_high(b)) snprintf(range, sizeof(range), "%u", OpStats::bucket_low(b));
+        else snprintf(range, sizeof(range), "%u-%u", OpStats::bucket_low(b), OpStats::bucket_high(b));
+        out.printf("    %-12s %12llu %12llu\n", range,
+            (unsigned long long)s.jumps_forward[b], (unsigned long long)s.jumps_backward[b]);
+    }
+}
+
+static void put_csv_field(OutputBuffer& out, std::string_view s) {
+    if (s.find_first_of(",\"\r\n") == std::string_view::npos) {
+        out.put(s.data(), s.size());
+        return;
+    }
+    out.put('"');
+    for (char c : s) {
+        if (c == '"') out.put('"');
+        out.put(c);
+    }
+    out.put('"');
+}
+
+static void write_opstats_csv_header(OutputBuffer& out) {
+    out.put("file,function,path,line,last_line,instructions,max_stack,k_form,jumps_forward,jumps_backward");
+    int count = current_backend_ptr->get_op_count();
+    for (int op = 0; op < count; op++) {
+        out.put(',');
+        out.put(current_backend_ptr->get_op_name(op));
+    }
+    out.put('\n');
+}
+
+// Function rows carry the function number, path and lines; total rows have
+// "total" in the function column and the largest max_stack
+static void write_opstats_csv_row(OutputBuffer& out, const char* file, const OpStats& s,
+                                  int function, const std::string& path, Proto* p) {
+    put_csv_field(out, file);
+    out.put(',');
+    if (p) {
+        out.put_int(function);
+        out.put(',');
+        put_csv_field(out, path);
+        out.printf(",%d,%d,", p->linedefined, p->lastlinedefined);
+    } else {
+        out.put("total,,,,");
+    }
+    uint64_t forward = 0, backward = 0;
+    for (int b = 0; b < OpStats::BUCKETS; b++) {
+        forward += s.jumps_forward[b];
+        backward += s.jumps_backward[b];
+    }
+    out.printf("%llu,%d,%llu,%llu,%llu", (unsigned long long)s.instructions, s.stack_max,
+        (unsigned long long)s.k_total(), (unsigned long long)forward, (unsigned long long)backward);
+    int count = current_backend_ptr->get_op_count();
+    for (int op = 0; op < count; op++) {
+        out.put(',');
+        out.put_int((long long)s.ops[op]);
+    }
+    out.put('\n');
+}
+
+static void put_json_buckets(OutputBuffer& out, const char* key, const uint64_t* counts) {
+    out.put(",\"");
+    out.put(key);
+    out.put("\":[");
+    bool first = true;
+    for (int b = 0; b < OpStats::BUCKETS; b++) {
+        if (!counts[b]) continue;
+        if (!first) out.put(',');
+        first = false;
+        out.printf("[%u,%u,", OpStats::bucket_low(b), OpStats::bucket_high(b));
+        out.put_int((long long)counts[b]);
+        out.put(']');
+    }
+    out.put(']');
+}
+
+// "instructions","k_form","max_stack","ops":{"NAME":[count,k_form],..} and
+// jump buckets as [low,high,count]; totals add "functions", the mean stack
+// size and the stack buckets
+static void put_opstats_json(OutputBuffer& out, const OpStats& s, bool total) {
+    if (total) {
+        out.put("\"functions\":");
+        out.put_int((long long)s.functions);
+        out.put(',');
+    }
+    out.put("\"instructions\":");
+    out.put_int((long long)s.instructions);
+    out.put(",\"k_form\":");
+    out.put_int((long long)s.k_total());
+    out.put(",\"max_stack\":");
+    out.put_int(s.stack_max);
+    if (total) {
+        out.printf(",\"mean_stack\":%.2f", s.functions ? (double)s.stack_total / (double)s.functions : 0.0);
+        put_json_buckets(out, "stack", s.stack);
+    }
+    out.put(",\"ops\":{");
+    bool first = true;
+    for (size_t op = 0; op < s.ops.size(); op++) {
+        if (!s.ops[op]) continue;
+        if (!first) out.put(',');
+        first = false;
+        out.printf("\"%s\":[", current_backend_ptr->get_op_name((int)op));
+        out.put_int((long long)s.ops[op]);
+        out.put(',');
+        out.put_int((long long)s.k_ops[op]);
+        out.put(']');
+    }
+    out.put('}');
+    put_json_buckets(out, "jumps_forward", s.jumps_forward);
+    put_json_buckets(out, "jumps_backward", s.jumps_backward);
+}
+
+static void write_opstats_file(const char* file, const ChunkInfo& info, OpStatsFormat format,
+                               OpStats& total, OutputBuffer& out) {
+    OpStats fn;
+    if (format == OPSTATS_TEXT) {
+        out.printf("=== Opcode Stats: %s ===\n", file);
+    } else if (format == OPSTATS_JSON) {
+        out.put("{\"file\":");
+        put_json_string(out, file);
+        out.put(",\"functions\":[");
+    }
+    for (size_t i = 0; i < info.protos.size(); i++) {
+        Proto* p = info.protos[i];
+        fn.clear();
+        fn.add_function(p);
+        total.add(fn);
+        if (format == OPSTATS_TEXT) {
+            out.printf("  [%zu] ", i);
+            if (i == 0) out.put("main chunk");
+            else out.printf("function %s (lines %d-%d)", path_of(info, (int)i).c_str(), p->linedefined, p->lastlinedefined);
+            out.printf(": %llu instructions, %llu K-form, stack %d, jumps %llu\n",
+                (unsigned long long)fn.instructions, (unsigned long long)fn.k_total(),
+                fn.stack_max, (unsigned long long)fn.jump_count());
+        } else if (format == OPSTATS_CSV) {
+            write_opstats_csv_row(out, file, fn, (int)i, path_of(info, (int)i), p);
+        } else {
+            if (i) out.put(',');
+            out.put("\n{\"function\":");
+            out.put_int((long long)i);
+            out.put(",\"path\":");
+            put_json_string(out, path_of(info, (int)i));
+            out.put(",\"line\":");
+            out.put_int(p->linedefined);
+            out.put(',');
+            put_opstats_json(out, fn, false);
+            out.put('}');
+        }
+    }
+    if (format == OPSTATS_TEXT) {
+        out.put('\n');
+        write_opstats_text_total(total, out);
+        out.put('\n');
+    } else if (format == OPSTATS_CSV) {
+        write_opstats_csv_row(out, file, total, 0, std::string(), NULL);
+    } else {
+        out.put("],\n\"total\":{");
+        put_opstats_json(out, total, true);
+        out.put("}}");
     }
+}
 
-    for (int i = 0; i < p->sizep; i++) {
-        collect_info(p->p[i]);
+// Files that fail to load are reported and skipped; the result is 1 then
+static int run_opstats(lua_State* L, const std::vector<std::string>& inputs, OpStatsFormat format, OutputBuffer& out) {
+    int rc = 0;
+    int loaded = 0;
+    OpStats corpus;
+    if (format == OPSTATS_CSV) write_opstats_csv_header(out);
+    else if (format == OPSTATS_JSON) out.put("{\"files\":[\n");
+    for (const std::string& input : inputs) {
+        if (luaL_loadfile(L, input.c_str()) != LUA_OK) {
+            fprintf(stderr, "Error loading file %s: %s\n", input.c_str(), lua_tostring(L, -1));
+            lua_settop(L, 0);
+            rc = 1;
+            continue;
+        }
+        Proto* p = clLvalue(s2v(ALCC_TOP(L) - 1))->p;
+        ChunkInfo info;
+        list_functions(p, info);
+        if (format == OPSTATS_JSON && loaded) out.put(",\n");
+        OpStats total;
+        write_opstats_file(input.c_str(), info, format, total, out);
+        corpus.add(total);
+        loaded++;
+        lua_settop(L, 0);
     }
+    if (format == OPSTATS_JSON) {
+        out.put("],\n\"corpus\":{\"files\":");
+        out.put_int(loaded);
+        out.put(',');
+        put_opstats_json(out, corpus, true);
+        out.put("}}\n");
+        return rc;
+    }
+    if (inputs.size() < 2) return rc;
+
+    if (format == OPSTATS_TEXT) {
+        out.printf("=== Corpus: %d files ===\n", loaded);
+        write_opstats_text_total(corpus, out);
+    } else {
+        write_opstats_csv_row(out, "*", corpus, 0, std::string(), NULL);
+    }
+    return rc;
+}
+
+// One path per line; blank lines are skipped
+static bool read_batch(const char* list_file, std::vector<std::string>& inputs) {
+    FILE* f = fopen(list_file, "r");
+    if (!f) return false;
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        size_t len = strlen(line);
+        while (len && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = 0;
+        if (len) inputs.push_back(line);
+    }
+    fclose(f);
+    return true;
 }
 
 int main(int argc, char** argv) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s input.luac\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--json | --callgraph dot|json] [-o output] input.luac\n", argv[0]);
+        fprintf(stderr, "       %s --opstats text|csv|json [--batch list] [-o output] [input.luac...]\n", argv[0]);
         return 1;
     }
 
     current_backend_ptr = current_backend;
 
-    const char* input_file = argv[1];
+    std::vector<std::string> inputs;
+    const char* callgraph_format = NULL;
+    const char* opstats_format = NULL;
+    const char* output_file = NULL;
+    bool json = false;
 
-    lua_State* L = alcc_newstate();
-    if (!L) return 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--callgraph") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing argument for --callgraph\n");
+                return 1;
+            }
+            callgraph_format = argv[++i];
+            if (strcmp(callgraph_format, "dot") != 0 && strcmp(callgraph_format, "json") != 0) {
+                fprintf(stderr, "Unknown format: %s\n", callgraph_format);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--opstats") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing argument for --opstats\n");
+                return 1;
+            }
+            opstats_format = argv[++i];
+            if (strcmp(opstats_format, "text") != 0 && strcmp(opstats_format, "csv") != 0 && strcmp(opstats_format, "json") != 0) {
+                fprintf(stderr, "Unknown format: %s\n", opstats_format);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing argument for --batch\n");
+                return 1;
+            }
+            if (!read_batch(argv[++i], inputs)) {
+                fprintf(stderr, "Cannot read %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 < argc) {
+                output_file = argv[++i];
+            } else {
+                fprintf(stderr, "Missing argument for -o\n");
+                return 1;
+            }
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
 
-    if (luaL_loadfile(L, input_file) != LUA_OK) {
-        fprintf(stderr, "Error loading file: %s\n", lua_tostring(L, -1));
+    if (inputs.empty()) {
+        fprintf(stderr, "No input file specified\n");
         return 1;
     }
-
-    StkId o = ALCC_TOP(L) - 1;
-    LClosure* cl_obj = clLvalue(s2v(o));
-    Proto* p = cl_obj->p;
-
-    collect_info(p);
-
-    printf("=== Functions Window ===\n");
-    for (size_t i = 0; i < all_protos.size(); i++) {
-        Proto* f = all_protos[i];
-        printf("  [%zu] %p - lines %d-%d, %d params, %d code bytes\n",
-            i, f, f->linedefined, f->lastlinedefined, f->numparams, f->sizecode);
+    if (inputs.size() > 1 && !opstats_format) {
+        fprintf(stderr, "Only --opstats accepts several input files\n");
+        return 1;
     }
 
-    printf("\n=== Strings Window ===\n");
-    for (const auto& str : all_strings) {
-        printf("  \"%s\"\n", str.c_str());
+    lua_State* L = alcc_newstate();
+    if (!L) return 1;
+
+    Proto* p = NULL;
+    if (!opstats_format) {
+        if (luaL_loadfile(L, inputs[0].c_str()) != LUA_OK) {
+            fprintf(stderr, "Error loading file: %s\n", lua_tostring(L, -1));
+            return 1;
+        }
+        StkId o = ALCC_TOP(L) - 1;
+        LClosure* cl_obj = clLvalue(s2v(o));
+        p = cl_obj->p;
     }
 
-    printf("\n=== Imports (Globals Read) ===\n");
-    for (const auto& g : globals_read) {
-        printf("  %s\n", g.c_str());
+    FILE* out = stdout;
+    if (output_file) {
+        out = fopen(output_file, "wb");
+        if (!out) {
+            fprintf(stderr, "Cannot write %s\n", output_file);
+            return 1;
+        }
     }
 
-    printf("\n=== Exports (Globals Written) ===\n");
-    for (const auto& g : globals_write) {
-        printf("  %s\n", g.c_str());
+    int rc = 0;
+    bool load_failed = false;
+    {
+        OutputBuffer buf(out);
+        ChunkInfo info;
+        CallGraph cg;
+        if (opstats_format) {
+            OpStatsFormat format = strcmp(opstats_format, "csv") == 0 ? OPSTATS_CSV
+                                 : strcmp(opstats_format, "json") == 0 ? OPSTATS_JSON : OPSTATS_TEXT;
+            load_failed = run_opstats(L, inputs, format, buf) != 0;
+        } else {
+            if (callgraph_format || !json) cg.build(p);
+            if (callgraph_format) {
+                if (strcmp(callgraph_format, "dot") == 0) write_callgraph_dot(cg, buf);
+                else write_callgraph_json(cg, buf);
+            } else {
+                collect_info(p, info);
+                if (json) write_json(info, buf);
+                else write_report(info, cg, buf);
+            }
+        }
+        if (!buf.flush()) rc = 1;
     }
+    if (out != stdout && fclose(out) != 0) rc = 1;
+    if (rc) fprintf(stderr, "Cannot write output\n");
 
     lua_close(L);
-    return 0;
+    return rc || load_failed;
 }
@@ -2,11 +2,18 @@
 #define ALCC_PLUGIN_H
 
 #include <stdio.h>
+#include <stdint.h>
 
 extern "C" {
 #include "lua.h"
 #include "lobject.h" // For Proto
 }
+#include "../core/alcc_backend.h" // For AlccInstruction
+
+// Plugins that fill the fields after on_ast_process export
+//   extern "C" int alcc_plugin_api(void) { return ALCC_PLUGIN_API_VERSION; }
+// Without it a plugin is API 1 and only the fields up to on_ast_process are read.
+#define ALCC_PLUGIN_API_VERSION 3
 
 typedef struct {
     FILE* f;
@@ -14,6 +21,34 @@ typedef struct {
     char buffer[4096];
 } ParseCtx;
 
+// Register liveness of one function as computed by the decompiler.
+// A register set is 4 x 64-bit words; bit r of the set is register r.
+typedef struct {
+    int num_blocks;
+    const int* blocks;        // 2 ints per basic block: first pc, last pc
+    const uint64_t* live_in;  // 4 words per block: registers live on entry
+    const uint64_t* live_out; // 4 words per block: registers live on exit
+} AlccLiveness;
+
+// Append-only text sink. reserve() returns room for at least n bytes,
+// valid until the next call on the sink; commit() appends the first n of
+// them. Text has no length limit and is not copied again by the plugin.
+typedef struct AlccOutput {
+    void* ctx;
+    char* (*reserve)(struct AlccOutput* o, size_t n);
+    void (*commit)(struct AlccOutput* o, size_t n);
+} AlccOutput;
+
+// Sparse pc -> text table of instructions whose listing a plugin replaces.
+// set() copies the text; open() starts an empty text for pc and returns the
+// sink to write it into, valid until the next set() or open(). A later
+// entry for the same pc replaces the earlier one.
+typedef struct AlccOverrides {
+    void* ctx;
+    void (*set)(struct AlccOverrides* o, int pc, const char* text, size_t len);
+    AlccOutput* (*open)(struct AlccOverrides* o, int pc);
+} AlccOverrides;
+
 typedef struct {
     const char* name;
     // Called after bytecode is loaded but before processing
@@ -33,8 +68,22 @@ typedef struct {
 
     // Called after AST is built, before printing. root is ASTNode*.
     void (*on_ast_process)(void* root);
+
+    // API 2
+
+    // Called once per decompiled function with its register liveness.
+    // The data is only valid during the call.
+    void (*on_liveness)(Proto* p, const AlccLiveness* live);
+
+    // API 3
+
+    // Called once per listed function (disassembly, and decompiler fallback
+    // listings) with every instruction decoded: code[pc] for pc < count.
+    // Takes the place of on_instruction, which is then not called.
+    void (*on_code)(Proto* p, const AlccInstruction* code, int count, AlccOverrides* out);
 } AlccPlugin;
 
 typedef AlccPlugin* (*alcc_plugin_init_fn)(void);
+typedef int (*alcc_plugin_api_fn)(void);
 
 #endif
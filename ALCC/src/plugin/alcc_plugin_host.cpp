@@ -0,0 +1,339 @@
+#include "alcc_plugin_host.h"
+#include "../core/alcc_utils.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <algorithm>
+#include <chrono>
+
+AlccPlugin* alcc_load_plugin(const char* path) {
+    void* handle = dlopen(path, RTLD_NOW | RTLD_GLOBAL);
+    if (!handle) {
+        fprintf(stderr, "Error loading plugin %s: %s\n", path, dlerror());
+        return NULL;
+    }
+
+    alcc_plugin_init_fn init = (alcc_plugin_init_fn)dlsym(handle, "alcc_plugin_init");
+    if (!init) {
+        fprintf(stderr, "Plugin %s does not export alcc_plugin_init\n", path);
+        return NULL;
+    }
+    alcc_plugin_api_fn api_fn = (alcc_plugin_api_fn)dlsym(handle, "alcc_plugin_api");
+    int api = api_fn ? api_fn() : 1;
+
+    AlccPlugin* plugin = init();
+    if (!plugin) {
+        fprintf(stderr, "Plugin %s failed to initialize\n", path);
+        return NULL;
+    }
+    // Older plugins' structs end where the next API version's fields begin
+    size_t size = api >= 3 ? sizeof(AlccPlugin)
+                : api == 2 ? offsetof(AlccPlugin, on_code)
+                : offsetof(AlccPlugin, on_liveness);
+    AlccPlugin* copy = new AlccPlugin();
+    memcpy(copy, plugin, size);
+    return copy;
+}
+
+enum Hook {
+    HOOK_POST_LOAD, HOOK_ON_INSTRUCTION, HOOK_ON_DISASM_HEADER, HOOK_ON_ASM_LINE,
+    HOOK_ON_DECOMPILE_INST, HOOK_ON_AST_PROCESS, HOOK_ON_LIVENESS, HOOK_ON_CODE,
+    HOOK_COUNT
+};
+
+static const char* const hook_names[HOOK_COUNT] = {
+    "post_load", "on_instruction", "on_disasm_header", "on_asm_line",
+    "on_decompile_inst", "on_ast_process", "on_liveness", "on_code"
+};
+
+struct ChainMember {
+    AlccPlugin* plugin;
+    uint64_t calls[HOOK_COUNT];
+    uint64_t ns[HOOK_COUNT];
+};
+
+static std::vector<ChainMember> chain;
+static AlccPlugin chain_plugin;
+static bool chain_timed = false;
+
+// Counts one call of a hook (or none, for callers counting themselves) and
+// times the scope when stats are enabled
+class HookTimer {
+public:
+    HookTimer(ChainMember& m, Hook hook, uint64_t calls = 1) : ns(m.ns[hook]) {
+        m.calls[hook] += calls;
+        if (chain_timed) start = std::chrono::steady_clock::now();
+    }
+    ~HookTimer() {
+        if (chain_timed) {
+            ns += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+private:
+    uint64_t& ns;
+    std::chrono::steady_clock::time_point start;
+};
+
+static void chain_post_load(lua_State* L, Proto* p) {
+    for (ChainMember& m : chain) {
+        if (!m.plugin->post_load) continue;
+        HookTimer t(m, HOOK_POST_LOAD);
+        m.plugin->post_load(L, p);
+    }
+}
+
+static int chain_on_instruction(Proto* p, int pc, char* out_buffer, size_t buffer_size) {
+    for (ChainMember& m : chain) {
+        if (!m.plugin->on_instruction) continue;
+        HookTimer t(m, HOOK_ON_INSTRUCTION);
+        if (m.plugin->on_instruction(p, pc, out_buffer, buffer_size)) return 1;
+    }
+    return 0;
+}
+
+static void chain_on_disasm_header(Proto* p) {
+    for (ChainMember& m : chain) {
+        if (!m.plugin->on_disasm_header) continue;
+        HookTimer t(m, HOOK_ON_DISASM_HEADER);
+        m.plugin->on_disasm_header(p);
+    }
+}
+
+static void chain_on_asm_line(ParseCtx* ctx, char* line) {
+    for (ChainMember& m : chain) {
+        if (!m.plugin->on_asm_line) continue;
+        HookTimer t(m, HOOK_ON_ASM_LINE);
+        m.plugin->on_asm_line(ctx, line);
+    }
+}
+
+static int chain_on_decompile_inst(Proto* p, int pc, char* out_buffer, size_t buffer_size) {
+    for (ChainMember& m : chain) {
+        if (!m.plugin->on_decompile_inst) continue;
+        HookTimer t(m, HOOK_ON_DECOMPILE_INST);
+        if (m.plugin->on_decompile_inst(p, pc, out_buffer, buffer_size)) return 1;
+    }
+    return 0;
+}
+
+static void chain_on_ast_process(void* root) {
+    for (ChainMember& m : chain) {
+        if (!m.plugin->on_ast_process) continue;
+        HookTimer t(m, HOOK_ON_AST_PROCESS);
+        m.plugin->on_ast_process(root);
+    }
+}
+
+static void chain_on_liveness(Proto* p, const AlccLiveness* live) {
+    for (ChainMember& m : chain) {
+        if (!m.plugin->on_liveness) continue;
+        HookTimer t(m, HOOK_ON_LIVENESS);
+        m.plugin->on_liveness(p, live);
+    }
+}
+
+// The table each plugin's on_code writes into: entries for a pc another
+// plugin has set already are dropped before they reach the real one
+struct ChainOverrides {
+    AlccOverrides filter;
+    AlccOverrides* out;
+    std::vector<int> owner; // per pc: chain index of the plugin that set it, -1 if none
+    int current;
+    AlccOutput discard;
+    std::vector<char> scratch;
+};
+static ChainOverrides chain_out;
+
+static bool claim(ChainOverrides* c, int pc) {
+    // Out of range pcs go through; the table drops them
+    if (pc < 0 || pc >= (int)c->owner.size()) return true;
+    if (c->owner[pc] >= 0 && c->owner[pc] != c->current) return false;
+    c->owner[pc] = c->current;
+    return true;
+}
+
+static void chain_set(AlccOverrides* o, int pc, const char* text, size_t len) {
+    ChainOverrides* c = (ChainOverrides*)o->ctx;
+    if (claim(c, pc)) c->out->set(c->out, pc, text, len);
+}
+
+static AlccOutput* chain_open(AlccOverrides* o, int pc) {
+    ChainOverrides* c = (ChainOverrides*)o->ctx;
+    if (claim(c, pc)) return c->out->open(c->out, pc);
+    return &c->discard;
+}
+
+static char* discard_reserve(AlccOutput* o, size_t n) {
+    ChainOverrides* c = (ChainOverrides*)o->ctx;
+    if (c->scratch.size() < n) c->scratch.resize(n);
+    return c->scratch.data();
+}
+
+static void discard_commit(AlccOutput* o, size_t n) {
+    (void)o;
+    (void)n;
+}
+
+static void chain_on_code(Proto* p, const AlccInstruction* code, int count, AlccOverrides* out) {
+    ChainOverrides& c = chain_out;
+    c.filter = {&c, chain_set, chain_open};
+    c.discard = {&c, discard_reserve, discard_commit};
+    c.out = out;
+    c.owner.assign(count, -1);
+    for (size_t i = 0; i < chain.size(); i++) {
+        ChainMember& m = chain[i];
+        c.current = (int)i;
+        if (m.plugin->on_code) {
+            HookTimer t(m, HOOK_ON_CODE);
+            m.plugin->on_code(p, code, count, &c.filter);
+        } else if (m.plugin->on_instruction) {
+            // Next to on_code plugins a plugin without on_code is asked for every
+            // free pc here, before the listing is printed
+            HookTimer t(m, HOOK_ON_INSTRUCTION, 0);
+            char buffer[4096];
+            for (int pc = 0; pc < count; pc++) {
+                if (c.owner[pc] >= 0) continue;
+                m.calls[HOOK_ON_INSTRUCTION]++;
+                if (!m.plugin->on_instruction(p, pc, buffer, sizeof(buffer))) continue;
+                c.owner[pc] = c.current;
+                out->set(out, pc, buffer, strlen(buffer));
+            }
+        }
+    }
+}
+
+void PluginChain::add(AlccPlugin* plugin) {
+    ChainMember m;
+    memset(&m, 0, sizeof(m));
+    m.plugin = plugin;
+    chain.push_back(m);
+
+    // A chain hook only where some plugin has the hook, so the tools' tests
+    // for one (the decompiler skips its cache for on_ast_process) still hold
+    AlccPlugin& c = chain_plugin;
+    c.name = chain.size() == 1 ? plugin->name : "plugin chain";
+    if (plugin->post_load) c.post_load = chain_post_load;
+    if (plugin->on_instruction) c.on_instruction = chain_on_instruction;
+    if (plugin->on_disasm_header) c.on_disasm_header = chain_on_disasm_header;
+    if (plugin->on_asm_line) c.on_asm_line = chain_on_asm_line;
+    if (plugin->on_decompile_inst) c.on_decompile_inst = chain_on_decompile_inst;
+    if (plugin->on_ast_process) c.on_ast_process = chain_on_ast_process;
+    if (plugin->on_liveness) c.on_liveness = chain_on_liveness;
+    if (plugin->on_code) c.on_code = chain_on_code;
+}
+
+AlccPlugin* PluginChain::plugin() {
+    return chain.empty() ? NULL : &chain_plugin;
+}
+
+void PluginChain::set_stats(bool enabled) {
+    chain_timed = enabled;
+}
+
+void PluginChain::print_stats(FILE* f) {
+    struct Row {
+        size_t member;
+        int hook;
+    };
+    std::vector<Row> rows;
+    uint64_t calls = 0, ns = 0;
+    for (size_t i = 0; i < chain.size(); i++) {
+        for (int h = 0; h < HOOK_COUNT; h++) {
+            if (!chain[i].calls[h]) continue;
+            rows.push_back(Row{i, h});
+            calls += chain[i].calls[h];
+            ns += chain[i].ns[h];
+        }
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+        return chain[a.member].ns[a.hook] > chain[b.member].ns[b.hook];
+    });
+
+    fprintf(f, "Plugin hooks (%zu plugins): %llu calls, %.3f ms\n", chain.size(), (unsigned long long)calls, ns / 1e6);
+    fprintf(f, "  %-2s %-24s %-18s %12s %12s %10s\n", "#", "plugin", "hook", "calls", "total ms", "us/call");
+    for (const Row& r : rows) {
+        const ChainMember& m = chain[r.member];
+        fprintf(f, "  %-2zu %-24s %-18s %12llu %12.3f %10.3f\n", r.member + 1, m.plugin->name ? m.plugin->name : "?",
+                hook_names[r.hook], (unsigned long long)m.calls[r.hook], m.ns[r.hook] / 1e6,
+                m.ns[r.hook] / 1e3 / m.calls[r.hook]);
+    }
+}
+
+AlccOutput* PluginOverrides::open(AlccOverrides* o, int pc) {
+    PluginOverrides* self = (PluginOverrides*)o->ctx;
+    self->entries.push_back(Entry{pc, self->text_used, 0});
+    return &self->sink;
+}
+
+char* PluginOverrides::reserve(AlccOutput* o, size_t n) {
+    PluginOverrides* self = (PluginOverrides*)o->ctx;
+    if (self->text.size() - self->text_used < n) {
+        self->text.resize(std::max(self->text.size() * 2, self->text_used + n));
+    }
+    return self->text.data() + self->text_used;
+}
+
+void PluginOverrides::commit(AlccOutput* o, size_t n) {
+    PluginOverrides* self = (PluginOverrides*)o->ctx;
+    self->text_used += n;
+    self->entries.back().len += n;
+}
+
+void PluginOverrides::set(AlccOverrides* o, int pc, const char* s, size_t len) {
+    AlccOutput* out = open(o, pc);
+    memcpy(reserve(out, len), s, len);
+    commit(out, len);
+}
+
+void PluginOverrides::clear() {
+    entries.clear();
+    text_used = 0;
+    cursor = 0;
+    legacy = NULL;
+    proto = NULL;
+}
+
+void PluginOverrides::collect(AlccPlugin* plugin, Proto* p) {
+    clear();
+    decoded.resize(p->sizecode);
+    for (int pc = 0; pc < p->sizecode; pc++) {
+        current_backend->decode_instruction((uint32_t)p->code[pc], &decoded[pc]);
+    }
+    if (!plugin) return;
+
+    if (plugin->on_code) {
+        AlccOverrides out = {this, set, open};
+        plugin->on_code(p, decoded.data(), p->sizecode, &out);
+        // Sorted by pc (plugins usually set them in order already); of
+        // several entries for one pc the last one counts
+        auto by_pc = [](const Entry& a, const Entry& b) { return a.pc < b.pc; };
+        if (!std::is_sorted(entries.begin(), entries.end(), by_pc)) std::stable_sort(entries.begin(), entries.end(), by_pc);
+        size_t kept = 0;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].pc < 0 || entries[i].pc >= p->sizecode) continue;
+            if (kept && entries[kept - 1].pc == entries[i].pc) entries[kept - 1] = entries[i];
+            else entries[kept++] = entries[i];
+        }
+        entries.resize(kept);
+    } else if (plugin->on_instruction) {
+        // API 1: on_instruction is still called per pc from find(), as the
+        // listing is printed
+        legacy = plugin;
+        proto = p;
+    }
+}
+
+const char* PluginOverrides::find(int pc, size_t* len) {
+    if (legacy) {
+        if (!legacy->on_instruction(proto, pc, buffer, sizeof(buffer))) return NULL;
+        *len = strlen(buffer);
+        return buffer;
+    }
+    while (cursor < entries.size() && entries[cursor].pc < pc) cursor++;
+    if (cursor == entries.size() || entries[cursor].pc != pc) return NULL;
+    *len = entries[cursor].len;
+    return text.data() + entries[cursor].offset;
+}
@@ -0,0 +1,77 @@
+#ifndef ALCC_PLUGIN_HOST_H
+#define ALCC_PLUGIN_HOST_H
+
+#include "alcc_plugin.h"
+#include <stdint.h>
+#include <vector>
+
+// Loads a plugin shared object. The result is a copy owned by the tool with
+// every field of the current AlccPlugin valid (NULL where the plugin's API
+// version predates it). NULL after printing the error.
+AlccPlugin* alcc_load_plugin(const char* path);
+
+// The plugins given with repeated -p, acting as one AlccPlugin. Hooks run
+// in load order, and on_asm_line and on_ast_process see what the plugins
+// before changed. Of the plugins replacing an instruction (on_instruction,
+// on_code, on_decompile_inst) the first one loaded wins: later ones are not
+// asked for that pc, or their entries for it are dropped. Within one
+// plugin's on_code a later entry still replaces an earlier one.
+//
+// Every hook call is counted per plugin; with stats enabled it is timed as
+// well. Hooks are only called on the main thread.
+class PluginChain {
+public:
+    static void add(AlccPlugin* plugin);
+
+    // NULL while no plugin is loaded
+    static AlccPlugin* plugin();
+
+    static void set_stats(bool enabled);
+    // Calls, total and mean time per plugin and hook, costliest first
+    static void print_stats(FILE* f);
+};
+
+// Instruction listings a plugin replaces in one function, filled once per
+// function by on_code. For API 1 plugins find() calls on_instruction
+// instead, so those see the same calls as before.
+class PluginOverrides {
+public:
+    PluginOverrides() : text_used(0), cursor(0), legacy(NULL), proto(NULL) {
+        sink = {this, reserve, commit};
+    }
+
+    void collect(AlccPlugin* plugin, Proto* p);
+    void clear();
+
+    // Replacement text for pc, NULL if none. pcs must not decrease between
+    // calls until the next collect().
+    const char* find(int pc, size_t* len);
+
+    size_t size() const { return entries.size(); }
+
+    // The function's instructions as collect() decoded them, for the listing
+    const AlccInstruction* code() const { return decoded.data(); }
+
+private:
+    struct Entry {
+        int pc;
+        size_t offset;
+        size_t len;
+    };
+    std::vector<Entry> entries; // sorted by pc after collect()
+    std::vector<char> text;     // entry texts back to back; size() is capacity
+    size_t text_used;
+    AlccOutput sink;            // appends to the last entry
+    size_t cursor;
+    std::vector<AlccInstruction> decoded;
+    AlccPlugin* legacy;
+    Proto* proto;
+    char buffer[4096];
+
+    static void set(AlccOverrides* o, int pc, const char* s, size_t len);
+    static AlccOutput* open(AlccOverrides* o, int pc);
+    static char* reserve(AlccOutput* o, size_t n);
+    static void commit(AlccOutput* o, size_t n);
+};
+
+#endif
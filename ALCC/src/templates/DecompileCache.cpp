@@ -0,0 +1,151 @@
+#include "DecompileCache.h"
+#include <string.h>
+#include <inttypes.h>
+
+extern "C" {
+#include "lstring.h"
+}
+
+#include "../core/compat.h"
+
+// Bump when decompiler output changes so old caches are ignored
+#define CACHE_FORMAT 13
+
+#ifdef ANDROLUA
+#define CACHE_VARIANT 1
+#else
+#define CACHE_VARIANT 0
+#endif
+
+struct Fnv64 {
+    uint64_t h;
+    Fnv64() : h(14695981039346656037ULL) {}
+    void bytes(const void* data, size_t len) {
+        const unsigned char* b = (const unsigned char*)data;
+        for (size_t i = 0; i < len; i++) {
+            h ^= b[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    void u64(uint64_t v) { bytes(&v, sizeof(v)); }
+    void str(TString* s) {
+        if (!s) {
+            u64(~0ULL);
+            return;
+        }
+        size_t len = tsslen(s);
+        u64(len);
+        bytes(getstr(s), len);
+    }
+};
+
+uint64_t DecompileCache::hash_proto(Proto* p, const uint64_t* child_hashes) {
+    Fnv64 h;
+    h.u64(p->numparams);
+    h.u64(isvararg(p));
+    h.u64(p->maxstacksize);
+
+    h.u64(p->sizecode);
+    for (int i = 0; i < p->sizecode; i++) h.u64((uint32_t)p->code[i]);
+
+    h.u64(p->sizek);
+    for (int i = 0; i < p->sizek; i++) {
+        TValue* k = &p->k[i];
+        if (ttisstring(k)) {
+            h.u64('s');
+            h.str(tsvalue(k));
+        } else if (ttisinteger(k)) {
+            h.u64('i');
+            h.u64((uint64_t)ivalue(k));
+        } else if (ttisnumber(k)) {
+            lua_Number n = fltvalue(k);
+            h.u64('f');
+            h.bytes(&n, sizeof(n));
+        } else if (ttisboolean(k)) {
+            h.u64(ttistrue(k) ? 'T' : 'F');
+        } else {
+            h.u64('n');
+        }
+    }
+
+    h.u64(p->sizeupvalues);
+    for (int i = 0; i < p->sizeupvalues; i++) {
+        Upvaldesc* u = &p->upvalues[i];
+        h.u64(u->instack);
+        h.u64(u->idx);
+        h.u64(ALCC_UPVAL_KIND_GET(u));
+        h.str(u->name);
+    }
+
+    // Local names shape the output; line info does not
+    h.u64(p->sizelocvars);
+    for (int i = 0; i < p->sizelocvars; i++) {
+        h.str(p->locvars[i].varname);
+        h.u64(p->locvars[i].startpc);
+        h.u64(p->locvars[i].endpc);
+    }
+
+    h.u64(p->sizep);
+    for (int i = 0; i < p->sizep; i++) h.u64(child_hashes[i]);
+    return h.h;
+}
+
+int DecompileCache::load(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    char line[64];
+    int format = 0, version = 0, variant = 0;
+    if (!fgets(line, sizeof(line), f) || sscanf(line, "ALCC-CACHE %d %d %d", &format, &version, &variant) != 3 ||
+        format != CACHE_FORMAT || version != LUA_VERSION_NUM || variant != CACHE_VARIANT) {
+        fclose(f);
+        return 0;
+    }
+    // Records: "<hash> <len>\n", len bytes of text, "\n". Text may be empty
+    // or start with whitespace, so it is read by length only.
+    while (fgets(line, sizeof(line), f)) {
+        uint64_t hash;
+        size_t len;
+        if (sscanf(line, "%" SCNx64 " %zu", &hash, &len) != 2) break;
+        std::string text(len, '\0');
+        if (len && fread(&text[0], 1, len, f) != len) break;
+        if (fgetc(f) != '\n') break;
+        Entry& e = entries[hash];
+        e.text.swap(text);
+        e.used = false;
+    }
+    fclose(f);
+    return 1;
+}
+
+int DecompileCache::save(const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return 0;
+    fprintf(f, "ALCC-CACHE %d %d %d\n", CACHE_FORMAT, LUA_VERSION_NUM, CACHE_VARIANT);
+    for (auto& it : entries) {
+        if (!it.second.used) continue;
+        fprintf(f, "%016" PRIx64 " %zu\n", it.first, it.second.text.size());
+        fwrite(it.second.text.data(), 1, it.second.text.size(), f);
+        fputc('\n', f);
+    }
+    fclose(f);
+    return 1;
+}
+
+const std::string* DecompileCache::lookup(uint64_t hash) {
+    auto it = entries.find(hash);
+    if (it == entries.end()) return nullptr;
+    it->second.used = true;
+    return &it->second.text;
+}
+
+void DecompileCache::store(uint64_t hash, const std::string& text) {
+    Entry& e = entries[hash];
+    e.text = text;
+    e.used = true;
+}
+
+void DecompileCache::print_stats(FILE* f) {
+    int total = hits + misses;
+    fprintf(f, "Cache: %d/%d functions reused (%.1f%%), %d decompiled, %zu bytes spliced\n",
+            hits, total, total ? 100.0 * hits / total : 0.0, misses, reused_bytes);
+}
@@ -0,0 +1,47 @@
+#ifndef DECOMPILE_CACHE_H
+#define DECOMPILE_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+extern "C" {
+#include "lua.h"
+#include "lobject.h"
+}
+
+// Persistent cache of decompiled function bodies keyed by Proto hash.
+// A hash covers code, constants, upvalue descriptors, debug names and the
+// hashes of all nested functions, but no addresses or line info, so an
+// unchanged function keeps its key across chunk revisions.
+class DecompileCache {
+public:
+    int hits;     // functions spliced from the cache (including nested ones)
+    int misses;   // functions decompiled
+    size_t reused_bytes;
+
+    DecompileCache() : hits(0), misses(0), reused_bytes(0) {}
+
+    // Returns 0 if the file is missing or from another ALCC version
+    int load(const char* path);
+    // Writes only the entries used or added since load(), dropping stale revisions
+    int save(const char* path);
+
+    const std::string* lookup(uint64_t hash);
+    void store(uint64_t hash, const std::string& text);
+
+    void print_stats(FILE* f);
+
+    // child_hashes holds the hashes of p->p[0 .. sizep-1]
+    static uint64_t hash_proto(Proto* p, const uint64_t* child_hashes);
+
+private:
+    struct Entry {
+        std::string text;
+        bool used;
+    };
+    std::unordered_map<uint64_t, Entry> entries;
+};
+
+#endif
@@ -1,11 +1,19 @@
 #include "DecompilerCore.h"
 #include "../ast/ASTPrinter.h"
+#include "../ast/ASTJson.h"
+#include "../ast/ASTPasses.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <vector>
 #include <string>
 #include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <sstream>
+#include <chrono>
+#include <mutex>
 
 extern "C" {
 #include "lua.h"
@@ -20,8 +28,12 @@ extern "C" {
 #include "../core/alcc_utils.h"
 #include "../core/compat.h"
 #include "../core/alcc_backend.h"
+#include "../analysis/ControlFlow.h"
+#include "../analysis/Dominators.h"
+#include "../analysis/Liveness.h"
+#include "../core/alcc_pool.h"
+#include "DecompileCache.h"
 
-#define MAX_LABELS 1000
 #define BLOCK_IF 0
 #define BLOCK_LOOP 1
 #define BLOCK_WHILE 2
@@ -47,9 +59,10 @@ static int is_identifier(const char* s) {
     return 1;
 }
 
+// Jump targets indexed by pc; labels are numbered in pc order.
 struct JumpAnalysis {
-    int targets[MAX_LABELS];
-    int types[MAX_LABELS];
+    std::vector<int> label_id;   // pc -> label number, -1 if not a jump target
+    std::vector<int> label_type; // pc -> TARGET_NORMAL / TARGET_REPEAT
     int count;
 };
 
@@ -57,48 +70,29 @@ struct AnalysisBlock {
     int target_pc;
     int start_pc;
     int type;
+    int loop_header;     // CFG block heading the loop, -1 for if blocks
+    int exit_pc;         // first pc after the loop, -1 for if blocks
     Statement* ast_stmt; // Pointer to IfStmt, WhileStmt, etc.
     Block* ast_block;    // The block we are currently filling
 };
 
 struct BlockStack {
-    AnalysisBlock blocks[100];
+    std::vector<AnalysisBlock> blocks;
     int top;
 };
 
-static void bs_push(BlockStack* bs, int target, int type, Statement* stmt, Block* blk, int start_pc = -1) {
-    if (bs->top < 100) {
-        bs->blocks[bs->top].target_pc = target;
-        bs->blocks[bs->top].start_pc = start_pc;
-        bs->blocks[bs->top].type = type;
-        bs->blocks[bs->top].ast_stmt = stmt;
-        bs->blocks[bs->top].ast_block = blk;
-        bs->top++;
-    }
-}
-
-// Returns: 0 = nothing, 1 = pop (end), 2 = else transition
-static int bs_check_end(BlockStack* bs, int pc, Proto* p) {
-    if (bs->top > 0) {
-        if (bs->blocks[bs->top-1].type == BLOCK_REPEAT) return 0;
-
-        if (bs->blocks[bs->top-1].target_pc <= pc) {
-            if (pc > 0) {
-                 Instruction prev = p->code[pc-1];
-                 if (GET_OPCODE(prev) == OP_JMP) {
-                     int sJ = ALCC_GET_JMP_OFFSET(prev);
-                     int target = pc + sJ;
-                     if (bs->blocks[bs->top-1].type == BLOCK_IF && target > pc) {
-                         bs->blocks[bs->top-1].target_pc = target;
-                         return 2;
-                     }
-                 }
-            }
-            bs->top--;
-            return 1;
-        }
-    }
-    return 0;
+static void bs_push(BlockStack* bs, int target, int type, Statement* stmt, Block* blk, int start_pc = -1,
+                    int loop_header = -1, int exit_pc = -1) {
+    if (bs->top == (int)bs->blocks.size()) bs->blocks.emplace_back();
+    AnalysisBlock& ab = bs->blocks[bs->top];
+    ab.target_pc = target;
+    ab.start_pc = start_pc;
+    ab.type = type;
+    ab.loop_header = loop_header;
+    ab.exit_pc = exit_pc;
+    ab.ast_stmt = stmt;
+    ab.ast_block = blk;
+    bs->top++;
 }
 
 static int is_toclose(Proto* p, int pc, int reg) {
@@ -110,115 +104,348 @@ static int is_toclose(Proto* p, int pc, int reg) {
     return 0;
 }
 
-static void analyze_jumps(Proto* p, JumpAnalysis* ja) {
-    ja->count = 0;
+// Helper to check conditional jump
+static int is_conditional_jump(Proto* p, int pc, int* target) {
+    if (pc >= p->sizecode) return 0;
     AlccInstruction dec;
-    for (int i=0; i<p->sizecode; i++) {
-        current_backend->decode_instruction((uint32_t)p->code[i], &dec);
-        int op = dec.op;
-        int target = -1;
-        int type = TARGET_NORMAL;
-        if (op == OP_JMP) {
-            target = i + 1 + dec.bx;
-        } else if (op == OP_FORLOOP || op == OP_TFORLOOP) {
-            target = i + 1 - dec.bx;
-        } else if (op == OP_FORPREP) {
-            target = i + 1 + dec.bx + 1;
-        } else if (op == OP_EQ || op == OP_LT || op == OP_LE || op == OP_EQK || op == OP_EQI ||
-                   op == OP_LTI || op == OP_LEI || op == OP_GTI || op == OP_GEI ||
-                   op == OP_TEST || op == OP_TESTSET) {
-             if (i + 1 < p->sizecode) {
-                 AlccInstruction next;
-                 current_backend->decode_instruction((uint32_t)p->code[i+1], &next);
-                 if (next.op == OP_JMP) {
-                     int dest = i + 1 + 1 + next.bx;
-                     if (dest <= i) {
-                         target = dest;
-                         type = TARGET_REPEAT;
-                     }
-                 }
+    current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+    if (ControlFlowGraph::is_test(dec.op)) {
+        if (pc + 1 < p->sizecode) {
+             AlccInstruction next;
+             current_backend->decode_instruction((uint32_t)p->code[pc+1], &next);
+             if (next.op == OP_JMP) {
+                 if (target) *target = pc + 1 + 1 + next.bx;
+                 return 1;
              }
         }
-        if (target >= 0 && target < p->sizecode) {
-            int found = -1;
-            for (int j=0; j<ja->count; j++) {
-                if (ja->targets[j] == target) { found=j; break; }
-            }
-            if (found >= 0) {
-                 if (type == TARGET_REPEAT) ja->types[found] = TARGET_REPEAT;
-            } else if (ja->count < MAX_LABELS) {
-                ja->targets[ja->count] = target;
-                ja->types[ja->count] = type;
-                ja->count++;
-            }
+    }
+    return 0;
+}
+
+// Register of the boolean loads at pc: a false load that skips a true load
+// into the same register, which the tests of a comparison read as a value
+// (`local z = a == b`) jump between. -1 when pc holds anything else.
+static int bool_load_reg(Proto* p, int pc) {
+    if (pc < 0 || pc + 1 >= p->sizecode) return -1;
+    AlccInstruction no, yes;
+    current_backend->decode_instruction((uint32_t)p->code[pc], &no);
+    current_backend->decode_instruction((uint32_t)p->code[pc + 1], &yes);
+#if defined(LUA_53) || defined(LUA_52)
+    if (no.op != OP_LOADBOOL || no.b != 0 || no.c == 0 || yes.op != OP_LOADBOOL || yes.b == 0 || yes.c != 0) return -1;
+#else
+    if (no.op != OP_LFALSESKIP || yes.op != OP_LOADTRUE) return -1;
+#endif
+    return no.a == yes.a ? no.a : -1;
+}
+
+// TFORCALL pc of the generic for opened at pc, else -1. 5.4 opens it with
+// TFORPREP; 5.2 and 5.3 with a JMP into the call, told apart from other
+// jumps landing there (the exit of an if/else at the end of the body) by
+// the TFORLOOP after the call, which loops back to the instruction after
+// the JMP.
+static int generic_for_call(Proto* p, int pc, const AlccInstruction& dec) {
+#if defined(LUA_53) || defined(LUA_52)
+    if (dec.op != OP_JMP) return -1;
+#else
+    if (dec.op != OP_TFORPREP) return -1;
+#endif
+    int target = ControlFlowGraph::branch_target(dec, pc);
+    if (target <= pc || target + 1 >= p->sizecode) return -1;
+    AlccInstruction call, loop;
+    current_backend->decode_instruction((uint32_t)p->code[target], &call);
+    if (call.op != OP_TFORCALL) return -1;
+#if defined(LUA_53) || defined(LUA_52)
+    current_backend->decode_instruction((uint32_t)p->code[target + 1], &loop);
+    if (loop.op != OP_TFORLOOP || ControlFlowGraph::branch_target(loop, target + 1) != pc + 1) return -1;
+#else
+    (void)loop;
+#endif
+    return target;
+}
+
+// pc of the FORLOOP closing the numeric for opened by the FORPREP at pc
+static int forloop_pc(const AlccInstruction& dec, int pc) {
+#if defined(LUA_53) || defined(LUA_52)
+    return ControlFlowGraph::branch_target(dec, pc);
+#else
+    return ControlFlowGraph::branch_target(dec, pc) - 1;
+#endif
+}
+
+static Expression* negate_condition(Expression* cond) {
+    if (auto* ue = dynamic_cast<UnaryExpr*>(cond)) {
+        if (ue->op == "not") {
+            Expression* inner = ue->expr;
+            ue->expr = nullptr;
+            delete ue;
+            return inner;
         }
     }
-    for (int i=0; i<ja->count-1; i++) {
-        for (int j=i+1; j<ja->count; j++) {
-            if (ja->targets[i] > ja->targets[j]) {
-                int tmp = ja->targets[i]; ja->targets[i] = ja->targets[j]; ja->targets[j] = tmp;
-                tmp = ja->types[i]; ja->types[i] = ja->types[j]; ja->types[j] = tmp;
-            }
+    if (auto* be = dynamic_cast<BinaryExpr*>(cond)) {
+        static const char* const flips[][2] = {
+            {"==", "~="}, {"~=", "=="}, {"<", ">="}, {">=", "<"}, {"<=", ">"}, {">", "<="}
+        };
+        for (auto& f : flips) {
+            if (be->op == f[0]) { be->op = f[1]; return be; }
         }
     }
+    return new UnaryExpr("not", cond);
 }
 
-static int get_label_id(JumpAnalysis* ja, int pc) {
-    for (int i=0; i<ja->count; i++) if (ja->targets[i] == pc) return i;
-    return -1;
-}
-static int get_label_type(JumpAnalysis* ja, int pc) {
-    for (int i=0; i<ja->count; i++) if (ja->targets[i] == pc) return ja->types[i];
-    return TARGET_NORMAL;
+static DecompileTimings* active_timings = nullptr;
+
+static long long elapsed_ns(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
 }
 
 struct DecompilerContext {
     Proto* p;
     BlockStack bs;
     JumpAnalysis ja;
+    ControlFlowGraph cfg;
+    DominatorTree dom;
+    DominatorTree pdom;
+    LoopForest loops;
+    Liveness liveness;
+    int live_block;                      // block whose per-pc sets are in live_after_pc
+    std::vector<RegSet> live_after_pc;
+    std::vector<unsigned char> for_loop; // header block -> loop driven by a for statement
     Block* current_block;
     Block* root_block;
     std::vector<Expression*> pending_regs;
+    uint64_t pending_mask[4]; // bit per register holding a pending expression (frames are < 256 slots)
+    std::vector<Expression*> inline_scan; // scratch stack for is_safe_to_inline
+    bool opaque_reads; // a store was emitted for an instruction the tree does not show
+
+    // Emitted labels; the ones no goto refers to are dropped after the walk
+    std::vector<LabelStmt*> label_nodes;
+    std::vector<Block*> label_blocks;
+    std::vector<unsigned char> label_used;
+
+    // Statement count when the header of a `while cond` loop was entered
+    Block* while_mark_block;
+    size_t while_mark_size;
+
+    // Nested functions built by other tasks: body slot to fill once they finish
+    std::vector<std::pair<Proto*, Block**>> stitches;
 
-    DecompilerContext(Proto* proto) : p(proto), current_block(nullptr), root_block(nullptr) {
+    // Last multi-result call, folded into a following generic for
+    Assignment* last_call;
+    int last_call_reg;
+    int last_call_pc;
+
+    // Table constructors being filled, innermost last. The instructions
+    // computing their fields emit into scratch, where the stores pick the
+    // values up again.
+    struct OpenTable {
+        int reg;
+        TableConstructor* tc;
+        long long next_index; // array index of the next positional field, -1 after a multret field
+        int placed;           // list registers added ahead of their SETLIST
+        Block* outer;
+        Block* scratch;
+    };
+    std::vector<OpenTable> open_tables;
+
+    // Tests of a short-circuit condition being read (see scan_condition):
+    // their pcs, where each one's operands start, their jump targets and
+    // the conditions read so far. value_reg is the register a condition
+    // read as a value goes to, -1 for the condition of an if.
+    struct CondChain {
+        std::vector<int> tests;
+        std::vector<int> starts;
+        std::vector<int> targets;
+        std::vector<Expression*> conds;
+        int value_reg;
+        bool elseif;
+    };
+    CondChain chain;
+
+    DecompilerContext(Proto* proto) : p(proto), live_block(-1), current_block(nullptr), root_block(nullptr), opaque_reads(false),
+                                      while_mark_block(nullptr), while_mark_size(0),
+                                      last_call(nullptr), last_call_reg(-1), last_call_pc(-1) {
         bs.top = 0;
         pending_regs.resize(p->maxstacksize, nullptr);
+        memset(pending_mask, 0, sizeof(pending_mask));
     }
 
-    bool is_safe_to_inline(Expression* expr) {
-        if (!expr) return false;
-        if (dynamic_cast<Literal*>(expr)) return true;
-        if (dynamic_cast<Variable*>(expr)) return true;
-        if (auto* ue = dynamic_cast<UnaryExpr*>(expr)) return is_safe_to_inline(ue->expr);
-        if (auto* be = dynamic_cast<BinaryExpr*>(expr)) return is_safe_to_inline(be->left) && is_safe_to_inline(be->right);
-        return false;
+    void analyze() {
+        cfg.build(p);
+        dom.compute(cfg);
+        pdom.compute(cfg, true);
+        loops.compute(cfg, dom);
+        liveness.compute(cfg, p);
+
+        int n = p->sizecode;
+        ja.label_id.assign(n, -1);
+        ja.label_type.assign(n, TARGET_NORMAL);
+        for_loop.assign(cfg.num_blocks(), 0);
+
+        AlccInstruction dec;
+        for (int i = 0; i < n; i++) {
+            current_backend->decode_instruction((uint32_t)p->code[i], &dec);
+            int target = ControlFlowGraph::branch_target(dec, i);
+            if (target >= 0 && target < n) ja.label_id[target] = 0;
+
+            int dest;
+            if (is_conditional_jump(p, i, &dest) && dest <= i && dest >= 0) {
+                // Only the jump closing the loop is an `until`; earlier backward
+                // exits are continues threaded through the latch.
+                int h = cfg.block_at(dest);
+                if (loops.is_header(h) && loops.last_pc[h] == i + 1) ja.label_type[dest] = TARGET_REPEAT;
+            }
+
+            if ((dec.op == OP_FORPREP || generic_for_call(p, i, dec) >= 0) && i + 1 < n) {
+                int h = loops.header[cfg.block_of[i + 1]];
+                if (h >= 0) for_loop[h] = 1;
+            }
+        }
+
+        ja.count = 0;
+        for (int i = 0; i < n; i++) {
+            if (ja.label_id[i] >= 0) ja.label_id[i] = ja.count++;
+        }
+        label_nodes.assign(ja.count, nullptr);
+        label_blocks.assign(ja.count, nullptr);
+        label_used.assign(ja.count, 0);
     }
 
-    Expression* clone_expr(Expression* expr) {
-        if (!expr) return nullptr;
-        if (auto* l = dynamic_cast<Literal*>(expr)) {
-             if (l->type == Literal::STRING) return new Literal(l->string_val);
-             if (l->type == Literal::NUMBER) return new Literal(l->number_val);
-             if (l->type == Literal::BOOLEAN) return new Literal(l->bool_val);
-             return new Literal();
+    // Header of a `while cond do` loop: the header block ends in the exit test
+    bool is_simple_while(int h) {
+        if (!loops.is_header(h) || for_loop[h]) return false;
+        const ControlFlowGraph::BasicBlock& blk = cfg.blocks[h];
+        if (ja.label_type[blk.start_pc] == TARGET_REPEAT) return false;
+        int target;
+        if (!is_conditional_jump(p, blk.end_pc, &target)) return false;
+        return target == loops.exit_pc(h);
+    }
+
+    // Innermost loop being reconstructed, or null
+    AnalysisBlock* innermost_loop() {
+        for (int k = bs.top - 1; k >= 0; k--) {
+            if (bs.blocks[k].type != BLOCK_IF) return &bs.blocks[k];
         }
-        if (auto* v = dynamic_cast<Variable*>(expr)) {
-             return new Variable(v->name, v->is_upvalue);
+        return nullptr;
+    }
+
+    // pc where the innermost open block ends, -1 if unbounded
+    int enclosing_end() {
+        if (bs.top == 0) return -1;
+        AnalysisBlock& top = bs.blocks[bs.top-1];
+        return top.type == BLOCK_REPEAT ? top.exit_pc : top.target_pc;
+    }
+
+    // The JMP at pc skips the else part of the innermost if. Its target must stay
+    // inside the current loop (otherwise it is a break) and post-dominate the test.
+    bool is_else_jump(int pc) {
+        if (pc < 0 || bs.top == 0) return false;
+        AnalysisBlock& top = bs.blocks[bs.top-1];
+        if (top.type != BLOCK_IF || top.target_pc != pc + 1) return false;
+        AlccInstruction dec;
+        current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+        if (dec.op != OP_JMP) return false;
+        // The jump of a test (the second test of `a or b`) skips the body
+        // rather than an else part
+        if (pc > top.start_pc + 1 && is_conditional_jump(p, pc - 1, nullptr)) return false;
+        int target = pc + 1 + dec.bx;
+        if (target <= pc + 1) return false;
+        int to = cfg.block_at(target);
+        // The loop of the test: a then part ending in break is outside the
+        // natural loop, since it never reaches the latch
+        int cond_blk = cfg.block_at(top.start_pc);
+        int loop = cond_blk >= 0 ? loops.header[cond_blk] : -1;
+        if (loop >= 0 && !loops.contains(loop, to)) return false;
+        if (to >= 0 && pdom.reachable(cond_blk) && !pdom.dominates(to, cond_blk)) return false;
+        return true;
+    }
+
+    // Statement leaving the current position for target: break when it is the
+    // exit of the innermost loop, goto otherwise.
+    Statement* make_jump(int target) {
+        AnalysisBlock* loop = innermost_loop();
+        if (loop && loop->exit_pc == target) return new BreakStmt();
+        if (target < 0 || target >= p->sizecode || ja.label_id[target] < 0) return nullptr;
+        int id = ja.label_id[target];
+        label_used[id] = 1;
+        return new GotoStmt("L" + std::to_string(id));
+    }
+
+    void add_label(int pc) {
+        int id = ja.label_id[pc];
+        if (id < 0 || label_nodes[id]) return;
+        LabelStmt* lbl = new LabelStmt("L" + std::to_string(id));
+        label_nodes[id] = lbl;
+        label_blocks[id] = current_block;
+        current_block->add(lbl);
+    }
+
+    void prune_labels() {
+        std::unordered_set<Statement*> dead;
+        std::vector<Block*> touched;
+        for (int id = 0; id < ja.count; id++) {
+            if (label_nodes[id] && !label_used[id]) {
+                dead.insert(label_nodes[id]);
+                touched.push_back(label_blocks[id]);
+            }
         }
-        if (auto* ue = dynamic_cast<UnaryExpr*>(expr)) {
-             return new UnaryExpr(ue->op, clone_expr(ue->expr));
+        if (dead.empty()) return;
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (Block* blk : touched) {
+            auto& stmts = blk->statements;
+            stmts.erase(std::remove_if(stmts.begin(), stmts.end(), [&](Statement* s) {
+                if (!dead.count(s)) return false;
+                delete s;
+                return true;
+            }), stmts.end());
         }
-        if (auto* be = dynamic_cast<BinaryExpr*>(expr)) {
-             return new BinaryExpr(clone_expr(be->left), be->op, clone_expr(be->right));
+    }
+
+    // Literals and variables combined with unary and binary operators only
+    bool is_safe_to_inline(Expression* expr) {
+        if (!expr) return false;
+        std::vector<Expression*>& stack = inline_scan;
+        stack.assign(1, expr);
+        while (!stack.empty()) {
+            Expression* e = stack.back();
+            stack.pop_back();
+            switch (e->kind) {
+                case ASTNode::LITERAL:
+                case ASTNode::VARIABLE:
+                    break;
+                case ASTNode::UNARY: {
+                    UnaryExpr* ue = static_cast<UnaryExpr*>(e);
+                    if (!ue->expr) return false;
+                    stack.push_back(ue->expr);
+                    break;
+                }
+                case ASTNode::BINARY: {
+                    BinaryExpr* be = static_cast<BinaryExpr*>(e);
+                    if (!be->left || !be->right) return false;
+                    stack.push_back(be->left);
+                    stack.push_back(be->right);
+                    break;
+                }
+                default:
+                    return false;
+            }
         }
-        return nullptr;
+        return true;
     }
 
-    Expression* make_var(int reg, int pc) {
+    Expression* clone_expr(Expression* expr) {
+        return ast_clone(expr);
+    }
+
+    std::string reg_name(int reg, int pc) {
         const char* name = luaF_getlocalname(p, reg + 1, pc);
-        if (name) return new Variable(name);
-        if (reg < p->numparams) return new Variable("P" + std::to_string(reg));
-        return new Variable("v" + std::to_string(reg));
+        if (name) return name;
+        if (reg < p->numparams) return "P" + std::to_string(reg);
+        return "v" + std::to_string(reg);
+    }
+
+    Expression* make_var(int reg, int pc) {
+        return new Variable(reg_name(reg, pc));
     }
 
     Expression* make_upval(int idx) {
@@ -256,6 +483,16 @@ struct DecompilerContext {
         return make_var(reg, pc);
     }
 
+    // Like get_expr, but hands over a pending expression instead of cloning it
+    Expression* take_expr(int reg, int pc) {
+        if ((size_t)reg < pending_regs.size() && pending_regs[reg] && is_safe_to_inline(pending_regs[reg])) {
+            Expression* expr = pending_regs[reg];
+            clear_pending(reg);
+            return expr;
+        }
+        return get_expr(reg, pc);
+    }
+
     void set_expr(int reg, Expression* expr) {
         if ((size_t)reg < pending_regs.size()) {
             if (pending_regs[reg]) {
@@ -270,6 +507,16 @@ struct DecompilerContext {
                 delete pending_regs[reg];
             }
             pending_regs[reg] = expr;
+            if (expr) pending_mask[reg >> 6] |= 1ULL << (reg & 63);
+            else pending_mask[reg >> 6] &= ~(1ULL << (reg & 63));
+        }
+    }
+
+    // Forget a pending expression without emitting it (ownership moved elsewhere)
+    void clear_pending(int reg) {
+        if ((size_t)reg < pending_regs.size()) {
+            pending_regs[reg] = nullptr;
+            pending_mask[reg >> 6] &= ~(1ULL << (reg & 63));
         }
     }
 
@@ -279,25 +526,155 @@ struct DecompilerContext {
             assign->targets.push_back(make_var(reg, pc));
             assign->values.push_back(pending_regs[reg]);
             current_block->add(assign);
-            pending_regs[reg] = nullptr;
+            clear_pending(reg);
+        }
+    }
+
+    // Registers live right after pc; per-pc sets are built one block at a time
+    const RegSet& live_after(int pc) {
+        int b = cfg.block_of[pc];
+        if (b != live_block) {
+            liveness.block_live_after(cfg, p, b, live_after_pc);
+            live_block = b;
+        }
+        return live_after_pc[pc - cfg.blocks[b].start_pc];
+    }
+
+    RegSet live_before(int pc) {
+        RegSet live = live_after(pc);
+        AlccInstruction dec;
+        RegSet use, def;
+        current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+        Liveness::effects(p, pc, dec, use, def);
+        live.transfer(use, def);
+        return live;
+    }
+
+    // Unnamed register: a compiler temporary rather than a source local
+    bool is_temporary(int reg, int pc) {
+        return luaF_getlocalname(p, reg + 1, pc) == NULL;
+    }
+
+    // Emits every pending expression, lowest register first, visiting only
+    // occupied slots. Temporaries that are dead at pc (or right after pc when
+    // after is set) were fully inlined into their uses and are dropped.
+    void flush_all_pending(int pc, bool after = false) {
+        DecompileTimings* t = active_timings;
+        std::chrono::steady_clock::time_point start;
+        if (t) start = std::chrono::steady_clock::now();
+        RegSet live;
+        if (pc >= 0 && pc < p->sizecode) live = after ? live_after(pc) : live_before(pc);
+        int name_pc = after ? pc + 1 : pc;
+        int visited = 0, dropped = 0;
+        for (int w = 0; w < 4; w++) {
+            while (pending_mask[w]) {
+                int reg = w * 64 + __builtin_ctzll(pending_mask[w]);
+                if (!live.test(reg) && is_temporary(reg, name_pc)) {
+                    set_expr(reg, nullptr);
+                    dropped++;
+                } else {
+                    flush_pending(reg, pc);
+                }
+                visited++;
+            }
+        }
+        if (t) {
+            t->flush_ns += elapsed_ns(start);
+            t->flush_calls++;
+            t->flush_slots += visited;
+            t->frame_slots += (long long)pending_regs.size();
+            t->dead_temps += dropped;
+        }
+    }
+
+    // Emits the pending values flush_all_pending(pc, true) keeps, before a
+    // test or return at pc builds its operands: a named local must be stored
+    // and then read, not inlined and stored as well
+    void flush_kept_pending(int pc) {
+        const RegSet& live = live_after(pc);
+        for (int w = 0; w < 4; w++) {
+            uint64_t bits = pending_mask[w];
+            while (bits) {
+                int reg = w * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                if (live.test(reg) || !is_temporary(reg, pc + 1)) flush_pending(reg, pc);
+            }
         }
     }
 
-    void flush_all_pending(int pc) {
-        for (size_t i = 0; i < pending_regs.size(); i++) {
-            flush_pending(i, pc);
+    // An instruction the builder does not express still reads and writes
+    // registers: pending values it reads are emitted rather than lost, and
+    // what it overwrites is no longer pending (named locals are kept)
+    void settle_opaque(int pc, const AlccInstruction& dec) {
+        if (!(pending_mask[0] | pending_mask[1] | pending_mask[2] | pending_mask[3])) return;
+        RegSet use, def;
+        Liveness::effects(p, pc, dec, use, def);
+        for (int w = 0; w < 4; w++) {
+            uint64_t bits = pending_mask[w] & use.w[w];
+            if (bits) opaque_reads = true;
+            while (bits) {
+                flush_pending(w * 64 + __builtin_ctzll(bits), pc);
+                bits &= bits - 1;
+            }
+            bits = pending_mask[w] & def.w[w];
+            while (bits) {
+                int reg = w * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                if (is_temporary(reg, pc)) set_expr(reg, nullptr);
+                else flush_pending(reg, pc);
+            }
+        }
+    }
+
+    // After an aborted walk: frees the pending values and open constructors,
+    // which are not part of the tree
+    void discard() {
+        for (int w = 0; w < 4; w++) {
+            while (pending_mask[w]) {
+                int reg = w * 64 + __builtin_ctzll(pending_mask[w]);
+                ast_dispose(pending_regs[reg]);
+                clear_pending(reg);
+            }
+        }
+        for (OpenTable& t : open_tables) {
+            ast_dispose(t.tc);
+            ast_dispose(t.scratch);
         }
+        open_tables.clear();
+        for (Expression* e : chain.conds) ast_dispose(e);
+        chain.conds.clear();
+    }
+
+    // After instruction pc: forget temporaries no later instruction reads
+    void drop_dead_temps(int pc) {
+        if (!(pending_mask[0] | pending_mask[1] | pending_mask[2] | pending_mask[3])) return;
+        if (pc < 0 || pc >= p->sizecode) return;
+        const RegSet& live = live_after(pc);
+        int dropped = 0;
+        for (int w = 0; w < 4; w++) {
+            uint64_t bits = pending_mask[w] & ~live.w[w];
+            while (bits) {
+                int reg = w * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                if (is_temporary(reg, pc + 1)) {
+                    set_expr(reg, nullptr);
+                    dropped++;
+                }
+            }
+        }
+        if (active_timings) active_timings->dead_temps += dropped;
     }
 };
 
-static Proto* printed_proto_list[1000];
-static int printed_proto_count = 0;
-static int is_proto_printed(Proto* p) {
-    for(int i=0;i<printed_proto_count;i++) if(printed_proto_list[i]==p) return 1;
-    return 0;
-}
-static void set_proto_printed(Proto* p) {
-    if(printed_proto_count<1000) printed_proto_list[printed_proto_count++]=p;
+static FunctionDecl* make_function_decl(Proto* p, Block* body) {
+    FunctionDecl* func_node = new FunctionDecl("", body); // Name filled by caller if needed
+    for(int i=0; i<p->numparams; i++) {
+        const char* name = luaF_getlocalname(p, i + 1, 0);
+        if(name) func_node->params.push_back(name);
+        else func_node->params.push_back("P" + std::to_string(i));
+    }
+    if(isvararg(p)) func_node->is_vararg = true;
+    return func_node;
 }
 
 // Helpers
@@ -344,72 +721,650 @@ static void process_unary(DecompilerContext& ctx, int pc, int op, int a, int b)
     ctx.set_expr(a, un);
 }
 
-// Helper to check conditional jump
-static int is_conditional_jump(Proto* p, int pc, int* target) {
-    if (pc >= p->sizecode) return 0;
+// Table constructors
+// NEWTABLE opens a constructor and the stores into it become its fields, so
+// values loaded in between, nested constructors and SETLIST batches of any
+// size are folded in a single pass over the code.
+
+// Instructions read as part of another one: the metamethod fallbacks of
+// arithmetic and the latches and iterator calls of loops
+static bool expressed_elsewhere(int op) {
+    switch (op) {
+        case OP_EXTRAARG: case OP_FORLOOP: case OP_TFORCALL: case OP_TFORLOOP:
+#if !(defined(LUA_53) || defined(LUA_52))
+        case OP_MMBIN: case OP_MMBINI: case OP_MMBINK:
+#endif
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool is_table_store(int op) {
+    return op == OP_SETFIELD || op == OP_SETI || op == OP_SETTABLE || op == OP_SETLIST;
+}
+
+static void open_table(DecompilerContext& ctx, int a) {
+    ctx.set_expr(a, nullptr);
+    DecompilerContext::OpenTable t = {a, new TableConstructor(), 1, 0, ctx.current_block, new Block()};
+    ctx.open_tables.push_back(t);
+    ctx.current_block = t.scratch;
+}
+
+// Emits the innermost constructor as `vA = {...}`, followed by what was
+// evaluated after its last store
+static void close_table(DecompilerContext& ctx, int pc) {
+    DecompilerContext::OpenTable t = ctx.open_tables.back();
+    ctx.open_tables.pop_back();
+    Assignment* assign = new Assignment(false);
+    assign->targets.push_back(ctx.make_var(t.reg, pc));
+    assign->values.push_back(t.tc);
+    t.outer->add(assign);
+    for (Statement* s : t.scratch->statements) t.outer->add(s);
+    t.scratch->statements.clear();
+    delete t.scratch;
+    ctx.current_block = t.outer;
+}
+
+static void close_tables(DecompilerContext& ctx, int pc) {
+    while (!ctx.open_tables.empty()) close_table(ctx, pc);
+}
+
+// Before pc: closes the constructors pc does not continue. A constructor
+// stays inside one basic block, only stores into it read its register and
+// nothing at or below its register is written while it is open.
+static void settle_tables(DecompilerContext& ctx, int pc) {
+    if (pc > 0 && ctx.cfg.block_of[pc] != ctx.cfg.block_of[pc - 1]) {
+        close_tables(ctx, pc);
+        return;
+    }
     AlccInstruction dec;
-    current_backend->decode_instruction((uint32_t)p->code[pc], &dec);
+    current_backend->decode_instruction((uint32_t)ctx.p->code[pc], &dec);
+    if (dec.op == OP_EXTRAARG) return;
+    int succ[2];
+    if (ControlFlowGraph::successors(dec, pc, succ) != 1 || succ[0] != pc + 1) {
+        close_tables(ctx, pc);
+        return;
+    }
+
+    RegSet use, def;
+    Liveness::effects(ctx.p, pc, dec, use, def);
+    if (is_table_store(dec.op)) {
+        // A store into an outer constructor completes the ones nested in it
+        for (size_t k = ctx.open_tables.size(); k-- > 0;) {
+            if (ctx.open_tables[k].reg != dec.a) continue;
+            while (ctx.open_tables.size() > k + 1) close_table(ctx, pc);
+            use.reset(dec.a);
+            break;
+        }
+    }
+    int lowest_def = def.first();
+    while (!ctx.open_tables.empty()) {
+        const DecompilerContext::OpenTable& t = ctx.open_tables.back();
+        bool ends = lowest_def <= t.reg + t.placed;
+        for (const DecompilerContext::OpenTable& o : ctx.open_tables) ends = ends || use.test(o.reg);
+        if (!ends) break;
+        close_table(ctx, pc);
+    }
+}
+
+// Single assignment `vR = value` of register reg
+static bool is_reg_store(DecompilerContext& ctx, Statement* s, int reg, int pc) {
+    if (s->kind != ASTNode::ASSIGN) return false;
+    Assignment* as = static_cast<Assignment*>(s);
+    if (as->is_local || as->targets.size() != 1 || as->values.size() != 1) return false;
+    if (as->targets[0]->kind != ASTNode::VARIABLE) return false;
+    Variable* v = static_cast<Variable*>(as->targets[0]);
+    return !v->is_upvalue && v->name == ctx.reg_name(reg, pc);
+}
+
+// Takes the value out of a `vR = value` statement and frees the statement
+static Expression* take_store_value(DecompilerContext& ctx, Statement* s) {
+    Assignment* as = static_cast<Assignment*>(s);
+    Expression* value = as->values[0];
+    as->values.clear();
+    if (ctx.last_call == as) ctx.last_call = nullptr;
+    delete as;
+    return value;
+}
+
+// The `multret = call` statement a CALL with open results leaves
+static bool is_multret_store(Statement* s) {
+    if (s->kind != ASTNode::ASSIGN) return false;
+    Assignment* as = static_cast<Assignment*>(s);
+    return as->targets.size() == 1 && as->values.size() == 1 && as->targets[0]->kind == ASTNode::VARIABLE &&
+           static_cast<Variable*>(as->targets[0])->name == "multret";
+}
+
+// Array index of the first item of a SETLIST
+static long long setlist_first(Proto* p, int pc, const AlccInstruction& dec) {
+    AlccInstruction extra;
+    extra.bx = 0;
+#if defined(LUA_53) || defined(LUA_52)
+    long long batch = dec.c;
+    if (batch == 0 && pc + 1 < p->sizecode) {
+        current_backend->decode_instruction((uint32_t)p->code[pc + 1], &extra);
+        batch = extra.bx;
+    }
+    return (batch - 1) * LFIELDS_PER_FLUSH + 1;
+#else
+    long long first = dec.c;
+    if (dec.k && pc + 1 < p->sizecode) {
+        current_backend->decode_instruction((uint32_t)p->code[pc + 1], &extra);
+#ifdef MAXARG_vC
+        first += (long long)extra.bx * (MAXARG_vC + 1);
+#else
+        first += (long long)extra.bx * (MAXARG_C + 1);
+#endif
+    }
+    return first + 1;
+#endif
+}
+
+// Item count of a SETLIST. With B == 0 the items run up to the open results
+// of the CALL or VARARG right before it, and *multi is set to what that
+// instruction left (1 call, 2 vararg); -1 when that instruction is neither.
+static int setlist_count(Proto* p, int pc, const AlccInstruction& dec, int* multi) {
+    *multi = 0;
+    if (dec.b != 0) return dec.b;
+    if (pc == 0) return -1;
+    AlccInstruction prev;
+    current_backend->decode_instruction((uint32_t)p->code[pc - 1], &prev);
+#if defined(LUA_53) || defined(LUA_52)
+    int open_results = prev.op == OP_VARARG ? prev.b : prev.c;
+#else
+    int open_results = prev.c;
+#endif
+    if ((prev.op != OP_CALL && prev.op != OP_VARARG) || open_results != 0 || prev.a <= dec.a) return -1;
+    *multi = prev.op == OP_CALL ? 1 : 2;
+    return prev.a - dec.a;
+}
+
+// Value of register reg for a store into the constructor t: its pending
+// expression, the `vR = value` statement at the end of the scratch block,
+// or the register itself
+static Expression* fetch_item(DecompilerContext& ctx, DecompilerContext::OpenTable& t, int reg, int pc) {
+    if (reg <= t.reg) return ctx.get_expr(reg, pc);
+    if ((size_t)reg < ctx.pending_regs.size() && ctx.pending_regs[reg]) {
+        Expression* e = ctx.pending_regs[reg];
+        ctx.clear_pending(reg);
+        return e;
+    }
+    std::vector<Statement*>& stmts = t.scratch->statements;
+    if (!stmts.empty() && is_reg_store(ctx, stmts.back(), reg, pc)) {
+        Statement* s = stmts.back();
+        stmts.pop_back();
+        return take_store_value(ctx, s);
+    }
+    return ctx.make_var(reg, pc);
+}
+
+// Adds the store at pc to the innermost constructor. Returns false, after
+// closing the constructor, when the store's values cannot be taken without
+// moving other statements across them; the caller then emits it as usual.
+static bool table_store(DecompilerContext& ctx, int pc, const AlccInstruction& dec) {
+    if (ctx.open_tables.empty() || ctx.open_tables.back().reg != dec.a) return false;
+    DecompilerContext::OpenTable& t = ctx.open_tables.back();
+    Proto* p = ctx.p;
     int op = dec.op;
-    if (op == OP_EQ || op == OP_LT || op == OP_LE || op == OP_EQK || op == OP_EQI ||
-        op == OP_LTI || op == OP_LEI || op == OP_GTI || op == OP_GEI ||
-        op == OP_TEST || op == OP_TESTSET) {
-        if (pc + 1 < p->sizecode) {
-             AlccInstruction next;
-             current_backend->decode_instruction((uint32_t)p->code[pc+1], &next);
-             if (next.op == OP_JMP) {
-                 if (target) *target = pc + 1 + 1 + next.bx;
-                 return 1;
-             }
+    int nslots = (int)ctx.pending_regs.size();
+
+    // Registers read, in evaluation order
+    int regs[256];
+    int nregs = 0;
+    int multi = 0;
+    long long first = 0;
+    bool ok = t.next_index >= 0;
+    if (op == OP_SETLIST) {
+        int count = setlist_count(p, pc, dec, &multi);
+        first = setlist_first(p, pc, dec);
+        // An open result only expands as the last positional field
+        ok = ok && count >= 0 && (!multi || first + t.placed == t.next_index);
+        for (int j = t.placed + 1; j <= count - (multi ? 1 : 0); j++) regs[nregs++] = dec.a + j;
+    } else if (op == OP_SETTABLE) {
+        if (!ISK(dec.b)) regs[nregs++] = dec.b;
+        if (!dec.k && !ISK(dec.c)) regs[nregs++] = dec.c;
+        if (nregs == 2 && dec.b == dec.c) ok = false;
+    } else if (!dec.k) {
+        regs[nregs++] = dec.c;
+    }
+
+    // Dry run of the fetches, last value first. A value above the
+    // constructor is folded only from a temporary holding a pending
+    // expression or a `vR = value` statement; a named local there was
+    // declared after the constructor, and an unexpressed temporary would
+    // print as a register name.
+    std::vector<Statement*>& stmts = t.scratch->statements;
+    size_t top = stmts.size();
+    if (ok && multi == 1) ok = top > 0 && is_multret_store(stmts[--top]);
+    for (int r = nregs; ok && r-- > 0;) {
+        int reg = regs[r];
+        Expression* pending = reg < nslots ? ctx.pending_regs[reg] : nullptr;
+        if (reg <= t.reg) ok = !pending || ctx.is_safe_to_inline(pending);
+        else if (!ctx.is_temporary(reg, pc)) ok = false;
+        else if (!pending && top > 0 && is_reg_store(ctx, stmts[top - 1], reg, pc)) top--;
+        else ok = pending != nullptr;
+    }
+    // A keyed store first adds the list items below its own registers, so
+    // the fields keep their source order. What is left in front of the
+    // values it takes must be such items.
+    int reg = t.reg + t.placed + 1;
+    size_t s = 0;
+    if (ok && op != OP_SETLIST) {
+        int limit = nslots;
+        for (int r = 0; r < nregs; r++) {
+            if (regs[r] > t.reg && regs[r] < limit) limit = regs[r];
+        }
+        for (; reg < limit && ctx.is_temporary(reg, pc); reg++) {
+            if (ctx.pending_regs[reg]) continue;
+            if (s < top && is_reg_store(ctx, stmts[s], reg, pc)) s++;
+            else break;
         }
     }
-    return 0;
+    if (!ok || s < top) {
+        close_table(ctx, pc);
+        return false;
+    }
+
+    s = 0;
+    for (int r = t.reg + t.placed + 1; r < reg; r++) {
+        Expression* item;
+        if (ctx.pending_regs[r]) {
+            item = ctx.pending_regs[r];
+            ctx.clear_pending(r);
+        } else {
+            item = take_store_value(ctx, stmts[s++]);
+        }
+        t.tc->fields.push_back({nullptr, item});
+        t.next_index++;
+    }
+    t.placed = reg - t.reg - 1;
+    stmts.erase(stmts.begin(), stmts.begin() + top);
+
+    if (op == OP_SETLIST) {
+        Expression* last = nullptr;
+        if (multi == 1) {
+            last = take_store_value(ctx, stmts.back());
+            stmts.pop_back();
+        } else if (multi == 2) {
+            last = new Variable("...");
+        }
+        Expression* items[256];
+        for (int r = nregs; r-- > 0;) items[r] = fetch_item(ctx, t, regs[r], pc);
+        // Items placed ahead are skipped; indices off the array part become keys
+        long long idx = first + t.placed;
+        for (int r = 0; r < nregs; r++, idx++) {
+            if (idx == t.next_index) {
+                t.tc->fields.push_back({nullptr, items[r]});
+                t.next_index++;
+            } else {
+                t.tc->fields.push_back({new Literal((double)idx), items[r]});
+            }
+        }
+        if (last) {
+            t.tc->fields.push_back({nullptr, last});
+            t.next_index = -1;
+        }
+        t.placed = 0;
+        return true;
+    }
+
+    Expression* value;
+    Expression* key;
+    if (op == OP_SETTABLE) {
+        value = (dec.k || ISK(dec.c)) ? ctx.make_const(INDEXK(dec.c)) : fetch_item(ctx, t, dec.c, pc);
+        key = ISK(dec.b) ? ctx.make_const(INDEXK(dec.b)) : fetch_item(ctx, t, dec.b, pc);
+    } else {
+        value = dec.k ? ctx.make_const(dec.c) : fetch_item(ctx, t, dec.c, pc);
+        if (op == OP_SETI) key = new Literal((double)dec.b);
+        else if (ttisstring(&p->k[dec.b])) key = new Literal(std::string(getstr(tsvalue(&p->k[dec.b]))));
+        else key = ctx.make_const(dec.b);
+    }
+    t.tc->fields.push_back({key, value});
+    return true;
 }
 
-ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
+// 0: nothing ends at pc, 1: innermost block ended, 2: if block continues with an else part
+static int bs_check_end(DecompilerContext& ctx, int pc) {
+    BlockStack& bs = ctx.bs;
+    if (bs.top == 0) return 0;
+    AnalysisBlock& top = bs.blocks[bs.top-1];
+    if (top.type == BLOCK_REPEAT || top.target_pc < 0 || top.target_pc > pc) return 0;
+    if (ctx.is_else_jump(pc - 1)) {
+        AlccInstruction jmp;
+        current_backend->decode_instruction((uint32_t)ctx.p->code[pc-1], &jmp);
+        int end = pc + jmp.bx;
+        // An else part ending with the then part of the enclosing if jumps
+        // straight to that if's end (luaK_finish threads jumps to jumps)
+        AnalysisBlock* outer = bs.top > 1 ? &bs.blocks[bs.top-2] : nullptr;
+        int limit = outer && outer->type != BLOCK_REPEAT ? outer->target_pc : -1;
+        if (limit > pc && end > limit) {
+            AlccInstruction over;
+            current_backend->decode_instruction((uint32_t)ctx.p->code[limit - 1], &over);
+            if (over.op == OP_JMP && ControlFlowGraph::branch_target(over, limit - 1) == end) end = limit - 1;
+        }
+        top.target_pc = end;
+        return 2;
+    }
+    bs.top--;
+    return 1;
+}
+
+// Opens an else part on the innermost if when an elseif test turned into a break/goto
+static void open_pending_else(DecompilerContext& ctx, bool pending_elseif) {
+    if (!pending_elseif) return;
+    IfStmt* if_stmt = (IfStmt*)ctx.bs.blocks[ctx.bs.top-1].ast_stmt;
+    Block* else_blk = new Block();
+    if_stmt->clauses.push_back({nullptr, else_blk});
+    ctx.bs.blocks[ctx.bs.top-1].ast_block = else_blk;
+    ctx.current_block = else_blk;
+}
+
+// `if not cond then break/goto end` for a test that leaves the current block
+static void add_conditional_exit(DecompilerContext& ctx, Expression* cond, int dest) {
+    Statement* exit = ctx.make_jump(dest);
+    if (!exit) {
+        delete cond;
+        return;
+    }
+    Block* body = new Block();
+    body->add(exit);
+    IfStmt* guard = new IfStmt();
+    guard->clauses.push_back({negate_condition(cond), body});
+    ctx.current_block->add(guard);
+}
+
+// Short-circuit conditions
+// `if a and (b or c) then` compiles to a test and jump per operand, each
+// jump going to the then part, the else part or the start of a later
+// operand. Read one by one, the tests would nest ifs whose exits need
+// gotos into the else part. scan_condition finds the tests of such a
+// condition before the first is decoded, each test then only records its
+// condition, and the last one joins them with `and` and `or`.
+
+// Longer chains are read as nested ifs
+static const size_t MAX_CHAIN = 16;
+
+// Instructions computing the operands of a later test. They only load
+// values into temporaries, so they leave no statements behind.
+static bool is_operand_load(int op) {
+    switch (op) {
+        case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK: case OP_GETUPVAL:
+        case OP_GETTABUP: case OP_GETTABLE: case OP_GETI: case OP_GETFIELD:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Condition of tests [s, e) of the chain, entering its last test's
+// fallthrough fall, which is t_true or t_false. Every jump must go to one of
+// them or to the start of a later test in the range. The tests split at the
+// last m where those before m leave only for m or for one of t_true
+// (`or`) and t_false (`and`). Without out this only checks the shape;
+// with it the conditions are taken from the chain.
+static bool cond_tree(DecompilerContext::CondChain& ch, size_t s, size_t e, int t_true, int t_false, int fall,
+                      Expression** out) {
+    if (e - s == 1) {
+        if (ch.targets[s] != (fall == t_true ? t_false : t_true)) return false;
+        if (out) {
+            *out = fall == t_true ? ch.conds[s] : negate_condition(ch.conds[s]);
+            ch.conds[s] = nullptr;
+        }
+        return true;
+    }
+    for (size_t m = e - 1; m > s; m--) {
+        int mid = ch.starts[m];
+        bool to_true = false, to_false = false, ok = true;
+        for (size_t k = s; ok && k < m; k++) {
+            int t = ch.targets[k];
+            bool inner = t == mid;
+            for (size_t j = k + 1; j < m && !inner; j++) inner = ch.starts[j] == t;
+            if (inner) continue;
+            if (t == t_true) to_true = true;
+            else if (t == t_false) to_false = true;
+            else ok = false;
+        }
+        if (!ok || to_true == to_false) continue;
+        int left_true = to_true ? t_true : mid;
+        int left_false = to_true ? mid : t_false;
+        if (!cond_tree(ch, s, m, left_true, left_false, mid, nullptr) ||
+            !cond_tree(ch, m, e, t_true, t_false, fall, nullptr)) {
+            continue;
+        }
+        if (out) {
+            Expression* left;
+            Expression* right;
+            cond_tree(ch, s, m, left_true, left_false, mid, &left);
+            cond_tree(ch, m, e, t_true, t_false, fall, &right);
+            *out = new BinaryExpr(left, to_true ? "or" : "and", right);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Fills ctx.chain when the test at pc starts a condition of two or more
+// tests that ends in a plain if: the else part is ahead of the then part,
+// inside the enclosing block and not the exit of the loop. Jumps threaded
+// through the else jump of the enclosing if are retargeted to it, as for
+// single tests.
+static void scan_condition(DecompilerContext& ctx, int pc, bool elseif) {
+    Proto* p = ctx.p;
+    DecompilerContext::CondChain& ch = ctx.chain;
+    int blk = ctx.cfg.block_of[pc];
+    if (ctx.is_simple_while(blk) && ctx.cfg.blocks[blk].end_pc == pc) return;
+    int limit = ctx.enclosing_end();
+    int over = -1;
+    if (limit >= 0 && limit - 1 > pc + 1) {
+        AlccInstruction jmp;
+        current_backend->decode_instruction((uint32_t)p->code[limit - 1], &jmp);
+        if (jmp.op == OP_JMP) over = ControlFlowGraph::branch_target(jmp, limit - 1);
+    }
+
+    AlccInstruction dec;
+    int at = pc, start = pc;
+    while (ch.tests.size() < MAX_CHAIN && at < p->sizecode) {
+        int target;
+        current_backend->decode_instruction((uint32_t)p->code[at], &dec);
+        if (dec.op == OP_TESTSET || !is_conditional_jump(p, at, &target) || target <= at + 1) break;
+        if (start != pc && ctx.loops.is_header(ctx.cfg.block_of[start])) break;
+        if (limit >= 0 && target > limit && target == over) target = limit - 1;
+        ch.tests.push_back(at);
+        ch.starts.push_back(start);
+        ch.targets.push_back(target);
+        start = at + 2;
+        if (bool_load_reg(p, start) >= 0) break;
+        for (at = start; at < p->sizecode; at++) {
+            current_backend->decode_instruction((uint32_t)p->code[at], &dec);
+            if (!is_operand_load(dec.op) || !ctx.is_temporary(dec.a, at + 1)) break;
+        }
+    }
+
+    // The longest run of tests that reads as one condition. Read as a value,
+    // the last test falls through to the false load.
+    AnalysisBlock* loop = ctx.innermost_loop();
+    for (size_t n = ch.tests.size(); n >= 1; n--) {
+        ch.tests.resize(n);
+        ch.starts.resize(n);
+        ch.targets.resize(n);
+        int then_pc = ch.tests[n - 1] + 2;
+        int else_pc = ch.targets[n - 1];
+        ch.value_reg = bool_load_reg(p, then_pc);
+        ch.elseif = elseif;
+        if (ch.value_reg >= 0) {
+            if (cond_tree(ch, 0, n, then_pc + 1, then_pc, then_pc, nullptr)) return;
+            continue;
+        }
+        if (n < 2 || else_pc <= then_pc || (loop && else_pc == loop->exit_pc) || (limit >= 0 && else_pc > limit)) continue;
+        if (cond_tree(ch, 0, n, then_pc, else_pc, then_pc, nullptr)) return;
+    }
+    ch.tests.clear();
+    ch.starts.clear();
+    ch.targets.clear();
+}
+
+// Joins the conditions of a complete chain. For an if, *dest is set to its
+// else part; for a value, to the true load.
+static Expression* chain_condition(DecompilerContext& ctx, int* dest) {
+    DecompilerContext::CondChain& ch = ctx.chain;
+    size_t n = ch.tests.size();
+    int then_pc = ch.tests[n - 1] + 2;
+    Expression* cond = nullptr;
+    if (ch.value_reg >= 0) {
+        *dest = then_pc + 1;
+        cond_tree(ch, 0, n, then_pc + 1, then_pc, then_pc, &cond);
+    } else {
+        *dest = ch.targets[n - 1];
+        cond_tree(ch, 0, n, then_pc, *dest, then_pc, &cond);
+    }
+    ch.tests.clear();
+    ch.starts.clear();
+    ch.targets.clear();
+    ch.conds.clear();
+    return cond;
+}
+
+static void open_generic_for(DecompilerContext& ctx, int pc, int a, int call_pc) {
+    Proto* p = ctx.p;
+    AlccInstruction call;
+    current_backend->decode_instruction((uint32_t)p->code[call_pc], &call);
+
+    ForInStmt* fs = new ForInStmt(new Block());
+#if defined(LUA_53) || defined(LUA_52)
+    int first_var = a + 3;
+#else
+    int first_var = a + 4;
+#endif
+    for (int j = 0; j < call.c; j++) fs->vars.push_back(ctx.reg_name(first_var + j, pc + 1));
+
+    Block* blk = ctx.current_block;
+    if (ctx.last_call && ctx.last_call_reg == a && ctx.last_call_pc == pc - 1 &&
+        !blk->statements.empty() && blk->statements.back() == ctx.last_call) {
+        // for k, v in pairs(t): the explist is the call that filled the control registers
+        fs->exprs.push_back(ctx.last_call->values[0]);
+        ctx.last_call->values.clear();
+        delete ctx.last_call;
+        blk->statements.pop_back();
+        ctx.last_call = nullptr;
+    } else {
+        for (int j = 0; j < 3; j++) fs->exprs.push_back(ctx.take_expr(a + j, pc));
+        while (fs->exprs.size() > 1) {
+            Literal* l = dynamic_cast<Literal*>(fs->exprs.back());
+            if (!l || l->type != Literal::NIL) break;
+            delete l;
+            fs->exprs.pop_back();
+        }
+    }
+    ctx.flush_all_pending(pc);
+    blk->add(fs);
+
+    int header = pc + 1 < p->sizecode ? ctx.loops.header[ctx.cfg.block_of[pc + 1]] : -1;
+    bs_push(&ctx.bs, call_pc + 2, BLOCK_LOOP, fs, fs->body, pc, header, call_pc + 2);
+    ctx.current_block = fs->body;
+}
+
+// Analysis results handed to plugins once the whole tree is built
+struct FunctionFacts {
+    ControlFlowGraph cfg;
+    Liveness liveness;
+};
+
+static bool over_budget(const DecompileBudget* budget, std::chrono::steady_clock::time_point start,
+                        size_t nodes_start, bool read_clock, DecompileBudget::Hit* hit) {
+    if (budget->max_nodes > 0) {
+        long long nodes = (long long)(ASTNode::created - nodes_start);
+        if (nodes > budget->max_nodes) {
+            *hit = {nullptr, "nodes", nodes, budget->max_nodes};
+            return true;
+        }
+    }
+    if (budget->max_ms > 0 && read_clock) {
+        long long ms = elapsed_ns(start) / 1000000;
+        if (ms > budget->max_ms) {
+            *hit = {nullptr, "time", ms, budget->max_ms};
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool passes_enabled = true;
+
+// Folds constants, chains elseifs, merges assignments and drops dead
+// temporaries in one traversal of a function body. Temporaries stay when
+// instructions missing from the tree read some of them.
+static void run_passes(Block* body, DecompileTimings* timings, bool opaque_reads) {
+    AstPassManager pm;
+    if (opaque_reads) {
+        pm.add(new_fold_constants_pass());
+        pm.add(new_elseif_pass());
+        pm.add(new_multi_assign_pass());
+    } else {
+        pm.add_defaults();
+    }
+    pm.timed = timings != nullptr;
+    pm.run(body);
+    if (!timings) return;
+    timings->passes_ns += pm.total_ns;
+    for (size_t i = 0; i < pm.passes.size() && i < (size_t)DecompileTimings::MAX_PASSES; i++) {
+        timings->pass_names[i] = pm.passes[i]->name;
+        timings->pass_ns[i] += pm.passes[i]->ns;
+        timings->pass_nodes[i] += pm.passes[i]->nodes;
+        timings->pass_rewrites[i] += pm.passes[i]->rewrites;
+    }
+}
+
+// Builds one function. Nested closures get an empty body recorded in stitches.
+// Returns NULL with hit filled in when the function goes over its time or
+// node budget; bytes are checked when the chunk is printed.
+static FunctionDecl* build_function(Proto* p, std::vector<std::pair<Proto*, Block**>>& stitches, FunctionFacts* facts,
+                                    const DecompileBudget* budget, DecompileBudget::Hit* hit) {
+    DecompileTimings* timings = active_timings;
+    std::chrono::steady_clock::time_point phase_start;
+    if (timings) phase_start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point budget_start;
+    size_t nodes_start = ASTNode::created;
+    if (budget) budget_start = std::chrono::steady_clock::now();
+    bool aborted = false;
+
     DecompilerContext ctx(p);
-    analyze_jumps(p, &ctx.ja);
+    ctx.analyze();
+
+    if (timings) {
+        timings->analysis_ns += elapsed_ns(phase_start);
+        phase_start = std::chrono::steady_clock::now();
+    }
 
     // Create Root FunctionDecl
     Block* root_block = new Block();
     ctx.root_block = root_block;
     ctx.current_block = root_block;
 
-    FunctionDecl* func_node = new FunctionDecl("", root_block); // Name filled by caller if needed
-
-    // Params
-    for(int i=0; i<p->numparams; i++) {
-        const char* name = luaF_getlocalname(p, i + 1, 0);
-        if(name) func_node->params.push_back(name);
-        else func_node->params.push_back("P" + std::to_string(i));
-    }
-    if(isvararg(p)) func_node->is_vararg = true;
+    FunctionDecl* func_node = make_function_decl(p, root_block);
 
     AlccInstruction dec;
     bool pending_elseif = false;
 
     for (int i=0; i<p->sizecode; i++) {
-        int lbl = get_label_id(&ctx.ja, i);
-        int lbl_type = get_label_type(&ctx.ja, i);
-
-        if (lbl >= 0 || lbl_type != TARGET_NORMAL) {
-            ctx.flush_all_pending(i);
+        // The clock is read every 32 instructions to keep small functions cheap
+        if (budget && over_budget(budget, budget_start, nodes_start, (i & 31) == 0, hit)) {
+            aborted = true;
+            break;
         }
+        int lbl = ctx.ja.label_id[i];
+        int lbl_type = ctx.ja.label_type[i];
 
-        if (lbl_type == TARGET_REPEAT) {
-             RepeatStmt* rep = new RepeatStmt(new Block(), nullptr);
-             ctx.current_block->add(rep);
-             bs_push(&ctx.bs, -1, BLOCK_REPEAT, rep, rep->body, i);
-             ctx.current_block = rep->body;
-        }
+        if (!ctx.open_tables.empty()) settle_tables(ctx, i);
 
-        if (lbl >= 0) {
-            ctx.current_block->add(new LabelStmt("L" + std::to_string(lbl)));
+        if (lbl >= 0 || lbl_type != TARGET_NORMAL) {
+            ctx.flush_all_pending(i);
         }
 
         current_backend->decode_instruction((uint32_t)p->code[i], &dec);
 
         int status;
-        while ((status = bs_check_end(&ctx.bs, i, p))) {
+        while ((status = bs_check_end(ctx, i))) {
             ctx.flush_all_pending(i); // Block end boundary
             if (status == 2) {
                 // ELSE transition
@@ -434,6 +1389,11 @@ ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
 
         if (dec.op == OP_FORLOOP || dec.op == OP_TFORLOOP) {
              ctx.flush_all_pending(i);
+             if (lbl >= 0) {
+                 // A jump to the latch continues the loop: the label ends the body
+                 ctx.add_label(i);
+                 lbl = -1;
+             }
              if (ctx.bs.top > 0 && ctx.bs.blocks[ctx.bs.top-1].type == BLOCK_LOOP) {
                  ctx.bs.top--;
                  if (ctx.bs.top > 0) ctx.current_block = ctx.bs.blocks[ctx.bs.top-1].ast_block;
@@ -441,6 +1401,33 @@ ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
              }
         }
 
+        // Loops start at their header: repeat when closed by a backward test,
+        // `while true` when no test at the header exits them.
+        int blk = ctx.cfg.block_of[i];
+        if (lbl_type == TARGET_REPEAT) {
+             int header = ctx.loops.is_header(blk) ? blk : -1;
+             RepeatStmt* rep = new RepeatStmt(new Block(), nullptr);
+             ctx.current_block->add(rep);
+             bs_push(&ctx.bs, -1, BLOCK_REPEAT, rep, rep->body, i, header, header >= 0 ? ctx.loops.exit_pc(header) : -1);
+             ctx.current_block = rep->body;
+        } else if (ctx.loops.is_header(blk) && ctx.loops.first_pc[blk] == i && !ctx.for_loop[blk] &&
+                   !ctx.is_simple_while(blk)) {
+             int exit_pc = ctx.loops.exit_pc(blk);
+             WhileStmt* ws = new WhileStmt(new Literal(true), new Block());
+             ctx.current_block->add(ws);
+             bs_push(&ctx.bs, exit_pc, BLOCK_WHILE, ws, ws->body, i, blk, exit_pc);
+             ctx.current_block = ws->body;
+        }
+
+        if (lbl >= 0) {
+            ctx.add_label(i);
+        }
+
+        if (ctx.cfg.blocks[blk].start_pc == i && ctx.is_simple_while(blk)) {
+            ctx.while_mark_block = ctx.current_block;
+            ctx.while_mark_size = ctx.current_block->statements.size();
+        }
+
         int op = dec.op;
         int a = dec.a;
         int b = dec.b;
@@ -462,6 +1449,36 @@ ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
                 ctx.set_expr(a, ctx.make_const(bx));
                 break;
             }
+            case OP_LOADKX: {
+                AlccInstruction extra;
+                extra.bx = 0;
+                if (i + 1 < p->sizecode) current_backend->decode_instruction((uint32_t)p->code[i + 1], &extra);
+                ctx.set_expr(a, ctx.make_const(extra.bx));
+                break;
+            }
+#if defined(LUA_53) || defined(LUA_52)
+            case OP_LOADBOOL: {
+                // With C set it is half of a comparison turned into a value;
+                // the true half of one the tests were not read into is unknown
+                if (c) break;
+                if (bool_load_reg(p, i - 1) == a) ctx.settle_opaque(i, dec);
+                else ctx.set_expr(a, new Literal(b != 0));
+                break;
+            }
+#else
+            case OP_LOADFALSE: ctx.set_expr(a, new Literal(false)); break;
+            case OP_LOADTRUE: {
+                // The true half of a comparison the tests were not read into
+                // is unknown
+                if (bool_load_reg(p, i - 1) == a) ctx.settle_opaque(i, dec);
+                else ctx.set_expr(a, new Literal(true));
+                break;
+            }
+#endif
+            case OP_LOADNIL: {
+                for (int j = 0; j <= b; j++) ctx.set_expr(a + j, new Literal());
+                break;
+            }
             case OP_GETUPVAL: {
                 ctx.set_expr(a, ctx.make_upval(b));
                 break;
@@ -515,6 +1532,7 @@ ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
                 break;
             }
             case OP_SETTABLE: {
+                if (table_store(ctx, i, dec)) break;
                 Assignment* assign = new Assignment(false);
                 Expression* key = ISK(b) ? ctx.make_const(INDEXK(b)) : ctx.get_expr(b, i);
                 assign->targets.push_back(new BinaryExpr(ctx.get_expr(a, i), "[", key));
@@ -523,6 +1541,7 @@ ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
                 break;
             }
             case OP_SETI: {
+                if (table_store(ctx, i, dec)) break;
                 Assignment* assign = new Assignment(false);
                 assign->targets.push_back(new BinaryExpr(ctx.get_expr(a, i), "[", new Literal((double)b)));
                 assign->values.push_back(k ? ctx.make_const(c) : ctx.get_expr(c, i));
@@ -530,6 +1549,7 @@ ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
                 break;
             }
             case OP_SETFIELD: {
+                if (table_store(ctx, i, dec)) break;
                 Expression* key = ttisstring(&p->k[b]) ? (Expression*)new Literal(std::string(getstr(tsvalue(&p->k[b])))) : ctx.make_const(b);
                 Assignment* assign = new Assignment(false);
                 assign->targets.push_back(new BinaryExpr(ctx.get_expr(a, i), "[", key));
@@ -604,7 +1624,10 @@ ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
                          ctx.current_block->add(a_stmt);
 
                          // We should clear pending for these targets?
-                         for(int j=0; j<c-1; j++) ctx.pending_regs[a+j] = nullptr;
+                         for(int j=0; j<c-1; j++) ctx.set_expr(a+j, nullptr);
+                         ctx.last_call = a_stmt;
+                         ctx.last_call_reg = a;
+                         ctx.last_call_pc = i;
                          // But we just assigned them. They are now holding the result of call.
                          // Can we say pending[a] = Variable(a)?
                          // No need, get_expr does that by default.
@@ -616,51 +1639,28 @@ ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
             case OP_NEWARRAY:
 #endif
             case OP_NEWTABLE: {
-                TableConstructor* tc = new TableConstructor();
-                Assignment* assign = new Assignment(false);
-                assign->targets.push_back(ctx.make_var(a, i));
-                assign->values.push_back(tc);
-                ctx.current_block->add(assign);
-                // Can't easily inline table constructor logic yet with loop below.
-
-                int table_reg = a;
-                int next_pc = i + 1;
-                while (next_pc < p->sizecode) {
-                    AlccInstruction next_inst;
-                    current_backend->decode_instruction((uint32_t)p->code[next_pc], &next_inst);
-                    if (next_inst.op == OP_EXTRAARG) { next_pc++; continue; }
-                    if (next_inst.op == OP_SETFIELD && next_inst.a == table_reg) {
-                         Expression* key = nullptr;
-                         if (ttisstring(&p->k[next_inst.b])) key = new Literal(std::string(getstr(tsvalue(&p->k[next_inst.b]))));
-                         else key = ctx.make_const(next_inst.b);
-
-                         Expression* val = next_inst.k ? ctx.make_const(next_inst.c) : ctx.get_expr(next_inst.c, next_pc);
-                         tc->fields.push_back({key, val});
-                         next_pc++;
-                    } else if (next_inst.op == OP_SETLIST && next_inst.a == table_reg) {
-                         int num = next_inst.b;
-                         if (num == 0) num = 0;
-                         for (int j=1; j<=num; j++) {
-                             tc->fields.push_back({nullptr, ctx.get_expr(next_inst.a + j, next_pc)});
-                         }
-                         next_pc++;
-                    } else if (next_inst.op == OP_SETI && next_inst.a == table_reg) {
-                         Expression* key = new Literal((double)next_inst.b);
-                         Expression* val = next_inst.k ? ctx.make_const(next_inst.c) : ctx.get_expr(next_inst.c, next_pc);
-                         tc->fields.push_back({key, val});
-                         next_pc++;
-                    } else {
-                         break;
-                    }
+                open_table(ctx, a);
+                break;
+            }
+            case OP_SETLIST: {
+                if (table_store(ctx, i, dec)) break;
+                // Outside a constructor: one indexed store per item
+                int multi;
+                int count = setlist_count(p, i, dec, &multi);
+                long long first = setlist_first(p, i, dec);
+                for (int j = 1; j <= count; j++) {
+                    Assignment* assign = new Assignment(false);
+                    assign->targets.push_back(new BinaryExpr(ctx.get_expr(a, i), "[", new Literal((double)(first + j - 1))));
+                    if (j == count && multi) assign->values.push_back(new Variable(multi == 1 ? "multret" : "..."));
+                    else assign->values.push_back(ctx.get_expr(a + j, i));
+                    ctx.current_block->add(assign);
                 }
-                i = next_pc - 1;
                 break;
             }
             case OP_CLOSURE: {
                  // Simplified closure handling
                 Proto* sub = p->p[bx];
-                ASTNode* sub_ast = build_ast(sub, plugin);
-                FunctionDecl* sub_func = dynamic_cast<FunctionDecl*>(sub_ast);
+                FunctionDecl* sub_func = make_function_decl(sub, nullptr);
                 std::string func_name;
                 bool is_local = false;
 
@@ -697,26 +1697,27 @@ ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
                     sub_func->name = func_name;
                     sub_func->is_local = is_local;
                     ctx.current_block->add(sub_func);
+                    ctx.stitches.push_back({sub, &sub_func->body});
                 } else {
                     Assignment* assign = new Assignment(false);
                     assign->targets.push_back(ctx.make_var(a, i));
-                    ClosureExpr* closure = new ClosureExpr(sub_func->body);
+                    ClosureExpr* closure = new ClosureExpr(nullptr);
                     closure->params = sub_func->params;
                     closure->is_vararg = sub_func->is_vararg;
-                    sub_func->body = nullptr;
                     delete sub_func;
                     assign->values.push_back(closure);
                     ctx.current_block->add(assign);
+                    ctx.stitches.push_back({sub, &closure->body});
                 }
-                set_proto_printed(sub);
                 break;
             }
             case OP_RETURN: {
-                ctx.flush_all_pending(i);
                 ReturnStmt* ret = new ReturnStmt();
+                ctx.flush_kept_pending(i);
                 if (b > 0) {
                     for(int j=0; j<b-1; j++) ret->values.push_back(ctx.get_expr(a+j, i));
                 }
+                ctx.flush_all_pending(i, true);
                 ctx.current_block->add(ret);
                 break;
             }
@@ -724,29 +1725,17 @@ ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
             case OP_EQ: case OP_LT: case OP_LE: case OP_EQK: case OP_EQI:
             case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
             case OP_TEST: case OP_TESTSET: {
-                ctx.flush_all_pending(i); // Control flow
                 if (i + 1 < p->sizecode) {
                     AlccInstruction next_dec;
                     current_backend->decode_instruction((uint32_t)p->code[i+1], &next_dec);
                     if (next_dec.op == OP_JMP) {
                         int dest = i + 1 + 1 + next_dec.bx;
-                        bool is_while = false;
-                        if (dest > i && dest <= p->sizecode) {
-                             AlccInstruction back_inst;
-                             if(dest>0) {
-                                 current_backend->decode_instruction((uint32_t)p->code[dest-1], &back_inst);
-                                 if (back_inst.op == OP_JMP) {
-                                     int back_dest = (dest-1)+1+back_inst.bx;
-                                     if(back_dest==i || (lbl>=0 && back_dest==i)) is_while=true;
-                                 }
-                             }
-                        }
-                        bool is_repeat = (dest <= i);
                         Expression* cond = nullptr;
                         Expression* lhs = nullptr;
                         Expression* rhs = nullptr;
                         std::string op_str = "==";
                         int cond_inv = k;
+                        ctx.flush_kept_pending(i);
 
                         #ifdef LUA_53
                         if (op == OP_TEST || op == OP_TESTSET) {
@@ -775,64 +1764,592 @@ ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
                             else if (op == OP_GEI) op_str = cond_inv ? "<" : ">=";
                             cond = new BinaryExpr(lhs, op_str, rhs);
                         }
+                        if (ctx.chain.tests.empty() && op != OP_TESTSET) scan_condition(ctx, i, pending_elseif);
+                        bool value = !ctx.chain.tests.empty() && ctx.chain.value_reg >= 0;
+                        // Control flow: operands are inlined into cond, the rest is flushed
+                        if (!value) ctx.flush_all_pending(i, true);
 
-                        if (is_while) {
-                            Block* body = new Block();
-                            WhileStmt* ws = new WhileStmt(cond, body);
-                            ctx.current_block->add(ws);
-                            bs_push(&ctx.bs, dest, BLOCK_WHILE, ws, body, i);
-                            ctx.current_block = body;
-                            i++;
-                        } else if (is_repeat) {
-                            if (ctx.bs.top > 0 && ctx.bs.blocks[ctx.bs.top-1].type == BLOCK_REPEAT) {
+                        if (!ctx.chain.tests.empty()) {
+                            ctx.chain.conds.push_back(cond);
+                            if (ctx.chain.conds.size() < ctx.chain.tests.size()) {
+                                i++;
+                                break;
+                            }
+                            pending_elseif = ctx.chain.elseif;
+                            int reg = ctx.chain.value_reg;
+                            cond = chain_condition(ctx, &dest);
+                            if (value) {
+                                // Continues after the true load
+                                ctx.set_expr(reg, cond);
+                                i = dest;
+                                break;
+                            }
+                        }
+
+                        AnalysisBlock* loop = ctx.innermost_loop();
+                        int loop_start = (loop && loop->loop_header >= 0) ? ctx.cfg.blocks[loop->loop_header].start_pc : -1;
+                        if (dest <= i && loop && loop->type != BLOCK_REPEAT && dest == loop_start && loop->exit_pc > i + 2) {
+                            // luaK_finish threads jumps to jumps: a test skipping to the
+                            // loop latch is retargeted to the header. Undo that.
+                            AlccInstruction latch;
+                            current_backend->decode_instruction((uint32_t)p->code[loop->exit_pc - 1], &latch);
+                            if (latch.op == OP_JMP && ControlFlowGraph::branch_target(latch, loop->exit_pc - 1) == dest) {
+                                dest = loop->exit_pc - 1;
+                            }
+                        }
+                        int limit = ctx.enclosing_end();
+                        if (dest > i && limit >= 0 && dest > limit && limit - 1 > i + 1) {
+                            // Same threading through the else jump of the enclosing if
+                            AlccInstruction over;
+                            current_backend->decode_instruction((uint32_t)p->code[limit - 1], &over);
+                            if (over.op == OP_JMP && ControlFlowGraph::branch_target(over, limit - 1) == dest) {
+                                dest = limit - 1;
+                            }
+                        }
+
+                        if (dest <= i) {
+                            if (ctx.bs.top > 0 && ctx.bs.blocks[ctx.bs.top-1].type == BLOCK_REPEAT &&
+                                ctx.bs.blocks[ctx.bs.top-1].exit_pc == i + 2) {
                                 RepeatStmt* rs = (RepeatStmt*)ctx.bs.blocks[ctx.bs.top-1].ast_stmt;
                                 rs->condition = cond;
                                 ctx.bs.top--;
                                 if(ctx.bs.top>0) ctx.current_block = ctx.bs.blocks[ctx.bs.top-1].ast_block;
                                 else ctx.current_block = root_block;
+                            } else {
+                                open_pending_else(ctx, pending_elseif);
+                                add_conditional_exit(ctx, cond, dest);
                             }
-                            i++;
+                        } else if (ctx.is_simple_while(blk) && ctx.cfg.blocks[blk].end_pc == i) {
+                            Block* body = new Block();
+                            Block* outer = ctx.current_block;
+                            WhileStmt* ws;
+                            if (ctx.while_mark_block == outer && outer->statements.size() == ctx.while_mark_size) {
+                                ws = new WhileStmt(cond, body);
+                            } else {
+                                // The test needs statements of its own: keep them inside the loop
+                                ws = new WhileStmt(new Literal(true), body);
+                                size_t from = ctx.while_mark_block == outer ? ctx.while_mark_size : outer->statements.size();
+                                body->statements.assign(outer->statements.begin() + from, outer->statements.end());
+                                outer->statements.resize(from);
+                            }
+                            ctx.while_mark_block = nullptr;
+                            outer->add(ws);
+                            bs_push(&ctx.bs, dest, BLOCK_WHILE, ws, body, i, blk, dest);
+                            ctx.current_block = body;
+                            if (ws->condition != cond) add_conditional_exit(ctx, cond, dest);
+                        } else if ((loop && dest == loop->exit_pc) || (limit >= 0 && dest > limit)) {
+                            open_pending_else(ctx, pending_elseif);
+                            add_conditional_exit(ctx, cond, dest);
                         } else {
                             Block* then_blk = new Block();
                             if (pending_elseif) {
-                                IfStmt* if_stmt = (IfStmt*)ctx.bs.blocks[ctx.bs.top-1].ast_stmt;
+                                AnalysisBlock& top = ctx.bs.blocks[ctx.bs.top-1];
+                                IfStmt* if_stmt = (IfStmt*)top.ast_stmt;
                                 if_stmt->clauses.push_back({cond, then_blk});
-                                ctx.bs.blocks[ctx.bs.top-1].ast_block = then_blk;
+                                top.ast_block = then_blk;
+                                top.target_pc = dest;
+                                top.start_pc = i;
                             } else {
                                 IfStmt* if_stmt = new IfStmt();
                                 if_stmt->clauses.push_back({cond, then_blk});
                                 ctx.current_block->add(if_stmt);
-                                bs_push(&ctx.bs, dest, BLOCK_IF, if_stmt, then_blk);
+                                bs_push(&ctx.bs, dest, BLOCK_IF, if_stmt, then_blk, i);
                             }
                             ctx.current_block = then_blk;
-                            pending_elseif = false;
-                            i++;
                         }
+                        pending_elseif = false;
+                        i++;
                         break;
                     }
                 }
+                ctx.flush_all_pending(i); // Test without a paired jump
+                break;
+            }
+
+            case OP_JMP: {
+                int target = ControlFlowGraph::branch_target(dec, i);
+                int call_pc = generic_for_call(p, i, dec);
+                if (call_pc >= 0) {
+                    open_generic_for(ctx, i, a, call_pc);
+                    break;
+                }
+                if (target == i + 1 || ctx.is_else_jump(i)) break;
+                AnalysisBlock* loop = ctx.innermost_loop();
+                if (loop && loop->loop_header >= 0 && i + 1 == loop->exit_pc &&
+                    target == ctx.cfg.blocks[loop->loop_header].start_pc) {
+                    break; // back edge closing the loop
+                }
+                ctx.flush_all_pending(i);
+                Statement* jump = ctx.make_jump(target);
+                if (jump) ctx.current_block->add(jump);
+                break;
+            }
+
+            case OP_FORPREP: {
+                int end_pc = forloop_pc(dec, i);
+                Expression* start = ctx.take_expr(a, i);
+                Expression* limit = ctx.take_expr(a + 1, i);
+                Expression* step = ctx.take_expr(a + 2, i);
+                Literal* one = dynamic_cast<Literal*>(step);
+                if (one && one->type == Literal::NUMBER && one->number_val == 1) {
+                    delete step;
+                    step = nullptr;
+                }
+                ctx.flush_all_pending(i);
+                ForNumStmt* fs = new ForNumStmt(ctx.reg_name(a + 3, i + 1), start, limit, step, new Block());
+                ctx.current_block->add(fs);
+                int header = i + 1 < p->sizecode ? ctx.loops.header[ctx.cfg.block_of[i + 1]] : -1;
+                bs_push(&ctx.bs, end_pc + 1, BLOCK_LOOP, fs, fs->body, i, header, end_pc + 1);
+                ctx.current_block = fs->body;
+                break;
+            }
+
+            case OP_TFORPREP: {
+                int call_pc = generic_for_call(p, i, dec);
+                if (call_pc >= 0) open_generic_for(ctx, i, a, call_pc);
                 break;
             }
 
             default:
                  // Fallback or todo
+                 if (!expressed_elsewhere(op)) ctx.settle_opaque(i, dec);
                  break;
         }
 
+        ctx.drop_dead_temps(i);
         pending_elseif = false;
     }
 
-    // End flush
-    ctx.flush_all_pending(p->sizecode);
+    if (aborted) ctx.discard();
+    else close_tables(ctx, p->sizecode);
+
+    if (!aborted) {
+        // End flush
+        ctx.flush_all_pending(p->sizecode);
+        ctx.prune_labels();
+        if (passes_enabled) run_passes(root_block, timings, ctx.opaque_reads);
+        if (budget) aborted = over_budget(budget, budget_start, nodes_start, true, hit);
+    }
+    if (aborted) {
+        delete func_node;
+        func_node = nullptr;
+        ctx.stitches.clear();
+    }
 
+    stitches.swap(ctx.stitches);
+    if (facts) {
+        facts->cfg = std::move(ctx.cfg);
+        facts->liveness = std::move(ctx.liveness);
+    }
+    if (timings) {
+        timings->walk_ns += elapsed_ns(phase_start);
+        timings->functions++;
+    }
     return func_node;
 }
 
-void DecompilerCore::decompile(Proto* p, int level, AlccPlugin* plugin, const char* name_override) {
-    ASTNode* root = build_ast(p, plugin);
+static DecompileCache* active_cache = nullptr;
+static DecompileBudget* active_budget = nullptr;
+
+void DecompilerCore::set_cache(DecompileCache* cache) {
+    active_cache = cache;
+}
+
+void DecompilerCore::set_budget(DecompileBudget* budget) {
+    active_budget = budget;
+}
+
+void DecompilerCore::set_passes(bool enabled) {
+    passes_enabled = enabled;
+}
+
+void DecompilerCore::set_timings(DecompileTimings* timings) {
+    active_timings = timings;
+}
+
+void DecompileTimings::reset() {
+    functions = 0;
+    analysis_ns = 0;
+    walk_ns = 0;
+    flush_ns = 0;
+    print_ns = 0;
+    flush_calls = 0;
+    flush_slots = 0;
+    frame_slots = 0;
+    dead_temps = 0;
+    passes_ns = 0;
+    for (int i = 0; i < MAX_PASSES; i++) {
+        pass_names[i] = nullptr;
+        pass_ns[i] = 0;
+        pass_nodes[i] = 0;
+        pass_rewrites[i] = 0;
+    }
+}
+
+void DecompileTimings::print(FILE* f) {
+    fprintf(f, "Decompile timing (%lld functions):\n", (long long)functions);
+    fprintf(f, "  analysis  %10.3f ms\n", analysis_ns / 1e6);
+    fprintf(f, "  walk      %10.3f ms (flush %.3f ms, passes %.3f ms)\n", walk_ns / 1e6, flush_ns / 1e6,
+            passes_ns / 1e6);
+    fprintf(f, "  print     %10.3f ms\n", print_ns / 1e6);
+    fprintf(f, "  flush_all_pending: %lld calls, %lld slots visited (full frame scan: %lld)\n",
+            (long long)flush_calls, (long long)flush_slots, (long long)frame_slots);
+    fprintf(f, "  dead temporaries dropped by liveness: %lld\n", (long long)dead_temps);
+    long long in_passes = 0;
+    for (int i = 0; i < MAX_PASSES && pass_names[i]; i++) {
+        fprintf(f, "  pass %-14s %10.3f ms  %lld nodes, %lld rewrites\n", pass_names[i].load(), pass_ns[i] / 1e6,
+                (long long)pass_nodes[i], (long long)pass_rewrites[i]);
+        in_passes += pass_ns[i];
+    }
+    if (pass_names[0]) fprintf(f, "  pass traversal     %10.3f ms\n", (passes_ns - in_passes) / 1e6);
+}
+
+void DecompileBudget::print(FILE* f) {
+    fprintf(f, "Decompile budget: %d of %lld functions over budget, printed as disassembly\n",
+            (int)hits.size(), functions);
+    for (const Hit& h : hits) {
+        if (h.p->linedefined == 0) fprintf(f, "  main chunk");
+        else fprintf(f, "  function at lines %d-%d", h.p->linedefined, h.p->lastlinedefined);
+        fprintf(f, ": %s %lld%s > %lld\n", h.limit, h.used, strcmp(h.limit, "time") == 0 ? " ms" : "", h.max);
+    }
+}
+
+// Stand-in for a function over budget: the template's listing as comments.
+// Nested functions still decompile and follow as local functions.
+static FunctionDecl* listing_function(Proto* p, const DecompileBudget::Hit& hit, const DecompileListing& listing,
+                                      std::vector<std::pair<Proto*, Block**>>& stitches) {
+    std::string text = std::string("-- decompilation skipped: ") + hit.limit + " budget exceeded ("
+                       + std::to_string(hit.used) + " > " + std::to_string(hit.max) + ")";
+    if (listing) {
+        char* buf = nullptr;
+        size_t len = 0;
+        FILE* mem = open_memstream(&buf, &len);
+        if (mem) {
+            listing(p, mem);
+            fclose(mem);
+            size_t start = 0;
+            while (start < len) {
+                size_t end = start;
+                while (end < len && buf[end] != '\n') end++;
+                text += "\n-- ";
+                text.append(buf + start, end - start);
+                start = end + 1;
+            }
+            free(buf);
+        }
+    }
+    Block* body = new Block();
+    body->add(new RawStmt(text));
+    for (int c = 0; c < p->sizep; c++) {
+        FunctionDecl* sub = make_function_decl(p->p[c], nullptr);
+        sub->name = "closure_" + std::to_string(c);
+        sub->is_local = true;
+        body->add(sub);
+        stitches.push_back({p->p[c], &sub->body});
+    }
+    return make_function_decl(p, body);
+}
+
+// Functions of one chunk in pre-order; protos[0] is the root
+struct ProtoTree {
+    std::vector<Proto*> protos;
+    std::vector<size_t> parent;       // index of the enclosing function, -1 for the root
+    std::unordered_map<Proto*, size_t> index;
+    std::vector<uint64_t> hashes;
+    std::vector<Block*> bodies;       // body of each decompiled function in the final AST
+    std::vector<unsigned char> fresh; // decompiled in this run rather than spliced from the cache
+    std::vector<unsigned char> listed; // function or a nested one fell back to disassembly
+};
+
+static Block* cached_body(const std::string& text) {
+    Block* body = new Block();
+    if (!text.empty()) body->add(new RawStmt(text));
+    return body;
+}
+
+static FunctionDecl* build_tree(Proto* p, AlccPlugin* plugin, DecompileCache* cache, const DecompileListing& listing,
+                                ProtoTree& tree) {
+    // Every function of the tree is an independent task
+    std::vector<Proto*>& protos = tree.protos;
+    std::unordered_map<Proto*, size_t>& index = tree.index;
+    std::vector<size_t>& parent = tree.parent;
+    std::vector<std::pair<Proto*, size_t>> stack(1, {p, (size_t)-1});
+    while (!stack.empty()) {
+        Proto* f = stack.back().first;
+        size_t up = stack.back().second;
+        stack.pop_back();
+        index[f] = protos.size();
+        parent.push_back(up);
+        protos.push_back(f);
+        for (int j = f->sizep - 1; j >= 0; j--) stack.push_back({f->p[j], protos.size() - 1});
+    }
+    size_t n = protos.size();
+    tree.bodies.assign(n, nullptr);
+    tree.fresh.assign(n, 1);
+    tree.listed.assign(n, 0);
+
+    // Cached subtrees are spliced whole; only the remaining functions become tasks
+    std::vector<const std::string*> cached(n, nullptr);
+    if (cache) {
+        tree.hashes.assign(n, 0);
+        std::vector<uint64_t> children;
+        for (size_t j = n; j-- > 0;) {
+            Proto* f = protos[j];
+            children.resize(f->sizep);
+            for (int c = 0; c < f->sizep; c++) children[c] = tree.hashes[index[f->p[c]]];
+            tree.hashes[j] = DecompileCache::hash_proto(f, children.data());
+        }
+        for (size_t j = 0; j < n; j++) {
+            if (parent[j] != (size_t)-1 && !tree.fresh[parent[j]]) {
+                tree.fresh[j] = 0;
+            } else if ((cached[j] = cache->lookup(tree.hashes[j]))) {
+                tree.fresh[j] = 0;
+                cache->reused_bytes += cached[j]->size();
+            }
+            if (tree.fresh[j]) cache->misses++;
+            else cache->hits++;
+        }
+    }
+
+    // Largest functions first so the longest task never starts last
+    std::vector<size_t> order;
+    for (size_t j = 0; j < n; j++) if (tree.fresh[j]) order.push_back(j);
+    std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+        return protos[x]->sizecode > protos[y]->sizecode;
+    });
+
+    DecompileBudget* budget = (active_budget && active_budget->enabled()) ? active_budget : nullptr;
+    std::vector<FunctionDecl*> results(n, nullptr);
+    std::vector<std::vector<std::pair<Proto*, Block**>>> stitches(n);
+    std::vector<FunctionFacts> facts((plugin && plugin->on_liveness) ? n : 0);
+    std::vector<DecompileBudget::Hit> over(budget ? n : 0, DecompileBudget::Hit{nullptr, nullptr, 0, 0});
+    TaskPool::run(order, [&](size_t j) {
+        results[j] = build_function(protos[j], stitches[j], facts.empty() ? nullptr : &facts[j],
+                                    budget, budget ? &over[j] : nullptr);
+    });
+
+    // Listings go through the template and its plugin hooks, so they run here
+    if (budget) {
+        budget->functions += (long long)order.size();
+        for (size_t j = 0; j < n; j++) {
+            if (!over[j].limit) continue;
+            over[j].p = protos[j];
+            budget->hits.push_back(over[j]);
+            results[j] = listing_function(protos[j], over[j], listing, stitches[j]);
+            for (size_t k = j; k != (size_t)-1 && !tree.listed[k]; k = parent[k]) tree.listed[k] = 1;
+        }
+    }
+
+    // Plugins see every function's liveness in proto order, on this thread
+    for (size_t j = 0; j < facts.size(); j++) {
+        if (!tree.fresh[j]) continue;
+        FunctionFacts& f = facts[j];
+        AlccLiveness live;
+        live.num_blocks = f.cfg.num_blocks();
+        live.blocks = (const int*)f.cfg.blocks.data();
+        live.live_in = f.liveness.live_in.empty() ? nullptr : f.liveness.live_in[0].w;
+        live.live_out = f.liveness.live_out.empty() ? nullptr : f.liveness.live_out[0].w;
+        plugin->on_liveness(protos[j], &live);
+    }
+    for (size_t j = 0; j < n; j++) if (results[j]) tree.bodies[j] = results[j]->body;
+
+    // Stitch bodies in proto order; the output does not depend on scheduling
+    for (size_t j = 0; j < n; j++) {
+        for (auto& st : stitches[j]) {
+            size_t k = index[st.first];
+            if (cached[k]) {
+                *st.second = tree.bodies[k] = cached_body(*cached[k]);
+                continue;
+            }
+            FunctionDecl* sub = results[k];
+            *st.second = sub->body ? sub->body : new Block();
+            sub->body = nullptr;
+        }
+    }
+    for (size_t j = 1; j < n; j++) delete results[j];
+    if (cached[0]) return make_function_decl(p, tree.bodies[0] = cached_body(*cached[0]));
+    return results[0];
+}
+
+// --budget-bytes, after the chunk was printed with sizes: functions whose own
+// text went over the limit get their listing instead, with their nested
+// bodies moved into its stubs. The chunk's hits start at first. Returns
+// whether the chunk must be printed again.
+static bool list_over_bytes(ProtoTree& tree, std::unordered_map<const Block*, LuaPrinter::BodySize>& sizes,
+                            DecompileBudget* budget, const DecompileListing& listing, size_t first) {
+    bool any = false;
+    for (size_t j = 0; j < tree.protos.size(); j++) {
+        if (!tree.fresh[j] || tree.listed[j] || !tree.bodies[j]) continue;
+        auto it = sizes.find(tree.bodies[j]);
+        if (it == sizes.end() || (long long)it->second.bytes <= budget->max_bytes) continue;
+        DecompileBudget::Hit hit = {tree.protos[j], "bytes", (long long)it->second.bytes, budget->max_bytes};
+        budget->hits.push_back(hit);
+        std::vector<std::pair<Proto*, Block**>> stubs;
+        FunctionDecl* decl = listing_function(tree.protos[j], hit, listing, stubs);
+        for (auto& st : stubs) {
+            size_t k = tree.index[st.first];
+            auto sub = tree.bodies[k] ? sizes.find(tree.bodies[k]) : sizes.end();
+            if (sub == sizes.end()) {
+                *st.second = new Block();
+                continue;
+            }
+            *sub->second.slot = nullptr;
+            *st.second = tree.bodies[k];
+            sub->second.slot = st.second;
+        }
+        Block** slot = it->second.slot;
+        sizes.erase(it);
+        ast_dispose(*slot);
+        *slot = tree.bodies[j] = decl->body;
+        decl->body = nullptr;
+        delete decl;
+        for (size_t k = j; k != (size_t)-1 && !tree.listed[k]; k = tree.parent[k]) tree.listed[k] = 1;
+        any = true;
+    }
+    if (!any) return false;
+    // Keep the hits of this chunk in proto order
+    std::stable_sort(budget->hits.begin() + first, budget->hits.end(),
+                     [&](const DecompileBudget::Hit& x, const DecompileBudget::Hit& y) {
+                         return tree.index[x.p] < tree.index[y.p];
+                     });
+    return true;
+}
+
+ASTNode* DecompilerCore::build_ast(Proto* p, AlccPlugin* plugin) {
+    ProtoTree tree;
+    // A plugin rewriting the AST would be bypassed by cached text, and the
+    // cache holds text the passes ran on
+    DecompileCache* cache = ((plugin && plugin->on_ast_process) || !passes_enabled) ? nullptr : active_cache;
+    return build_tree(p, plugin, cache, DecompileListing(), tree);
+}
+
+void DecompilerCore::decompile(Proto* p, int level, AlccPlugin* plugin, const char* name_override,
+                               const DecompileListing& listing) {
+    ProtoTree tree;
+    DecompileCache* cache = ((plugin && plugin->on_ast_process) || !passes_enabled) ? nullptr : active_cache;
+    DecompileBudget* bytes_budget = (active_budget && active_budget->max_bytes > 0) ? active_budget : nullptr;
+    size_t first_hit = bytes_budget ? bytes_budget->hits.size() : 0;
+    ASTNode* root = build_tree(p, plugin, cache, listing, tree);
     if (plugin && plugin->on_ast_process) plugin->on_ast_process(root);
+    std::chrono::steady_clock::time_point print_start;
+    if (active_timings) print_start = std::chrono::steady_clock::now();
     LuaPrinter printer;
     printer.indent_level = level;
+    std::unordered_map<const Block*, LuaPrinter::BodySize> sizes;
+    if (bytes_budget) {
+        // Sizes are taken while printing; the text is held until they pass
+        printer.body_sizes = &sizes;
+        printer.hold = true;
+    }
     root->accept(printer);
+    if (bytes_budget && list_over_bytes(tree, sizes, bytes_budget, listing, first_hit)) {
+        printer.discard();
+        printer.body_sizes = nullptr;
+        root->accept(printer);
+    }
+    printer.flush();
     printf("\n");
+    if (active_timings) active_timings->print_ns += elapsed_ns(print_start);
+
+    if (cache) {
+        // Bodies are stored unindented; RawStmt re-indents them on splice
+        for (size_t j = 0; j < tree.protos.size(); j++) {
+            // A listing is not kept: a later run with other limits may decompile it
+            if (!tree.fresh[j] || tree.listed[j] || !tree.bodies[j]) continue;
+            std::ostringstream text;
+            LuaPrinter body_printer(text);
+            tree.bodies[j]->accept(body_printer);
+            body_printer.flush();
+            std::string s = text.str();
+            if (!s.empty() && s.back() == '\n') s.pop_back();
+            cache->store(tree.hashes[j], s);
+        }
+    }
+}
+
+void DecompilerCore::stream_ndjson(Proto* p, FILE* out, bool source) {
+    // Functions in pre-order with their --func paths ("" is the main function)
+    std::vector<Proto*> protos;
+    std::vector<std::string> paths;
+    std::unordered_map<Proto*, size_t> index;
+    std::vector<std::pair<Proto*, std::string>> stack(1, {p, std::string()});
+    while (!stack.empty()) {
+        Proto* f = stack.back().first;
+        std::string path = stack.back().second;
+        stack.pop_back();
+        index[f] = protos.size();
+        protos.push_back(f);
+        paths.push_back(path);
+        for (int j = f->sizep - 1; j >= 0; j--) {
+            stack.push_back({f->p[j], path.empty() ? std::to_string(j) : path + "/" + std::to_string(j)});
+        }
+    }
+    size_t n = protos.size();
+
+    // Lines finished ahead of their turn wait here; the rest go straight out
+    std::mutex lock;
+    std::vector<std::string> ready(n);
+    std::vector<unsigned char> done(n, 0);
+    size_t next = 0;
+
+    std::vector<size_t> order(n);
+    for (size_t j = 0; j < n; j++) order[j] = j;
+    TaskPool::run(order, [&](size_t j) {
+        Proto* f = protos[j];
+        std::vector<std::pair<Proto*, Block**>> stitches;
+        FunctionDecl* func = build_function(f, stitches, nullptr, nullptr, nullptr);
+
+        thread_local std::string line;
+        line.clear();
+        line.append("{\"path\":");
+        JsonWriter::write_string(line, paths[j]);
+        line.append(",\"line\":" + std::to_string(f->linedefined));
+        line.append(",\"last_line\":" + std::to_string(f->lastlinedefined));
+        line.append(",\"params\":[");
+        for (size_t i = 0; i < func->params.size(); i++) {
+            if (i > 0) line.push_back(',');
+            JsonWriter::write_string(line, func->params[i]);
+        }
+        line.append(func->is_vararg ? "],\"vararg\":true" : "],\"vararg\":false");
+        if (source) {
+            // Nested bodies print as a pointer to their own line
+            std::vector<Block*> stubs;
+            for (auto& st : stitches) {
+                Block* stub = new Block();
+                stub->add(new RawStmt("-- function " + paths[index[st.first]]));
+                *st.second = stub;
+                stubs.push_back(stub);
+            }
+            std::ostringstream text;
+            LuaPrinter printer(text);
+            func->body->accept(printer);
+            printer.flush();
+            line.append(",\"source\":");
+            JsonWriter::write_string(line, text.str());
+            for (size_t i = 0; i < stitches.size(); i++) {
+                *stitches[i].second = nullptr;
+                delete stubs[i];
+            }
+        } else {
+            JsonWriter writer(line);
+            for (auto& st : stitches) writer.proto_refs[st.second] = paths[index[st.first]];
+            line.append(",\"ast\":");
+            func->body->accept(writer);
+        }
+        line.append("}\n");
+        delete func;
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (j != next) {
+            ready[j] = line;
+            done[j] = 1;
+            return;
+        }
+        fwrite(line.data(), 1, line.size(), out);
+        for (next++; next < n && done[next]; next++) {
+            fwrite(ready[next].data(), 1, ready[next].size(), out);
+            std::string().swap(ready[next]);
+        }
+        fflush(out);
+    });
 }
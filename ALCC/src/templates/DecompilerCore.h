@@ -9,10 +9,80 @@ extern "C" {
 #include "lobject.h"
 }
 
+#include <atomic>
+#include <functional>
+#include <vector>
+
+class DecompileCache;
+
+// Per-phase totals over a run, summed across worker threads
+struct DecompileTimings {
+    std::atomic<long long> functions;
+    std::atomic<long long> analysis_ns; // CFG, dominators, loops, labels
+    std::atomic<long long> walk_ns;     // AST construction, flushes included
+    std::atomic<long long> flush_ns;
+    std::atomic<long long> print_ns;
+    std::atomic<long long> flush_calls;
+    std::atomic<long long> flush_slots; // occupied registers visited by flush_all_pending
+    std::atomic<long long> frame_slots; // registers a full frame scan would have visited
+    std::atomic<long long> dead_temps;  // pending temporaries dropped as dead by liveness
+    std::atomic<long long> passes_ns;   // AST passes, part of walk
+
+    // Per AST pass, in the order they run
+    static const int MAX_PASSES = 8;
+    std::atomic<const char*> pass_names[MAX_PASSES];
+    std::atomic<long long> pass_ns[MAX_PASSES];
+    std::atomic<long long> pass_nodes[MAX_PASSES];
+    std::atomic<long long> pass_rewrites[MAX_PASSES];
+
+    DecompileTimings() { reset(); }
+    void reset();
+    void print(FILE* f);
+};
+
+// Per-function limits (0 = none). A function over any of them is printed as
+// the template's annotated disassembly; the rest of the chunk is unaffected.
+// Nodes and bytes count the function alone, without its nested functions.
+struct DecompileBudget {
+    long long max_ms;
+    long long max_nodes;
+    long long max_bytes;
+
+    struct Hit {
+        Proto* p;
+        const char* limit; // "time", "nodes" or "bytes"
+        long long used;
+        long long max;
+    };
+    std::vector<Hit> hits; // in proto order
+    long long functions;   // functions checked against the limits
+
+    DecompileBudget() : max_ms(0), max_nodes(0), max_bytes(0), functions(0) {}
+    bool enabled() const { return max_ms > 0 || max_nodes > 0 || max_bytes > 0; }
+    void print(FILE* f);
+};
+
+// Writes the annotated disassembly of one function, nested functions excluded
+typedef std::function<void(Proto* p, FILE* out)> DecompileListing;
+
 class DecompilerCore {
 public:
-    static void decompile(Proto* p, int level, AlccPlugin* plugin, const char* name_override = NULL);
+    // Splice unchanged functions from cache and record new ones (NULL disables)
+    static void set_cache(DecompileCache* cache);
+    // Accumulate phase timings into timings (NULL disables)
+    static void set_timings(DecompileTimings* timings);
+    // Enforce per-function limits and record the functions over them (NULL disables)
+    static void set_budget(DecompileBudget* budget);
+    // Run the built-in AST passes on each function (on by default)
+    static void set_passes(bool enabled);
+    static void decompile(Proto* p, int level, AlccPlugin* plugin, const char* name_override = NULL,
+                          const DecompileListing& listing = DecompileListing());
     static ASTNode* build_ast(Proto* p, AlccPlugin* plugin);
+    // Writes one JSON object per function to out, one per line, as soon as it
+    // and every function before it in proto order are built: path, line
+    // range, params and the body as an AST or as Lua source. Nested bodies
+    // are referenced by path. The cache and budgets are not used.
+    static void stream_ndjson(Proto* p, FILE* out, bool source);
 };
 
 #endif
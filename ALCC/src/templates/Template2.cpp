@@ -1,64 +1,67 @@
 #include "Template2.h"
 #include "../core/compat.h"
 #include "DecompilerCore.h"
+#include "../plugin/alcc_plugin_host.h"
 #include <iostream>
 
 void Template2::decompile(Proto* p, int level, AlccPlugin* plugin) {
-    DecompilerCore::decompile(p, level, plugin);
+    // Functions over a decompile budget fall back to this template's listing
+    DecompilerCore::decompile(p, level, plugin, NULL, [this, plugin](Proto* f, FILE* out) {
+        print_code(f, 0, plugin, out);
+    });
 }
 
 void Template2::disassemble(Proto* p, AlccPlugin* plugin) {
     print_proto(p, 0, plugin);
 }
 
-void Template2::print_code(Proto* p, int level, AlccPlugin* plugin) {
-    char buffer[4096];
-    AlccInstruction dec;
+void Template2::print_code(Proto* p, int level, AlccPlugin* plugin, FILE* out) {
+    PluginOverrides overrides;
+    overrides.collect(plugin, p);
 
     for (int i = 0; i < p->sizecode; i++) {
-        Instruction inst = p->code[i];
-
-        current_backend->decode_instruction((uint32_t)inst, &dec);
+        const AlccInstruction& dec = overrides.code()[i];
         const AlccOpInfo* info = current_backend->get_op_info(dec.op);
 
-        printf("%*s  ", level*2, "");
+        fprintf(out, "%*s  ", level*2, "");
 
         // Plugin Hook
-        if (plugin && plugin->on_instruction) {
-            if (plugin->on_instruction(p, i, buffer, sizeof(buffer))) {
-                printf("%s\n", buffer);
-                continue;
-            }
+        const char* text;
+        size_t text_len;
+        if (plugin && (text = overrides.find(i, &text_len))) {
+            fwrite(text, 1, text_len, out);
+            fputc('\n', out);
+            continue;
         }
 
         if (!info) {
-            printf("UNKNOWN(%d)\n", dec.op);
+            fprintf(out, "UNKNOWN(%d)\n", dec.op);
             continue;
         }
 
-        printf("%s", info->name);
+        fprintf(out, "%s", info->name);
 
         switch (info->mode) {
             case ALCC_iABC:
-                printf(" %d %d %d", dec.a, dec.b, dec.c);
-                if (info->has_k && dec.k) printf(" k");
+                fprintf(out, " %d %d %d", dec.a, dec.b, dec.c);
+                if (info->has_k && dec.k) fprintf(out, " k");
                 break;
             case ALCC_ivABC:
-                printf(" %d %d %d", dec.a, dec.b, dec.c);
-                if (info->has_k && dec.k) printf(" k");
+                fprintf(out, " %d %d %d", dec.a, dec.b, dec.c);
+                if (info->has_k && dec.k) fprintf(out, " k");
                 break;
             case ALCC_iABx:
-                printf(" %d %d", dec.a, dec.bx);
+                fprintf(out, " %d %d", dec.a, dec.bx);
                 break;
             case ALCC_iAsBx:
-                printf(" %d %d", dec.a, dec.bx);
+                fprintf(out, " %d %d", dec.a, dec.bx);
                 break;
             case ALCC_iAx:
-                printf(" %d", dec.bx);
+                fprintf(out, " %d", dec.bx);
                 break;
             case ALCC_isJ:
-                printf(" %d", dec.bx);
-                if (info->has_k && dec.k) printf(" k");
+                fprintf(out, " %d", dec.bx);
+                if (info->has_k && dec.k) fprintf(out, " k");
                 break;
         }
 
@@ -68,15 +71,15 @@ void Template2::print_code(Proto* p, int level, AlccPlugin* plugin) {
             if (bx < p->sizek) {
                 TValue* k = &p->k[bx];
                 if (ttisstring(k)) {
-                    printf(" ; ");
-                    alcc_print_string(getstr(tsvalue(k)), tsslen(tsvalue(k)));
+                    fprintf(out, " ; ");
+                    alcc_print_string(getstr(tsvalue(k)), tsslen(tsvalue(k)), out);
                 }
-                else if (ttisinteger(k)) printf(" ; %lld", ivalue(k));
-                else if (ttisnumber(k)) printf(" ; %f", fltvalue(k));
+                else if (ttisinteger(k)) fprintf(out, " ; %lld", ivalue(k));
+                else if (ttisnumber(k)) fprintf(out, " ; %f", fltvalue(k));
             }
         }
 
-        printf("\n");
+        fprintf(out, "\n");
     }
 }
 
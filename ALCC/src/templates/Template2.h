@@ -30,7 +30,7 @@ public:
 
 private:
     void print_proto(Proto* p, int level, AlccPlugin* plugin);
-    void print_code(Proto* p, int level, AlccPlugin* plugin);
+    void print_code(Proto* p, int level, AlccPlugin* plugin, FILE* out = stdout);
 
     char* get_line(ParseCtx* ctx, AlccPlugin* plugin);
     void parse_error(ParseCtx* ctx, const char* fmt, ...);
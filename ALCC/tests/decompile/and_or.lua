@@ -0,0 +1,26 @@
+-- Tests joined by `and` and `or` read as one condition, so the else part
+-- is not entered by a goto from the then part
+local x, y = X, Y
+local r
+if x > 1 and (y < 3 or y > 6) then
+  r = 1
+else
+  r = 2
+end
+if x and y or r then
+  r = 3
+else
+  r = 4
+end
+if x == 1 or y == 2 then
+  if x and y then r = 5 else r = 6 end
+elseif x == 5 and (y == 5 or y == 7) then
+  r = 7
+end
+for k = 1, 3 do
+  if y == k then
+    r = k
+    break
+  end
+end
+print(r)
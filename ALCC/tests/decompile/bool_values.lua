@@ -0,0 +1,8 @@
+-- Comparisons read as values: the tests jump between a false load that
+-- skips a true load, and the value is the comparison, not a constant
+local a, b = A, B
+local z1 = not (a == b)
+local z2 = a == b
+local z3 = a ~= false and b == 2
+local z4 = a == 1 or b < 3
+print(z1, z2, z3, z4)
@@ -0,0 +1,42 @@
+local one, two = 1, 2
+local out = {}
+
+local function classify(n, zero)
+  local kind
+  if n < zero then
+    kind = "negative"
+  elseif n == zero then
+    kind = "zero"
+  else
+    kind = "positive"
+  end
+  out[n] = kind
+end
+
+local total = 0
+for i = 1, 10 do
+  if i < two or i > total then
+    total = total + i
+  end
+end
+
+local j = 0
+while j < 5 do
+  j = j + one
+  if j == 4 then
+    break
+  end
+end
+
+local k = 10
+repeat
+  k = k - two
+until k < 0
+
+local names = {}
+for key, value in pairs({a = 1, b = 2}) do
+  names[key] = value
+end
+
+classify(total, j)
+print(out[total], total, j, k)
@@ -0,0 +1,12 @@
+-- An if/else at the end of a generic for body jumps to the TFORCALL,
+-- like the jump opening the loop on 5.2 and 5.3, and stays an if/else
+local t, c = {1, 2}, X
+local a, b = 0, 0
+for i, v in ipairs(t) do
+  if c then
+    a = a + v
+  else
+    b = b + i
+  end
+end
+print(a, b)
@@ -0,0 +1,8 @@
+-- Finite numbers near the top of the double range print as themselves;
+-- only infinities print as a division
+local a = 1.5e308
+local b = 1.7976931348623157e308
+local c = -1e308
+local d = 2 ^ 1024
+local e = -(2 ^ 1024)
+print(a, b, c, d, e)
@@ -0,0 +1,15 @@
+local t, n, two = {}, 0, 2
+for k, v in pairs({1, 2, 3}) do
+  if v < two or v > n then
+    n = n + v
+  end
+end
+local s = 0
+for i = 1, 3 do
+  for j2 = 1, 3 do
+    if j2 == i or i > j2 then
+      s = s + j2
+    end
+  end
+end
+print(n, s)
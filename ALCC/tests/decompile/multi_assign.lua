@@ -0,0 +1,14 @@
+-- Adjacent stores of constants, locals and upvalues merge into one
+-- assignment; stores of global reads stay separate
+local p, q, r = 0, 0, 0
+for i = 1, 3 do
+  p = X
+  q = i
+  r = Y
+end
+local s, t
+while p do
+  s = 1
+  t = p
+end
+print(p, q, r, s, t)
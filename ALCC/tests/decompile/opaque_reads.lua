@@ -0,0 +1,9 @@
+-- Values read only by instructions the decompiler does not express
+-- (RETURN1, ADDI) must still be stored
+local function one() return 1 end
+local function append(r, x)
+  r[#r + 1] = x
+end
+local r = {}
+append(r, one())
+print(#r)
@@ -0,0 +1,14 @@
+-- Constructor fields are folded only from values the decompiler holds:
+-- i * 2 (MULK) is not expressed, so its SETLIST stays a store per item,
+-- and locals declared after a constructor are not its items
+local r = {}
+for i = 1, 3 do
+  r[i] = {i, i * 2}
+end
+local t = {}
+local one = 1
+local j = 0
+j = j + one
+t[j] = 1
+local u = {1, 2, x = r, [3] = "c"}
+print(r, t, u)
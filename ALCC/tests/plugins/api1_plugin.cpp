@@ -0,0 +1,33 @@
+// A plugin built against plugin API 1: its struct ends at on_ast_process and
+// it does not export alcc_plugin_api. Non-null words follow the struct, so a
+// tool that reads the later fields of such a plugin calls into them and crashes.
+#include "alcc_plugin.h"
+
+typedef struct {
+    const char* name;
+    void (*post_load)(lua_State* L, Proto* p);
+    int (*on_instruction)(Proto* p, int pc, char* out_buffer, size_t buffer_size);
+    void (*on_disasm_header)(Proto* p);
+    void (*on_asm_line)(ParseCtx* ctx, char* line);
+    int (*on_decompile_inst)(Proto* p, int pc, char* out_buffer, size_t buffer_size);
+    void (*on_ast_process)(void* root);
+} AlccPluginV1;
+
+static int v1_on_instruction(Proto* p, int pc, char* out_buffer, size_t buffer_size) {
+    (void)p;
+    if (pc != 0) return 0;
+    snprintf(out_buffer, buffer_size, "[API1] first instruction");
+    return 1;
+}
+
+static struct {
+    AlccPluginV1 plugin;
+    const void* after[4];
+} image = {
+    { "API 1 Plugin", NULL, v1_on_instruction, NULL, NULL, NULL, NULL },
+    { (const void*)1, (const void*)1, (const void*)1, (const void*)1 }
+};
+
+extern "C" AlccPlugin* alcc_plugin_init(void) {
+    return (AlccPlugin*)&image;
+}
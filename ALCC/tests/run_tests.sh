@@ -0,0 +1,190 @@
+#!/bin/bash
+# Output comparison tests. Run from the ALCC directory after building:
+#   make LUA_VER=5.4 check        (or: tests/run_tests.sh -5.4)
+# The argument is the tool suffix of the build. Each case writes a tool's
+# output and compares it with tests/expected<suffix>/<case>.out. Bytecode
+# differs between Lua versions, so the expected outputs are per version;
+# versions without a directory are skipped.
+# UPDATE=1 tests/run_tests.sh -5.4 rewrites the expected outputs instead.
+
+SUFFIX=${1-}
+EXPECTED=tests/expected$SUFFIX
+if [ ! -d "$EXPECTED" ]; then
+    echo "No expected outputs for this build ($EXPECTED), skipping."
+    exit 0
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+passed=0
+failed=0
+
+# check NAME FILE: FILE must equal $EXPECTED/NAME.out
+check() {
+    if [ "$UPDATE" = 1 ]; then
+        cp "$2" "$EXPECTED/$1.out"
+        echo "    updated $1"
+    elif diff -u "$EXPECTED/$1.out" "$2" > "$TMP/diff" 2>&1; then
+        passed=$((passed + 1))
+        echo "    ok      $1"
+    else
+        failed=$((failed + 1))
+        echo "    FAILED  $1"
+        cat "$TMP/diff"
+    fi
+}
+
+compile() {
+    if ! ./alcc-c$SUFFIX "$1" -o "$2"; then
+        echo "Cannot compile $1"
+        exit 1
+    fi
+}
+
+echo "[1] Decompiler output"
+for src in tests/decompile/*.lua; do
+    name=$(basename "$src" .lua)
+    compile "$src" "$TMP/$name.luac"
+    ./alcc-dec$SUFFIX "$TMP/$name.luac" > "$TMP/$name.out" 2>&1
+    check "$name" "$TMP/$name.out"
+done
+
+echo "[2] Decompile cache"
+# The second run must reuse every function, including empty bodies, and
+# print the same text as the first
+compile tests/tools/cache.lua "$TMP/cache.luac"
+./alcc-dec$SUFFIX --cache "$TMP/cache.bin" "$TMP/cache.luac" > "$TMP/cache_first.out" 2>/dev/null
+./alcc-dec$SUFFIX --cache "$TMP/cache.bin" "$TMP/cache.luac" > "$TMP/cache_second.out" 2> "$TMP/cache.err"
+if cmp -s "$TMP/cache_first.out" "$TMP/cache_second.out"; then
+    echo "reused text matches" > "$TMP/cache.out"
+else
+    echo "reused text differs" > "$TMP/cache.out"
+fi
+cat "$TMP/cache.err" >> "$TMP/cache.out"
+check cache "$TMP/cache.out"
+
+echo "[3] Function selection"
+# Line 2 holds two closures, so --func-line must refuse to pick one
+compile tests/tools/same_line.lua "$TMP/same_line.luac"
+{
+    for line in 2 3 6; do
+        echo "--func-line $line:"
+        ./alcc-dec$SUFFIX --func-line $line "$TMP/same_line.luac" 2>&1
+        echo "exit $?"
+    done
+} > "$TMP/same_line.out"
+check same_line "$TMP/same_line.out"
+
+echo "[4] Plugin API compatibility"
+# api1_plugin.so has the plugin API 1 struct followed by non-null words, so
+# reading fields past on_ast_process from it crashes. The sample plugin
+# exports the current API. Pointers in the listing are masked.
+compile tests/tools/plugins.lua "$TMP/plugins.luac"
+{
+    echo "alcc-d, API 1 and current plugins:"
+    ./alcc-d$SUFFIX "$TMP/plugins.luac" -p plugins/sample_plugin.so -p tests/plugins/api1_plugin.so 2>&1 |
+        sed 's/0x[0-9a-f]*/PTR/g'
+    echo "exit ${PIPESTATUS[0]}"
+    echo "alcc-dec, API 1 plugin:"
+    ./alcc-dec$SUFFIX "$TMP/plugins.luac" > "$TMP/plain.out" 2>&1
+    ./alcc-dec$SUFFIX -p tests/plugins/api1_plugin.so "$TMP/plugins.luac" > "$TMP/api1.out" 2>&1
+    echo "exit $?"
+    grep -v "^-- Loaded plugin" "$TMP/api1.out" | diff "$TMP/plain.out" - && echo "same output as without plugins"
+} > "$TMP/plugins.out"
+check plugins "$TMP/plugins.out"
+
+echo "[5] Budgets"
+# The main chunk and large() are over 60 bytes; the functions nested in them
+# still decompile
+compile tests/tools/budget.lua "$TMP/budget.luac"
+./alcc-dec$SUFFIX --budget-bytes 60 "$TMP/budget.luac" > "$TMP/budget.out" 2> "$TMP/budget.err"
+cat "$TMP/budget.err" >> "$TMP/budget.out"
+check budget "$TMP/budget.out"
+
+echo "[6] Flag combinations"
+# Flags --ndjson would ignore are rejected, and nothing reaches stdout
+{
+    for flags in "--ast-bin $TMP/x.bin" "-p tests/plugins/api1_plugin.so" "--func 0" "--func-line 3" \
+                 "--budget-ms 5" "--cache $TMP/x.cache" "-t v2"; do
+        ./alcc-dec$SUFFIX --ndjson ast $flags "$TMP/budget.luac" 2>&1 | sed "s|$TMP|TMP|g"
+        echo "exit ${PIPESTATUS[0]}"
+    done
+    ./alcc-dec$SUFFIX --ast-bin "$TMP/x.bin" --budget-bytes 10 "$TMP/budget.luac" 2>&1
+    echo "exit $?"
+} > "$TMP/flags.out"
+check flags "$TMP/flags.out"
+
+echo "[7] CFG output"
+# --split writes one file per function into its directory, so it rejects -o
+{
+    mkdir "$TMP/split"
+    ./alcc-cfg$SUFFIX --split "$TMP/split" "$TMP/budget.luac" 2>&1
+    echo "exit $?"
+    ls "$TMP/split"
+    ./alcc-cfg$SUFFIX --split "$TMP/split" -o "$TMP/cfg.dot" "$TMP/budget.luac" 2>&1
+    echo "exit $?"
+    [ -e "$TMP/cfg.dot" ] || echo "no $TMP/cfg.dot" | sed "s|$TMP|TMP|g"
+    ./alcc-cfg$SUFFIX -o "$TMP/cfg.dot" "$TMP/budget.luac" 2>&1
+    echo "exit $?"
+    cat "$TMP/split/"*.dot | grep -c "^digraph"
+    grep -c "^  subgraph" "$TMP/cfg.dot"
+} > "$TMP/cfg.out"
+check cfg "$TMP/cfg.out"
+
+echo "[8] CFG formats"
+# The CSR dump is checked through tests/tools/csr_json, which rebuilds the
+# JSON lines from it; apart from the path they must match --format json
+compile tests/tools/cfg.lua "$TMP/cfg.luac"
+for format in json graphml blocks; do
+    ./alcc-cfg$SUFFIX --format $format "$TMP/cfg.luac" > "$TMP/cfg_$format.out" 2>&1
+    check cfg_$format "$TMP/cfg_$format.out"
+done
+./alcc-cfg$SUFFIX --format csr -o "$TMP/cfg.csr" "$TMP/cfg.luac"
+tests/tools/csr_json "$TMP/cfg.csr" > "$TMP/cfg_csr.out" 2>&1
+sed 's/,"path":"[^"]*"//' "$TMP/cfg_json.out" > "$TMP/cfg_json_nopath.out"
+if tail -n +2 "$TMP/cfg_csr.out" | cmp -s - "$TMP/cfg_json_nopath.out"; then
+    echo "matches json" >> "$TMP/cfg_csr.out"
+else
+    echo "differs from json" >> "$TMP/cfg_csr.out"
+fi
+check cfg_csr "$TMP/cfg_csr.out"
+# --analyze adds dominators, post-dominators, the loop forest and edge
+# classes; the CSR dump carries them too, without the summary counts
+./alcc-cfg$SUFFIX --format json --analyze "$TMP/control_flow.luac" > "$TMP/cfg_analyze.out" 2>&1
+check cfg_analyze "$TMP/cfg_analyze.out"
+./alcc-cfg$SUFFIX --format csr --analyze -o "$TMP/cfg_analyze.csr" "$TMP/control_flow.luac"
+tests/tools/csr_json "$TMP/cfg_analyze.csr" > "$TMP/cfg_analyze_dump.out" 2>&1
+head -n 1 "$TMP/cfg_analyze_dump.out" > "$TMP/cfg_analyze_csr.out"
+sed -e 's/,"path":"[^"]*"//' -e 's/,"loops":.*}$/}/' "$TMP/cfg_analyze.out" > "$TMP/cfg_analyze_nopath.out"
+if tail -n +2 "$TMP/cfg_analyze_dump.out" | cmp -s - "$TMP/cfg_analyze_nopath.out"; then
+    echo "matches json" >> "$TMP/cfg_analyze_csr.out"
+else
+    echo "differs from json" >> "$TMP/cfg_analyze_csr.out"
+fi
+check cfg_analyze_csr "$TMP/cfg_analyze_csr.out"
+
+echo "[9] Call graph"
+compile tests/tools/info.lua "$TMP/info.luac"
+for format in dot json; do
+    ./alcc-info$SUFFIX --callgraph $format "$TMP/info.luac" > "$TMP/callgraph_$format.out" 2>&1
+    check callgraph_$format "$TMP/callgraph_$format.out"
+done
+
+echo "[10] Function info"
+# The string constants include quotes, a backslash and bytes >= 0x80
+./alcc-info$SUFFIX --json "$TMP/info.luac" > "$TMP/info_json.out" 2>&1
+check info_json "$TMP/info_json.out"
+
+echo "[11] Opcode statistics"
+for format in text csv json; do
+    ./alcc-info$SUFFIX --opstats $format "$TMP/info.luac" 2>&1 | sed "s|$TMP|TMP|g" > "$TMP/opstats_$format.out"
+    check opstats_$format "$TMP/opstats_$format.out"
+done
+# --batch reads one input per line and skips blank lines; the corpus
+# totals cover every file
+printf '%s\n\n%s\n' "$TMP/info.luac" "$TMP/cfg.luac" > "$TMP/batch.txt"
+./alcc-info$SUFFIX --opstats json --batch "$TMP/batch.txt" 2>&1 | sed "s|$TMP|TMP|g" > "$TMP/opstats_batch.out"
+check opstats_batch "$TMP/opstats_batch.out"
+
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]
@@ -0,0 +1,16 @@
+local t = {}
+local function small(x)
+  t.x = x
+end
+local function large(a, b)
+  t.a = a
+  t.b = b
+  t.c = a .. b
+  t.d = { a, b, a, b }
+  local function inner(y)
+    t.y = y
+  end
+  inner(a)
+end
+small(1)
+large("p", "q")
@@ -0,0 +1,10 @@
+local function empty() end
+local function also_empty() end
+local t = {}
+local function fill(n, v) t[n] = v end
+local function last() end
+empty()
+also_empty()
+fill(1, t)
+last()
+print(#t)
@@ -0,0 +1,10 @@
+local n = 0
+local function count(t)
+  for i = 1, #t do
+    if t[i] then n = n + t[i] end
+  end
+  return function() return n end
+end
+while n < 10 do
+  count({1, 2})
+end
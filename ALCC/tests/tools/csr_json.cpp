@@ -0,0 +1,151 @@
+// Reads an alcc-cfg --format csr dump and prints its header, then each
+// function as the line alcc-cfg --format json writes for it, less the
+// fields the dump does not hold (path and the summary counts). The runner
+// compares those lines with the JSON output of the same input.
+//
+//   make tests/tools/csr_json && tests/tools/csr_json graph.csr
+
+#include "../../src/analysis/CfgBinary.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct Reader {
+    std::vector<unsigned char> data;
+    size_t pos;
+
+    Reader() : pos(0) {}
+
+    bool take(void* dst, size_t size) {
+        if (data.size() - pos < size) return false;
+        memcpy(dst, data.data() + pos, size);
+        pos += size;
+        return true;
+    }
+
+    template <typename T>
+    bool take_array(std::vector<T>& v, size_t count) {
+        v.resize(count);
+        return take(v.data(), count * sizeof(T));
+    }
+};
+
+static int fail(const char* what) {
+    fprintf(stderr, "Bad CSR dump: %s\n", what);
+    return 1;
+}
+
+// A block id of the shared numbering as the JSON output writes it for a
+// function whose blocks start at base
+static long long local_block(uint32_t v, uint32_t base, uint32_t count) {
+    if (v == CFG_BIN_NONE) return -1;
+    if (v == CFG_BIN_EXIT) return count;
+    return (long long)v - base;
+}
+
+static void print_ids(const char* key, const std::vector<uint32_t>& ids, const CfgBinFunction& f, bool local) {
+    printf(",\"%s\":[", key);
+    for (uint32_t b = 0; b < f.block_count; b++) {
+        uint32_t v = ids[f.first_block + b];
+        printf(b ? ",%lld" : "%lld", local ? local_block(v, f.first_block, f.block_count) : (long long)v);
+    }
+    printf("]");
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s graph.csr\n", argv[0]);
+        return 1;
+    }
+    FILE* file = fopen(argv[1], "rb");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    Reader in;
+    unsigned char buf[4096];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), file)) > 0) in.data.insert(in.data.end(), buf, buf + got);
+    fclose(file);
+
+    CfgBinHeader hdr;
+    if (!in.take(&hdr, sizeof(hdr))) return fail("short header");
+    if (memcmp(hdr.magic, CFG_BIN_MAGIC, 4) != 0) return fail("magic");
+    if (hdr.byte_order != CFG_BIN_BYTE_ORDER) return fail("byte order");
+    if (hdr.version != CFG_BIN_VERSION) return fail("version");
+    printf("%.4s version %u functions %u blocks %u edges %u closures %u flags %u\n", hdr.magic, hdr.version,
+           hdr.function_count, hdr.block_count, hdr.edge_count, hdr.closure_count, hdr.flags);
+
+    std::vector<CfgBinFunction> functions;
+    std::vector<CfgBinBlock> blocks;
+    std::vector<uint32_t> offset, succ, idom, ipdom, loop, depth;
+    std::vector<CfgBinClosure> closures;
+    std::vector<unsigned char> edge_kind;
+    if (!in.take_array(functions, hdr.function_count) || !in.take_array(blocks, hdr.block_count) ||
+        !in.take_array(offset, hdr.block_count + 1) || !in.take_array(succ, hdr.edge_count) ||
+        !in.take_array(closures, hdr.closure_count)) {
+        return fail("short arrays");
+    }
+    bool analyzed = (hdr.flags & CFG_BIN_STRUCTURE) != 0;
+    if (analyzed && (!in.take_array(idom, hdr.block_count) || !in.take_array(ipdom, hdr.block_count) ||
+                     !in.take_array(loop, hdr.block_count) || !in.take_array(depth, hdr.block_count) ||
+                     !in.take_array(edge_kind, hdr.edge_count))) {
+        return fail("short structure arrays");
+    }
+    if (in.pos != in.data.size()) return fail("trailing bytes");
+
+    // Functions tile the blocks in order, and the offsets the edges
+    uint32_t next = 0;
+    for (const CfgBinFunction& f : functions) {
+        if (f.first_block != next) return fail("function blocks");
+        next += f.block_count;
+    }
+    if (next != hdr.block_count) return fail("block count");
+    if (offset[0] != 0 || offset[hdr.block_count] != hdr.edge_count) return fail("offset bounds");
+    for (uint32_t b = 0; b < hdr.block_count; b++) {
+        if (offset[b] > offset[b + 1]) return fail("offset order");
+    }
+
+    // EdgeClasses::Kind order
+    static const char kind_letters[] = "tfbcu";
+    for (uint32_t j = 0; j < hdr.function_count; j++) {
+        const CfgBinFunction& f = functions[j];
+        uint32_t end = f.first_block + f.block_count;
+        printf("{\"function\":%u,\"line\":%d,\"last_line\":%d,\"blocks\":[", j, f.line, f.last_line);
+        for (uint32_t b = f.first_block; b < end; b++) {
+            printf(b > f.first_block ? ",[%u,%u]" : "[%u,%u]", blocks[b].start_pc + 1, blocks[b].end_pc + 1);
+        }
+        printf("],\"edges\":[");
+        bool first = true;
+        for (uint32_t b = f.first_block; b < end; b++) {
+            for (uint32_t e = offset[b]; e < offset[b + 1]; e++) {
+                if (succ[e] < f.first_block || succ[e] >= end) return fail("edge leaves its function");
+                printf(first ? "[%u,%u]" : ",[%u,%u]", b - f.first_block, succ[e] - f.first_block);
+                first = false;
+            }
+        }
+        printf("],\"closures\":[");
+        first = true;
+        for (const CfgBinClosure& c : closures) {
+            if (c.block < f.first_block || c.block >= end) continue;
+            if (c.function >= hdr.function_count || functions[c.function].parent != j) return fail("closure target");
+            printf(first ? "[%u,%u,%u]" : ",[%u,%u,%u]", c.block - f.first_block, c.pc + 1, c.function);
+            first = false;
+        }
+        printf("]");
+        if (analyzed) {
+            print_ids("idom", idom, f, true);
+            print_ids("ipdom", ipdom, f, true);
+            print_ids("loop", loop, f, true);
+            print_ids("depth", depth, f, false);
+            printf(",\"edge_kinds\":\"");
+            for (uint32_t e = offset[f.first_block]; e < offset[end]; e++) {
+                putchar(edge_kind[e] < sizeof(kind_letters) - 1 ? kind_letters[edge_kind[e]] : '?');
+            }
+            printf("\"");
+        }
+        printf("}\n");
+    }
+    return 0;
+}
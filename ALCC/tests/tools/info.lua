@@ -0,0 +1,16 @@
+-- Callees by global, field and local name, and a string constant with
+-- quotes, a backslash and bytes >= 0x80 for the JSON escaping
+local M = {}
+function M.greet(name)
+  return "say \"hi\" \\ " .. name .. "\200\255"
+end
+local function helper(x)
+  print(M.greet(x))
+end
+function run(list)
+  for i = 1, #list do
+    helper(list[i])
+  end
+  return string.format("%d", #list)
+end
+run({"a", "b"})
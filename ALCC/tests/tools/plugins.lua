@@ -0,0 +1,3 @@
+local a = ...
+local b = a
+print(b)
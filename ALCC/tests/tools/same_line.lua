@@ -0,0 +1,8 @@
+local function outer()
+    local a, b = function() return 1 end, function() return 2 end
+    return a() + b()
+end
+local function other()
+    return outer() * 2
+end
+print(other())